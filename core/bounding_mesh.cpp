@@ -1,4 +1,11 @@
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+#include <set>
 #include "bounding_mesh.h"
+#include "mesh_processing.h"
+#include "parallel.h"
 #include "config.h"
 
 #ifdef VTK_QC_BOUND
@@ -168,27 +175,395 @@ BoundingMesh::simplify_qc(const float *vertices, int num_vertices, const uint32_
  
     return bm;
 #else
-    // VTK not available, return regular AABB
-    float   min[3] = {1e6, 1e6, 1e6}, max[3] = {-1e6, -1e6, -1e6};
-    float   x, y, z;
+    // VTK not available, use the built-in simplifier
+    return BoundingMesh::simplify(vertices, num_vertices, triangles, num_triangles, 2*divisions*divisions);
+#endif
+}
+
+static void
+vertex_bounds(float *bmin, float *bmax, const float *vertices, int num_vertices)
+{
+    std::mutex mutex;
 
-    for (int i = 0; i < num_vertices; i++)
+    for (int i = 0; i < 3; i++)
     {
-        x = vertices[3*i+0];
-        y = vertices[3*i+1];
-        z = vertices[3*i+2];
+        bmin[i] = FLT_MAX;
+        bmax[i] = -FLT_MAX;
+    }
+
+    parallel_for(num_vertices, [&](size_t begin, size_t end) {
+        float lmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float lmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+        for (size_t v = begin; v < end; v++)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                lmin[i] = std::min(lmin[i], vertices[3*v+i]);
+                lmax[i] = std::max(lmax[i], vertices[3*v+i]);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < 3; i++)
+        {
+            bmin[i] = std::min(bmin[i], lmin[i]);
+            bmax[i] = std::max(bmax[i], lmax[i]);
+        }
+    });
+}
 
-        min[0] = std::min(min[0], x);
-        min[1] = std::min(min[1], y);
-        min[2] = std::min(min[2], z);
+BoundingMesh*
+BoundingMesh::simplify(const float *vertices, int num_vertices, const uint32_t *triangles, int num_triangles, int target_faces)
+{
+    std::vector<float>      out_vertices;
+    std::vector<uint32_t>   out_triangles;
+
+    simplify_mesh(out_vertices, out_triangles, 
+        vertices, num_vertices, 
+        triangles, num_triangles, 3, 
+        std::max(target_faces, 2));
 
-        max[0] = std::max(max[0], x);
-        max[1] = std::max(max[1], y);
-        max[2] = std::max(max[2], z);
+    if (out_triangles.empty())
+    {
+        // Nothing left (or nothing to start with), return regular AABB
+        float bmin[3], bmax[3];
+
+        if (num_vertices == 0)
+            return BoundingMesh::bbox(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, true);
+
+        vertex_bounds(bmin, bmax, vertices, num_vertices);
+        return BoundingMesh::bbox(bmin[0], bmin[1], bmin[2], bmax[0], bmax[1], bmax[2], true);
     }
 
-    return BoundingMesh::bbox(min[0], min[1], min[2], max[0], max[1], max[2], true);
-#endif
+    printf("... Simplified (VC): %d vertices, %d triangles\n", (int)out_vertices.size()/3, (int)out_triangles.size()/3);
+
+    BoundingMesh *bm = new BoundingMesh;
+
+    const uint32_t num_faces = out_triangles.size() / 3;
+
+    bm->vertices.swap(out_vertices);
+    bm->faces.swap(out_triangles);
+    bm->loop_start.resize(num_faces);
+    bm->loop_total.resize(num_faces, 3);
+
+    for (uint32_t i = 0; i < num_faces; i++)
+        bm->loop_start[i] = 3*i;
+
+    return bm;
+}
+
+// Convex hull
+
+struct HullFace
+{
+    int     v[3];
+    double  n[3];
+    double  d;          // Plane: dot(n, p) = d
+    bool    alive;
+};
+
+static HullFace
+make_hull_face(const std::vector<double>& points, int a, int b, int c, const double *inside)
+{
+    HullFace f;
+    const double *pa = &points[3*a];
+    const double *pb = &points[3*b];
+    const double *pc = &points[3*c];
+    const double e1[3] = { pb[0]-pa[0], pb[1]-pa[1], pb[2]-pa[2] };
+    const double e2[3] = { pc[0]-pa[0], pc[1]-pa[1], pc[2]-pa[2] };
+
+    f.v[0] = a; f.v[1] = b; f.v[2] = c;
+    f.n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+    f.n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+    f.n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+
+    double len = sqrt(f.n[0]*f.n[0] + f.n[1]*f.n[1] + f.n[2]*f.n[2]);
+    if (len > 0.0)
+    {
+        f.n[0] /= len; f.n[1] /= len; f.n[2] /= len;
+    }
+
+    f.d = f.n[0]*pa[0] + f.n[1]*pa[1] + f.n[2]*pa[2];
+    f.alive = true;
+
+    // Make the face point away from the interior point
+    if (f.n[0]*inside[0] + f.n[1]*inside[1] + f.n[2]*inside[2] > f.d)
+    {
+        std::swap(f.v[1], f.v[2]);
+        f.n[0] = -f.n[0]; f.n[1] = -f.n[1]; f.n[2] = -f.n[2];
+        f.d = -f.d;
+    }
+
+    return f;
+}
+
+static double
+point_line_distance2(const double *p, const double *a, const double *b)
+{
+    const double ab[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+    const double ap[3] = { p[0]-a[0], p[1]-a[1], p[2]-a[2] };
+    const double c[3] = { ab[1]*ap[2] - ab[2]*ap[1], ab[2]*ap[0] - ab[0]*ap[2], ab[0]*ap[1] - ab[1]*ap[0] };
+    const double l2 = ab[0]*ab[0] + ab[1]*ab[1] + ab[2]*ab[2];
+
+    return (c[0]*c[0] + c[1]*c[1] + c[2]*c[2]) / l2;
+}
+
+BoundingMesh*
+BoundingMesh::convex_hull(const float *vertices, int num_vertices, int max_faces)
+{
+    if (num_vertices == 0)
+        return BoundingMesh::bbox(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, true);
+
+    float bmin[3], bmax[3];
+    vertex_bounds(bmin, bmax, vertices, num_vertices);
+
+    // A convex hull of k points has at most 2k-4 triangles. The directions
+    // used are the 6 major axes (so the hull touches the bbox), plus
+    // a spherical Fibonacci point set.
+
+    const int num_directions = std::max(6, max_faces/2 + 2);
+    std::vector<float> directions(3*num_directions);
+
+    const float axes[6][3] = { {1,0,0}, {-1,0,0}, {0,1,0}, {0,-1,0}, {0,0,1}, {0,0,-1} };
+    for (int d = 0; d < 6; d++)
+        for (int i = 0; i < 3; i++)
+            directions[3*d+i] = axes[d][i];
+
+    const int num_fibonacci = num_directions - 6;
+    const double golden_angle = M_PI * (3.0 - sqrt(5.0));
+
+    for (int d = 0; d < num_fibonacci; d++)
+    {
+        const double z = 1.0 - (d + 0.5) * 2.0 / num_fibonacci;
+        const double r = sqrt(1.0 - z*z);
+        const double phi = d * golden_angle;
+
+        directions[3*(6+d)+0] = r * cos(phi);
+        directions[3*(6+d)+1] = r * sin(phi);
+        directions[3*(6+d)+2] = z;
+    }
+
+    // Extreme vertex in each direction. Positions are taken relative
+    // to the bbox center, for precision.
+
+    const float center[3] = { 0.5f*(bmin[0]+bmax[0]), 0.5f*(bmin[1]+bmax[1]), 0.5f*(bmin[2]+bmax[2]) };
+    std::vector<float> best_dot(num_directions, -FLT_MAX);
+    std::vector<int> best_vertex(num_directions, 0);
+    std::mutex mutex;
+
+    // Vertices are processed in blocks, first computing only the maximum 
+    // dot product per block and direction (which vectorizes well). The
+    // vertex index is only searched for when the block improves on the
+    // current best.
+
+    const size_t BLOCK = 1024;
+
+    parallel_for(num_vertices, [&](size_t begin, size_t end) {
+        std::vector<float> ldot(num_directions, -FLT_MAX);
+        std::vector<int> lvertex(num_directions, 0);
+        float x[BLOCK], y[BLOCK], z[BLOCK];
+
+        for (size_t block = begin; block < end; block += BLOCK)
+        {
+            const size_t n = std::min(BLOCK, end - block);
+
+            for (size_t i = 0; i < n; i++)
+            {
+                x[i] = vertices[3*(block+i)+0] - center[0];
+                y[i] = vertices[3*(block+i)+1] - center[1];
+                z[i] = vertices[3*(block+i)+2] - center[2];
+            }
+
+            for (int d = 0; d < num_directions; d++)
+            {
+                const float dx = directions[3*d+0];
+                const float dy = directions[3*d+1];
+                const float dz = directions[3*d+2];
+                float lane_max[8] = { -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+                size_t i = 0;
+
+                for (; i + 8 <= n; i += 8)
+                    for (int j = 0; j < 8; j++)
+                        lane_max[j] = std::max(lane_max[j], x[i+j]*dx + y[i+j]*dy + z[i+j]*dz);
+                for (; i < n; i++)
+                    lane_max[0] = std::max(lane_max[0], x[i]*dx + y[i]*dy + z[i]*dz);
+
+                float m = lane_max[0];
+                for (int j = 1; j < 8; j++)
+                    m = std::max(m, lane_max[j]);
+
+                if (m <= ldot[d])
+                    continue;
+
+                for (i = 0; i < n; i++)
+                {
+                    if (x[i]*dx + y[i]*dy + z[i]*dz >= m)
+                    {
+                        ldot[d] = m;
+                        lvertex[d] = block + i;
+                        break;
+                    }
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int d = 0; d < num_directions; d++)
+        {
+            if (ldot[d] > best_dot[d])
+            {
+                best_dot[d] = ldot[d];
+                best_vertex[d] = lvertex[d];
+            }
+        }
+    }, 16384);
+
+    std::sort(best_vertex.begin(), best_vertex.end());
+    best_vertex.erase(std::unique(best_vertex.begin(), best_vertex.end()), best_vertex.end());
+
+    const int num_points = best_vertex.size();
+    std::vector<double> points(3*num_points);
+
+    for (int p = 0; p < num_points; p++)
+        for (int i = 0; i < 3; i++)
+            points[3*p+i] = vertices[3*best_vertex[p]+i] - center[i];
+
+    // Initial tetrahedron, from points that are far apart
+
+    const double extent = sqrt(
+        (bmax[0]-bmin[0])*(bmax[0]-bmin[0]) + 
+        (bmax[1]-bmin[1])*(bmax[1]-bmin[1]) + 
+        (bmax[2]-bmin[2])*(bmax[2]-bmin[2]));
+    const double eps = 1e-6 * extent;
+
+    int t[4] = { 0, -1, -1, -1 };
+    double dmax;
+
+    dmax = 0.0;
+    for (int p = 1; p < num_points; p++)
+    {
+        const double dx = points[3*p+0] - points[0];
+        const double dy = points[3*p+1] - points[1];
+        const double dz = points[3*p+2] - points[2];
+        const double d = dx*dx + dy*dy + dz*dz;
+        if (d > dmax) { dmax = d; t[1] = p; }
+    }
+
+    if (t[1] >= 0)
+    {
+        dmax = 0.0;
+        for (int p = 0; p < num_points; p++)
+        {
+            const double d = point_line_distance2(&points[3*p], &points[3*t[0]], &points[3*t[1]]);
+            if (d > dmax) { dmax = d; t[2] = p; }
+        }
+    }
+
+    if (t[2] >= 0 && sqrt(dmax) > eps)
+    {
+        const double origin[3] = { 0.0, 0.0, 0.0 };
+        HullFace base = make_hull_face(points, t[0], t[1], t[2], origin);
+        
+        dmax = eps;
+        for (int p = 0; p < num_points; p++)
+        {
+            const double d = fabs(base.n[0]*points[3*p] + base.n[1]*points[3*p+1] + base.n[2]*points[3*p+2] - base.d);
+            if (d > dmax) { dmax = d; t[3] = p; }
+        }
+    }
+
+    if (t[3] < 0)
+    {
+        // Degenerate (flat) point set
+        return BoundingMesh::bbox(bmin[0], bmin[1], bmin[2], bmax[0], bmax[1], bmax[2], true);
+    }
+
+    double inside[3];
+    for (int i = 0; i < 3; i++)
+        inside[i] = 0.25 * (points[3*t[0]+i] + points[3*t[1]+i] + points[3*t[2]+i] + points[3*t[3]+i]);
+
+    std::vector<HullFace> faces;
+    faces.push_back(make_hull_face(points, t[0], t[1], t[2], inside));
+    faces.push_back(make_hull_face(points, t[0], t[1], t[3], inside));
+    faces.push_back(make_hull_face(points, t[0], t[2], t[3], inside));
+    faces.push_back(make_hull_face(points, t[1], t[2], t[3], inside));
+
+    // Incrementally add the other points, replacing the faces each point
+    // can see with a fan of faces connecting the point to the horizon
+
+    std::set<std::pair<int,int>>    visible_edges;
+    std::vector<std::pair<int,int>> horizon;
+
+    for (int p = 0; p < num_points; p++)
+    {
+        if (p == t[0] || p == t[1] || p == t[2] || p == t[3])
+            continue;
+
+        const double *pp = &points[3*p];
+        visible_edges.clear();
+
+        for (HullFace& f : faces)
+        {
+            if (!f.alive)
+                continue;
+
+            if (f.n[0]*pp[0] + f.n[1]*pp[1] + f.n[2]*pp[2] - f.d > eps)
+            {
+                f.alive = false;
+                visible_edges.insert(std::make_pair(f.v[0], f.v[1]));
+                visible_edges.insert(std::make_pair(f.v[1], f.v[2]));
+                visible_edges.insert(std::make_pair(f.v[2], f.v[0]));
+            }
+        }
+
+        if (visible_edges.empty())
+            continue;
+
+        horizon.clear();
+        for (const auto& e : visible_edges)
+        {
+            if (visible_edges.find(std::make_pair(e.second, e.first)) == visible_edges.end())
+                horizon.push_back(e);
+        }
+
+        for (const auto& e : horizon)
+            faces.push_back(make_hull_face(points, e.first, e.second, p, inside));
+
+        // Compact every now and then
+        if (faces.size() > 64 && faces.size() > 4*(size_t)num_points)
+            faces.erase(std::remove_if(faces.begin(), faces.end(), [](const HullFace& f) { return !f.alive; }), faces.end());
+    }
+
+    // Output, with only the points used
+
+    BoundingMesh *bm = new BoundingMesh;
+    std::vector<int> point_index(num_points, -1);
+
+    for (const HullFace& f : faces)
+    {
+        if (!f.alive)
+            continue;
+
+        bm->loop_start.push_back(bm->faces.size());
+        bm->loop_total.push_back(3);
+
+        for (int i = 0; i < 3; i++)
+        {
+            int& pi = point_index[f.v[i]];
+            if (pi == -1)
+            {
+                pi = bm->vertices.size() / 3;
+                for (int j = 0; j < 3; j++)
+                    bm->vertices.push_back(points[3*f.v[i]+j] + center[j]);
+            }
+            bm->faces.push_back(pi);
+        }
+    }
+
+    printf("... Convex hull: %d vertices, %d triangles\n", (int)bm->vertices.size()/3, (int)bm->loop_start.size());
+
+    return bm;
 }
 
 BoundingMesh::BoundingMesh() 
@@ -18,9 +18,20 @@ struct BoundingMesh
     static BoundingMesh *bbox_from_group(OSPGroup group, bool edges_only=false);
     static BoundingMesh *bbox_from_instance(OSPInstance instance, bool edges_only=false);
 
-    // Generates a simplified version of the given geometry using quadratic clustering (requires VTK)
-    // If VTK support is not enabled it returns add bbox (edges) based on vertex positions.
+    // Generates a simplified version of the given geometry using quadric clustering with VTK,
+    // if VTK support is enabled. Otherwise the built-in simplifier below is used,
+    // with a target of roughly 2 * divisions^2 faces.
     static BoundingMesh *simplify_qc(const float *vertices, int nv, const uint32_t *triangles, int nt, int divisions);
+
+    // Generates a simplified version of the given triangle mesh using (multithreaded)
+    // vertex clustering, aiming for roughly target_faces triangles
+    static BoundingMesh *simplify(const float *vertices, int nv, const uint32_t *triangles, int nt, int target_faces);
+
+    // Generates a convex hull of the given points with at most max_faces triangles.
+    // The hull is spanned by the extreme points in a set of evenly spread 
+    // directions, so it is exact for low-polygon inputs and a close fit otherwise. 
+    // Degenerate (flat) inputs result in a bbox.
+    static BoundingMesh *convex_hull(const float *vertices, int nv, int max_faces=512);
     
     // Deserialize
     static BoundingMesh *deserialize(const uint8_t *buffer, uint32_t size);
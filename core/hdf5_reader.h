@@ -0,0 +1,386 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Parallel chunked reading of HDF5 datasets for plugins                    //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#ifndef HDF5_READER_H
+#define HDF5_READER_H
+
+#include <stdint.h>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+#include <hdf5.h>
+
+#include "parallel.h"
+#include "plugin.h"
+
+// Reads (a selection of) an HDF5 dataset as float values. The selection 
+// is read in chunks of rows (along the slowest-varying dimension), each 
+// chunk in the dataset's own element type. As HDF5 itself isn't 
+// thread-safe the chunks are read by the calling thread, while the 
+// previous chunk is converted to float by worker threads. Datasets of 
+// (signed and unsigned) 8 to 64-bit integers, half, float and double 
+// values are supported. Header-only, as only the HDF5 plugins use it.
+
+enum HDF5ValueType
+{
+    HDF5_UNSUPPORTED,
+    HDF5_INT8,
+    HDF5_UINT8,
+    HDF5_INT16,
+    HDF5_UINT16,
+    HDF5_INT32,
+    HDF5_UINT32,
+    HDF5_INT64,
+    HDF5_UINT64,
+    HDF5_HALF,
+    HDF5_FLOAT,
+    HDF5_DOUBLE
+};
+
+struct HDF5Dataset
+{
+    hid_t                   file;
+    hid_t                   dset;
+    std::vector<hsize_t>    dims;           // Slowest-varying first
+    HDF5ValueType           value_type;
+    size_t                  value_size;
+    hid_t                   memory_type;    // To read values with, in native byte order
+    bool                    own_memory_type;
+
+    HDF5Dataset()
+    {
+        file = dset = memory_type = -1;
+        value_type = HDF5_UNSUPPORTED;
+        value_size = 0;
+        own_memory_type = false;
+    }
+
+    ~HDF5Dataset()
+    {
+        close();
+    }
+
+    void close()
+    {
+        if (own_memory_type)
+            H5Tclose(memory_type);
+        if (dset >= 0)
+            H5Dclose(dset);
+        if (file >= 0)
+            H5Fclose(file);
+
+        file = dset = memory_type = -1;
+        own_memory_type = false;
+    }
+
+    size_t num_values() const
+    {
+        size_t n = 1;
+        for (hsize_t d : dims)
+            n *= d;
+        return n;
+    }
+};
+
+// Determines how to read values of the given file type
+inline bool
+hdf5_value_type(HDF5Dataset& ds, hid_t file_type)
+{
+    const size_t size = H5Tget_size(file_type);
+
+    ds.value_size = size;
+
+    switch (H5Tget_class(file_type))
+    {
+    case H5T_INTEGER:
+    {
+        const bool sgn = H5Tget_sign(file_type) == H5T_SGN_2;
+
+        switch (size)
+        {
+        case 1: ds.value_type = sgn ? HDF5_INT8 : HDF5_UINT8;   ds.memory_type = sgn ? H5T_NATIVE_INT8 : H5T_NATIVE_UINT8; break;
+        case 2: ds.value_type = sgn ? HDF5_INT16 : HDF5_UINT16; ds.memory_type = sgn ? H5T_NATIVE_INT16 : H5T_NATIVE_UINT16; break;
+        case 4: ds.value_type = sgn ? HDF5_INT32 : HDF5_UINT32; ds.memory_type = sgn ? H5T_NATIVE_INT32 : H5T_NATIVE_UINT32; break;
+        case 8: ds.value_type = sgn ? HDF5_INT64 : HDF5_UINT64; ds.memory_type = sgn ? H5T_NATIVE_INT64 : H5T_NATIVE_UINT64; break;
+        default: return false;
+        }
+
+        return true;
+    }
+
+    case H5T_FLOAT:
+    {
+        if (size == 4)
+        {
+            ds.value_type = HDF5_FLOAT;
+            ds.memory_type = H5T_NATIVE_FLOAT;
+            return true;
+        }
+        else if (size == 8)
+        {
+            ds.value_type = HDF5_DOUBLE;
+            ds.memory_type = H5T_NATIVE_DOUBLE;
+            return true;
+        }
+        else if (size == 2)
+        {
+            // No native half type, read the IEEE 754 half values as 
+            // stored, but in native byte order
+
+            size_t spos, epos, esize, mpos, msize;
+            H5Tget_fields(file_type, &spos, &epos, &esize, &mpos, &msize);
+
+            if (spos != 15 || epos != 10 || esize != 5 || mpos != 0 || msize != 10)
+                return false;
+
+            ds.value_type = HDF5_HALF;
+            ds.memory_type = H5Tcopy(file_type);
+            ds.own_memory_type = true;
+            H5Tset_order(ds.memory_type, H5Tget_order(H5T_NATIVE_FLOAT));
+            return true;
+        }
+
+        return false;
+    }
+
+    default:
+        return false;
+    }
+}
+
+// Opens the dataset and determines its dimensions and value type. 
+// Returns false (with message set) when the file or dataset can't be 
+// opened, or the values are of an unsupported type.
+inline bool
+open_hdf5_dataset(HDF5Dataset& ds, const std::string& fname, const std::string& dataset, std::string& message)
+{
+    ds.close();
+
+    ds.file = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (ds.file < 0)
+    {
+        message = "Could not open HDF5 file " + fname;
+        return false;
+    }
+
+    ds.dset = H5Dopen2(ds.file, dataset.c_str(), H5P_DEFAULT);
+    if (ds.dset < 0)
+    {
+        message = "Could not open dataset " + dataset + " in " + fname;
+        return false;
+    }
+
+    hid_t space = H5Dget_space(ds.dset);
+    const int rank = H5Sget_simple_extent_ndims(space);
+
+    if (rank > 0)
+    {
+        ds.dims.resize(rank);
+        H5Sget_simple_extent_dims(space, &ds.dims[0], NULL);
+    }
+
+    H5Sclose(space);
+
+    hid_t file_type = H5Dget_type(ds.dset);
+    const bool supported = hdf5_value_type(ds, file_type);
+    H5Tclose(file_type);
+
+    if (rank <= 0 || !supported)
+    {
+        message = "Dataset " + dataset + " has an unsupported type or shape";
+        return false;
+    }
+
+    return true;
+}
+
+// IEEE 754 half to float
+inline float
+half_to_float(uint16_t h)
+{
+    const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    const uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t bits;
+
+    if (exponent == 0x1f)
+        bits = sign | 0x7f800000 | (mantissa << 13);        // Inf, NaN
+    else if (exponent != 0)
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else if (mantissa == 0)
+        bits = sign;                                        // Zero
+    else
+    {
+        // Subnormal, normalize
+        int e = -1;
+        do
+        {
+            e++;
+            mantissa <<= 1;
+        }
+        while ((mantissa & 0x400) == 0);
+
+        bits = sign | ((uint32_t)(112 - e) << 23) | ((mantissa & 0x3ff) << 13);
+    }
+
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+template<typename T>
+inline void
+hdf5_convert_values(float *dst, const T *src, size_t n)
+{
+    parallel_for(n, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            dst[i] = (float)src[i];
+    });
+}
+
+// Converts n values read as the given type to float, in parallel
+inline void
+hdf5_convert_values(float *dst, const void *src, HDF5ValueType type, size_t n)
+{
+    switch (type)
+    {
+    case HDF5_INT8:     hdf5_convert_values(dst, (const int8_t*)src, n); break;
+    case HDF5_UINT8:    hdf5_convert_values(dst, (const uint8_t*)src, n); break;
+    case HDF5_INT16:    hdf5_convert_values(dst, (const int16_t*)src, n); break;
+    case HDF5_UINT16:   hdf5_convert_values(dst, (const uint16_t*)src, n); break;
+    case HDF5_INT32:    hdf5_convert_values(dst, (const int32_t*)src, n); break;
+    case HDF5_UINT32:   hdf5_convert_values(dst, (const uint32_t*)src, n); break;
+    case HDF5_INT64:    hdf5_convert_values(dst, (const int64_t*)src, n); break;
+    case HDF5_UINT64:   hdf5_convert_values(dst, (const uint64_t*)src, n); break;
+    case HDF5_FLOAT:    memcpy(dst, src, n*sizeof(float)); break;
+    case HDF5_DOUBLE:   hdf5_convert_values(dst, (const double*)src, n); break;
+    case HDF5_HALF:
+        parallel_for(n, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                dst[i] = half_to_float(((const uint16_t*)src)[i]);
+        });
+        break;
+    default:
+        break;
+    }
+}
+
+// Reads the hyperslab selection given by start, stride and count (one 
+// value per dimension, in dataset order; stride may be NULL for 1) as 
+// float values into dst, which must hold the product of count values.
+// When state is given progress is reported and reading stops when the
+// state is canceled. Returns false (with message set) on failure or 
+// when canceled.
+inline bool
+read_hdf5_dataset(float *dst, const HDF5Dataset& ds, const hsize_t *start, const hsize_t *stride, 
+    const hsize_t *count, PluginState *state, std::string& message, const std::string& progress_message="Reading")
+{
+    const int rank = ds.dims.size();
+
+    std::vector<hsize_t> chunk_start(start, start+rank);
+    std::vector<hsize_t> chunk_stride(rank, 1);
+    std::vector<hsize_t> chunk_count(count, count+rank);
+
+    if (stride != NULL)
+        chunk_stride.assign(stride, stride+rank);
+
+    size_t row_values = 1;
+    for (int i = 1; i < rank; i++)
+        row_values *= count[i];
+
+    const size_t num_rows = count[0];
+
+    if (num_rows == 0 || row_values == 0)
+        return true;
+
+    // Chunks of about 8M values, float values are read in place
+
+    const size_t chunk_rows = std::max<size_t>(1, (8*1024*1024) / row_values);
+    const bool convert = ds.value_type != HDF5_FLOAT;
+
+    std::vector<uint8_t> buffers[2];
+    std::thread converter;
+
+    if (convert)
+    {
+        buffers[0].resize(chunk_rows * row_values * ds.value_size);
+        buffers[1].resize(chunk_rows * row_values * ds.value_size);
+    }
+
+    hid_t filespace = H5Dget_space(ds.dset);
+    bool ok = true;
+    int c = 0;
+
+    for (size_t row = 0; row < num_rows; row += chunk_rows, c++)
+    {
+        const size_t rows = std::min(chunk_rows, num_rows - row);
+        float *chunk_dst = dst + row * row_values;
+        void *buffer = convert ? (void*)&buffers[c%2][0] : (void*)chunk_dst;
+
+        chunk_start[0] = start[0] + row * chunk_stride[0];
+        chunk_count[0] = rows;
+
+        hid_t memspace = H5Screate_simple(rank, &chunk_count[0], NULL);
+
+        herr_t status = H5Sselect_hyperslab(filespace, H5S_SELECT_SET, &chunk_start[0], &chunk_stride[0], &chunk_count[0], NULL);
+        if (status >= 0)
+            status = H5Dread(ds.dset, ds.memory_type, memspace, filespace, H5P_DEFAULT, buffer);
+
+        H5Sclose(memspace);
+
+        // Conversion of the previous chunk done, as its buffer is reused next
+        if (converter.joinable())
+            converter.join();
+
+        if (status < 0)
+        {
+            message = "Error reading HDF5 dataset";
+            ok = false;
+            break;
+        }
+
+        if (convert)
+            converter = std::thread(static_cast<void(*)(float*, const void*, HDF5ValueType, size_t)>(hdf5_convert_values), 
+                chunk_dst, (const void*)buffer, ds.value_type, rows * row_values);
+
+        if (state != nullptr)
+        {
+            state->set_progress(1.0f * (row + rows) / num_rows, progress_message);
+
+            if (state->canceled())
+            {
+                message = "Canceled";
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    if (converter.joinable())
+        converter.join();
+
+    H5Sclose(filespace);
+
+    return ok;
+}
+
+#endif
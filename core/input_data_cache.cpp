@@ -0,0 +1,225 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Shared cache of input data read by plugins                               //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+#include "input_data_cache.h"
+#include "plugin.h"
+
+struct InputDataEntry
+{
+    std::mutex                  mutex;      // Held while loading
+    std::weak_ptr<const void>   data;
+    uint64_t                    length;
+
+    InputDataEntry()
+    {
+        length = 0;
+    }
+};
+
+typedef std::map<std::string, std::shared_ptr<InputDataEntry>>  InputDataEntryMap;
+
+static std::mutex           input_data_mutex;
+static InputDataEntryMap    input_data_entries;
+
+std::shared_ptr<const void>
+get_input_data(const std::string& path, uint64_t offset, uint64_t length,
+    const std::string& type, const input_data_load_function_t& load)
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0)
+        return nullptr;
+
+    char s[128];
+    snprintf(s, 128, "\n%ld.%09ld\n%llu\n%llu\n", (long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec,
+        (unsigned long long)offset, (unsigned long long)length);
+
+    const std::string key = path + s + type;
+
+    std::shared_ptr<InputDataEntry> entry;
+
+    {
+        std::lock_guard<std::mutex> lock(input_data_mutex);
+
+        // Remove entries whose data was released (and aren't being loaded)
+        for (InputDataEntryMap::iterator it = input_data_entries.begin(); it != input_data_entries.end(); )
+        {
+            if (it->second.use_count() == 1 && it->second->data.expired())
+                it = input_data_entries.erase(it);
+            else
+                ++it;
+        }
+
+        std::shared_ptr<InputDataEntry>& e = input_data_entries[key];
+        if (!e)
+            e = std::make_shared<InputDataEntry>();
+        entry = e;
+    }
+
+    std::lock_guard<std::mutex> lock(entry->mutex);
+
+    std::shared_ptr<const void> data = entry->data.lock();
+
+    if (data)
+    {
+        printf("... Using cached input data from %s (%llu bytes at offset %llu)\n", path.c_str(),
+            (unsigned long long)length, (unsigned long long)offset);
+        return data;
+    }
+
+    void *buffer;
+
+    if (posix_memalign(&buffer, 64, std::max<uint64_t>(length, 1)) != 0)
+    {
+        printf("... ERROR: could not allocate %llu bytes for input data\n", (unsigned long long)length);
+        return nullptr;
+    }
+
+    if (!load(buffer))
+    {
+        free(buffer);
+        return nullptr;
+    }
+
+    data = std::shared_ptr<const void>(buffer, [](const void *p) { free(const_cast<void*>(p)); });
+
+    entry->length = length;
+    entry->data = data;
+
+    return data;
+}
+
+std::shared_ptr<const void>
+read_input_data(const std::string& path, uint64_t offset, uint64_t length,
+    const std::string& type, PluginState *state)
+{
+    return get_input_data(path, offset, length, type, [&](void *buffer) {
+
+        FILE *f = fopen(path.c_str(), "rb");
+        if (f == nullptr)
+            return false;
+
+        if (fseeko(f, offset, SEEK_SET) != 0)
+        {
+            fclose(f);
+            return false;
+        }
+
+        // Read in chunks, so progress can be reported and reading canceled
+
+        const uint64_t chunk_size = 64*1024*1024;
+        uint8_t *p = (uint8_t*)buffer;
+        uint64_t actual_size = 0;
+
+        while (actual_size < length)
+        {
+            size_t n = fread(p + actual_size, 1, std::min(chunk_size, length - actual_size), f);
+            if (n == 0)
+                break;
+
+            actual_size += n;
+
+            if (state != nullptr)
+            {
+                state->set_progress(1.0f * actual_size / length, "Reading " + path);
+
+                if (state->canceled())
+                {
+                    fclose(f);
+                    return false;
+                }
+            }
+        }
+
+        fclose(f);
+
+        if (actual_size != length)
+        {
+            printf("... WARNING: expected to read %llu bytes from %s, got only %llu!\n",
+                (unsigned long long)length, path.c_str(), (unsigned long long)actual_size);
+            memset(p + actual_size, 0, length - actual_size);
+        }
+
+        return true;
+    });
+}
+
+uint64_t
+get_input_data_cache_size()
+{
+    std::lock_guard<std::mutex> lock(input_data_mutex);
+
+    uint64_t size = 0;
+
+    for (auto& kv : input_data_entries)
+    {
+        if (!kv.second->data.expired())
+            size += kv.second->length;
+    }
+
+    return size;
+}
+
+std::shared_ptr<const void>
+map_input_data(const std::string& path, uint64_t offset, uint64_t length, bool writable)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || length == 0 || (uint64_t)st.st_size < offset + length)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    // The mapping itself needs to start at a page boundary
+    const uint64_t page_size = sysconf(_SC_PAGESIZE);
+    const uint64_t delta = offset % page_size;
+    const uint64_t map_length = length + delta;
+
+    void *base = mmap(nullptr, map_length, writable ? PROT_READ|PROT_WRITE : PROT_READ,
+        writable ? MAP_PRIVATE : MAP_SHARED, fd, offset - delta);
+    close(fd);
+
+    if (base == MAP_FAILED)
+    {
+        printf("... WARNING: could not map %s (%llu bytes at offset %llu)\n", path.c_str(),
+            (unsigned long long)length, (unsigned long long)offset);
+        return nullptr;
+    }
+
+    return std::shared_ptr<const void>((uint8_t*)base + delta, [base, map_length](const void*) {
+        munmap(base, map_length);
+    });
+}
@@ -0,0 +1,73 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Shared cache of input data read by plugins                               //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#ifndef INPUT_DATA_CACHE_H
+#define INPUT_DATA_CACHE_H
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+
+struct PluginState;
+
+// Plugin instances reading the same input data (e.g. two volumes using
+// the same raw file with a different value_scale) share a single copy
+// of it. Data is keyed on (path, mtime, offset, length, type) and is
+// reference-counted: it stays in the cache for as long as a plugin
+// instance holds on to the returned pointer.
+// The returned data must not be modified, make a copy for that.
+// A returned buffer is 64-byte aligned, so it can be passed to OSPRay
+// as shared data (see PluginState::shared_memory).
+
+// Fills buffer (length bytes) with the data, returns false on failure
+typedef std::function<bool(void *buffer)>   input_data_load_function_t;
+
+// Returns the cached data for the given key, calling load() to fill
+// a new buffer if it isn't cached. Type is any string describing the
+// data, e.g. a voxel type or dataset name. Concurrent requests for the
+// same data wait for a single load.
+// Returns nullptr if the file doesn't exist or loading failed.
+std::shared_ptr<const void>
+get_input_data(const std::string& path, uint64_t offset, uint64_t length,
+    const std::string& type, const input_data_load_function_t& load);
+
+// Returns length bytes of the file at path starting at offset, see
+// get_input_data(). When state is given the file is read in chunks, with
+// progress reported and reading stopped when the state is canceled.
+std::shared_ptr<const void>
+read_input_data(const std::string& path, uint64_t offset, uint64_t length,
+    const std::string& type, PluginState *state=nullptr);
+
+// Total size in bytes of the input data currently held
+uint64_t
+get_input_data_cache_size();
+
+// Memory-maps length bytes of the file at path starting at offset, without
+// reading it. The mapping is released when the returned pointer is. 
+// Read-only mappings are shared with the page cache. A writable mapping is
+// private (copy-on-write), so data can be modified in place without changing 
+// the file. The data has the alignment of offset (relative to a page).
+// Returns nullptr if the file is shorter than offset+length or can't be mapped.
+// Note that mapped data is not part of the input data cache.
+std::shared_ptr<const void>
+map_input_data(const std::string& path, uint64_t offset, uint64_t length, bool writable=false);
+
+#endif
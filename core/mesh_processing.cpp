@@ -0,0 +1,837 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Server-side processing of mesh data received from Blender                //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+#include <atomic>
+#include <mutex>
+#include "mesh_processing.h"
+#include "parallel.h"
+
+// For each vertex the list of loops using it, stored as offsets
+// into a single array (offsets has num_vertices+1 entries)
+static void
+vertex_loops(std::vector<uint32_t>& offsets, std::vector<uint32_t>& loops,
+    uint32_t num_vertices, const uint32_t *loop_vertices, uint32_t num_loops)
+{
+    offsets.assign(num_vertices+1, 0);
+    loops.resize(num_loops);
+
+    for (uint32_t l = 0; l < num_loops; l++)
+        offsets[loop_vertices[l]+1]++;
+
+    for (uint32_t v = 0; v < num_vertices; v++)
+        offsets[v+1] += offsets[v];
+
+    std::vector<uint32_t> next(offsets.begin(), offsets.end()-1);
+
+    for (uint32_t l = 0; l < num_loops; l++)
+        loops[next[loop_vertices[l]]++] = l;
+}
+
+bool
+check_polygons(
+    const uint32_t *loop_start, const uint32_t *loop_total, uint32_t num_polygons,
+    const uint32_t *loop_vertices, uint32_t num_loops, uint32_t num_vertices)
+{
+    std::atomic<bool> ok(true);
+
+    parallel_for(num_polygons, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++)
+        {
+            if ((uint64_t)loop_start[p] + loop_total[p] > num_loops)
+            {
+                ok = false;
+                return;
+            }
+        }
+    });
+
+    parallel_for(num_loops, [&](size_t begin, size_t end) {
+        for (size_t l = begin; l < end; l++)
+        {
+            if (loop_vertices[l] >= num_vertices)
+            {
+                ok = false;
+                return;
+            }
+        }
+    });
+
+    return ok;
+}
+
+int
+triangulate_polygons(std::vector<uint32_t>& indices,
+    const uint32_t *loop_start, const uint32_t *loop_total, uint32_t num_polygons,
+    const uint32_t *loop_vertices)
+{
+    std::atomic<bool> have_quads(false);
+
+    parallel_for(num_polygons, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++)
+        {
+            if (loop_total[p] > 3)
+            {
+                have_quads = true;
+                return;
+            }
+        }
+    });
+
+    const int n = have_quads ? 4 : 3;
+
+    // Primitive offset per polygon
+
+    std::vector<uint32_t> offsets(num_polygons+1);
+
+    offsets[0] = 0;
+    for (uint32_t p = 0; p < num_polygons; p++)
+    {
+        const uint32_t t = loop_total[p];
+        uint32_t count;
+
+        if (t < 3)
+            count = 0;
+        else if (n == 3)
+            count = t - 2;
+        else
+            count = (t - 1) / 2;
+
+        offsets[p+1] = offsets[p] + count;
+    }
+
+    indices.resize(offsets[num_polygons]*n);
+
+    parallel_for(num_polygons, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++)
+        {
+            const uint32_t t = loop_total[p];
+            const uint32_t *v = loop_vertices + loop_start[p];
+            uint32_t *out = &indices[0] + offsets[p]*n;
+
+            if (t < 3)
+                continue;
+
+            if (n == 3)
+            {
+                for (uint32_t i = 1; i < t-1; i++)
+                {
+                    *out++ = v[0];
+                    *out++ = v[i];
+                    *out++ = v[i+1];
+                }
+                continue;
+            }
+
+            // Fan of quads, with a triangle (last index repeated) at
+            // the end for an odd number of vertices
+            uint32_t i = 1;
+            for (; i+2 < t; i += 2)
+            {
+                *out++ = v[0];
+                *out++ = v[i];
+                *out++ = v[i+1];
+                *out++ = v[i+2];
+            }
+            if (i+1 < t)
+            {
+                *out++ = v[0];
+                *out++ = v[i];
+                *out++ = v[i+1];
+                *out++ = v[i+1];
+            }
+        }
+    });
+
+    return n;
+}
+
+void
+compute_smooth_normals(std::vector<float>& normals,
+    const float *vertices, uint32_t num_vertices,
+    const uint32_t *loop_start, const uint32_t *loop_total, uint32_t num_polygons,
+    const uint32_t *loop_vertices, uint32_t num_loops)
+{
+    // Polygon normals using Newell's method, which are
+    // proportional to polygon area
+
+    std::vector<float>      polygon_normals(num_polygons*3);
+    std::vector<uint32_t>   loop_polygons(num_loops);
+
+    parallel_for(num_polygons, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++)
+        {
+            const uint32_t s = loop_start[p];
+            const uint32_t t = loop_total[p];
+            float nx = 0.0f, ny = 0.0f, nz = 0.0f;
+
+            for (uint32_t i = 0; i < t; i++)
+            {
+                const float *a = vertices + 3*loop_vertices[s+i];
+                const float *b = vertices + 3*loop_vertices[s+(i+1)%t];
+
+                nx += (a[1] - b[1]) * (a[2] + b[2]);
+                ny += (a[2] - b[2]) * (a[0] + b[0]);
+                nz += (a[0] - b[0]) * (a[1] + b[1]);
+
+                loop_polygons[s+i] = p;
+            }
+
+            polygon_normals[3*p+0] = nx;
+            polygon_normals[3*p+1] = ny;
+            polygon_normals[3*p+2] = nz;
+        }
+    });
+
+    std::vector<uint32_t> offsets, loops;
+    vertex_loops(offsets, loops, num_vertices, loop_vertices, num_loops);
+
+    normals.resize(num_vertices*3);
+
+    parallel_for(num_vertices, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++)
+        {
+            float nx = 0.0f, ny = 0.0f, nz = 0.0f;
+
+            for (uint32_t i = offsets[v]; i < offsets[v+1]; i++)
+            {
+                const float *pn = &polygon_normals[3*loop_polygons[loops[i]]];
+                nx += pn[0];
+                ny += pn[1];
+                nz += pn[2];
+            }
+
+            const float len = sqrtf(nx*nx + ny*ny + nz*nz);
+            if (len > 0.0f)
+            {
+                nx /= len;
+                ny /= len;
+                nz /= len;
+            }
+            else
+            {
+                // Unused vertex or degenerate polygons
+                nx = ny = 0.0f;
+                nz = 1.0f;
+            }
+
+            normals[3*v+0] = nx;
+            normals[3*v+1] = ny;
+            normals[3*v+2] = nz;
+        }
+    });
+}
+
+void
+resolve_loop_colors(std::vector<float>& vertex_colors,
+    const float *loop_colors, uint32_t num_vertices,
+    const uint32_t *loop_vertices, uint32_t num_loops)
+{
+    std::vector<uint32_t> offsets, loops;
+    vertex_loops(offsets, loops, num_vertices, loop_vertices, num_loops);
+
+    vertex_colors.resize(num_vertices*4);
+
+    parallel_for(num_vertices, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++)
+        {
+            float c[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            const uint32_t n = offsets[v+1] - offsets[v];
+
+            for (uint32_t i = offsets[v]; i < offsets[v+1]; i++)
+            {
+                const float *lc = loop_colors + 4*loops[i];
+                c[0] += lc[0];
+                c[1] += lc[1];
+                c[2] += lc[2];
+                c[3] += lc[3];
+            }
+
+            float *out = &vertex_colors[4*v];
+
+            if (n > 0)
+            {
+                for (int j = 0; j < 4; j++)
+                    out[j] = c[j] / n;
+            }
+            else
+            {
+                out[0] = out[1] = out[2] = out[3] = 1.0f;
+            }
+        }
+    });
+}
+
+// Spreads the lower 10 bits of v over 30 bits, for 3D Morton codes
+static inline uint32_t
+morton_spread(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+static inline uint32_t
+morton_code(const float *p, const float *bmin, const float *scale)
+{
+    uint32_t c[3];
+
+    for (int i = 0; i < 3; i++)
+    {
+        float f = (p[i] - bmin[i]) * scale[i];
+        c[i] = f <= 0.0f ? 0 : (f >= 1023.0f ? 1023 : (uint32_t)f);
+    }
+
+    return (morton_spread(c[0]) << 2) | (morton_spread(c[1]) << 1) | morton_spread(c[2]);
+}
+
+static inline uint64_t
+hash_bytes(uint64_t h, const void *data, size_t size)
+{
+    // FNV-1a
+    const uint8_t *b = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++)
+        h = (h ^ b[i]) * 1099511628211ull;
+    return h;
+}
+
+uint32_t
+optimize_mesh(std::vector<float>& vertices, std::vector<float> *normals, std::vector<float> *colors,
+    uint32_t num_vertices, std::vector<uint32_t>& indices, int indices_per_primitive, bool weld)
+{
+    const uint32_t nv = num_vertices;
+    const int n = indices_per_primitive;
+    const size_t num_primitives = indices.size() / n;
+
+    // Weld vertices with bit-identical attributes. Vertices are sorted
+    // on a hash of their attributes, after which duplicates end up in
+    // the same run. Each unique vertex is represented by the vertex 
+    // with the lowest index in its run.
+
+    std::vector<uint32_t>   weld_remap(nv);     // vertex -> unique vertex
+    std::vector<uint32_t>   unique;             // unique vertex -> representing vertex
+
+    if (weld)
+    {
+        std::vector<uint64_t>   hashes(nv);
+
+        parallel_for(nv, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; v++)
+            {
+                uint64_t h = 14695981039346656037ull;
+                h = hash_bytes(h, &vertices[3*v], 3*sizeof(float));
+                if (normals)
+                    h = hash_bytes(h, &(*normals)[3*v], 3*sizeof(float));
+                if (colors)
+                    h = hash_bytes(h, &(*colors)[4*v], 4*sizeof(float));
+                hashes[v] = h;
+            }
+        });
+
+        auto same_attributes = [&](uint32_t a, uint32_t b) {
+            return memcmp(&vertices[3*a], &vertices[3*b], 3*sizeof(float)) == 0
+                && (!normals || memcmp(&(*normals)[3*a], &(*normals)[3*b], 3*sizeof(float)) == 0)
+                && (!colors || memcmp(&(*colors)[4*a], &(*colors)[4*b], 4*sizeof(float)) == 0);
+        };
+
+        auto compare_attributes = [&](uint32_t a, uint32_t b) {
+            int c = memcmp(&vertices[3*a], &vertices[3*b], 3*sizeof(float));
+            if (c == 0 && normals)
+                c = memcmp(&(*normals)[3*a], &(*normals)[3*b], 3*sizeof(float));
+            if (c == 0 && colors)
+                c = memcmp(&(*colors)[4*a], &(*colors)[4*b], 4*sizeof(float));
+            return c;
+        };
+
+        std::vector<uint32_t> order(nv);
+        for (uint32_t v = 0; v < nv; v++)
+            order[v] = v;
+
+        parallel_sort(order, [&](uint32_t a, uint32_t b) {
+            if (hashes[a] != hashes[b])
+                return hashes[a] < hashes[b];
+            int c = compare_attributes(a, b);
+            if (c != 0)
+                return c < 0;
+            return a < b;
+        });
+
+        for (uint32_t i = 0; i < nv; i++)
+        {
+            const uint32_t v = order[i];
+            if (i == 0 || hashes[v] != hashes[order[i-1]] || !same_attributes(v, unique.back()))
+                unique.push_back(v);
+            weld_remap[v] = unique.size() - 1;
+        }
+    }
+    else
+    {
+        unique.resize(nv);
+        for (uint32_t v = 0; v < nv; v++)
+        {
+            unique[v] = v;
+            weld_remap[v] = v;
+        }
+    }
+
+    const uint32_t nu = unique.size();
+
+    // Bounding box of the vertices
+
+    float bmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float bmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    std::mutex bbox_mutex;
+
+    parallel_for(nv, [&](size_t begin, size_t end) {
+        float lmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float lmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+        for (size_t v = begin; v < end; v++)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                lmin[i] = std::min(lmin[i], vertices[3*v+i]);
+                lmax[i] = std::max(lmax[i], vertices[3*v+i]);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(bbox_mutex);
+        for (int i = 0; i < 3; i++)
+        {
+            bmin[i] = std::min(bmin[i], lmin[i]);
+            bmax[i] = std::max(bmax[i], lmax[i]);
+        }
+    });
+
+    float scale[3];
+    for (int i = 0; i < 3; i++)
+        scale[i] = bmax[i] > bmin[i] ? 1023.0f / (bmax[i] - bmin[i]) : 0.0f;
+
+    // Sort unique vertices along the Morton curve. Keys hold the 
+    // Morton code in the upper 32 bits and the index in the lower.
+
+    std::vector<uint64_t> keys(nu);
+
+    parallel_for(nu, [&](size_t begin, size_t end) {
+        for (size_t u = begin; u < end; u++)
+            keys[u] = ((uint64_t)morton_code(&vertices[3*unique[u]], bmin, scale) << 32) | u;
+    });
+
+    parallel_sort(keys, std::less<uint64_t>());
+
+    std::vector<uint32_t> unique_remap(nu);     // unique vertex -> new vertex index
+
+    parallel_for(nu, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            unique_remap[keys[i] & 0xffffffff] = i;
+    });
+
+    // Gather vertex attributes in the new order
+
+    std::vector<float> new_vertices(nu*3);
+    std::vector<float> new_normals(normals ? nu*3 : 0);
+    std::vector<float> new_colors(colors ? nu*4 : 0);
+
+    parallel_for(nu, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const uint32_t v = unique[keys[i] & 0xffffffff];
+            memcpy(&new_vertices[3*i], &vertices[3*v], 3*sizeof(float));
+            if (normals)
+                memcpy(&new_normals[3*i], &(*normals)[3*v], 3*sizeof(float));
+            if (colors)
+                memcpy(&new_colors[4*i], &(*colors)[4*v], 4*sizeof(float));
+        }
+    });
+
+    vertices.swap(new_vertices);
+    if (normals)
+        normals->swap(new_normals);
+    if (colors)
+        colors->swap(new_colors);
+
+    // Remap indices and sort primitives on the Morton code of their centroid
+
+    keys.resize(num_primitives);
+
+    parallel_for(num_primitives, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++)
+        {
+            float c[3] = { 0.0f, 0.0f, 0.0f };
+            uint32_t *prim = &indices[p*n];
+
+            for (int j = 0; j < n; j++)
+            {
+                prim[j] = unique_remap[weld_remap[prim[j]]];
+                c[0] += vertices[3*prim[j]+0];
+                c[1] += vertices[3*prim[j]+1];
+                c[2] += vertices[3*prim[j]+2];
+            }
+
+            c[0] /= n;
+            c[1] /= n;
+            c[2] /= n;
+
+            keys[p] = ((uint64_t)morton_code(c, bmin, scale) << 32) | p;
+        }
+    });
+
+    parallel_sort(keys, std::less<uint64_t>());
+
+    std::vector<uint32_t> new_indices(indices.size());
+
+    parallel_for(num_primitives, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            memcpy(&new_indices[i*n], &indices[(keys[i] & 0xffffffff)*n], n*sizeof(uint32_t));
+    });
+
+    indices.swap(new_indices);
+
+    return nu;
+}
+
+// Splits primitive p into at most two triangles, in the same way as
+// Embree does for quads. Returns the number of triangles.
+static inline int
+primitive_triangles(uint32_t tris[2][3], const uint32_t *indices, size_t p, int n)
+{
+    const uint32_t *v = indices + p*n;
+
+    tris[0][0] = v[0];
+    tris[0][1] = v[1];
+    tris[0][2] = n == 4 ? v[3] : v[2];
+
+    if (n == 3 || v[2] == v[3])
+    {
+        tris[0][2] = v[2];
+        return 1;
+    }
+
+    tris[1][0] = v[2];
+    tris[1][1] = v[3];
+    tris[1][2] = v[1];
+
+    return 2;
+}
+
+void
+simplify_mesh(std::vector<float>& out_vertices, std::vector<uint32_t>& out_triangles,
+    const float *vertices, uint32_t num_vertices, 
+    const uint32_t *indices, uint32_t num_primitives, int indices_per_primitive,
+    uint32_t target_triangles)
+{
+    const int n = indices_per_primitive;
+
+    out_vertices.clear();
+    out_triangles.clear();
+
+    if (num_vertices == 0 || num_primitives == 0)
+        return;
+
+    // Bounding box and surface area
+
+    float bmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float bmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    double area = 0.0;
+    std::mutex mutex;
+
+    parallel_for(num_vertices, [&](size_t begin, size_t end) {
+        float lmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float lmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+        for (size_t v = begin; v < end; v++)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                lmin[i] = std::min(lmin[i], vertices[3*v+i]);
+                lmax[i] = std::max(lmax[i], vertices[3*v+i]);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < 3; i++)
+        {
+            bmin[i] = std::min(bmin[i], lmin[i]);
+            bmax[i] = std::max(bmax[i], lmax[i]);
+        }
+    });
+
+    parallel_for(num_primitives, [&](size_t begin, size_t end) {
+        double larea = 0.0;
+        uint32_t tris[2][3];
+
+        for (size_t p = begin; p < end; p++)
+        {
+            const int nt = primitive_triangles(tris, indices, p, n);
+
+            for (int t = 0; t < nt; t++)
+            {
+                const float *a = vertices + 3*tris[t][0];
+                const float *b = vertices + 3*tris[t][1];
+                const float *c = vertices + 3*tris[t][2];
+                const float e1[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+                const float e2[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+                const float cx = e1[1]*e2[2] - e1[2]*e2[1];
+                const float cy = e1[2]*e2[0] - e1[0]*e2[2];
+                const float cz = e1[0]*e2[1] - e1[1]*e2[0];
+                larea += 0.5 * sqrt(cx*cx + cy*cy + cz*cz);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        area += larea;
+    });
+
+    // A surface of the given area covers roughly area/cell_size^2 grid
+    // cells, with about two triangles per occupied cell after clustering.
+    // Cell indices are limited to 21 bits per axis, to fit in a 64-bit key.
+
+    float extent = std::max(bmax[0]-bmin[0], std::max(bmax[1]-bmin[1], bmax[2]-bmin[2]));
+    float cell_size = sqrt(2.0 * area / std::max<uint32_t>(target_triangles, 2));
+
+    cell_size = std::max(cell_size, extent / ((1<<21) - 1));
+    if (cell_size <= 0.0f)
+        cell_size = 1.0f;
+
+    const float inv_cell_size = 1.0f / cell_size;
+
+    // Sort vertices on cell, each run of vertices in the same cell 
+    // becomes one cluster
+
+    std::vector<std::pair<uint64_t, uint32_t>> cells(num_vertices);
+
+    parallel_for(num_vertices, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++)
+        {
+            uint64_t key = 0;
+            for (int i = 0; i < 3; i++)
+            {
+                uint64_t c = (uint64_t)((vertices[3*v+i] - bmin[i]) * inv_cell_size);
+                key = (key << 21) | std::min<uint64_t>(c, (1<<21) - 1);
+            }
+            cells[v] = std::make_pair(key, (uint32_t)v);
+        }
+    });
+
+    parallel_sort(cells, std::less<std::pair<uint64_t, uint32_t>>());
+
+    std::vector<uint32_t>   cluster_start;
+    std::vector<uint32_t>   vertex_cluster(num_vertices);
+
+    for (uint32_t i = 0; i < num_vertices; i++)
+    {
+        if (i == 0 || cells[i].first != cells[i-1].first)
+            cluster_start.push_back(i);
+        vertex_cluster[cells[i].second] = cluster_start.size() - 1;
+    }
+
+    const uint32_t num_clusters = cluster_start.size();
+    cluster_start.push_back(num_vertices);
+
+    // Map primitives to cluster triangles, dropping degenerate ones.
+    // Triangles are rotated to start at their lowest index, so duplicates
+    // (with the same orientation) can be removed after sorting.
+
+    typedef std::pair<uint64_t, uint32_t> Triangle;     // (i << 32 | j, k)
+
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<Triangle>> chunk_triangles;
+    
+    const size_t num_chunks = std::max<size_t>(1, std::min<size_t>(parallel_num_threads(), num_primitives / 4096));
+    const size_t chunk = (num_primitives + num_chunks - 1) / num_chunks;
+    chunk_triangles.resize(num_chunks);
+
+    parallel_for(num_chunks, [&](size_t cbegin, size_t cend) {
+        for (size_t ch = cbegin; ch < cend; ch++)
+        {
+            std::vector<Triangle>& out = chunk_triangles[ch];
+            uint32_t tris[2][3];
+
+            for (size_t p = ch*chunk; p < std::min<size_t>((ch+1)*chunk, num_primitives); p++)
+            {
+                const int nt = primitive_triangles(tris, indices, p, n);
+
+                for (int t = 0; t < nt; t++)
+                {
+                    uint32_t a = vertex_cluster[tris[t][0]];
+                    uint32_t b = vertex_cluster[tris[t][1]];
+                    uint32_t c = vertex_cluster[tris[t][2]];
+
+                    if (a == b || b == c || a == c)
+                        continue;
+
+                    while (a > b || a > c)
+                    {
+                        uint32_t tmp = a;
+                        a = b; b = c; c = tmp;
+                    }
+
+                    out.push_back(Triangle(((uint64_t)a << 32) | b, c));
+                }
+            }
+        }
+    }, 1);
+
+    for (auto& ct : chunk_triangles)
+    {
+        triangles.insert(triangles.end(), ct.begin(), ct.end());
+        std::vector<Triangle>().swap(ct);
+    }
+
+    parallel_sort(triangles, std::less<Triangle>());
+    triangles.erase(std::unique(triangles.begin(), triangles.end()), triangles.end());
+
+    // Only keep clusters that are used by a triangle
+
+    std::vector<uint32_t> cluster_remap(num_clusters, 0xffffffff);
+
+    for (const Triangle& t : triangles)
+    {
+        cluster_remap[t.first >> 32] = 0;
+        cluster_remap[t.first & 0xffffffff] = 0;
+        cluster_remap[t.second] = 0;
+    }
+
+    uint32_t num_used = 0;
+    for (uint32_t c = 0; c < num_clusters; c++)
+    {
+        if (cluster_remap[c] == 0)
+            cluster_remap[c] = num_used++;
+    }
+
+    out_vertices.resize(num_used*3);
+
+    parallel_for(num_clusters, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++)
+        {
+            if (cluster_remap[c] == 0xffffffff)
+                continue;
+
+            double sum[3] = { 0.0, 0.0, 0.0 };
+            for (uint32_t i = cluster_start[c]; i < cluster_start[c+1]; i++)
+            {
+                const float *p = vertices + 3*cells[i].second;
+                sum[0] += p[0];
+                sum[1] += p[1];
+                sum[2] += p[2];
+            }
+
+            const uint32_t count = cluster_start[c+1] - cluster_start[c];
+            float *out = &out_vertices[3*cluster_remap[c]];
+            out[0] = sum[0] / count;
+            out[1] = sum[1] / count;
+            out[2] = sum[2] / count;
+        }
+    });
+
+    out_triangles.resize(triangles.size()*3);
+
+    parallel_for(triangles.size(), [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++)
+        {
+            out_triangles[3*t+0] = cluster_remap[triangles[t].first >> 32];
+            out_triangles[3*t+1] = cluster_remap[triangles[t].first & 0xffffffff];
+            out_triangles[3*t+2] = cluster_remap[triangles[t].second];
+        }
+    });
+}
+
+void
+subsample_points(std::vector<uint32_t>& selected, const float *positions, uint32_t num_points, 
+    uint32_t target_points)
+{
+    selected.clear();
+
+    if (target_points >= num_points)
+    {
+        selected.resize(num_points);
+        for (uint32_t i = 0; i < num_points; i++)
+            selected[i] = i;
+        return;
+    }
+
+    if (target_points == 0)
+        return;
+
+    // Bounding box of the points
+
+    float bmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float bmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    std::mutex bbox_mutex;
+
+    parallel_for(num_points, [&](size_t begin, size_t end) {
+        float lmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float lmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+        for (size_t p = begin; p < end; p++)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                lmin[i] = std::min(lmin[i], positions[3*p+i]);
+                lmax[i] = std::max(lmax[i], positions[3*p+i]);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(bbox_mutex);
+        for (int i = 0; i < 3; i++)
+        {
+            bmin[i] = std::min(bmin[i], lmin[i]);
+            bmax[i] = std::max(bmax[i], lmax[i]);
+        }
+    });
+
+    float scale[3];
+    for (int i = 0; i < 3; i++)
+        scale[i] = bmax[i] > bmin[i] ? 1023.0f / (bmax[i] - bmin[i]) : 0.0f;
+
+    // Sort along the Morton curve, keys as in optimize_mesh()
+
+    std::vector<uint64_t> keys(num_points);
+
+    parallel_for(num_points, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++)
+            keys[p] = ((uint64_t)morton_code(&positions[3*p], bmin, scale) << 32) | p;
+    });
+
+    parallel_sort(keys, std::less<uint64_t>());
+
+    // One point per stratum of consecutive points along the curve, at a 
+    // (deterministic) pseudo-random position within the stratum to avoid
+    // aliasing with regular structures in the input order
+
+    selected.resize(target_points);
+
+    const double width = (double)num_points / target_points;
+
+    parallel_for(target_points, [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; s++)
+        {
+            const uint64_t h = (s + 1) * 0x9E3779B97F4A7C15ull;
+            const double jitter = (h >> 11) * (1.0 / 9007199254740992.0);   // [0, 1)
+            const size_t k = std::min<size_t>(num_points - 1, (size_t)((s + jitter) * width));
+
+            selected[s] = keys[k] & 0xffffffff;
+        }
+    });
+}
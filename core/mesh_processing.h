@@ -0,0 +1,85 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Server-side processing of mesh data received from Blender                //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#ifndef MESH_PROCESSING_H
+#define MESH_PROCESSING_H
+
+#include <stdint.h>
+#include <vector>
+
+// Polygons are defined in the same way as in Blender: polygon i uses
+// loop_total[i] consecutive loops starting at loop_start[i], with
+// loop_vertices[l] holding the vertex index of loop l.
+
+// Checks that all loops and vertex indices referenced are in range
+bool check_polygons(
+    const uint32_t *loop_start, const uint32_t *loop_total, uint32_t num_polygons,
+    const uint32_t *loop_vertices, uint32_t num_loops, uint32_t num_vertices);
+
+// Converts polygons to primitives for an OSPRay "mesh" geometry.
+// If the mesh contains any polygons with more than 3 vertices the output is quads (4 indices per
+// primitive), with triangles encoded as quads by repeating the last
+// vertex index and larger polygons split into a fan of quads.
+// Otherwise the output is triangles (3 indices per primitive).
+// Returns the number of indices per primitive (3 or 4).
+// XXX concave polygons with more than 4 vertices are not handled correctly
+int triangulate_polygons(std::vector<uint32_t>& indices,
+    const uint32_t *loop_start, const uint32_t *loop_total, uint32_t num_polygons,
+    const uint32_t *loop_vertices);
+
+// Area-weighted smooth vertex normals (x, y, z, ...)
+void compute_smooth_normals(std::vector<float>& normals,
+    const float *vertices, uint32_t num_vertices,
+    const uint32_t *loop_start, const uint32_t *loop_total, uint32_t num_polygons,
+    const uint32_t *loop_vertices, uint32_t num_loops);
+
+// Per-vertex RGBA colors, averaged over the loops using each vertex
+void resolve_loop_colors(std::vector<float>& vertex_colors,
+    const float *loop_colors, uint32_t num_vertices,
+    const uint32_t *loop_vertices, uint32_t num_loops);
+
+// Optimizes a mesh for BVH build and traversal: vertices with exactly
+// the same attributes are merged (when weld is true), after which
+// vertices and primitives are sorted along a Morton curve.
+// Normals and colors are optional (pass nullptr) and are reordered
+// together with the vertices. Indices are remapped in place.
+// Returns the new number of vertices.
+uint32_t optimize_mesh(std::vector<float>& vertices, std::vector<float> *normals, std::vector<float> *colors,
+    uint32_t num_vertices, std::vector<uint32_t>& indices, int indices_per_primitive, bool weld=true);
+
+// Simplifies a triangle or quad mesh (indices_per_primitive 3 or 4) by
+// clustering vertices on a regular grid, with the cell size chosen to
+// get roughly target_triangles triangles in the result. Each cluster
+// is represented by the mean position of its vertices. The output is 
+// always a triangle mesh.
+void simplify_mesh(std::vector<float>& out_vertices, std::vector<uint32_t>& out_triangles,
+    const float *vertices, uint32_t num_vertices, 
+    const uint32_t *indices, uint32_t num_primitives, int indices_per_primitive,
+    uint32_t target_triangles);
+
+// Selects target_points of the points (x, y, z, ...), spatially 
+// stratified: the points are sorted along a Morton curve, which is 
+// split into target_points strata of consecutive points, and one point
+// of each stratum is picked. Returns the indices of the selected points
+// (in Morton order), or all points if there are at most target_points.
+void subsample_points(std::vector<uint32_t>& selected, const float *positions, uint32_t num_points, 
+    uint32_t target_points);
+
+#endif
@@ -0,0 +1,138 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Simple thread-based parallel loops                                       //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Set in the worker threads of parallel_for(), so that parallel loops
+// nested in them (e.g. a parallel_sort() per chunk) run serially instead 
+// of oversubscribing the machine. Can also be set by code running its 
+// own worker threads.
+inline bool&
+parallel_nested()
+{
+    static thread_local bool nested = false;
+    return nested;
+}
+
+// Number of worker threads to use, can be overridden with
+// BLOSPRAY_NUM_THREADS. Returns 1 within a parallel loop.
+inline unsigned int
+parallel_num_threads()
+{
+    if (parallel_nested())
+        return 1;
+
+    const char *s = getenv("BLOSPRAY_NUM_THREADS");
+    if (s != nullptr && atoi(s) > 0)
+        return atoi(s);
+
+    unsigned int n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+// Calls func(begin, end) on contiguous chunks of [0, count), with
+// one chunk per thread. Small ranges (less than min_chunk items per
+// thread) are handled in fewer threads, down to a single serial call
+// in the calling thread.
+template<typename F>
+void
+parallel_for(size_t count, F func, size_t min_chunk=4096)
+{
+    if (count == 0)
+        return;
+
+    size_t num_threads = parallel_num_threads();
+    num_threads = std::max<size_t>(1, std::min(num_threads, count / std::max<size_t>(1, min_chunk)));
+
+    if (num_threads == 1)
+    {
+        func(size_t(0), count);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    const size_t chunk = (count + num_threads - 1) / num_threads;
+
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        size_t begin = t * chunk;
+        size_t end = std::min(begin + chunk, count);
+        if (begin >= end)
+            break;
+        threads.push_back(std::thread([&func](size_t b, size_t e) {
+            parallel_nested() = true;
+            func(b, e);
+        }, begin, end));
+    }
+
+    for (auto& th : threads)
+        th.join();
+}
+
+// Sorts v using cmp. Chunks of v are sorted in parallel and then
+// merged pairwise, with the merges in each round done in parallel.
+template<typename T, typename Compare>
+void
+parallel_sort(std::vector<T>& v, Compare cmp, size_t min_chunk=65536)
+{
+    const size_t n = v.size();
+    size_t num_chunks = std::max<size_t>(1, std::min<size_t>(parallel_num_threads(), n / min_chunk));
+
+    if (num_chunks == 1)
+    {
+        std::sort(v.begin(), v.end(), cmp);
+        return;
+    }
+
+    const size_t chunk = (n + num_chunks - 1) / num_chunks;
+
+    parallel_for(num_chunks, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++)
+        {
+            size_t first = std::min(c*chunk, n);
+            size_t last = std::min(first+chunk, n);
+            std::sort(v.begin()+first, v.begin()+last, cmp);
+        }
+    }, 1);
+
+    for (size_t width = chunk; width < n; width *= 2)
+    {
+        const size_t num_merges = (n + 2*width - 1) / (2*width);
+
+        parallel_for(num_merges, [&](size_t begin, size_t end) {
+            for (size_t m = begin; m < end; m++)
+            {
+                size_t first = m*2*width;
+                size_t middle = std::min(first+width, n);
+                size_t last = std::min(first+2*width, n);
+                std::inplace_merge(v.begin()+first, v.begin()+middle, v.begin()+last, cmp);
+            }
+        }, 1);
+    }
+}
+
+#endif
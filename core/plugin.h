@@ -21,6 +21,12 @@
 #ifndef PLUGIN_H
 #define PLUGIN_H
 
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
 #include <vector>
 #include <ospray/ospray.h>
 #include <ospray/ospray_util.h>
@@ -118,6 +124,92 @@ typedef std::vector<OSPLight>               Lights;
 //
 // Structures
 //
+
+// Description of the OSPRay volume or geometry created by a plugin,
+// in terms of its OSPRay type and parameters. A plugin can optionally
+// fill this in, in which case the server can store the created data
+// in an on-disk cache (when BLOSPRAY_CACHE_DIR is set). A later instance 
+// with the same parameters and unchanged input files is then recreated 
+// from the (memory-mapped) cache file, without calling the plugin.
+//
+// Arrays are not copied. They need to stay valid until the 
+// create_instance_function returns, or an owner can be passed that
+// keeps them alive (the server releases it when done).
+// Only plain value types can be used (i.e. no OSPRay object arrays).
+
+struct CacheableObject
+{
+    struct Parameter
+    {
+        std::string                 name;
+        OSPDataType                 type;
+        uint64_t                    count;      // Number of array items, 0 for a single value
+        const void                  *data;      // Array data, not copied
+        std::shared_ptr<const void> owner;      // Optional
+        std::vector<uint8_t>        value;      // Single value, copied
+    };
+
+    // As passed to ospNewVolume() or ospNewGeometry(), e.g. "structured_regular"
+    std::string             subtype;
+    std::vector<Parameter>  parameters;
+
+    void add_array(const std::string& name, OSPDataType type, uint64_t count, const void *data,
+        std::shared_ptr<const void> owner=nullptr)
+    {
+        Parameter p;
+        p.name = name;
+        p.type = type;
+        p.count = count;
+        p.data = data;
+        p.owner = owner;
+        parameters.push_back(p);
+    }
+
+    void add_value(const std::string& name, OSPDataType type, const void *value, size_t size)
+    {
+        Parameter p;
+        p.name = name;
+        p.type = type;
+        p.count = 0;
+        p.data = nullptr;
+        p.value.resize(size);
+        memcpy(p.value.data(), value, size);
+        parameters.push_back(p);
+    }
+
+    void add_int(const std::string& name, int value)
+    {
+        add_value(name, OSP_INT, &value, sizeof(int));
+    }
+
+    void add_float(const std::string& name, float value)
+    {
+        add_value(name, OSP_FLOAT, &value, sizeof(float));
+    }
+
+    void add_vec3i(const std::string& name, int x, int y, int z)
+    {
+        int v[3] = { x, y, z };
+        add_value(name, OSP_VEC3I, v, sizeof(v));
+    }
+
+    void add_vec3f(const std::string& name, float x, float y, float z)
+    {
+        float v[3] = { x, y, z };
+        add_value(name, OSP_VEC3F, v, sizeof(v));
+    }
+
+    bool empty() const
+    {
+        return subtype.empty();
+    }
+
+    void clear()
+    {
+        subtype.clear();
+        parameters.clear();
+    }
+};
  
 // XXX rename, as it is not the state of the plugin, but state of one
 // of the "instances" managed by the plugin, e.g. PluginInstanceState or just PluginInstance
@@ -135,6 +227,17 @@ struct PluginState
     // Custom properties set on the Blender mesh data.
     // XXX Will be updated by the server when needed.
     json            parameters;
+
+    // Frame number (time step) the instance is created for, set by the 
+    // server. Time-dependent data can also be selected with parameter
+    // values that depend on the frame, e.g. "data{{'%04d' % frame}}.raw",
+    // in which case the instance is re-created when these change.
+    int             frame;
+
+    // Set to true by create_instance_function when the instance depends
+    // on frame (and not only on its parameters), so the server re-creates 
+    // it when the frame changes.
+    bool            frame_dependent;
     
     // Bounding geometry, may be NULL
     BoundingMesh    *bound;
@@ -149,22 +252,109 @@ struct PluginState
     OSPVolume       volume;
     float           volume_data_range[2];
     // XXX could add optional TF
+
+    // Volume plugin, optional: for volumes stored quantized (e.g. floats 
+    // as uchar) the original value of stored value v is 
+    // v * volume_value_scale + volume_value_offset. The data range is in
+    // original values, the server maps it (and e.g. isovalues) to stored
+    // values.
+    float           volume_value_scale;
+    float           volume_value_offset;
+
+    // Volume plugin, optional: a lower-resolution version of the volume
+    // (same bound and data range), used instead of the volume during
+    // interactive rendering like the LOD proxies of large meshes
+    OSPVolume       lod_volume;
     
     // Geometry plugin:
     OSPGeometry     geometry;    
+
+    // Geometry plugin, optional: the same geometry as a triangle or 
+    // quad mesh (lod_indices_per_primitive 3 or 4). For large meshes
+    // the server uses these to build a simplified proxy in the background,
+    // which is used during interactive rendering. The server takes over
+    // the arrays, leaving them empty.
+    std::vector<float>      lod_vertices;
+    std::vector<uint32_t>   lod_indices;
+    int                     lod_indices_per_primitive;
+
+    // Set by the server: the number of primitives from which it builds a 
+    // proxy (0 = never). The arrays above only need to be filled for 
+    // geometry with at least this many primitives.
+    uint32_t                lod_min_primitives;
     
     // Scene plugin:
     GroupInstances  group_instances;    // Need a refcount of at least 1 to survive in the list
     Lights          lights;
 
+    // Scene plugin, optional: a lower-detail version of the group of each
+    // entry in group_instances (same order, nullptr for none), used instead 
+    // during interactive rendering like the LOD proxies of large meshes
+    std::vector<OSPGroup>   lod_groups;
+
+    // Volume and geometry plugins, optional: description of the volume 
+    // or geometry created, see CacheableObject
+    CacheableObject cacheable;
+
+    // Memory referenced by OSPRay shared data of this instance (e.g. a
+    // memory-mapped cache file). Released after the OSPRay objects.
+    std::vector<std::shared_ptr<const void>>    shared_memory;
+
+    // Optional: approximate memory used by this instance's data, in bytes.
+    // When left at 0 the server estimates it from the cacheable object.
+    // Used for the server's memory budget.
+    size_t          data_size;
+
     PluginState()
     {
         renderer = "";
+        frame = 0;
+        frame_dependent = false;
         bound = nullptr;
         data = nullptr;
         volume = nullptr;
         volume_data_range[0] = volume_data_range[1] = 0.0f;
+        volume_value_scale = 1.0f;
+        volume_value_offset = 0.0f;
+        lod_volume = nullptr;
         geometry = nullptr;
+        lod_indices_per_primitive = 3;
+        lod_min_primitives = 0;
+        data_size = 0;
+        progress = 0.0f;
+        cancel_requested = false;
+    }
+
+    // The create_instance_function runs on a separate thread in the server.
+    // Long-running plugins should report their progress (fraction in [0,1], 
+    // plus optional message) and regularly check if they have been canceled. 
+    // When canceled they should clean up, set result.success to false 
+    // and return.
+
+    void set_progress(float fraction, const std::string& message="")
+    {
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        progress = fraction;
+        progress_message = message;
+    }
+
+    bool canceled() const
+    {
+        return cancel_requested;
+    }
+
+    // Used by the server
+
+    float get_progress(std::string& message)
+    {
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        message = progress_message;
+        return progress;
+    }
+
+    void cancel()
+    {
+        cancel_requested = true;
     }
 
     ~PluginState()
@@ -173,13 +363,26 @@ struct PluginState
             delete bound;
         if (volume != nullptr)
             ospRelease(volume);
+        if (lod_volume != nullptr)
+            ospRelease(lod_volume);
         if (geometry != nullptr)
             ospRelease(geometry);
         for (auto& gi : group_instances)
             ospRelease(gi.first);
+        for (auto& g : lod_groups)
+        {
+            if (g != nullptr)
+                ospRelease(g);
+        }
         for (auto& l : lights)     
             ospRelease(l);
     }
+
+protected:
+    std::mutex          progress_mutex;
+    float               progress;
+    std::string         progress_message;
+    std::atomic<bool>   cancel_requested;
 };
 
 // XXX better name
@@ -207,6 +410,27 @@ struct PluginResult
     }
 };
 
+// Current view, passed to scene plugins that provide an 
+// update_view_function. Positions and directions are in world space.
+
+struct PluginView
+{
+    float       position[3];
+    float       view_dir[3];
+    float       up_dir[3];
+
+    bool        perspective;        // Otherwise orthographic
+    float       fov_y;              // Degrees, perspective only
+    float       height;             // Of the view, orthographic only
+    float       aspect;
+
+    int         image_height;       // Pixels
+    bool        final_render;
+
+    // Transform of the scene object the plugin instance is used in
+    glm::mat4   object2world;
+};
+
 //
 // Functions
 //
@@ -226,6 +450,23 @@ typedef void (*clear_data_function_t)(
     PluginState *state
 );
 
+typedef void (*query_bound_function_t)(
+    PluginResult &result,
+    PluginState *state
+);
+
+typedef bool (*update_instance_function_t)(
+    PluginResult &result,
+    PluginState *state,
+    const std::set<std::string>& changed_parameters
+);
+
+typedef bool (*update_view_function_t)(
+    PluginResult &result,
+    PluginState *state,
+    const PluginView &view
+);
+
 typedef struct 
 {
     // One-time plugin loading/unloading. Both may be NULL.
@@ -235,6 +476,8 @@ typedef struct
     // Create/destroy the scene element(s) this plugin instance provides.
     // Depending on the type of plugin the corresponding fields in
     // PluginState must be set.
+    // This function is called on a separate thread, see the progress and 
+    // cancellation methods in PluginState. 
     // This function may not be NULL.
     create_instance_function_t  create_instance_function;    
     
@@ -242,10 +485,31 @@ typedef struct
     // May be NULL
     clear_data_function_t       clear_data_function;
     
-    // Optimization later: allow light-weight updating (if we can
-    // reliably detect what exactly changed)
-    // Properties were updated, update elements
-    //object_update_function_t    object_update_function;
+    // Set PluginState.bound based on the parameters only, without loading 
+    // all the data (e.g. from a file header). Only parameters is set in the 
+    // PluginState passed, and the state is discarded afterwards.
+    // This allows a bound to be queried for a plugin instance that hasn't
+    // been created (yet). May be NULL.
+    query_bound_function_t      query_bound_function;
+    
+    // Light-weight update of an existing plugin instance after some of its
+    // parameters changed. PluginState.parameters holds the new values, 
+    // changed_parameters the names of parameters that were added, removed 
+    // or changed. The plugin updates the OSPRay scene elements in the state 
+    // (in place, or by replacing them) and returns true. When the changes 
+    // can't be handled this way the function should return false without
+    // modifying the state, after which the instance is re-created with
+    // create_instance_function. Called on the main server thread, so
+    // should be fast. May be NULL.
+    update_instance_function_t  update_instance_function;
+
+    // Scene plugins: update the instance for a new view, e.g. to select 
+    // the level of detail to show. Called on the main server thread
+    // before each render, and for each scene object using the instance.
+    // Returns true when group_instances in the state was changed, after
+    // which the server replaces the object's OSPRay instances. Should be 
+    // fast, as rendering waits for it. May be NULL.
+    update_view_function_t      update_view_function;
 }
 PluginFunctions;
 
@@ -326,6 +590,12 @@ typedef struct
     //PluginRenderer      renderer;
     bool                uses_renderer_type;
 
+    // Set to true when create_instance_function can be called for 
+    // multiple instances concurrently (i.e. the plugin doesn't use
+    // global state). Otherwise instances are created one at a time.
+    // Defaults to false.
+    bool                thread_safe;
+
     PluginParameter     *parameters;
     PluginFunctions     functions;    
 }
@@ -349,8 +619,13 @@ Some notes regarding our plugins:
   The plugin could return a loose bound in reponse to an extent()
   query while returning a tight bound for load(), which would then update
   the bound geometry in Blender
+  -> query_bound_function provides the cheap path, when a plugin 
+     instance exists its (tight) bound is used instead
   
 - How to add a framenumber/timestamp parameter to the plugin API?
+  -> PluginState::frame, plus PluginState::frame_dependent. When rendering
+     an animation the server creates the instance for the next frame
+     in the background
 */
 
 
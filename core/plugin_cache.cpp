@@ -0,0 +1,326 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// On-disk cache of plugin instance data                                    //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "plugin_cache.h"
+
+static const char       cache_magic[8] = { 'B', 'L', 'S', 'P', 'C', 'A', 'C', 'H' };
+static const uint32_t   cache_version = 2;
+static const uint64_t   cache_alignment = 64;
+
+// File layout: header, parameter table, then the parameter data and
+// serialized bound, each starting at an aligned offset
+
+struct CacheHeader
+{
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    plugin_type;
+    char        subtype[64];
+    float       data_range[2];
+    float       value_scale;
+    float       value_offset;
+    uint32_t    num_parameters;
+    uint32_t    bound_size;
+    uint64_t    bound_offset;
+};
+
+struct CacheParameter
+{
+    char        name[64];
+    uint32_t    type;
+    uint32_t    is_array;
+    uint64_t    count;
+    uint64_t    offset;
+    uint64_t    size;
+};
+
+static uint64_t
+align(uint64_t offset)
+{
+    return (offset + cache_alignment - 1) / cache_alignment * cache_alignment;
+}
+
+size_t
+ospray_type_size(OSPDataType type)
+{
+    switch (type)
+    {
+    case OSP_CHAR:
+    case OSP_UCHAR:
+        return 1;
+    case OSP_SHORT:
+    case OSP_USHORT:
+        return 2;
+    case OSP_INT:
+    case OSP_UINT:
+    case OSP_FLOAT:
+        return 4;
+    case OSP_LONG:
+    case OSP_ULONG:
+    case OSP_DOUBLE:
+    case OSP_VEC2I:
+    case OSP_VEC2UI:
+    case OSP_VEC2F:
+        return 8;
+    case OSP_VEC3I:
+    case OSP_VEC3UI:
+    case OSP_VEC3F:
+        return 12;
+    case OSP_VEC4I:
+    case OSP_VEC4UI:
+    case OSP_VEC4F:
+        return 16;
+    case OSP_BOX3F:
+        return 24;
+    default:
+        return 0;
+    }
+}
+
+static bool
+write_padding(FILE *f, uint64_t& pos)
+{
+    static const uint8_t zeroes[cache_alignment] = { 0 };
+
+    uint64_t n = align(pos) - pos;
+    if (n > 0 && fwrite(zeroes, 1, n, f) != n)
+        return false;
+
+    pos += n;
+    return true;
+}
+
+bool
+write_plugin_cache(const std::string& fname, PluginType type, const PluginState *state)
+{
+    const CacheableObject& object = state->cacheable;
+
+    if (object.empty() || object.subtype.size() >= sizeof(CacheHeader::subtype))
+        return false;
+
+    // Set up header and parameter table
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.plugin_type = type;
+    strcpy(header.subtype, object.subtype.c_str());
+    header.data_range[0] = state->volume_data_range[0];
+    header.data_range[1] = state->volume_data_range[1];
+    header.value_scale = state->volume_value_scale;
+    header.value_offset = state->volume_value_offset;
+    header.num_parameters = object.parameters.size();
+
+    std::vector<CacheParameter> table(object.parameters.size());
+    uint64_t pos = align(sizeof(CacheHeader) + table.size()*sizeof(CacheParameter));
+
+    for (size_t i = 0; i < object.parameters.size(); i++)
+    {
+        const CacheableObject::Parameter& p = object.parameters[i];
+        CacheParameter& cp = table[i];
+        size_t item_size = ospray_type_size(p.type);
+
+        if (item_size == 0 || p.name.size() >= sizeof(cp.name))
+        {
+            printf("... WARNING: plugin cache: can't store parameter '%s' (type %d)\n", p.name.c_str(), p.type);
+            return false;
+        }
+
+        memset(&cp, 0, sizeof(cp));
+        strcpy(cp.name, p.name.c_str());
+        cp.type = p.type;
+        cp.is_array = p.count > 0;
+        cp.count = p.count;
+        cp.offset = pos;
+        cp.size = cp.is_array ? p.count * item_size : p.value.size();
+
+        pos = align(pos + cp.size);
+    }
+
+    uint32_t bound_size = 0;
+    uint8_t *bound = nullptr;
+
+    if (state->bound != nullptr)
+        bound = state->bound->serialize(bound_size);
+
+    header.bound_offset = pos;
+    header.bound_size = bound_size;
+
+    // Write file
+
+    const std::string tmp_fname = fname + ".tmp";
+
+    FILE *f = fopen(tmp_fname.c_str(), "wb");
+    if (f == nullptr)
+    {
+        printf("... WARNING: plugin cache: could not open '%s' for writing\n", tmp_fname.c_str());
+        delete [] bound;
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+        && (table.empty() || fwrite(table.data(), sizeof(CacheParameter), table.size(), f) == table.size());
+
+    pos = sizeof(CacheHeader) + table.size()*sizeof(CacheParameter);
+
+    for (size_t i = 0; ok && i < object.parameters.size(); i++)
+    {
+        const CacheableObject::Parameter& p = object.parameters[i];
+        const void *data = table[i].is_array ? p.data : p.value.data();
+
+        ok = write_padding(f, pos) && fwrite(data, 1, table[i].size, f) == table[i].size;
+        pos += table[i].size;
+    }
+
+    if (ok && bound != nullptr)
+        ok = write_padding(f, pos) && fwrite(bound, 1, bound_size, f) == bound_size;
+
+    delete [] bound;
+
+    if (fclose(f) != 0)
+        ok = false;
+
+    if (!ok || rename(tmp_fname.c_str(), fname.c_str()) != 0)
+    {
+        printf("... WARNING: plugin cache: failed to write '%s'\n", fname.c_str());
+        unlink(tmp_fname.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool
+read_plugin_cache(const std::string& fname, PluginType type, PluginState *state)
+{
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(CacheHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    const uint64_t file_size = st.st_size;
+
+    void *mapping = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        printf("... WARNING: plugin cache: could not map '%s'\n", fname.c_str());
+        return false;
+    }
+
+    std::shared_ptr<const void> memory(mapping, [file_size](const void *p) {
+        munmap(const_cast<void*>(p), file_size);
+    });
+
+    // Validate header and parameter table
+
+    const uint8_t *base = (const uint8_t*)mapping;
+    const CacheHeader *header = (const CacheHeader*)base;
+
+    if (memcmp(header->magic, cache_magic, sizeof(cache_magic)) != 0
+        || header->version != cache_version
+        || header->plugin_type != (uint32_t)type
+        || header->subtype[sizeof(header->subtype)-1] != '\0'
+        || sizeof(CacheHeader) + (uint64_t)header->num_parameters*sizeof(CacheParameter) > file_size
+        || header->bound_offset + header->bound_size > file_size)
+    {
+        printf("... WARNING: plugin cache: '%s' is invalid, ignoring\n", fname.c_str());
+        return false;
+    }
+
+    const CacheParameter *table = (const CacheParameter*)(base + sizeof(CacheHeader));
+
+    for (uint32_t i = 0; i < header->num_parameters; i++)
+    {
+        const CacheParameter& cp = table[i];
+        size_t item_size = ospray_type_size((OSPDataType)cp.type);
+
+        if (cp.name[sizeof(cp.name)-1] != '\0' || item_size == 0
+            || cp.size != (cp.is_array ? cp.count * item_size : item_size)
+            || cp.offset + cp.size > file_size)
+        {
+            printf("... WARNING: plugin cache: '%s' is invalid, ignoring\n", fname.c_str());
+            return false;
+        }
+    }
+
+    // Recreate the OSPRay object, referencing the mapped arrays
+
+    OSPObject object;
+
+    if (type == PT_VOLUME)
+        object = ospNewVolume(header->subtype);
+    else
+        object = ospNewGeometry(header->subtype);
+
+    for (uint32_t i = 0; i < header->num_parameters; i++)
+    {
+        const CacheParameter& cp = table[i];
+
+        if (cp.is_array)
+        {
+            OSPData data = ospNewSharedData(base + cp.offset, (OSPDataType)cp.type, cp.count);
+            ospCommit(data);
+            ospSetObject(object, cp.name, data);
+            ospRelease(data);
+        }
+        else
+            ospSetParam(object, cp.name, (OSPDataType)cp.type, base + cp.offset);
+    }
+
+    ospCommit(object);
+
+    if (type == PT_VOLUME)
+    {
+        state->volume = (OSPVolume)object;
+        state->volume_data_range[0] = header->data_range[0];
+        state->volume_data_range[1] = header->data_range[1];
+        state->volume_value_scale = header->value_scale;
+        state->volume_value_offset = header->value_offset;
+    }
+    else
+        state->geometry = (OSPGeometry)object;
+
+    if (header->bound_size > 0)
+        state->bound = BoundingMesh::deserialize(base + header->bound_offset, header->bound_size);
+
+    state->shared_memory.push_back(memory);
+    state->data_size = file_size;
+
+    return true;
+}
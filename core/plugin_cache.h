@@ -0,0 +1,48 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// On-disk cache of plugin instance data                                    //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#ifndef PLUGIN_CACHE_H
+#define PLUGIN_CACHE_H
+
+#include <string>
+#include <ospray/ospray.h>
+#include "plugin.h"
+
+// A cache file holds the CacheableObject description of a volume or
+// geometry plugin instance, plus its bound and (for volumes) data range.
+// Array data is stored 64-byte aligned, so the file can be memory-mapped
+// and used directly as OSPRay shared data.
+
+// Size in bytes of a single item of the given type, 0 for types
+// that can't be cached (e.g. OSPRay objects)
+size_t ospray_type_size(OSPDataType type);
+
+// Writes the state's cacheable object, bound and data range to the given file.
+// The file is first written under a temporary name and then renamed, so
+// a partially written file is never used.
+bool write_plugin_cache(const std::string& fname, PluginType type, const PluginState *state);
+
+// Maps the given cache file and creates the volume or geometry in state from
+// it, plus the bound and data range. The mapping is added to state->shared_memory
+// and its size stored in state->data_size.
+// Returns false if the file does not exist or doesn't match the plugin type.
+bool read_plugin_cache(const std::string& fname, PluginType type, PluginState *state);
+
+#endif
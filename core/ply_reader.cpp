@@ -0,0 +1,812 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// PLY mesh reader                                                          //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <sys/stat.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <sstream>
+
+#include "ply_reader.h"
+#include "input_data_cache.h"
+#include "parallel.h"
+#include "plugin.h"
+#include "voxels.h"         // voxel_swap()
+
+static void
+set_progress(PluginState *state, float fraction, const std::string& message)
+{
+    if (state != nullptr)
+        state->set_progress(fraction, message);
+}
+
+static bool
+canceled(PluginState *state)
+{
+    return state != nullptr && state->canceled();
+}
+
+enum PlyType
+{
+    PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, 
+    PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64,
+    PLY_INVALID
+};
+
+enum PlyFormat
+{
+    PLY_ASCII,
+    PLY_BINARY_LE,
+    PLY_BINARY_BE
+};
+
+struct PlyProperty
+{
+    std::string     name;
+    PlyType         type;           // Of the values
+    bool            is_list;
+    PlyType         count_type;     // Lists only
+    uint32_t        offset;         // In the record, when the element has a fixed size
+};
+
+struct PlyElement
+{
+    std::string                 name;
+    uint64_t                    count;
+    std::vector<PlyProperty>    properties;
+    bool                        fixed_size;     // No list properties
+    uint32_t                    record_size;    // Binary, fixed size only
+
+    int find(const char *name) const
+    {
+        for (size_t i = 0; i < properties.size(); i++)
+            if (properties[i].name == name)
+                return i;
+        return -1;
+    }
+};
+
+struct PlyFile
+{
+    std::shared_ptr<const void>     mapping;
+    const uint8_t                   *data;
+    uint64_t                        size;
+    uint64_t                        body_offset;
+    PlyFormat                       format;
+    std::vector<PlyElement>         elements;
+};
+
+static PlyType
+ply_type(const std::string& name)
+{
+    if (name == "char" || name == "int8") return PLY_INT8;
+    if (name == "uchar" || name == "uint8") return PLY_UINT8;
+    if (name == "short" || name == "int16") return PLY_INT16;
+    if (name == "ushort" || name == "uint16") return PLY_UINT16;
+    if (name == "int" || name == "int32") return PLY_INT32;
+    if (name == "uint" || name == "uint32") return PLY_UINT32;
+    if (name == "float" || name == "float32") return PLY_FLOAT32;
+    if (name == "double" || name == "float64") return PLY_FLOAT64;
+    return PLY_INVALID;
+}
+
+static uint32_t
+ply_type_size(PlyType type)
+{
+    static const uint32_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+    return sizes[type];
+}
+
+template<typename T, bool SWAP>
+static inline double
+read_binary(const uint8_t *p)
+{
+    T v;
+    memcpy(&v, p, sizeof(T));
+    if (SWAP)
+        v = voxel_swap(v);
+    return v;
+}
+
+template<bool SWAP>
+static inline double
+read_binary_value(const uint8_t *p, PlyType type)
+{
+    switch (type)
+    {
+    case PLY_INT8:      return (int8_t)*p;
+    case PLY_UINT8:     return *p;
+    case PLY_INT16:     return read_binary<int16_t, SWAP>(p);
+    case PLY_UINT16:    return read_binary<uint16_t, SWAP>(p);
+    case PLY_INT32:     return read_binary<int32_t, SWAP>(p);
+    case PLY_UINT32:    return read_binary<uint32_t, SWAP>(p);
+    case PLY_FLOAT32:   return read_binary<float, SWAP>(p);
+    case PLY_FLOAT64:   return read_binary<double, SWAP>(p);
+    default:            return 0.0;
+    }
+}
+
+// Copies one property of count fixed-size records (stride bytes apart) 
+// to every n-th value of dst. Specialized per type, so the loop is
+// a plain strided copy (plus byte swap).
+template<typename S, typename D, bool SWAP>
+static void
+deinterleave(D *dst, uint32_t n, const uint8_t *src, uint32_t stride, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        S v;
+        memcpy(&v, src + i*stride, sizeof(S));
+        if (SWAP)
+            v = voxel_swap(v);
+        dst[i*n] = (D)v;
+    }
+}
+
+template<typename D, bool SWAP>
+static void
+deinterleave_property(D *dst, uint32_t n, const uint8_t *src, uint32_t stride, PlyType type, size_t begin, size_t end)
+{
+    switch (type)
+    {
+    case PLY_INT8:      deinterleave<int8_t, D, SWAP>(dst, n, src, stride, begin, end); break;
+    case PLY_UINT8:     deinterleave<uint8_t, D, SWAP>(dst, n, src, stride, begin, end); break;
+    case PLY_INT16:     deinterleave<int16_t, D, SWAP>(dst, n, src, stride, begin, end); break;
+    case PLY_UINT16:    deinterleave<uint16_t, D, SWAP>(dst, n, src, stride, begin, end); break;
+    case PLY_INT32:     deinterleave<int32_t, D, SWAP>(dst, n, src, stride, begin, end); break;
+    case PLY_UINT32:    deinterleave<uint32_t, D, SWAP>(dst, n, src, stride, begin, end); break;
+    case PLY_FLOAT32:   deinterleave<float, D, SWAP>(dst, n, src, stride, begin, end); break;
+    case PLY_FLOAT64:   deinterleave<double, D, SWAP>(dst, n, src, stride, begin, end); break;
+    default: break;
+    }
+}
+
+// Maps the file and parses its header
+static bool
+open_ply(PlyFile& ply, const std::string& fname, std::string& message)
+{
+    struct stat st;
+
+    if (stat(fname.c_str(), &st) != 0)
+    {
+        message = "Could not open PLY file " + fname;
+        return false;
+    }
+
+    ply.mapping = map_input_data(fname, 0, st.st_size);
+
+    if (!ply.mapping)
+    {
+        message = "Could not map PLY file " + fname;
+        return false;
+    }
+
+    ply.data = (const uint8_t*)ply.mapping.get();
+    ply.size = st.st_size;
+
+    const char *text = (const char*)ply.data;
+    const char *header_end = nullptr;
+
+    for (uint64_t i = 0; i + 10 <= ply.size && i < 1024*1024; i++)
+    {
+        if (text[i] == '\n' && memcmp(text + i + 1, "end_header", 10) == 0)
+        {
+            header_end = (const char*)memchr(text + i + 1, '\n', ply.size - i - 1);
+            break;
+        }
+    }
+
+    if (ply.size < 4 || memcmp(text, "ply", 3) != 0 || header_end == nullptr)
+    {
+        message = "Not a PLY file, or header not found: " + fname;
+        return false;
+    }
+
+    ply.body_offset = header_end + 1 - text;
+
+    std::istringstream header(std::string(text, header_end - text));
+    std::string line;
+    bool have_format = false;
+
+    while (std::getline(header, line))
+    {
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+
+        if (keyword == "format")
+        {
+            std::string format;
+            tokens >> format;
+
+            if (format == "ascii")
+                ply.format = PLY_ASCII;
+            else if (format == "binary_little_endian")
+                ply.format = PLY_BINARY_LE;
+            else if (format == "binary_big_endian")
+                ply.format = PLY_BINARY_BE;
+            else
+            {
+                message = "Unknown PLY format '" + format + "'";
+                return false;
+            }
+
+            have_format = true;
+        }
+        else if (keyword == "element")
+        {
+            PlyElement element;
+            tokens >> element.name >> element.count;
+            element.fixed_size = true;
+            element.record_size = 0;
+            ply.elements.push_back(element);
+        }
+        else if (keyword == "property")
+        {
+            if (ply.elements.empty())
+            {
+                message = "PLY property outside of an element";
+                return false;
+            }
+
+            PlyElement& element = ply.elements.back();
+            PlyProperty prop;
+            std::string type;
+
+            tokens >> type;
+
+            if (type == "list")
+            {
+                std::string count_type, value_type;
+                tokens >> count_type >> value_type >> prop.name;
+                prop.is_list = true;
+                prop.count_type = ply_type(count_type);
+                prop.type = ply_type(value_type);
+                element.fixed_size = false;
+            }
+            else
+            {
+                tokens >> prop.name;
+                prop.is_list = false;
+                prop.count_type = PLY_INVALID;
+                prop.type = ply_type(type);
+            }
+
+            if (prop.type == PLY_INVALID || (prop.is_list && prop.count_type == PLY_INVALID))
+            {
+                message = "Unknown PLY type in '" + line + "'";
+                return false;
+            }
+
+            prop.offset = element.record_size;
+            if (!prop.is_list)
+                element.record_size += ply_type_size(prop.type);
+
+            element.properties.push_back(prop);
+        }
+    }
+
+    if (!have_format)
+    {
+        message = "PLY header has no format line";
+        return false;
+    }
+
+    return true;
+}
+
+// Size in bytes of the binary record at p, 0 when it extends past end.
+// Optionally returns the offset within the record of the given property,
+// which can follow list properties of varying size.
+template<bool SWAP>
+static uint64_t
+binary_record_size(const uint8_t *p, const uint8_t *end, const PlyElement& element,
+    int property=-1, uint64_t *property_offset=nullptr)
+{
+    const uint8_t *q = p;
+
+    for (int i = 0; i < (int)element.properties.size(); i++)
+    {
+        const PlyProperty& prop = element.properties[i];
+
+        if (i == property)
+            *property_offset = q - p;
+
+        if (prop.is_list)
+        {
+            if (q + ply_type_size(prop.count_type) > end)
+                return 0;
+            const uint64_t n = read_binary_value<SWAP>(q, prop.count_type);
+            q += ply_type_size(prop.count_type) + n*ply_type_size(prop.type);
+        }
+        else
+            q += ply_type_size(prop.type);
+
+        if (q > end)
+            return 0;
+    }
+
+    return q - p;
+}
+
+// Extracts the vertex positions and face indices from a binary file
+template<bool SWAP>
+static bool
+read_binary_ply(PlyMesh& mesh, const PlyFile& ply, std::string& message, PluginState *state)
+{
+    const uint8_t *pos = ply.data + ply.body_offset;
+    const uint8_t *end = ply.data + ply.size;
+
+    for (const PlyElement& element : ply.elements)
+    {
+        if (canceled(state))
+            return false;
+
+        const int x = element.find("x");
+        int vi = element.find("vertex_indices");
+        if (vi == -1)
+            vi = element.find("vertex_index");
+
+        if (element.name == "vertex" && element.fixed_size)
+        {
+            if ((uint64_t)(end - pos) < element.count * element.record_size)
+            {
+                message = "PLY file is truncated (vertex data)";
+                return false;
+            }
+
+            const int y = element.find("y"), z = element.find("z");
+
+            if (x == -1 || y == -1 || z == -1)
+            {
+                message = "PLY vertex element lacks x, y or z";
+                return false;
+            }
+
+            set_progress(state, 0.0f, "Reading vertices");
+
+            mesh.vertices.resize(element.count*3);
+
+            const int xyz[3] = { x, y, z };
+
+            parallel_for(element.count, [&](size_t begin, size_t end) {
+                for (int c = 0; c < 3; c++)
+                {
+                    const PlyProperty& prop = element.properties[xyz[c]];
+                    deinterleave_property<float, SWAP>(&mesh.vertices[c], 3, 
+                        pos + prop.offset, element.record_size, prop.type, begin, end);
+                }
+            });
+
+            pos += element.count * element.record_size;
+        }
+        else if (element.name == "face" && vi != -1 && element.properties[vi].is_list)
+        {
+            set_progress(state, 0.5f, "Reading faces");
+
+            const uint64_t num_faces = element.count;
+            const PlyProperty& list = element.properties[vi];
+            const uint32_t count_size = ply_type_size(list.count_type);
+            const uint32_t index_size = ply_type_size(list.type);
+
+            // Offset of the list within the record, when only scalar 
+            // properties precede it
+            uint32_t list_offset = 0;
+            bool other_lists = false;
+
+            for (int i = 0; i < (int)element.properties.size(); i++)
+            {
+                if (i < vi)
+                    list_offset += ply_type_size(element.properties[i].type);
+                if (i != vi && element.properties[i].is_list)
+                    other_lists = true;
+            }
+
+            mesh.face_lengths.resize(num_faces);
+
+            // Start of the list in each face record, when not all records
+            // are the same size
+            std::vector<uint64_t> list_offsets;
+            uint64_t record_stride = 0;
+            uint64_t element_size = 0;
+
+            if (num_faces > 0 && !other_lists && (uint64_t)(end - pos) >= list_offset + count_size)
+            {
+                // Assume all faces have the same number of vertices as
+                // the first, check that in parallel
+                const uint64_t n = read_binary_value<SWAP>(pos + list_offset, list.count_type);
+                record_stride = element.record_size + count_size + n*index_size;
+
+                std::atomic<bool> uniform(num_faces * record_stride <= (uint64_t)(end - pos));
+
+                if (uniform)
+                {
+                    parallel_for(num_faces, [&](size_t begin, size_t end) {
+                        for (size_t f = begin; f < end && uniform; f++)
+                        {
+                            if ((uint64_t)read_binary_value<SWAP>(pos + f*record_stride + list_offset, list.count_type) != n)
+                                uniform = false;
+                        }
+                    });
+                }
+
+                if (uniform)
+                    element_size = num_faces * record_stride;
+                else
+                    record_stride = 0;
+            }
+
+            if (record_stride == 0)
+            {
+                list_offsets.resize(num_faces);
+
+                uint64_t offset = 0, record_list_offset = 0;
+                for (uint64_t f = 0; f < num_faces; f++)
+                {
+                    const uint64_t size = binary_record_size<SWAP>(pos + offset, end, element, vi, &record_list_offset);
+                    if (size == 0)
+                    {
+                        message = "PLY file is truncated (face data)";
+                        return false;
+                    }
+                    list_offsets[f] = offset + record_list_offset;
+                    offset += size;
+                }
+
+                element_size = offset;
+            }
+
+            auto record = [&](uint64_t f) {
+                return pos + (record_stride > 0 ? f*record_stride + list_offset : list_offsets[f]);
+            };
+
+            parallel_for(num_faces, [&](size_t begin, size_t end) {
+                for (size_t f = begin; f < end; f++)
+                    mesh.face_lengths[f] = read_binary_value<SWAP>(record(f), list.count_type);
+            });
+
+            std::vector<uint64_t> face_start(num_faces+1, 0);
+            for (uint64_t f = 0; f < num_faces; f++)
+                face_start[f+1] = face_start[f] + mesh.face_lengths[f];
+
+            mesh.faces.resize(face_start[num_faces]);
+
+            parallel_for(num_faces, [&](size_t begin, size_t end) {
+                if (record_stride > 0)
+                {
+                    // Fixed-layout records, copy per list entry across all faces
+                    const uint32_t n = mesh.face_lengths[0];
+                    for (uint32_t i = 0; i < n; i++)
+                        deinterleave_property<uint32_t, SWAP>(&mesh.faces[i], n, 
+                            pos + list_offset + count_size + i*index_size, record_stride, list.type, begin, end);
+                    return;
+                }
+
+                for (size_t f = begin; f < end; f++)
+                {
+                    const uint8_t *p = record(f) + count_size;
+                    for (uint32_t i = 0; i < mesh.face_lengths[f]; i++)
+                        mesh.faces[face_start[f]+i] = read_binary_value<SWAP>(p + i*index_size, list.type);
+                }
+            });
+
+            pos += element_size;
+        }
+        else if (element.fixed_size)
+        {
+            // Other element, skip
+            pos += element.count * element.record_size;
+        }
+        else
+        {
+            for (uint64_t i = 0; i < element.count; i++)
+            {
+                const uint64_t size = binary_record_size<SWAP>(pos, end, element);
+                if (size == 0)
+                {
+                    message = "PLY file is truncated (" + element.name + " data)";
+                    return false;
+                }
+                pos += size;
+            }
+        }
+
+        if (pos > end)
+        {
+            message = "PLY file is truncated (" + element.name + " data)";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static inline bool
+blank_line(const char *p, const char *end)
+{
+    for (; p < end; p++)
+        if (*p != ' ' && *p != '\t' && *p != '\r')
+            return false;
+    return true;
+}
+
+// Extracts the vertex positions and face indices from an ASCII file. 
+// The body is split into chunks at line boundaries. The lines in each 
+// chunk are counted first, so each chunk knows the element and index of 
+// its records, then the chunks are parsed. Vertices are written in place,
+// faces are collected per chunk and concatenated.
+static bool
+read_ascii_ply(PlyMesh& mesh, const PlyFile& ply, std::string& message, PluginState *state)
+{
+    const char *body = (const char*)ply.data + ply.body_offset;
+    const char *body_end = (const char*)ply.data + ply.size;
+    const uint64_t body_size = body_end - body;
+
+    const size_t num_chunks = std::max<size_t>(1, std::min<size_t>(4*parallel_num_threads(), body_size / (1024*1024)));
+
+    std::vector<const char*> chunk_start(num_chunks+1);
+    chunk_start[0] = body;
+    chunk_start[num_chunks] = body_end;
+
+    for (size_t c = 1; c < num_chunks; c++)
+    {
+        const char *p = std::max(chunk_start[c-1], body + c*body_size/num_chunks);
+        const char *nl = (const char*)memchr(p, '\n', body_end - p);
+        chunk_start[c] = nl != nullptr ? nl + 1 : body_end;
+    }
+
+    // First record (line) of each element
+
+    std::vector<uint64_t> element_start(ply.elements.size()+1, 0);
+    int vertex_element = -1, face_element = -1;
+
+    for (size_t e = 0; e < ply.elements.size(); e++)
+    {
+        element_start[e+1] = element_start[e] + ply.elements[e].count;
+        if (ply.elements[e].name == "vertex")
+            vertex_element = e;
+        else if (ply.elements[e].name == "face")
+            face_element = e;
+    }
+
+    int xyz[3] = { -1, -1, -1 }, vi = -1;
+
+    if (vertex_element != -1)
+    {
+        const PlyElement& element = ply.elements[vertex_element];
+        xyz[0] = element.find("x");
+        xyz[1] = element.find("y");
+        xyz[2] = element.find("z");
+
+        if (xyz[0] == -1 || xyz[1] == -1 || xyz[2] == -1)
+        {
+            message = "PLY vertex element lacks x, y or z";
+            return false;
+        }
+
+        mesh.vertices.resize(element.count*3);
+    }
+
+    if (face_element != -1)
+    {
+        vi = ply.elements[face_element].find("vertex_indices");
+        if (vi == -1)
+            vi = ply.elements[face_element].find("vertex_index");
+    }
+
+    set_progress(state, 0.0f, "Counting lines");
+
+    std::vector<uint64_t> chunk_lines(num_chunks+1, 0);
+
+    parallel_for(num_chunks, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++)
+        {
+            const char *p = chunk_start[c];
+            while (p < chunk_start[c+1])
+            {
+                const char *nl = (const char*)memchr(p, '\n', chunk_start[c+1] - p);
+                const char *line_end = nl != nullptr ? nl : chunk_start[c+1];
+                if (!blank_line(p, line_end))
+                    chunk_lines[c+1]++;
+                p = line_end + 1;
+            }
+        }
+    }, 1);
+
+    for (size_t c = 0; c < num_chunks; c++)
+        chunk_lines[c+1] += chunk_lines[c];
+
+    if (chunk_lines[num_chunks] < element_start[ply.elements.size()])
+    {
+        message = "PLY file is truncated";
+        return false;
+    }
+
+    if (canceled(state))
+        return false;
+
+    set_progress(state, 0.25f, "Parsing");
+
+    std::vector<std::vector<uint32_t>> chunk_faces(num_chunks), chunk_face_lengths(num_chunks);
+    std::atomic<bool> ok(true);
+
+    parallel_for(num_chunks, [&](size_t begin, size_t end) {
+        std::vector<double> values;
+
+        for (size_t c = begin; c < end && ok; c++)
+        {
+            uint64_t line = chunk_lines[c];
+            size_t e = std::upper_bound(element_start.begin(), element_start.end(), line) - element_start.begin() - 1;
+            const char *p = chunk_start[c];
+
+            while (p < chunk_start[c+1] && e < ply.elements.size())
+            {
+                const char *nl = (const char*)memchr(p, '\n', chunk_start[c+1] - p);
+                const char *line_end = nl != nullptr ? nl : chunk_start[c+1];
+
+                if (blank_line(p, line_end))
+                {
+                    p = line_end + 1;
+                    continue;
+                }
+
+                while (e < ply.elements.size() && line >= element_start[e+1])
+                    e++;
+
+                if ((int)e != vertex_element && ((int)e != face_element || vi == -1))
+                {
+                    line++;
+                    p = line_end + 1;
+                    continue;
+                }
+
+                // Parse the record, keeping the values of the list property
+                // (faces) or the scalars (vertices)
+
+                const PlyElement& element = ply.elements[e];
+                char *q = (char*)p;
+                double scalars[64];
+                values.clear();
+
+                for (size_t i = 0; i < element.properties.size() && ok; i++)
+                {
+                    const PlyProperty& prop = element.properties[i];
+                    const char *start = q;
+                    const double v = strtod(start, &q);
+
+                    if (q == start || q > line_end)
+                    {
+                        ok = false;
+                        break;
+                    }
+
+                    if (!prop.is_list)
+                    {
+                        if (i < 64)
+                            scalars[i] = v;
+                        continue;
+                    }
+
+                    for (uint64_t j = 0; j < (uint64_t)v; j++)
+                    {
+                        const char *start = q;
+                        const double w = strtod(start, &q);
+
+                        if (q == start || q > line_end)
+                        {
+                            ok = false;
+                            break;
+                        }
+
+                        if ((int)i == vi)
+                            values.push_back(w);
+                    }
+                }
+
+                if (!ok)
+                    break;
+
+                if ((int)e == vertex_element)
+                {
+                    float *vertex = &mesh.vertices[3*(line - element_start[e])];
+                    for (int j = 0; j < 3; j++)
+                        vertex[j] = xyz[j] < 64 ? scalars[xyz[j]] : 0.0f;
+                }
+                else
+                {
+                    chunk_face_lengths[c].push_back(values.size());
+                    for (double v : values)
+                        chunk_faces[c].push_back(v);
+                }
+
+                line++;
+                p = line_end + 1;
+            }
+        }
+    }, 1);
+
+    if (!ok)
+    {
+        message = "Could not parse PLY file, expected one record per line";
+        return false;
+    }
+
+    // Concatenate the faces
+
+    std::vector<uint64_t> face_offset(num_chunks+1, 0), index_offset(num_chunks+1, 0);
+
+    for (size_t c = 0; c < num_chunks; c++)
+    {
+        face_offset[c+1] = face_offset[c] + chunk_face_lengths[c].size();
+        index_offset[c+1] = index_offset[c] + chunk_faces[c].size();
+    }
+
+    mesh.face_lengths.resize(face_offset[num_chunks]);
+    mesh.faces.resize(index_offset[num_chunks]);
+
+    parallel_for(num_chunks, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++)
+        {
+            std::copy(chunk_face_lengths[c].begin(), chunk_face_lengths[c].end(), mesh.face_lengths.begin() + face_offset[c]);
+            std::copy(chunk_faces[c].begin(), chunk_faces[c].end(), mesh.faces.begin() + index_offset[c]);
+        }
+    }, 1);
+
+    return true;
+}
+
+bool
+read_ply(PlyMesh& mesh, const std::string& fname, std::string& message, PluginState *state)
+{
+    PlyFile ply;
+
+    if (!open_ply(ply, fname, message))
+        return false;
+
+    bool have_vertices = false, have_faces = false;
+
+    for (const PlyElement& element : ply.elements)
+    {
+        have_vertices = have_vertices || element.name == "vertex";
+        have_faces = have_faces || element.name == "face";
+    }
+
+    if (!have_vertices || !have_faces)
+    {
+        message = "PLY file needs both a vertex and a face element";
+        return false;
+    }
+
+    switch (ply.format)
+    {
+    case PLY_ASCII:
+        return read_ascii_ply(mesh, ply, message, state);
+    case PLY_BINARY_LE:
+        return read_binary_ply<false>(mesh, ply, message, state);
+    case PLY_BINARY_BE:
+        return read_binary_ply<true>(mesh, ply, message, state);
+    }
+
+    return false;
+}
@@ -0,0 +1,51 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// PLY mesh reader                                                          //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#ifndef PLY_READER_H
+#define PLY_READER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct PluginState;
+
+// PLY reader for ASCII and binary (little and big-endian) files. The 
+// file is memory-mapped and the header parsed, after which the vertex 
+// positions and face indices are extracted from the records in bulk, in 
+// parallel. Binary faces that all have the same number of vertices (the 
+// common case) are located directly, otherwise a single pass over the 
+// face records finds them first. ASCII files are split into chunks of 
+// lines that are parsed in parallel, assuming one record per line.
+
+// Polygons, face_lengths[f] vertex indices per face
+struct PlyMesh
+{
+    std::vector<float>      vertices;
+    std::vector<uint32_t>   faces;
+    std::vector<uint32_t>   face_lengths;
+};
+
+// Reads the vertex positions and faces of the given PLY file. Progress
+// is reported to, and cancellation checked on, state (may be nullptr).
+// Returns false on failure, with message set.
+bool read_ply(PlyMesh& mesh, const std::string& fname, std::string& message, PluginState *state=nullptr);
+
+#endif
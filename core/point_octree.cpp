@@ -0,0 +1,634 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Out-of-core point cloud octree files                                     //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "point_octree.h"
+#include "mesh_processing.h"
+#include "parallel.h"
+
+static const char       octree_magic[8] = { 'B', 'L', 'S', 'P', 'O', 'C', 'T', 'R' };
+static const uint32_t   octree_version = 1;
+static const uint64_t   octree_data_start = 4096;
+
+// Points are distributed over the cells of this level (at most 128^3)
+// before building, each non-empty cell is then built as a separate
+// subtree ("chunk") in memory
+static const int        chunk_max_level = 7;
+static const uint64_t   chunk_target_points = 2*1024*1024;
+
+// Nodes at this depth are leaves, however many (identical) points they hold
+static const uint32_t   max_level = 24;
+
+// File layout: header, node data (from octree_data_start), node table
+
+enum
+{
+    OCTREE_HAS_COLORS = 0x1
+};
+
+struct OctreeHeader
+{
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    flags;
+    uint64_t    num_points;
+    uint32_t    num_nodes;
+    uint32_t    node_capacity;
+    float       bounds[6];
+    int32_t     root;
+    uint32_t    reserved;
+    uint64_t    node_table_offset;
+};
+
+// Input point, as distributed in the temporary file
+struct OctreePoint
+{
+    float       position[3];
+    uint8_t     color[4];
+};
+
+// Octant of a point within a cell, bits are xyz (x highest),
+// matching the order of Morton codes
+static inline int
+octant(const float *p, const float *center)
+{
+    return ((p[0] >= center[0]) << 2) | ((p[1] >= center[1]) << 1) | (p[2] >= center[2]);
+}
+
+static void
+child_bounds(float *cb, const float *bounds, int o)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        const float center = 0.5f * (bounds[i] + bounds[3+i]);
+        const bool upper = (o >> (2-i)) & 1;
+        cb[i] = upper ? center : bounds[i];
+        cb[3+i] = upper ? bounds[3+i] : center;
+    }
+}
+
+// Morton code of cell (c[0], c[1], c[2]) at the given level
+static uint32_t
+cell_code(const uint32_t *c, int level)
+{
+    uint32_t code = 0;
+    for (int b = level-1; b >= 0; b--)
+        code = (code << 3) | (((c[0] >> b) & 1) << 2) | (((c[1] >> b) & 1) << 1) | ((c[2] >> b) & 1);
+    return code;
+}
+
+static void
+cell_bounds(float *cb, const float *bounds, uint32_t code, int level)
+{
+    uint32_t c[3] = { 0, 0, 0 };
+
+    for (int b = 0; b < level; b++)
+    {
+        c[0] |= ((code >> (3*b+2)) & 1) << b;
+        c[1] |= ((code >> (3*b+1)) & 1) << b;
+        c[2] |= ((code >> (3*b)) & 1) << b;
+    }
+
+    const float size = (bounds[3] - bounds[0]) / (1 << level);
+
+    for (int i = 0; i < 3; i++)
+    {
+        cb[i] = bounds[i] + c[i]*size;
+        cb[3+i] = level == 0 ? bounds[3+i] : cb[i] + size;
+    }
+}
+
+struct OctreeBuilder
+{
+    int             fd;
+    bool            has_colors;
+    uint32_t        capacity;
+
+    std::mutex                      mutex;
+    std::vector<PointOctreeNode>    nodes;
+    uint64_t                        file_pos;
+    std::atomic<bool>               ok;
+
+    OctreeBuilder(): fd(-1), has_colors(false), capacity(0), file_pos(octree_data_start), ok(true) {}
+
+    // Writes a new node holding the given points, returns its index
+    int32_t add_node(const float *bounds, uint32_t level, const OctreePoint *points, uint32_t n,
+        uint64_t subtree_points, const int32_t *children)
+    {
+        const uint64_t size = (uint64_t)n * (has_colors ? 16 : 12);
+
+        std::vector<uint8_t> data(size);
+        float *positions = (float*)data.data();
+        uint8_t *colors = data.data() + (uint64_t)n*12;
+
+        for (uint32_t p = 0; p < n; p++)
+        {
+            memcpy(positions + 3*p, points[p].position, 12);
+            if (has_colors)
+                memcpy(colors + 4*p, points[p].color, 4);
+        }
+
+        PointOctreeNode node;
+        memcpy(node.bounds, bounds, sizeof(node.bounds));
+        memcpy(node.children, children, sizeof(node.children));
+        node.num_points = n;
+        node.level = level;
+        node.subtree_points = subtree_points;
+
+        int32_t index;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            node.offset = file_pos;
+            file_pos += size;
+            index = nodes.size();
+            nodes.push_back(node);
+        }
+
+        if (size > 0 && pwrite(fd, data.data(), size, node.offset) != (ssize_t)size)
+            ok = false;
+
+        return index;
+    }
+
+    // Appends the points stored in the given node
+    void read_node(std::vector<OctreePoint>& points, int32_t index)
+    {
+        PointOctreeNode node;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            node = nodes[index];
+        }
+
+        const uint64_t size = (uint64_t)node.num_points * (has_colors ? 16 : 12);
+        std::vector<uint8_t> data(size);
+
+        if (size > 0 && pread(fd, data.data(), size, node.offset) != (ssize_t)size)
+        {
+            ok = false;
+            return;
+        }
+
+        const float *positions = (const float*)data.data();
+        const uint8_t *colors = data.data() + (uint64_t)node.num_points*12;
+        const size_t first = points.size();
+
+        points.resize(first + node.num_points);
+
+        for (uint32_t p = 0; p < node.num_points; p++)
+        {
+            OctreePoint& op = points[first+p];
+            memcpy(op.position, positions + 3*p, 12);
+            if (has_colors)
+                memcpy(op.color, colors + 4*p, 4);
+            else
+                memset(op.color, 255, 4);
+        }
+    }
+
+    // Creates an inner node with the given children, holding a stratified
+    // subsample of the points stored in the children
+    int32_t add_inner_node(const float *bounds, uint32_t level, const int32_t *children)
+    {
+        std::vector<OctreePoint> points;
+        uint64_t subtree_points = 0;
+
+        for (int o = 0; o < 8; o++)
+        {
+            if (children[o] < 0)
+                continue;
+
+            read_node(points, children[o]);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            subtree_points += nodes[children[o]].subtree_points;
+        }
+
+        std::vector<float> positions(3*points.size());
+        for (size_t p = 0; p < points.size(); p++)
+            memcpy(&positions[3*p], points[p].position, 12);
+
+        std::vector<uint32_t> selected;
+        subsample_points(selected, positions.data(), points.size(), capacity);
+
+        std::vector<OctreePoint> sample(selected.size());
+        for (size_t s = 0; s < selected.size(); s++)
+            sample[s] = points[selected[s]];
+
+        return add_node(bounds, level, sample.data(), sample.size(), subtree_points, children);
+    }
+
+    // Builds the subtree of the given points (reordered in place),
+    // returns its root node
+    int32_t build_subtree(OctreePoint *points, uint64_t n, const float *bounds, uint32_t level)
+    {
+        int32_t children[8];
+        std::fill(children, children+8, -1);
+
+        if (n <= capacity || level >= max_level)
+            return add_node(bounds, level, points, n, n, children);
+
+        // Sort the points by octant
+
+        float center[3];
+        for (int i = 0; i < 3; i++)
+            center[i] = 0.5f * (bounds[i] + bounds[3+i]);
+
+        uint64_t start[9] = { 0 };
+
+        for (uint64_t p = 0; p < n; p++)
+            start[octant(points[p].position, center)+1]++;
+
+        for (int o = 0; o < 8; o++)
+            start[o+1] += start[o];
+
+        {
+            std::vector<OctreePoint> tmp(points, points+n);
+            uint64_t pos[8];
+            std::copy(start, start+8, pos);
+
+            for (uint64_t p = 0; p < n; p++)
+                points[pos[octant(tmp[p].position, center)]++] = tmp[p];
+        }
+
+        for (int o = 0; o < 8; o++)
+        {
+            if (start[o+1] == start[o])
+                continue;
+
+            float cb[6];
+            child_bounds(cb, bounds, o);
+
+            children[o] = build_subtree(points+start[o], start[o+1]-start[o], cb, level+1);
+        }
+
+        return add_inner_node(bounds, level, children);
+    }
+
+    // Builds the levels above the chunks, returns the node for the
+    // given cell (-1 when empty)
+    int32_t build_upper(const std::vector<int32_t>& chunk_roots, int chunk_level,
+        const float *bounds, uint32_t code, int level)
+    {
+        if (level == chunk_level)
+            return chunk_roots[code];
+
+        int32_t children[8];
+        bool empty = true;
+
+        for (int o = 0; o < 8; o++)
+        {
+            children[o] = build_upper(chunk_roots, chunk_level, bounds, (code << 3) | o, level+1);
+            empty = empty && children[o] < 0;
+        }
+
+        if (empty)
+            return -1;
+
+        float cb[6];
+        cell_bounds(cb, bounds, code, level);
+
+        return add_inner_node(cb, level, children);
+    }
+};
+
+bool
+build_point_octree(const std::string& fname, const float *positions, const uint8_t *colors,
+    uint64_t num_points, uint32_t stride, uint32_t node_capacity)
+{
+    if (num_points == 0 || node_capacity == 0)
+        return false;
+
+    const uint8_t *position_bytes = (const uint8_t*)positions;
+
+    // Bounding cube, slightly enlarged so points on the maximum side
+    // fall inside
+
+    float bmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float bmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    std::mutex bbox_mutex;
+
+    parallel_for(num_points, [&](size_t begin, size_t end) {
+        float lmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float lmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+        for (size_t p = begin; p < end; p++)
+        {
+            const float *pos = (const float*)(position_bytes + p*stride);
+            for (int i = 0; i < 3; i++)
+            {
+                lmin[i] = std::min(lmin[i], pos[i]);
+                lmax[i] = std::max(lmax[i], pos[i]);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(bbox_mutex);
+        for (int i = 0; i < 3; i++)
+        {
+            bmin[i] = std::min(bmin[i], lmin[i]);
+            bmax[i] = std::max(bmax[i], lmax[i]);
+        }
+    });
+
+    float size = std::max(bmax[0]-bmin[0], std::max(bmax[1]-bmin[1], bmax[2]-bmin[2]));
+    size = size > 0.0f ? size * 1.0001f : 1.0f;
+
+    float bounds[6];
+    for (int i = 0; i < 3; i++)
+    {
+        const float center = 0.5f * (bmin[i] + bmax[i]);
+        bounds[i] = center - 0.5f*size;
+        bounds[3+i] = center + 0.5f*size;
+    }
+
+    printf("%llu points, bounds %.6f %.6f %.6f - %.6f %.6f %.6f\n", (unsigned long long)num_points,
+        bmin[0], bmin[1], bmin[2], bmax[0], bmax[1], bmax[2]);
+
+    // Count the points per cell at the finest chunk level
+
+    const uint32_t num_cells = 1 << (3*chunk_max_level);
+    const float cell_scale = (1 << chunk_max_level) / size;
+
+    auto point_cell = [&](const float *pos) {
+        uint32_t c[3];
+        for (int i = 0; i < 3; i++)
+        {
+            float f = (pos[i] - bounds[i]) * cell_scale;
+            c[i] = f <= 0.0f ? 0 : std::min((uint32_t)f, (uint32_t)(1 << chunk_max_level) - 1);
+        }
+        return cell_code(c, chunk_max_level);
+    };
+
+    std::vector<std::atomic<uint64_t>> cell_counts(num_cells);
+
+    parallel_for(num_points, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++)
+            cell_counts[point_cell((const float*)(position_bytes + p*stride))].fetch_add(1, std::memory_order_relaxed);
+    });
+
+    // Use the coarsest chunk level at which all chunks are small enough
+
+    int chunk_level = chunk_max_level;
+
+    for (int level = 0; level < chunk_max_level; level++)
+    {
+        const uint32_t cells_per_chunk = 1 << (3*(chunk_max_level-level));
+        uint64_t max_count = 0, count = 0;
+
+        for (uint32_t c = 0; c < num_cells; c++)
+        {
+            count += cell_counts[c];
+            if ((c+1) % cells_per_chunk == 0)
+            {
+                max_count = std::max(max_count, count);
+                count = 0;
+            }
+        }
+
+        if (max_count <= chunk_target_points)
+        {
+            chunk_level = level;
+            break;
+        }
+    }
+
+    const int chunk_shift = 3*(chunk_max_level-chunk_level);
+    const uint32_t num_chunks = 1 << (3*chunk_level);
+
+    std::vector<uint64_t> chunk_start(num_chunks+1, 0);
+    for (uint32_t c = 0; c < num_cells; c++)
+        chunk_start[(c >> chunk_shift)+1] += cell_counts[c];
+    for (uint32_t c = 0; c < num_chunks; c++)
+        chunk_start[c+1] += chunk_start[c];
+
+    std::vector<std::atomic<uint64_t>>().swap(cell_counts);
+
+    // Distribute the points over the chunks, in a temporary file
+
+    const std::string points_fname = fname + ".points.tmp";
+    const uint64_t points_size = num_points * sizeof(OctreePoint);
+
+    int pfd = open(points_fname.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644);
+    if (pfd == -1)
+    {
+        printf("... ERROR: point octree: could not open '%s' for writing\n", points_fname.c_str());
+        return false;
+    }
+
+    unlink(points_fname.c_str());
+
+    void *mapping = MAP_FAILED;
+    if (ftruncate(pfd, points_size) == 0)
+        mapping = mmap(nullptr, points_size, PROT_READ|PROT_WRITE, MAP_SHARED, pfd, 0);
+
+    if (mapping == MAP_FAILED)
+    {
+        printf("... ERROR: point octree: could not map %llu bytes of temporary storage\n", (unsigned long long)points_size);
+        close(pfd);
+        return false;
+    }
+
+    OctreePoint *points = (OctreePoint*)mapping;
+
+    printf("Distributing points over %d chunks (level %d)\n", num_chunks, chunk_level);
+
+    {
+        std::vector<std::atomic<uint64_t>> chunk_pos(num_chunks);
+        for (uint32_t c = 0; c < num_chunks; c++)
+            chunk_pos[c] = chunk_start[c];
+
+        parallel_for(num_points, [&](size_t begin, size_t end) {
+            for (size_t p = begin; p < end; p++)
+            {
+                const float *pos = (const float*)(position_bytes + p*stride);
+                const uint32_t chunk = point_cell(pos) >> chunk_shift;
+
+                OctreePoint& op = points[chunk_pos[chunk].fetch_add(1, std::memory_order_relaxed)];
+                memcpy(op.position, pos, 12);
+
+                if (colors != nullptr)
+                {
+                    memcpy(op.color, colors + p*stride, 3);
+                    op.color[3] = 255;
+                }
+                else
+                    memset(op.color, 255, 4);
+            }
+        });
+    }
+
+    // Build the chunks in parallel, largest first
+
+    const std::string tmp_fname = fname + ".tmp";
+
+    OctreeBuilder builder;
+    builder.has_colors = colors != nullptr;
+    builder.capacity = node_capacity;
+    builder.fd = open(tmp_fname.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644);
+
+    if (builder.fd == -1)
+    {
+        printf("... ERROR: point octree: could not open '%s' for writing\n", tmp_fname.c_str());
+        munmap(mapping, points_size);
+        close(pfd);
+        return false;
+    }
+
+    std::vector<uint32_t> chunks;
+    for (uint32_t c = 0; c < num_chunks; c++)
+        if (chunk_start[c+1] > chunk_start[c])
+            chunks.push_back(c);
+
+    std::sort(chunks.begin(), chunks.end(), [&](uint32_t a, uint32_t b) {
+        return chunk_start[a+1]-chunk_start[a] > chunk_start[b+1]-chunk_start[b];
+    });
+
+    printf("Building %d non-empty chunks\n", (int)chunks.size());
+
+    std::vector<int32_t> chunk_roots(num_chunks, -1);
+    std::atomic<size_t> next_chunk(0);
+    std::vector<std::thread> threads;
+
+    for (unsigned int t = 0; t < std::min<size_t>(parallel_num_threads(), chunks.size()); t++)
+    {
+        threads.push_back(std::thread([&]() {
+            parallel_nested() = true;
+
+            size_t i;
+            while (builder.ok && (i = next_chunk++) < chunks.size())
+            {
+                const uint32_t c = chunks[i];
+                float cb[6];
+                cell_bounds(cb, bounds, c, chunk_level);
+                chunk_roots[c] = builder.build_subtree(points+chunk_start[c], chunk_start[c+1]-chunk_start[c], cb, chunk_level);
+            }
+        }));
+    }
+
+    for (auto& th : threads)
+        th.join();
+
+    munmap(mapping, points_size);
+    close(pfd);
+
+    const int32_t root = builder.ok ? builder.build_upper(chunk_roots, chunk_level, bounds, 0, 0) : -1;
+
+    // Node table and header last, as the header contains the table offset
+
+    OctreeHeader header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, octree_magic, sizeof(octree_magic));
+    header.version = octree_version;
+    header.flags = colors != nullptr ? OCTREE_HAS_COLORS : 0;
+    header.num_points = num_points;
+    header.num_nodes = builder.nodes.size();
+    header.node_capacity = node_capacity;
+    memcpy(header.bounds, bounds, sizeof(bounds));
+    header.root = root;
+    header.node_table_offset = (builder.file_pos + 7) / 8 * 8;
+
+    const uint64_t table_size = builder.nodes.size() * sizeof(PointOctreeNode);
+
+    bool ok = builder.ok && root >= 0
+        && pwrite(builder.fd, builder.nodes.data(), table_size, header.node_table_offset) == (ssize_t)table_size
+        && pwrite(builder.fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header);
+
+    if (close(builder.fd) != 0)
+        ok = false;
+
+    if (!ok || rename(tmp_fname.c_str(), fname.c_str()) != 0)
+    {
+        printf("... ERROR: point octree: failed to write '%s'\n", fname.c_str());
+        unlink(tmp_fname.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool
+open_point_octree(PointOctree& octree, const std::string& fname)
+{
+    FILE *f = fopen(fname.c_str(), "rb");
+    if (f == nullptr)
+        return false;
+
+    struct stat st;
+    OctreeHeader header;
+
+    bool ok = fstat(fileno(f), &st) == 0
+        && fread(&header, sizeof(header), 1, f) == 1
+        && memcmp(header.magic, octree_magic, sizeof(octree_magic)) == 0
+        && header.version == octree_version
+        && header.num_nodes > 0
+        && header.root >= 0 && (uint32_t)header.root < header.num_nodes
+        && header.node_table_offset + (uint64_t)header.num_nodes*sizeof(PointOctreeNode) <= (uint64_t)st.st_size;
+
+    std::vector<PointOctreeNode> nodes;
+
+    if (ok)
+    {
+        nodes.resize(header.num_nodes);
+        ok = fseeko(f, header.node_table_offset, SEEK_SET) == 0
+            && fread(&nodes[0], sizeof(PointOctreeNode), nodes.size(), f) == nodes.size();
+    }
+
+    fclose(f);
+
+    const uint64_t point_size = (header.flags & OCTREE_HAS_COLORS) ? 16 : 12;
+
+    for (size_t n = 0; ok && n < nodes.size(); n++)
+    {
+        const PointOctreeNode& node = nodes[n];
+
+        ok = node.offset + node.num_points*point_size <= header.node_table_offset;
+
+        for (int o = 0; ok && o < 8; o++)
+            ok = node.children[o] < (int32_t)nodes.size();
+    }
+
+    if (!ok)
+    {
+        printf("... ERROR: '%s' is not a valid point octree file\n", fname.c_str());
+        return false;
+    }
+
+    octree.file = fname;
+    octree.has_colors = (header.flags & OCTREE_HAS_COLORS) != 0;
+    octree.num_points = header.num_points;
+    octree.node_capacity = header.node_capacity;
+    memcpy(octree.bounds, header.bounds, sizeof(octree.bounds));
+    octree.root = header.root;
+    octree.nodes.swap(nodes);
+
+    return true;
+}
@@ -0,0 +1,92 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Out-of-core point cloud octree files                                     //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#ifndef POINT_OCTREE_H
+#define POINT_OCTREE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A point octree file holds a (possibly very large) point cloud as an
+// octree of cubic nodes, for rendering with view-dependent detail.
+// Leaf nodes hold all points within their bounds, an inner node holds
+// a spatially stratified subsample of at most node_capacity points of
+// its subtree. Rendering a node's children instead of the node itself
+// therefore replaces its points with more detailed ones.
+//
+// The points of a node are stored contiguously, as float xyz positions
+// followed (when the file has colors) by RGBA8 colors, so a node can be
+// passed to OSPRay directly from a memory-mapped file. The node table
+// is stored at the end of the file.
+// Files are built with build_point_octree(), see the bloctree tool, and
+// rendered with the scene_point_octree plugin.
+
+struct PointOctreeNode
+{
+    float       bounds[6];          // min xyz, max xyz
+    int32_t     children[8];        // Node indices, -1 for none
+    uint64_t    offset;             // Of the positions in the file
+    uint32_t    num_points;         // Stored in this node
+    uint32_t    level;              // Root is 0
+    uint64_t    subtree_points;     // Of the input points within the bounds
+};
+
+struct PointOctree
+{
+    std::string     file;
+    bool            has_colors;
+    uint64_t        num_points;         // In the input
+    uint32_t        node_capacity;
+    float           bounds[6];          // Cube, of the root node
+    int32_t         root;
+
+    std::vector<PointOctreeNode>    nodes;
+
+    bool is_leaf(int32_t node) const
+    {
+        for (int i = 0; i < 8; i++)
+            if (nodes[node].children[i] >= 0)
+                return false;
+        return true;
+    }
+
+    // Bytes per point stored
+    uint32_t point_size() const
+    {
+        return has_colors ? 16 : 12;
+    }
+};
+
+// Builds an octree file from num_points points, with float xyz positions
+// at the given stride in bytes and optionally RGB8 colors (at the same
+// stride, may be nullptr). The input can be a memory-mapped file larger
+// than memory: points are first distributed into chunks of the octree
+// in a temporary file (next to fname), after which the chunks are built
+// in parallel.
+// Returns false on failure (e.g. a write error).
+bool build_point_octree(const std::string& fname, const float *positions, const uint8_t *colors,
+    uint64_t num_points, uint32_t stride, uint32_t node_capacity=65536);
+
+// Reads the header and node table of the given octree file.
+// Returns false if the file doesn't exist or isn't a valid octree file.
+bool open_point_octree(PointOctree& octree, const std::string& fname);
+
+#endif
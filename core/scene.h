@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <stdint.h>
 #include <ospray/ospray.h>
 
 //#include "messages.pb.h"
@@ -48,16 +49,65 @@ struct SceneObject
     virtual ~SceneObject() {}
 };
 
+// Simplified version of an object's geometry (or lower-resolution 
+// version of a volume), used for interactive rendering of large meshes 
+// and volumes. See the LOD handling in the server.
+struct LODProxy
+{
+	OSPGeometry geometry;		// Not owned, only used to detect changes
+	OSPGeometricModel gmodel;
+	OSPVolume volume;			// Not owned, only used to detect changes
+	OSPVolumetricModel vmodel;
+	OSPGroup group;
+	OSPInstance instance;
+
+	LODProxy()
+	{
+		geometry = nullptr;
+		gmodel = nullptr;
+		volume = nullptr;
+		vmodel = nullptr;
+		group = nullptr;
+		instance = nullptr;
+	}
+
+	void clear()
+	{
+		if (gmodel)
+			ospRelease(gmodel);
+		if (vmodel)
+			ospRelease(vmodel);
+		if (group)
+			ospRelease(group);
+		if (instance)
+			ospRelease(instance);
+		geometry = nullptr;
+		gmodel = nullptr;
+		volume = nullptr;
+		vmodel = nullptr;
+		group = nullptr;
+		instance = nullptr;
+	}
+
+	~LODProxy()
+	{
+		clear();
+	}
+};
+
 struct SceneObjectMesh : SceneObject
 {
 	OSPGeometricModel gmodel;
 	OSPGroup group;
 	OSPInstance instance;
+	OSPMaterial material;		// Not owned
+	LODProxy proxy;
 
 	SceneObjectMesh(): SceneObject()
 	{
 		type = SOT_MESH;
 		gmodel = nullptr;
+		material = nullptr;
 		group = ospNewGroup();
 		instance = ospNewInstance(group);
 	}           
@@ -75,11 +125,14 @@ struct SceneObjectGeometry : SceneObject
 	OSPGeometricModel gmodel;
 	OSPGroup group;
 	OSPInstance instance;
+	OSPMaterial material;		// Not owned
+	LODProxy proxy;
 
 	SceneObjectGeometry(): SceneObject()
 	{
 		type = SOT_GEOMETRY;
 		gmodel = nullptr;
+		material = nullptr;
 		group = ospNewGroup();
 		instance = ospNewInstance(group);
 	}           
@@ -98,6 +151,7 @@ struct SceneObjectVolume : SceneObject
 	OSPGroup group;
 	OSPInstance instance;
 	// XXX TF and material
+	LODProxy proxy;
 
 	SceneObjectVolume(): SceneObject()
 	{
@@ -190,11 +244,14 @@ struct SceneObjectSlice : SceneObject
 struct SceneObjectScene : SceneObject
 {
 	OSPInstanceList instances;
+	OSPInstanceList proxy_instances;	// LOD proxies of some of the instances
 	OSPLightList lights;
+	uint32_t instances_generation;		// Of the plugin instance the instances were created from
 
 	SceneObjectScene(): SceneObject()
 	{
 		type = SOT_SCENE;
+		instances_generation = 0;
 	}           
 
 	virtual ~SceneObjectScene()
@@ -202,6 +259,8 @@ struct SceneObjectScene : SceneObject
 		fprintf(stderr, "desc");
         for (OSPInstance& i : instances)
             ospRelease(i);
+        for (OSPInstance& i : proxy_instances)
+            ospRelease(i);
         for (OSPLight& l : lights)
             ospRelease(l);
 	}
@@ -0,0 +1,515 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Multi-resolution bricked volume files                                    //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+#include "volume_pyramid.h"
+#include "input_data_cache.h"
+#include "parallel.h"
+#include "plugin.h"
+#include "voxels.h"
+
+static const char       pyramid_magic[8] = { 'B', 'L', 'S', 'P', 'P', 'Y', 'R', 'M' };
+static const uint32_t   pyramid_version = 1;
+static const uint64_t   pyramid_alignment = 4096;
+static const int        pyramid_max_levels = 32;
+
+// File layout: header, level table, then the bricks of each level,
+// starting at an aligned offset
+
+struct PyramidHeader
+{
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    voxel_type;
+    uint32_t    value_size;
+    uint32_t    brick_size;
+    uint32_t    num_levels;
+    uint32_t    reserved;
+    float       data_range[2];
+};
+
+struct PyramidLevel
+{
+    uint32_t    dims[3];
+    uint32_t    bricks[3];
+    uint64_t    offset;
+};
+
+static uint64_t
+align(uint64_t offset)
+{
+    return (offset + pyramid_alignment - 1) / pyramid_alignment * pyramid_alignment;
+}
+
+// Copies brick (bx, by, bz) out of the dense volume, padding with zeroes
+// at the edges. Also updates the range of the values copied.
+template<typename T, bool SWAP>
+static void
+extract_brick(T *brick, const T *values, const uint32_t *dims, uint32_t brick_size,
+    uint32_t bx, uint32_t by, uint32_t bz, float& minval, float& maxval)
+{
+    const uint32_t x0 = bx*brick_size, y0 = by*brick_size, z0 = bz*brick_size;
+    const uint32_t nx = std::min(brick_size, dims[0]-x0);
+    const uint32_t ny = std::min(brick_size, dims[1]-y0);
+    const uint32_t nz = std::min(brick_size, dims[2]-z0);
+
+    if (nx < brick_size || ny < brick_size || nz < brick_size)
+        memset(brick, 0, (size_t)brick_size*brick_size*brick_size*sizeof(T));
+
+    for (uint32_t k = 0; k < nz; k++)
+    {
+        for (uint32_t j = 0; j < ny; j++)
+        {
+            const T *src = values + ((size_t)(z0+k)*dims[1] + (y0+j))*dims[0] + x0;
+            T *dst = brick + ((size_t)k*brick_size + j)*brick_size;
+
+            for (uint32_t i = 0; i < nx; i++)
+            {
+                T v = SWAP ? voxel_swap(src[i]) : src[i];
+                dst[i] = v;
+                minval = std::min(minval, (float)v);
+                maxval = std::max(maxval, (float)v);
+            }
+        }
+    }
+}
+
+// Halves the resolution of src (clamped at the edges for odd dimensions)
+template<typename T, bool SWAP>
+static void
+downsample(T *dst, const uint32_t *ddims, const T *src, const uint32_t *sdims)
+{
+    parallel_for(ddims[2], [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; k++)
+        {
+            const size_t z[2] = { 2*k, std::min<size_t>(2*k+1, sdims[2]-1) };
+
+            for (uint32_t j = 0; j < ddims[1]; j++)
+            {
+                const size_t y[2] = { 2*j, std::min<size_t>(2*j+1, sdims[1]-1) };
+
+                T *d = dst + ((size_t)k*ddims[1] + j)*ddims[0];
+
+                for (uint32_t i = 0; i < ddims[0]; i++)
+                {
+                    const size_t x[2] = { 2*i, std::min<size_t>(2*i+1, sdims[0]-1) };
+
+                    float sum = 0.0f;
+
+                    for (int c = 0; c < 8; c++)
+                    {
+                        T v = src[(z[c>>2]*sdims[1] + y[(c>>1)&1])*sdims[0] + x[c&1]];
+                        sum += SWAP ? voxel_swap(v) : v;
+                    }
+
+                    sum *= 0.125f;
+
+                    if (std::is_integral<T>::value)
+                        sum = std::round(sum);
+
+                    d[i] = (T)sum;
+                }
+            }
+        }
+    }, 1);
+}
+
+// Writes the bricks of the given dense level, in batches that are
+// extracted in parallel
+template<typename T, bool SWAP>
+static bool
+write_level(FILE *f, const T *values, const PyramidLevel& level, uint32_t brick_size,
+    float& minval, float& maxval)
+{
+    const size_t brick_values = (size_t)brick_size*brick_size*brick_size;
+    const size_t num_bricks = (size_t)level.bricks[0]*level.bricks[1]*level.bricks[2];
+    const size_t batch_size = std::max<size_t>(1, 4*parallel_num_threads());
+
+    std::vector<T> batch(batch_size*brick_values);
+    std::vector<float> batch_min(batch_size), batch_max(batch_size);
+
+    for (size_t first = 0; first < num_bricks; first += batch_size)
+    {
+        const size_t n = std::min(batch_size, num_bricks - first);
+
+        parallel_for(n, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; b++)
+            {
+                const size_t index = first + b;
+                const uint32_t bx = index % level.bricks[0];
+                const uint32_t by = (index / level.bricks[0]) % level.bricks[1];
+                const uint32_t bz = index / ((size_t)level.bricks[0]*level.bricks[1]);
+
+                batch_min[b] = std::numeric_limits<float>::max();
+                batch_max[b] = std::numeric_limits<float>::lowest();
+
+                extract_brick<T, SWAP>(&batch[b*brick_values], values, level.dims, brick_size,
+                    bx, by, bz, batch_min[b], batch_max[b]);
+            }
+        }, 1);
+
+        for (size_t b = 0; b < n; b++)
+        {
+            minval = std::min(minval, batch_min[b]);
+            maxval = std::max(maxval, batch_max[b]);
+        }
+
+        if (fwrite(&batch[0], sizeof(T)*brick_values, n, f) != n)
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+write_padding(FILE *f, uint64_t pos)
+{
+    static const uint8_t zeroes[pyramid_alignment] = { 0 };
+
+    uint64_t n = align(pos) - pos;
+    return n == 0 || fwrite(zeroes, 1, n, f) == n;
+}
+
+template<typename T>
+static bool
+build_pyramid(FILE *f, PyramidHeader& header, std::vector<PyramidLevel>& levels, const T *values, bool endian_flip)
+{
+    const uint32_t brick_size = header.brick_size;
+    const uint64_t brick_bytes = (uint64_t)brick_size*brick_size*brick_size*sizeof(T);
+
+    uint64_t pos = sizeof(PyramidHeader) + levels.size()*sizeof(PyramidLevel);
+
+    // Level 0 is taken from the input directly, each next level is
+    // downsampled from the one before (held in memory, so at most 1/8th
+    // of the input size)
+
+    const T *level_values = values;
+    std::vector<T> current, next;
+
+    header.data_range[0] = std::numeric_limits<float>::max();
+    header.data_range[1] = std::numeric_limits<float>::lowest();
+
+    for (size_t l = 0; l < levels.size(); l++)
+    {
+        PyramidLevel& level = levels[l];
+        const bool swap = endian_flip && l == 0 && sizeof(T) > 1;
+
+        printf("Level %d: %d x %d x %d voxels, %d x %d x %d bricks\n", (int)l,
+            level.dims[0], level.dims[1], level.dims[2], level.bricks[0], level.bricks[1], level.bricks[2]);
+
+        if (!write_padding(f, pos))
+            return false;
+
+        level.offset = pos = align(pos);
+
+        float minval = std::numeric_limits<float>::max();
+        float maxval = std::numeric_limits<float>::lowest();
+
+        if (!(swap ? write_level<T, true>(f, level_values, level, brick_size, minval, maxval)
+                   : write_level<T, false>(f, level_values, level, brick_size, minval, maxval)))
+            return false;
+
+        pos += brick_bytes * level.bricks[0] * level.bricks[1] * level.bricks[2];
+
+        if (l == 0)
+        {
+            header.data_range[0] = minval;
+            header.data_range[1] = maxval;
+        }
+
+        if (l+1 < levels.size())
+        {
+            const PyramidLevel& next_level = levels[l+1];
+
+            next.resize((size_t)next_level.dims[0]*next_level.dims[1]*next_level.dims[2]);
+
+            if (swap)
+                downsample<T, true>(&next[0], next_level.dims, level_values, level.dims);
+            else
+                downsample<T, false>(&next[0], next_level.dims, level_values, level.dims);
+
+            current.swap(next);
+            level_values = &current[0];
+        }
+    }
+
+    return true;
+}
+
+bool
+build_volume_pyramid(const std::string& fname, const void *values, OSPDataType voxel_type,
+    const uint32_t *dims, bool endian_flip, uint32_t brick_size, int max_levels)
+{
+    uint32_t value_size;
+
+    switch (voxel_type)
+    {
+    case OSP_UCHAR:     value_size = 1; break;
+    case OSP_SHORT:
+    case OSP_USHORT:    value_size = 2; break;
+    case OSP_FLOAT:     value_size = 4; break;
+    case OSP_DOUBLE:    value_size = 8; break;
+    default:
+        printf("... ERROR: volume pyramid: unsupported voxel type %d\n", voxel_type);
+        return false;
+    }
+
+    if (brick_size == 0 || dims[0] == 0 || dims[1] == 0 || dims[2] == 0)
+        return false;
+
+    if (max_levels <= 0 || max_levels > pyramid_max_levels)
+        max_levels = pyramid_max_levels;
+
+    // Set up header and level table
+
+    PyramidHeader header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, pyramid_magic, sizeof(pyramid_magic));
+    header.version = pyramid_version;
+    header.voxel_type = voxel_type;
+    header.value_size = value_size;
+    header.brick_size = brick_size;
+
+    std::vector<PyramidLevel> levels;
+    uint32_t level_dims[3] = { dims[0], dims[1], dims[2] };
+
+    while ((int)levels.size() < max_levels)
+    {
+        PyramidLevel level;
+        memset(&level, 0, sizeof(level));
+
+        for (int i = 0; i < 3; i++)
+        {
+            level.dims[i] = level_dims[i];
+            level.bricks[i] = (level_dims[i] + brick_size - 1) / brick_size;
+        }
+
+        levels.push_back(level);
+
+        if (level.bricks[0] == 1 && level.bricks[1] == 1 && level.bricks[2] == 1)
+            break;
+
+        for (int i = 0; i < 3; i++)
+            level_dims[i] = (level_dims[i] + 1) / 2;
+    }
+
+    header.num_levels = levels.size();
+
+    // Write file, first under a temporary name
+
+    const std::string tmp_fname = fname + ".tmp";
+
+    FILE *f = fopen(tmp_fname.c_str(), "wb");
+    if (f == nullptr)
+    {
+        printf("... ERROR: volume pyramid: could not open '%s' for writing\n", tmp_fname.c_str());
+        return false;
+    }
+
+    bool ok = fseeko(f, sizeof(PyramidHeader) + levels.size()*sizeof(PyramidLevel), SEEK_SET) == 0;
+
+    switch (voxel_type)
+    {
+    case OSP_UCHAR:
+        ok = ok && build_pyramid(f, header, levels, (const uint8_t*)values, endian_flip);
+        break;
+    case OSP_SHORT:
+        ok = ok && build_pyramid(f, header, levels, (const int16_t*)values, endian_flip);
+        break;
+    case OSP_USHORT:
+        ok = ok && build_pyramid(f, header, levels, (const uint16_t*)values, endian_flip);
+        break;
+    case OSP_FLOAT:
+        ok = ok && build_pyramid(f, header, levels, (const float*)values, endian_flip);
+        break;
+    case OSP_DOUBLE:
+        ok = ok && build_pyramid(f, header, levels, (const double*)values, endian_flip);
+        break;
+    default:
+        break;
+    }
+
+    // Header and level table last, as they contain the offsets and data range
+
+    ok = ok && fseeko(f, 0, SEEK_SET) == 0
+        && fwrite(&header, sizeof(header), 1, f) == 1
+        && fwrite(&levels[0], sizeof(PyramidLevel), levels.size(), f) == levels.size();
+
+    if (fclose(f) != 0)
+        ok = false;
+
+    if (!ok || rename(tmp_fname.c_str(), fname.c_str()) != 0)
+    {
+        printf("... ERROR: volume pyramid: failed to write '%s'\n", fname.c_str());
+        unlink(tmp_fname.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool
+open_volume_pyramid(VolumePyramid& pyramid, const std::string& fname)
+{
+    FILE *f = fopen(fname.c_str(), "rb");
+    if (f == nullptr)
+        return false;
+
+    struct stat st;
+    PyramidHeader header;
+
+    bool ok = fstat(fileno(f), &st) == 0
+        && fread(&header, sizeof(header), 1, f) == 1
+        && memcmp(header.magic, pyramid_magic, sizeof(pyramid_magic)) == 0
+        && header.version == pyramid_version
+        && header.num_levels > 0 && header.num_levels <= (uint32_t)pyramid_max_levels
+        && header.brick_size > 0;
+
+    std::vector<PyramidLevel> levels;
+
+    if (ok)
+    {
+        levels.resize(header.num_levels);
+        ok = fread(&levels[0], sizeof(PyramidLevel), levels.size(), f) == levels.size();
+    }
+
+    fclose(f);
+
+    const uint64_t brick_bytes = (uint64_t)header.brick_size*header.brick_size*header.brick_size*header.value_size;
+
+    for (size_t l = 0; ok && l < levels.size(); l++)
+    {
+        const PyramidLevel& level = levels[l];
+
+        ok = (uint64_t)level.bricks[0]*header.brick_size >= level.dims[0]
+            && (uint64_t)level.bricks[1]*header.brick_size >= level.dims[1]
+            && (uint64_t)level.bricks[2]*header.brick_size >= level.dims[2]
+            && level.offset + brick_bytes*level.bricks[0]*level.bricks[1]*level.bricks[2] <= (uint64_t)st.st_size;
+    }
+
+    if (!ok)
+    {
+        printf("... ERROR: '%s' is not a valid volume pyramid file\n", fname.c_str());
+        return false;
+    }
+
+    pyramid.file = fname;
+    pyramid.voxel_type = (OSPDataType)header.voxel_type;
+    pyramid.value_size = header.value_size;
+    pyramid.brick_size = header.brick_size;
+    pyramid.data_range[0] = header.data_range[0];
+    pyramid.data_range[1] = header.data_range[1];
+
+    pyramid.levels.resize(levels.size());
+
+    for (size_t l = 0; l < levels.size(); l++)
+    {
+        VolumePyramidLevel& level = pyramid.levels[l];
+        memcpy(level.dims, levels[l].dims, sizeof(level.dims));
+        memcpy(level.bricks, levels[l].bricks, sizeof(level.bricks));
+        level.offset = levels[l].offset;
+    }
+
+    return true;
+}
+
+std::shared_ptr<const void>
+read_volume_pyramid_level(const VolumePyramid& pyramid, int level_index, PluginState *state)
+{
+    if (level_index < 0 || level_index >= (int)pyramid.levels.size())
+        return nullptr;
+
+    const VolumePyramidLevel& level = pyramid.levels[level_index];
+    const uint32_t brick_size = pyramid.brick_size;
+    const uint32_t value_size = pyramid.value_size;
+    const uint64_t brick_bytes = (uint64_t)brick_size*brick_size*brick_size*value_size;
+    const uint64_t slab_bricks = (uint64_t)level.bricks[0]*level.bricks[1];
+
+    // The bricks are mapped (so not read up front) and copied into place
+    // one slab of bricks at a time, the bricks of a slab in parallel
+
+    std::shared_ptr<const void> bricks = map_input_data(pyramid.file, level.offset,
+        brick_bytes * slab_bricks * level.bricks[2]);
+
+    if (!bricks)
+        return nullptr;
+
+    void *buffer;
+
+    if (posix_memalign(&buffer, 64, std::max<uint64_t>(pyramid.level_size(level_index), 1)) != 0)
+    {
+        printf("... ERROR: could not allocate %llu bytes for volume pyramid level\n",
+            (unsigned long long)pyramid.level_size(level_index));
+        return nullptr;
+    }
+
+    std::shared_ptr<const void> values(buffer, [](const void *p) { free(const_cast<void*>(p)); });
+
+    const uint8_t *src = (const uint8_t*)bricks.get();
+    uint8_t *dst = (uint8_t*)buffer;
+
+    for (uint32_t bz = 0; bz < level.bricks[2]; bz++)
+    {
+        parallel_for(slab_bricks, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; b++)
+            {
+                const uint32_t bx = b % level.bricks[0];
+                const uint32_t by = b / level.bricks[0];
+                const uint32_t x0 = bx*brick_size, y0 = by*brick_size, z0 = bz*brick_size;
+                const uint32_t nx = std::min(brick_size, level.dims[0]-x0);
+                const uint32_t ny = std::min(brick_size, level.dims[1]-y0);
+                const uint32_t nz = std::min(brick_size, level.dims[2]-z0);
+
+                const uint8_t *brick = src + (bz*slab_bricks + b)*brick_bytes;
+
+                for (uint32_t k = 0; k < nz; k++)
+                {
+                    for (uint32_t j = 0; j < ny; j++)
+                    {
+                        memcpy(dst + (((size_t)(z0+k)*level.dims[1] + (y0+j))*level.dims[0] + x0)*value_size,
+                            brick + ((size_t)k*brick_size + j)*brick_size*value_size,
+                            (size_t)nx*value_size);
+                    }
+                }
+            }
+        }, 1);
+
+        if (state != nullptr)
+        {
+            state->set_progress(1.0f * (bz+1) / level.bricks[2], "Reading " + pyramid.file);
+
+            if (state->canceled())
+                return nullptr;
+        }
+    }
+
+    return values;
+}
@@ -0,0 +1,85 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Multi-resolution bricked volume files                                    //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#ifndef VOLUME_PYRAMID_H
+#define VOLUME_PYRAMID_H
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ospray/ospray.h>
+
+struct PluginState;
+
+// A volume pyramid file holds a regular volume at multiple resolutions:
+// level 0 is the full-resolution volume, each next level is downsampled
+// by 2 along each axis (averaging 2x2x2 voxels). Each level is stored
+// as cubic bricks of brick_size^3 voxels (x fastest, bricks at the edge
+// padded), so a level can be read with large sequential reads and
+// assembled in parallel. Values are stored in native byte order.
+// The file is built from a raw volume with build_volume_pyramid(), see
+// the blpyramid tool, and used by volume_raw with the pyramid parameter.
+
+struct VolumePyramidLevel
+{
+    uint32_t    dims[3];        // Voxels
+    uint32_t    bricks[3];      // Bricks per axis
+    uint64_t    offset;         // Of the first brick in the file
+};
+
+struct VolumePyramid
+{
+    std::string     file;
+    OSPDataType     voxel_type;
+    uint32_t        value_size;
+    uint32_t        brick_size;
+    float           data_range[2];      // Of level 0
+
+    std::vector<VolumePyramidLevel>     levels;
+
+    // Size in bytes of the given level when assembled
+    uint64_t level_size(int level) const
+    {
+        const VolumePyramidLevel& l = levels[level];
+        return (uint64_t)l.dims[0] * l.dims[1] * l.dims[2] * value_size;
+    }
+};
+
+// Builds a pyramid file from the given dense volume of dims voxels,
+// with values of the given type (byte-swapped when endian_flip is set).
+// Levels are added until the coarsest level fits in a single brick,
+// or until max_levels (when > 0).
+// Returns false on failure (e.g. unsupported voxel type or a write error).
+bool build_volume_pyramid(const std::string& fname, const void *values, OSPDataType voxel_type,
+    const uint32_t *dims, bool endian_flip, uint32_t brick_size=64, int max_levels=0);
+
+// Reads the header and level table of the given pyramid file.
+// Returns false if the file doesn't exist or isn't a valid pyramid file.
+bool open_volume_pyramid(VolumePyramid& pyramid, const std::string& fname);
+
+// Returns the given level as a dense (64-byte aligned) array, assembled
+// from its bricks in parallel. When state is given progress is reported
+// and reading stops when the state is canceled.
+// Returns nullptr on failure or when canceled.
+std::shared_ptr<const void>
+read_volume_pyramid_level(const VolumePyramid& pyramid, int level, PluginState *state=nullptr);
+
+#endif
@@ -0,0 +1,554 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Voxel preprocessing kernels for volume plugins                           //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#ifndef VOXELS_H
+#define VOXELS_H
+
+#include <stdint.h>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <ospray/ospray.h>
+
+#include "json.hpp"
+#include "parallel.h"
+
+// The kernels below make a single pass over the voxels, split over
+// threads with parallel_for(). The inner loops are specialized per
+// voxel type and per set of operations, without branches, so the
+// compiler can vectorize them.
+
+// Operations to apply to voxel values, in this order
+struct VoxelProcessing
+{
+    bool    endian_flip;        // Swap byte order of each value
+    bool    compute_range;      // Derive the value range (after swapping, before mapping)
+    bool    map_values;         // value = value * value_scale + value_offset
+    float   value_scale;
+    float   value_offset;
+
+    VoxelProcessing()
+    {
+        endian_flip = false;
+        compute_range = true;
+        map_values = false;
+        value_scale = 1.0f;
+        value_offset = 0.0f;
+    }
+};
+
+// Returns the value with its bytes in reverse order (compiles to a
+// single byte swap instruction for 2, 4 and 8-byte types)
+template<typename T>
+inline T
+voxel_swap(T value)
+{
+    uint8_t *bytes = (uint8_t*)&value;
+    std::reverse(bytes, bytes + sizeof(T));
+    return value;
+}
+
+// Converts a mapped value back to T, clamped to the range of T for
+// integer types (instead of wrapping around)
+template<typename T>
+inline T
+voxel_from_float(float value)
+{
+    if (std::is_integral<T>::value)
+    {
+        value = std::max(value, (float)std::numeric_limits<T>::lowest());
+        value = std::min(value, (float)std::numeric_limits<T>::max());
+    }
+
+    return (T)value;
+}
+
+template<typename T, bool SWAP, bool RANGE, bool MAP>
+inline void
+process_voxels_chunk(T *values, size_t n, float scale, float offset, float& minval, float& maxval)
+{
+    float mn = std::numeric_limits<float>::max();
+    float mx = std::numeric_limits<float>::lowest();
+
+    for (size_t i = 0; i < n; i++)
+    {
+        T v = values[i];
+
+        if (SWAP)
+            v = voxel_swap(v);
+
+        const float f = (float)v;
+
+        if (RANGE)
+        {
+            mn = f < mn ? f : mn;
+            mx = f > mx ? f : mx;
+        }
+
+        if (MAP)
+            v = voxel_from_float<T>(f * scale + offset);
+
+        if (SWAP || MAP)
+            values[i] = v;
+    }
+
+    minval = mn;
+    maxval = mx;
+}
+
+template<typename T, bool SWAP, bool RANGE, bool MAP>
+inline void
+process_voxels_parallel(T *values, size_t n, const VoxelProcessing& p, float& minval, float& maxval)
+{
+    // Fixed-size blocks with their own range, merged afterwards
+    const size_t block = 1024*1024;
+    const size_t num_blocks = (n + block - 1) / block;
+
+    std::vector<float> block_min(num_blocks), block_max(num_blocks);
+
+    parallel_for(num_blocks, [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; b++)
+        {
+            const size_t first = b * block;
+            process_voxels_chunk<T, SWAP, RANGE, MAP>(values + first, std::min(block, n - first),
+                p.value_scale, p.value_offset, block_min[b], block_max[b]);
+        }
+    }, 1);
+
+    minval = std::numeric_limits<float>::max();
+    maxval = std::numeric_limits<float>::lowest();
+
+    for (size_t b = 0; b < num_blocks; b++)
+    {
+        minval = std::min(minval, block_min[b]);
+        maxval = std::max(maxval, block_max[b]);
+    }
+}
+
+// Applies the given operations to the n values, in place. When
+// p.compute_range is set minval/maxval are set to the range of the
+// values before mapping, otherwise they are left untouched.
+template<typename T>
+void
+process_voxels(T *values, size_t n, const VoxelProcessing& p, float& minval, float& maxval)
+{
+    float mn, mx;
+
+    const bool swap = p.endian_flip && sizeof(T) > 1;
+    const int ops = (swap ? 4 : 0) | (p.compute_range ? 2 : 0) | (p.map_values ? 1 : 0);
+
+    switch (ops)
+    {
+    case 0: return;
+    case 1: process_voxels_parallel<T, false, false, true>(values, n, p, mn, mx); break;
+    case 2: process_voxels_parallel<T, false, true, false>(values, n, p, mn, mx); break;
+    case 3: process_voxels_parallel<T, false, true, true>(values, n, p, mn, mx); break;
+    case 4: process_voxels_parallel<T, true, false, false>(values, n, p, mn, mx); break;
+    case 5: process_voxels_parallel<T, true, false, true>(values, n, p, mn, mx); break;
+    case 6: process_voxels_parallel<T, true, true, false>(values, n, p, mn, mx); break;
+    case 7: process_voxels_parallel<T, true, true, true>(values, n, p, mn, mx); break;
+    }
+
+    if (p.compute_range)
+    {
+        minval = mn;
+        maxval = mx;
+    }
+}
+
+// Value range of the n values, computed in parallel
+template<typename T>
+void
+voxel_value_range(const T *values, size_t n, float& minval, float& maxval)
+{
+    VoxelProcessing p;
+    p.compute_range = true;
+
+    // Only reads, as neither swapping nor mapping is done
+    process_voxels_parallel<T, false, true, false>(const_cast<T*>(values), n, p, minval, maxval);
+}
+
+// Runtime dispatch on the OSPRay data type. Returns false for types
+// that aren't supported as voxel values.
+inline bool
+process_voxels(OSPDataType type, void *values, size_t n, const VoxelProcessing& p, float& minval, float& maxval)
+{
+    switch (type)
+    {
+    case OSP_UCHAR:
+        process_voxels((uint8_t*)values, n, p, minval, maxval);
+        return true;
+    case OSP_SHORT:
+        process_voxels((int16_t*)values, n, p, minval, maxval);
+        return true;
+    case OSP_USHORT:
+        process_voxels((uint16_t*)values, n, p, minval, maxval);
+        return true;
+    case OSP_FLOAT:
+        process_voxels((float*)values, n, p, minval, maxval);
+        return true;
+    case OSP_DOUBLE:
+        process_voxels((double*)values, n, p, minval, maxval);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Maps a voxel type name as used in plugin parameters ("uchar",
+// "short", "ushort", "float", "double") to the OSPRay data type and
+// value size. Returns false for unknown names.
+inline bool
+get_voxel_type(OSPDataType& type, uint32_t& value_size, const std::string& name)
+{
+    if (name == "uchar")
+    {
+        type = OSP_UCHAR;
+        value_size = sizeof(uint8_t);
+    }
+    else if (name == "short")
+    {
+        type = OSP_SHORT;
+        value_size = sizeof(int16_t);
+    }
+    else if (name == "ushort")
+    {
+        type = OSP_USHORT;
+        value_size = sizeof(uint16_t);
+    }
+    else if (name == "float")
+    {
+        type = OSP_FLOAT;
+        value_size = sizeof(float);
+    }
+    else if (name == "double")
+    {
+        type = OSP_DOUBLE;
+        value_size = sizeof(double);
+    }
+    else
+        return false;
+
+    return true;
+}
+
+// Quantizes n values to an integer type D, mapping [minval, maxval] 
+// linearly onto the full range of D (values outside it are clamped)
+template<typename S, typename D>
+void
+quantize_voxels(D *dst, const S *src, size_t n, float minval, float maxval)
+{
+    const float top = (float)std::numeric_limits<D>::max();
+    const float scale = maxval > minval ? top / (maxval - minval) : 0.0f;
+
+    parallel_for(n, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            float q = ((float)src[i] - minval) * scale + 0.5f;
+            q = q < 0.0f ? 0.0f : q;
+            q = q > top ? top : q;
+            dst[i] = (D)q;
+        }
+    });
+}
+
+// Quantizes n float or double values (src_type) to uchar or ushort
+// (dst_type), see above. Sets value_scale and value_offset so that 
+// the original value is (approximately) stored * value_scale + value_offset.
+// Returns false for unsupported types.
+inline bool
+quantize_voxels(void *dst, OSPDataType dst_type, const void *src, OSPDataType src_type, size_t n, 
+    float minval, float maxval, float& value_scale, float& value_offset)
+{
+    if ((src_type != OSP_FLOAT && src_type != OSP_DOUBLE) || (dst_type != OSP_UCHAR && dst_type != OSP_USHORT))
+        return false;
+
+    const float top = dst_type == OSP_UCHAR ? 255.0f : 65535.0f;
+
+    if (src_type == OSP_FLOAT && dst_type == OSP_UCHAR)
+        quantize_voxels((uint8_t*)dst, (const float*)src, n, minval, maxval);
+    else if (src_type == OSP_FLOAT)
+        quantize_voxels((uint16_t*)dst, (const float*)src, n, minval, maxval);
+    else if (dst_type == OSP_UCHAR)
+        quantize_voxels((uint8_t*)dst, (const double*)src, n, minval, maxval);
+    else
+        quantize_voxels((uint16_t*)dst, (const double*)src, n, minval, maxval);
+
+    value_scale = maxval > minval ? (maxval - minval) / top : 1.0f;
+    value_offset = minval;
+
+    return true;
+}
+
+// Quantizes n values of the given type to the type named by quantize 
+// ("uchar" or "ushort", as given in a plugin's quantize parameter), 
+// returning them in a new 64-byte aligned buffer, and sets type to 
+// the new type. Returns nullptr (with type unchanged) when quantize 
+// is not a supported target, or the values aren't float or double.
+inline std::shared_ptr<const void>
+quantize_volume(OSPDataType& type, const void *values, size_t n, float minval, float maxval, 
+    const std::string& quantize, float& value_scale, float& value_offset)
+{
+    OSPDataType dst_type;
+    uint32_t value_size;
+
+    if (!get_voxel_type(dst_type, value_size, quantize) || (dst_type != OSP_UCHAR && dst_type != OSP_USHORT)
+        || (type != OSP_FLOAT && type != OSP_DOUBLE))
+        return nullptr;
+
+    void *buffer;
+
+    if (posix_memalign(&buffer, 64, std::max<size_t>(n*value_size, 1)) != 0)
+        return nullptr;
+
+    quantize_voxels(buffer, dst_type, values, type, n, minval, maxval, value_scale, value_offset);
+
+    type = dst_type;
+
+    return std::shared_ptr<const void>(buffer, [](const void *p) { free(const_cast<void*>(p)); });
+}
+
+// A region of interest of a volume, optionally subsampled: voxels
+// roi_min + i*stride (per axis), for 0 <= i < dims
+struct VoxelRegion
+{
+    int32_t     full_dims[3];       // Of the complete volume
+    int32_t     roi_min[3];
+    int32_t     stride[3];
+    int32_t     dims[3];            // Of the region
+
+    bool is_full() const
+    {
+        return dims[0] == full_dims[0] && dims[1] == full_dims[1] && dims[2] == full_dims[2];
+    }
+
+    size_t num_voxels() const
+    {
+        return (size_t)dims[0] * dims[1] * dims[2];
+    }
+
+    // Adjusts the origin and spacing of the complete volume to the region
+    void apply(float *origin, float *spacing) const
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            origin[i] += roi_min[i] * spacing[i];
+            spacing[i] *= stride[i];
+        }
+    }
+};
+
+// Sets up the region from the (optional) roi_min, roi_max (both 
+// inclusive voxel indices) and stride plugin parameters. Without these 
+// the region is the complete volume. Returns false (with message set) 
+// for an invalid region.
+inline bool
+get_voxel_region(VoxelRegion& region, const int32_t *full_dims, const nlohmann::json& parameters, std::string& message)
+{
+    int32_t roi_max[3];
+
+    for (int i = 0; i < 3; i++)
+    {
+        region.full_dims[i] = full_dims[i];
+        region.roi_min[i] = 0;
+        region.stride[i] = 1;
+        roi_max[i] = full_dims[i] - 1;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (parameters.find("roi_min") != parameters.end())
+            region.roi_min[i] = parameters["roi_min"][i].get<int>();
+        if (parameters.find("roi_max") != parameters.end())
+            roi_max[i] = parameters["roi_max"][i].get<int>();
+        if (parameters.find("stride") != parameters.end())
+            region.stride[i] = parameters["stride"][i].get<int>();
+
+        if (region.roi_min[i] < 0 || roi_max[i] >= full_dims[i] || region.roi_min[i] > roi_max[i] || region.stride[i] < 1)
+        {
+            message = "Invalid region of interest or stride (volume is " + std::to_string(full_dims[0]) 
+                + "x" + std::to_string(full_dims[1]) + "x" + std::to_string(full_dims[2]) + ")";
+            return false;
+        }
+
+        region.dims[i] = (roi_max[i] - region.roi_min[i]) / region.stride[i] + 1;
+    }
+
+    return true;
+}
+
+// Copies the region out of the complete volume (values of value_size 
+// bytes), rows in parallel. Src may be memory-mapped, only the pages 
+// holding voxels in the region are touched (whole rows when strided in x).
+inline void
+gather_voxel_region(void *dst, const void *src, const VoxelRegion& region, uint32_t value_size)
+{
+    const int32_t *full = region.full_dims;
+
+    parallel_for((size_t)region.dims[1] * region.dims[2], [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++)
+        {
+            const size_t j = row % region.dims[1];
+            const size_t k = row / region.dims[1];
+            const size_t z = region.roi_min[2] + k*region.stride[2];
+            const size_t y = region.roi_min[1] + j*region.stride[1];
+
+            const uint8_t *s = (const uint8_t*)src + ((z*full[1] + y)*full[0] + region.roi_min[0]) * value_size;
+            uint8_t *d = (uint8_t*)dst + row * region.dims[0] * value_size;
+
+            if (region.stride[0] == 1)
+                memcpy(d, s, (size_t)region.dims[0] * value_size);
+            else
+            {
+                const size_t step = (size_t)region.stride[0] * value_size;
+
+                for (int32_t i = 0; i < region.dims[0]; i++, d += value_size, s += step)
+                    memcpy(d, s, value_size);
+            }
+        }
+    }, 64);
+}
+
+// A block of a regular volume, see find_voxel_blocks()
+struct VoxelBlock
+{
+    int32_t     origin[3];      // First voxel
+    int32_t     dims[3];        // Voxels (smaller than the block size at the volume edges)
+    float       range[2];       // Of the block's values
+};
+
+template<typename T>
+void
+voxel_block_range(const T *values, const int32_t *dims, VoxelBlock& block)
+{
+    float mn = std::numeric_limits<float>::max();
+    float mx = std::numeric_limits<float>::lowest();
+
+    for (int32_t k = 0; k < block.dims[2]; k++)
+    {
+        for (int32_t j = 0; j < block.dims[1]; j++)
+        {
+            const T *row = values + ((size_t)(block.origin[2]+k)*dims[1] + (block.origin[1]+j))*dims[0] + block.origin[0];
+
+            for (int32_t i = 0; i < block.dims[0]; i++)
+            {
+                const float f = (float)row[i];
+                mn = f < mn ? f : mn;
+                mx = f > mx ? f : mx;
+            }
+        }
+    }
+
+    block.range[0] = mn;
+    block.range[1] = mx;
+}
+
+// Splits the volume of dims voxels into blocks of block_size^3 voxels, 
+// computes the value range of each block (blocks in parallel) and 
+// returns the blocks whose range overlaps [minval, maxval], i.e. the
+// blocks that can contain values in that range, in x-fastest order.
+// Returns no blocks for unsupported types.
+inline std::vector<VoxelBlock>
+find_voxel_blocks(const void *values, OSPDataType type, const int32_t *dims, int32_t block_size,
+    float minval, float maxval)
+{
+    int32_t nb[3];
+    for (int i = 0; i < 3; i++)
+        nb[i] = (dims[i] + block_size - 1) / block_size;
+
+    const size_t num_blocks = (size_t)nb[0] * nb[1] * nb[2];
+    std::vector<VoxelBlock> blocks(num_blocks);
+    std::vector<uint8_t> keep(num_blocks);
+
+    parallel_for(num_blocks, [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; b++)
+        {
+            VoxelBlock& block = blocks[b];
+            const int32_t bidx[3] = { int32_t(b % nb[0]), int32_t((b / nb[0]) % nb[1]), int32_t(b / ((size_t)nb[0]*nb[1])) };
+
+            for (int i = 0; i < 3; i++)
+            {
+                block.origin[i] = bidx[i] * block_size;
+                block.dims[i] = std::min(block_size, dims[i] - block.origin[i]);
+            }
+
+            switch (type)
+            {
+            case OSP_UCHAR:     voxel_block_range((const uint8_t*)values, dims, block); break;
+            case OSP_SHORT:     voxel_block_range((const int16_t*)values, dims, block); break;
+            case OSP_USHORT:    voxel_block_range((const uint16_t*)values, dims, block); break;
+            case OSP_FLOAT:     voxel_block_range((const float*)values, dims, block); break;
+            case OSP_DOUBLE:    voxel_block_range((const double*)values, dims, block); break;
+            default:            block.range[0] = block.range[1] = 0.0f; keep[b] = 0; continue;
+            }
+
+            keep[b] = block.range[1] >= minval && block.range[0] <= maxval;
+        }
+    }, 1);
+
+    size_t n = 0;
+    for (size_t b = 0; b < num_blocks; b++)
+    {
+        if (keep[b])
+            blocks[n++] = blocks[b];
+    }
+
+    blocks.resize(n);
+
+    return blocks;
+}
+
+template<typename T>
+void
+gather_voxel_block(float *dst, const T *values, const int32_t *dims, const VoxelBlock& block)
+{
+    for (int32_t k = 0; k < block.dims[2]; k++)
+    {
+        for (int32_t j = 0; j < block.dims[1]; j++)
+        {
+            const T *row = values + ((size_t)(block.origin[2]+k)*dims[1] + (block.origin[1]+j))*dims[0] + block.origin[0];
+
+            for (int32_t i = 0; i < block.dims[0]; i++)
+                *dst++ = (float)row[i];
+        }
+    }
+}
+
+// Copies the voxels of the block (x fastest) to dst, converted to float
+inline void
+gather_voxel_block(float *dst, const void *values, OSPDataType type, const int32_t *dims, const VoxelBlock& block)
+{
+    switch (type)
+    {
+    case OSP_UCHAR:     gather_voxel_block(dst, (const uint8_t*)values, dims, block); break;
+    case OSP_SHORT:     gather_voxel_block(dst, (const int16_t*)values, dims, block); break;
+    case OSP_USHORT:    gather_voxel_block(dst, (const uint16_t*)values, dims, block); break;
+    case OSP_FLOAT:     gather_voxel_block(dst, (const float*)values, dims, block); break;
+    case OSP_DOUBLE:    gather_voxel_block(dst, (const double*)values, dims, block); break;
+    default:            break;
+    }
+}
+
+#endif
@@ -18,92 +18,224 @@
 // limitations under the License.                                           //
 // ======================================================================== //
 
-#include <cstdio>
+#include <sys/stat.h>
 #include <stdint.h>
-#include <iostream>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <mutex>
 #include <ospray/ospray.h>
 
 #include "plugin.h"
+#include "input_data_cache.h"
+#include "parallel.h"
 
-void
-create_spheres(PluginState *state, json& j, bool project, float scale, float radius, int bound_subsampling=10)
+// Stars are read from either a JSON array of objects with (at least) 
+// x, y, z and mag members, as written by scripts/hygcsv2json.py, or 
+// from the binary columnar format below, written by the same script
+// for an output file ending in .bin. The binary file is memory-mapped.
+//
+// Binary layout (little-endian): header, then for each column (x, y, z,
+// mag) an array of num_stars floats, at the offsets given in the header
+
+static const char   stars_magic[8] = { 'B', 'L', 'S', 'P', 'S', 'T', 'A', 'R' };
+static const uint32_t stars_version = 1;
+
+struct StarsHeader
 {
-    std::vector<float> positions;
-    std::vector<float> radii;
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    num_columns;
+    uint64_t    num_stars;
+    uint64_t    column_offsets[4];      // x, y, z, mag
+};
 
-    BoundingMesh *bound = new BoundingMesh;
-    std::vector<float>& bound_vertices = bound->vertices;
+// Columns of the catalog, either pointing into a mapped binary file
+// or into vectors filled from JSON
+struct StarColumns
+{
+    const float     *x, *y, *z, *mag;
+    uint64_t        count;
+};
 
-    float x, y, z;
-    float mag, brightness;
-    float min[3] = {1e6, 1e6, 1e6}, max[3] = {-1e6, -1e6, -1e6};    // XXX use float min/max
-    float minmag = 1e6, maxmag = -1e6;
-    int idx = 0;
+// Per-instance data, for updating the sphere radii in place
+struct StarsData
+{
+    std::vector<float>  relative_radii;     // For a base radius of 1
+};
 
-    for (json::iterator it = j.begin(); it != j.end(); ++it) 
+static bool
+map_binary_stars(StarColumns& columns, std::shared_ptr<const void>& mapping, 
+    const std::string& file, uint64_t file_size, std::string& message)
+{
+    mapping = map_input_data(file, 0, file_size);
+
+    if (!mapping || file_size < sizeof(StarsHeader))
     {
-        const json &e = *it;
+        message = "Could not map file '" + file + "'";
+        return false;
+    }
 
-        //printf("%s\n", e["x"].dump().c_str());
+    const uint8_t *data = (const uint8_t*)mapping.get();
+    StarsHeader header;
+    memcpy(&header, data, sizeof(header));
 
-        x = e["x"].get<float>();
-        y = e["y"].get<float>();
-        z = e["z"].get<float>();
+    if (header.version != stars_version || header.num_columns != 4)
+    {
+        message = "Unsupported version of binary star file '" + file + "'";
+        return false;
+    }
 
-        if (project)
-            scale = 1.0f / sqrt(x*x + y*y + z*z);
+    for (int c = 0; c < 4; c++)
+    {
+        if (header.column_offsets[c] % sizeof(float) != 0
+            || header.column_offsets[c] + header.num_stars*sizeof(float) > file_size)
+        {
+            message = "Binary star file '" + file + "' is truncated";
+            return false;
+        }
+    }
 
-        x *= scale;
-        y *= scale;
-        z *= scale;
+    columns.x = (const float*)(data + header.column_offsets[0]);
+    columns.y = (const float*)(data + header.column_offsets[1]);
+    columns.z = (const float*)(data + header.column_offsets[2]);
+    columns.mag = (const float*)(data + header.column_offsets[3]);
+    columns.count = header.num_stars;
 
-        positions.push_back(x);
-        positions.push_back(y);
-        positions.push_back(z);
+    return true;
+}
 
-        // Faintest stars naked to the visible eye are around +6.5 magnitude.
-        // A magnitude of 5 units higher means 100 times dimmer
-        // Magnitude 0 maps to radius.
-        mag = e["mag"].get<float>();
+static bool
+read_json_stars(StarColumns& columns, std::vector<float>& values, const std::string& file, std::string& message)
+{
+    std::ifstream fs(file);
+    json j;
+
+    if (!fs.is_open())
+    {
+        message = "Could not open file '" + file + "'";
+        return false;
+    }
+
+    try
+    {
+        fs >> j;
+
+        const size_t n = j.size();
+        values.resize(4*n);
+
+        size_t i = 0;
+        for (json::iterator it = j.begin(); it != j.end(); ++it, ++i) 
+        {
+            const json &e = *it;
+            values[i] = e["x"].get<float>();
+            values[n+i] = e["y"].get<float>();
+            values[2*n+i] = e["z"].get<float>();
+            values[3*n+i] = e["mag"].get<float>();
+        }
+
+        columns.x = &values[0];
+        columns.y = &values[n];
+        columns.z = &values[2*n];
+        columns.mag = &values[3*n];
+        columns.count = n;
+    }
+    catch (const json::exception& e)
+    {
+        message = "Could not read stars from '" + file + "': " + e.what();
+        return false;
+    }
+
+    return true;
+}
+
+void
+create_spheres(PluginState *state, const StarColumns& stars, bool project, float scale, float radius, int bound_subsampling=10)
+{
+    const size_t n = stars.count;
 
-        brightness = 1.0f;
-        if (mag >= 0.0f)
-            brightness = 1.0f / (powf(2.512f, mag));
+    std::vector<float> positions(3*n);
+    std::vector<float> radii(n);
 
-        radii.push_back(radius*sqrt(brightness));
+    StarsData *stars_data = new StarsData;
+    stars_data->relative_radii.resize(n);
 
-        min[0] = std::min(min[0], x);
-        min[1] = std::min(min[1], y);
-        min[2] = std::min(min[2], z);
+    // Faintest stars naked to the visible eye are around +6.5 magnitude.
+    // A magnitude of 5 units higher means 100 times dimmer, so brightness
+    // is 2.512^-mag and the relative radius sqrt(brightness) = 2^(-mag * 
+    // log2(2.512) / 2). Magnitude 0 (and brighter) maps to radius.
+    const float radius_exponent = -0.5f * std::log2(2.512f);
 
-        max[0] = std::max(max[0], x);
-        max[1] = std::max(max[1], y);
-        max[2] = std::max(max[2], z);
+    float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    float minmag = FLT_MAX, maxmag = -FLT_MAX;
+    std::mutex range_mutex;
 
-        minmag = std::min(minmag, mag);
-        maxmag = std::max(maxmag, mag);
+    parallel_for(n, [&](size_t begin, size_t end) {
 
-        if (idx % bound_subsampling == 0)
+        // Separate loops over the columns, so these vectorize
+        for (size_t i = begin; i < end; i++)
         {
-            bound_vertices.push_back(x);
-            bound_vertices.push_back(y);
-            bound_vertices.push_back(z);
+            const float x = stars.x[i], y = stars.y[i], z = stars.z[i];
+            const float s = project ? 1.0f / std::sqrt(x*x + y*y + z*z) : scale;
+            positions[3*i+0] = x * s;
+            positions[3*i+1] = y * s;
+            positions[3*i+2] = z * s;
         }
 
-        idx++;
-    }
+        for (size_t i = begin; i < end; i++)
+        {
+            const float mag = stars.mag[i];
+            const float relative = mag >= 0.0f ? std::exp2(radius_exponent * mag) : 1.0f;
+            stars_data->relative_radii[i] = relative;
+            radii[i] = radius * relative;
+        }
+
+        float lmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, lmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        float lminmag = FLT_MAX, lmaxmag = -FLT_MAX;
+
+        for (size_t i = begin; i < end; i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                lmin[c] = std::min(lmin[c], positions[3*i+c]);
+                lmax[c] = std::max(lmax[c], positions[3*i+c]);
+            }
+            lminmag = std::min(lminmag, stars.mag[i]);
+            lmaxmag = std::max(lmaxmag, stars.mag[i]);
+        }
+
+        std::lock_guard<std::mutex> lock(range_mutex);
+        for (int c = 0; c < 3; c++)
+        {
+            min[c] = std::min(min[c], lmin[c]);
+            max[c] = std::max(max[c], lmax[c]);
+        }
+        minmag = std::min(minmag, lminmag);
+        maxmag = std::max(maxmag, lmaxmag);
+    });
+
+    BoundingMesh *bound = new BoundingMesh;
+    std::vector<float>& bound_vertices = bound->vertices;
+
+    for (size_t i = 0; i < n; i += bound_subsampling)
+        bound_vertices.insert(bound_vertices.end(), &positions[3*i], &positions[3*i+3]);
 
+    printf("... %zu stars\n", n);
     printf("... Bounds %.6f %.6f %.6f; %.6f %.6f %.6f\n", 
         min[0], min[1], min[2], max[0], max[1], max[2]);
     printf("... Magnitude range %.6f %.6f\n", minmag, maxmag);
 
-    std::vector<float>::iterator minr, maxr;
+    if (n > 0)
+    {
+        std::vector<float>::iterator minr, maxr;
 
-    minr = std::min_element(radii.begin(), radii.end());
-    maxr = std::max_element(radii.begin(), radii.end());
+        minr = std::min_element(radii.begin(), radii.end());
+        maxr = std::max_element(radii.begin(), radii.end());
 
-    printf("... Radius range %.6f %.6f\n", *minr, *maxr);
+        printf("... Radius range %.6f %.6f\n", *minr, *maxr);
+    }
 
     OSPData data;
 
@@ -123,9 +255,18 @@ create_spheres(PluginState *state, json& j, bool project, float scale, float rad
         //ospSetData(mesh, "vertex.color", data);
       
     ospCommit(spheres);
+
+    // For the plugin cache
+    auto cached_positions = std::make_shared<std::vector<float>>(std::move(positions));
+    auto cached_radii = std::make_shared<std::vector<float>>(std::move(radii));
+
+    state->cacheable.subtype = "spheres";
+    state->cacheable.add_array("sphere.position", OSP_VEC3F, cached_positions->size()/3, cached_positions->data(), cached_positions);
+    state->cacheable.add_array("sphere.radius", OSP_FLOAT, cached_radii->size(), cached_radii->data(), cached_radii);
   
     state->geometry = spheres;
     state->bound = bound;
+    state->data = stars_data;
 }
 
 extern "C"
@@ -137,30 +278,81 @@ create_geometry(PluginResult &result, PluginState *state)
     const int project = state->parameters["project"];
     const std::string& file = state->parameters["file"];
 
-    std::ifstream fs;
-    json j;
+    // Binary or JSON, based on the first bytes
 
-    fs.open(file);
+    struct stat st;
+    char magic[8] = { 0 };
+    FILE *f = fopen(file.c_str(), "rb");
 
-    if (!fs.is_open())
+    if (f == nullptr || fstat(fileno(f), &st) != 0)
+    {
+        if (f != nullptr)
+            fclose(f);
+        result.set_success(false);
+        result.set_message("Could not open file '" + file + "'");
+        return;
+    }
+
+    const bool binary = fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, stars_magic, sizeof(magic)) == 0;
+    fclose(f);
+
+    StarColumns columns;
+    std::shared_ptr<const void> mapping;
+    std::vector<float> values;
+    std::string message;
+
+    if (binary ? !map_binary_stars(columns, mapping, file, st.st_size, message)
+               : !read_json_stars(columns, values, file, message))
     {
-        char msg[1024];
-        sprintf(msg, "Could not open file '%s'", file.c_str());
         result.set_success(false);
-        result.set_message(msg);
+        result.set_message(message);
         return;
     }
 
-    fs >> j;
-    fs.close();
+    create_spheres(state, columns, project, scale, radius);
+}
+
+extern "C"
+bool
+update_geometry(PluginResult &result, PluginState *state, const std::set<std::string>& changed)
+{
+    StarsData *stars_data = (StarsData*)state->data;
+
+    // Only a change in radius can be handled in place
+    if (stars_data == nullptr || changed.size() != 1 || changed.count("radius") == 0)
+        return false;
+
+    const float radius = state->parameters["radius"];
+
+    std::vector<float> radii(stars_data->relative_radii.size());
+
+    parallel_for(radii.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            radii[i] = radius * stars_data->relative_radii[i];
+    });
 
-    create_spheres(state, j, project, scale, radius);
+    OSPData data = ospNewCopiedData(radii.size(), OSP_FLOAT, radii.data());
+    ospCommit(data);
+    ospSetObject(state->geometry, "sphere.radius", data);
+    ospRelease(data);
+
+    ospCommit(state->geometry);
+
+    return true;
+}
+
+extern "C"
+void
+clear_data(PluginState *state)
+{
+    delete (StarsData*)state->data;
+    state->data = nullptr;
 }
 
 static PluginParameters 
 parameters = {
     
-    {"file",    PARAM_STRING,   1, FLAG_NONE, "File to load"},
+    {"file",    PARAM_STRING,   1, FLAG_NONE, "File to load (JSON, or binary as written by hygcsv2json.py)"},
     {"scale",   PARAM_FLOAT,    1, FLAG_NONE, "Scale factor to apply during reading"},
     {"radius",  PARAM_FLOAT,    1, FLAG_NONE, "Base sphere radius (unscaled by magnitude)"},
     {"project",  PARAM_INT,    1, FLAG_NONE, "Project positions on a unit sphere"},
@@ -175,7 +367,9 @@ functions = {
     NULL,               // Plugin unload
     
     create_geometry,    // Generate    
-    NULL,               // Clear data
+    clear_data,         // Clear data
+    NULL,               // Query bound
+    update_geometry,    // Update
 };
 
 
@@ -184,6 +378,7 @@ initialize(PluginDefinition *def)
 {
     def->type = PT_GEOMETRY;
     def->uses_renderer_type = false;
+    def->thread_safe = true;
     def->parameters = parameters;
     def->functions = functions;
     
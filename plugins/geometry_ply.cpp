@@ -18,269 +18,60 @@
 // limitations under the License.                                           //
 // ======================================================================== //
 
-// Uses RPly (http://w3.impa.br/~diego/software/rply/) by Diego Nehab
-#include <rply.h>
 #include <stdint.h>
 #include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
 #include <vector>
 #include "plugin.h"
-
-static std::vector<float> vertices;
-static int      next_vertex_element_index;
-
-static std::vector<uint32_t> faces;          // XXX vertex_indices
-static std::vector<uint32_t> face_lengths;
-static int      face_indices_size;
-static int      next_face_offset;
-static int      next_face_element_index;
-static int      num_triangles, num_quads;
-
-static std::vector<float> vertex_normals;
-static int      next_vertex_normal_element_index;
-
-static std::vector<float> vertex_colors;
-static int      next_vertex_color_element_index;
-static float    vertex_color_scale_factor;
-
-static std::vector<float>    vertex_texcoords;
-static int      next_vertex_texcoord_element_index;
-
-// Vertex callbacks
-
-static int
-vertex_cb(p_ply_argument argument)
-{
-    vertices.push_back(ply_get_argument_value(argument));
-    next_vertex_element_index++;
-
-    return 1;
-}
-
-static int
-vertex_color_cb(p_ply_argument argument)
-{
-    vertex_colors.push_back(ply_get_argument_value(argument) * vertex_color_scale_factor);
-    next_vertex_color_element_index++;
-
-    return 1;
-}
-
-static int
-vertex_normal_cb(p_ply_argument argument)
-{
-    vertex_normals.push_back(ply_get_argument_value(argument));
-    next_vertex_normal_element_index++;
-
-    return 1;
-}
-
-static int
-vertex_texcoord_cb(p_ply_argument argument)
-{
-    vertex_texcoords.push_back(ply_get_argument_value(argument));
-    next_vertex_texcoord_element_index++;
-
-    return 1;
-}
-
-// Face callback
-
-static int
-face_cb(p_ply_argument argument)
-{
-    long    length, value_index;
-    int     vertex_index;
-
-    ply_get_argument_property(argument, NULL, &length, &value_index);
-
-    if (value_index == -1)
-    {
-        // First value of a list property, the one that gives the 
-        // number of entries, i.e. start of new face
-        next_face_offset++;
-
-        face_lengths.push_back(length);
-        
-        return 1;
-    }
-    
-    faces.push_back(ply_get_argument_value(argument));
-
-    return 1;
-}
+#include "parallel.h"
+#include "ply_reader.h"
 
 extern "C"
 void
 load_ply_file(PluginResult &result, PluginState *state)
 {
     const std::string& plyfile = state->parameters["file"];
-    char        msg[1024];
-    int         vertex_values_per_loop = 1;
 
-    p_ply ply = ply_open(plyfile.c_str(), NULL, 0, NULL);
-    if (!ply)
-    {
-        
-        sprintf(msg, "Could not open PLY file %s", plyfile.c_str());
-        result.set_success(false);
-        result.set_message(msg);
-        printf("%s\n", msg);
-        return;
-    }
+    // The arrays are referenced by the cacheable object
+    std::shared_ptr<PlyMesh> mesh = std::make_shared<PlyMesh>();
+    std::string message;
 
-    if (!ply_read_header(ply))
+    if (!read_ply(*mesh, plyfile, message, state))
     {
-        strcpy(msg, "Could not read PLY header");
+        if (state->canceled())
+            message = "Canceled";
         result.set_success(false);
-        result.set_message(msg);
-        printf("%s\n", msg);
+        result.set_message(message);
+        printf("%s\n", message.c_str());
         return;
     }
 
-    // Check elements
-
-    p_ply_element   vertex_element=NULL, face_element=NULL;
-    const char      *name;
-
-    p_ply_element element = ply_get_next_element(ply, NULL);
-    while (element)
-    {
-        ply_get_element_info(element, &name, NULL);
-
-        if (strcmp(name, "vertex") == 0)
-            vertex_element = element;
-        else if (strcmp(name, "face") == 0)
-            face_element = element;
-
-        element = ply_get_next_element(ply, element);
-    }
-
-    // XXX turn into actual checks
-    assert(vertex_element && "Don't have a vertex element");
-    assert(face_element && "Don't have a face element");
-
-    // Set vertex and face property callbacks
-    
-    long nvertices, nfaces;
-
-    nvertices = ply_set_read_cb(ply, "vertex", "x", vertex_cb, NULL, 0);
-    ply_set_read_cb(ply, "vertex", "y", vertex_cb, NULL, 0);
-    ply_set_read_cb(ply, "vertex", "z", vertex_cb, NULL, 1);
-
-    nfaces = ply_set_read_cb(ply, "face", "vertex_indices", face_cb, NULL, 0);
-
-    //printf("%ld vertices\n%ld faces\n", nvertices, nfaces);
-
-    // Set optional per-vertex callbacks
-
-    int have_vertex_colors = 0;
-    int have_vertex_normals = 0;
-    int have_vertex_texcoords = 0;      // Either s,t or u,v sets will be used, but not both
-
-    p_ply_property  prop;
-    e_ply_type      ptype, plength_type, pvalue_type;
-    
-    // XXX check ply_set_read_cb() return values below
-
-    prop = ply_get_next_property(vertex_element, NULL);
-    while (prop)
-    {
-        ply_get_property_info(prop, &name, &ptype, &plength_type, &pvalue_type);
-
-        //printf("property '%s'\n", name);
-
-        if (strcmp(name, "red") == 0)
-        {
-            // Assumes green and blue properties are also available
-            // XXX is there ever an alpha value?
-            have_vertex_colors = 1;
-
-            if (ptype == PLY_UCHAR)
-                vertex_color_scale_factor = 1.0f / 255;
-            else if (ptype == PLY_FLOAT)
-                vertex_color_scale_factor = 1.0f;
-            else
-                fprintf(stderr, "Warning: vertex color value type is %d, don't know how to handle!\n", ptype);
-
-            ply_set_read_cb(ply, "vertex", "red", vertex_color_cb, NULL, 0);
-            ply_set_read_cb(ply, "vertex", "green", vertex_color_cb, NULL, 0);
-            ply_set_read_cb(ply, "vertex", "blue", vertex_color_cb, NULL, 1);
-        }
-        else if (strcmp(name, "nx") == 0)
-        {
-            // Assumes ny and nz properties are also available
-            have_vertex_normals = 1;
-
-            ply_set_read_cb(ply, "vertex", "nx", vertex_normal_cb, NULL, 0);
-            ply_set_read_cb(ply, "vertex", "ny", vertex_normal_cb, NULL, 0);
-            ply_set_read_cb(ply, "vertex", "nz", vertex_normal_cb, NULL, 1);
-        }
-        else if (strcmp(name, "s") == 0 && !have_vertex_texcoords)
-        {
-            // Assumes t property is also available
-            have_vertex_texcoords = 1;
-
-            ply_set_read_cb(ply, "vertex", "s", vertex_texcoord_cb, NULL, 0);
-            ply_set_read_cb(ply, "vertex", "t", vertex_texcoord_cb, NULL, 1);
-        }
-        else if (strcmp(name, "u") == 0 && !have_vertex_texcoords)
-        {
-            // Assumes v property is also available
-            have_vertex_texcoords = 1;
-
-            ply_set_read_cb(ply, "vertex", "u", vertex_texcoord_cb, NULL, 0);
-            ply_set_read_cb(ply, "vertex", "v", vertex_texcoord_cb, NULL, 1);
-        }
-
-        prop = ply_get_next_property(vertex_element, prop);
-    }
-
-    // Allocate memory and initialize some values
+    const std::vector<float>& vertices = mesh->vertices;
+    const std::vector<uint32_t>& faces = mesh->faces;
+    const std::vector<uint32_t>& face_lengths = mesh->face_lengths;
+    const uint32_t nvertices = vertices.size() / 3;
 
-    next_vertex_element_index = 0;
+    // Indices must refer to existing vertices
 
-    // As we don't know the number of indices needed in advance we assume
-    // quads. For a pure-triangle mesh this will overallocate by 1/4th,
-    // but for a mesh with general n-gons we might have to reallocate
-    // later on.
-    
-    next_face_offset = 0;
-    next_face_element_index = 0;
-    
-    face_indices_size = nfaces > 128 ? nfaces*4 : 512;
-
-    if (have_vertex_normals)
-    {
-        next_vertex_normal_element_index = 0;
-    }
+    std::atomic<bool> valid(true);
 
-    if (have_vertex_colors)
-    {
-        next_vertex_color_element_index = 0;
-    }
+    parallel_for(faces.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            if (faces[i] >= nvertices)
+                valid = false;
+    });
 
-    if (have_vertex_texcoords)
+    if (!valid)
     {
-        next_vertex_texcoord_element_index = 0;
-    }
-
-    // Let rply process the file using the callbacks we set above
-
-    num_triangles = num_quads = 0;
-
-    if (!ply_read(ply))
-    {
-        // Failed!
-        printf("Could not read PLY data!\n");
-
-        ply_close(ply);
-
+        result.set_success(false);
+        result.set_message("PLY face refers to a non-existent vertex");
         return;
     }
 
-    // Clean up PLY reader
-
-    ply_close(ply);
+    printf("%u vertices, %zu faces\n", nvertices, face_lengths.size());
 
     // Create geometry
 
@@ -317,6 +108,20 @@ load_ply_file(PluginResult &result, PluginState *state)
             ospSetObject(geometry, "index", data);
 
         ospCommit(geometry);
+
+        // For the plugin cache
+        state->cacheable.subtype = "triangles";
+        state->cacheable.add_array("vertex.position", OSP_VEC3F, nvertices, vertices.data(), mesh);
+        state->cacheable.add_array("index", OSP_VEC3UI, faces.size()/3, faces.data(), mesh);
+
+        // Allows the server to build a LOD proxy for large meshes. Only
+        // copied when the server will use it, as this doubles the mesh.
+        if (state->lod_min_primitives > 0 && faces.size()/3 >= state->lod_min_primitives)
+        {
+            state->lod_vertices = vertices;
+            state->lod_indices = faces;
+            state->lod_indices_per_primitive = 3;
+        }
     }
     else
     {
@@ -343,14 +148,48 @@ load_ply_file(PluginResult &result, PluginState *state)
             ospSetObject(geometry, "face", data);
 
         ospCommit(geometry);
+
+        state->cacheable.subtype = "subdivision";
+        state->cacheable.add_array("vertex.position", OSP_VEC3F, nvertices, vertices.data(), mesh);
+        state->cacheable.add_array("index", OSP_VEC3UI, faces.size()/3, faces.data(), mesh);
+        state->cacheable.add_array("face", OSP_UINT, face_lengths.size(), face_lengths.data(), mesh);
     }
 
     state->geometry = geometry;
 
+    // Bound: "box", "hull" (convex hull) or "simplified" (triangle meshes
+    // only). Defaults to a simplified mesh for triangle meshes, otherwise
+    // a box.
+
+    std::string bound_type = max_gon == 3 ? "simplified" : "box";
+
+    if (state->parameters.find("bound") != state->parameters.end())
+        bound_type = state->parameters["bound"].get<std::string>();
+
+    if (bound_type == "hull" && nvertices > 0)
+    {
+        state->bound = BoundingMesh::convex_hull(vertices.data(), nvertices);
+        return;
+    }
+
+    if (bound_type == "simplified" && max_gon == 3)
+    {
+        // Simplified version of the triangle mesh
+        state->bound = BoundingMesh::simplify(
+            vertices.data(), nvertices, 
+            faces.data(), faces.size()/3,
+            2000
+        );
+        return;
+    }
+
+    if (bound_type != "box")
+        printf("... WARNING: bound type '%s' not supported for this mesh, using a box\n", bound_type.c_str());
+
     // Bounding box edges based on vertices
 
     float min[3] = {1e6, 1e6, 1e6}, max[3] = {-1e6, -1e6, -1e6};
-    int i;
+    size_t i;
 
     i = 0;
     while (i < vertices.size())
@@ -373,6 +212,7 @@ static PluginParameters
 parameters = {
     
     {"file",          PARAM_STRING,    1, FLAG_NONE, "PLY file to load"},
+    {"bound",         PARAM_STRING,    1, FLAG_OPTIONAL, "Bound to show: box, hull or simplified (triangle meshes)"},
         
     PARAMETERS_DONE         // Sentinel (signals end of list)
 };
@@ -393,6 +233,7 @@ initialize(PluginDefinition *def)
 {
     def->type = PT_GEOMETRY;
     def->uses_renderer_type = false;
+    def->thread_safe = true;
     def->parameters = parameters;
     def->functions = functions;
     
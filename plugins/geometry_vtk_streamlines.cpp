@@ -19,19 +19,66 @@
 // ======================================================================== //
 
 #include <stdint.h>
+#include <algorithm>
 #include <cstdio>
 #include <vector>
 #include "config.h"
 #include "plugin.h"
+#include "parallel.h"
 
 #ifdef PLUGIN_VTK_STREAMLINES // XXX
 #include <vtkSmartPointer.h>
 #include <vtkPolyData.h>
 #include <vtkPointData.h>
+#include <vtkPointSet.h>
+#include <vtkPoints.h>
+#include <vtkIdList.h>
+#include <vtkCellType.h>
+#include <vtkFloatArray.h>
+#include <vtkDoubleArray.h>
 #include <vtkDataSetReader.h>
 #include <vtkColorTransferFunction.h>
 #endif
 
+// Number of entries in the scalar color lookup table
+static const int LUT_SIZE = 1024;
+
+// Copies the first n components of the tuples with the given IDs 
+// directly from array memory
+template<typename T>
+static void
+gather_tuples(float *dst, int n, const T *src, int num_components, const std::vector<vtkIdType>& ids)
+{
+    parallel_for(ids.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const T *tuple = src + ids[i]*num_components;
+            for (int c = 0; c < n; c++)
+                dst[n*i+c] = tuple[c];
+        }
+    });
+}
+
+static void
+gather_array(float *dst, int n, vtkDataArray *array, const std::vector<vtkIdType>& ids)
+{
+    vtkFloatArray *float_array = vtkFloatArray::SafeDownCast(array);
+    vtkDoubleArray *double_array = vtkDoubleArray::SafeDownCast(array);
+    const int num_components = array->GetNumberOfComponents();
+
+    if (float_array != nullptr)
+        gather_tuples(dst, n, float_array->GetPointer(0), num_components, ids);
+    else if (double_array != nullptr)
+        gather_tuples(dst, n, double_array->GetPointer(0), num_components, ids);
+    else
+    {
+        // Other value types, through the generic interface
+        for (size_t i = 0; i < ids.size(); i++)
+            for (int c = 0; c < n; c++)
+                dst[n*i+c] = array->GetComponent(ids[i], c);
+    }
+}
+
 extern "C"
 void
 load_file(PluginResult &result, PluginState *state)
@@ -109,75 +156,114 @@ load_file(PluginResult &result, PluginState *state)
     const vtkIdType np = dataset->GetNumberOfPoints();
     const vtkIdType nc = dataset->GetNumberOfCells();
 
-    printf("... %d points\n", np);
-    printf("... %d cells\n", nc);
+    printf("... %lld points\n", (long long)np);
+    printf("... %lld cells\n", (long long)nc);
+
+    // Stitch the line cells into polylines. In OSPRay's streamlines layout
+    // each index is the first vertex of a segment that runs to the next
+    // vertex, so the vertices of a polyline are shared by its segments. 
+    // A cell starting at the point the previous cell ended at continues
+    // the current polyline (streamlines written as separate 2-point lines
+    // are stored in order), otherwise it starts a new one.
 
-    std::vector<float>      positions;
+    std::vector<vtkIdType>  vertex_points;      // Point ID per vertex
     std::vector<uint32_t>   indices;
-    std::vector<float>      vcolors;
-    uint32_t    curindex = 0;
-    double  p[3], *col;
-    float v, f;
+    vtkIdType   last_point = -1;
+
+    vtkSmartPointer<vtkIdList> cell_points = vtkSmartPointer<vtkIdList>::New();
 
     for (vtkIdType i = 0; i < nc; i++)
     {
-        vtkCell *cell = dataset->GetCell(i);
+        const int cell_type = dataset->GetCellType(i);
 
-        if (cell->GetCellType() != VTK_LINE)
+        if (cell_type != VTK_LINE && cell_type != VTK_POLY_LINE)
         {
-            printf("Skipping cell %d, of non-line type %d\n", i, cell->GetCellType());
+            printf("Skipping cell %lld, of non-line type %d\n", (long long)i, cell_type);
             continue;
         }
 
-        if (cell->GetNumberOfPoints() != 2)
+        dataset->GetCellPoints(i, cell_points);
+        const vtkIdType n = cell_points->GetNumberOfIds();
+
+        if (n < 2)
         {
-            printf("Skipping cell %d which has %d (!= 2) points\n", i, cell->GetNumberOfPoints());
+            printf("Skipping cell %lld which has %lld (< 2) points\n", (long long)i, (long long)n);
             continue;
         }
 
-        vtkIdType pi = cell->GetPointId(0);
-        vtkIdType qi = cell->GetPointId(1);
-        
-        dataset->GetPoint(pi, p);
-        positions.push_back(p[0]);
-        positions.push_back(p[1]);
-        positions.push_back(p[2]);
+        if (cell_points->GetId(0) != last_point)
+            vertex_points.push_back(cell_points->GetId(0));
 
-        dataset->GetPoint(qi, p);
-        positions.push_back(p[0]);
-        positions.push_back(p[1]);
-        positions.push_back(p[2]);
+        for (vtkIdType j = 1; j < n; j++)
+        {
+            indices.push_back(vertex_points.size() - 1);
+            vertex_points.push_back(cell_points->GetId(j));
+        }
 
-        indices.push_back(curindex);
-        
-        curindex += 2;
+        last_point = cell_points->GetId(n-1);
+    }
+
+    const size_t nv = vertex_points.size();
 
-        if (color_by_scalars)
+    if (nv > UINT32_MAX)
+    {
+        result.set_success(false);
+        result.set_message("Too many streamline vertices for 32-bit indices");
+        return;
+    }
+
+    std::vector<float>      positions(3*nv);
+    std::vector<float>      vcolors;
+
+    vtkPointSet *point_set = vtkPointSet::SafeDownCast(dataset);
+
+    if (point_set != nullptr && point_set->GetPoints() != nullptr)
+        gather_array(positions.data(), 3, point_set->GetPoints()->GetData(), vertex_points);
+    else
+    {
+        double p[3];
+
+        for (size_t i = 0; i < nv; i++)
         {
-            v = (float)(scalar_data->GetTuple1(pi));
-            f = (v - scalar_range[0]) / scalar_value_range;
-            col = cool2warm->GetColor(f);
-            vcolors.push_back(col[0]);
-            vcolors.push_back(col[1]);
-            vcolors.push_back(col[2]);
-            vcolors.push_back(f);           // Note: alpha = normalized value
-
-            v = (float)(scalar_data->GetTuple1(qi));
-            f = (v - scalar_range[0]) / scalar_value_range;
-            col = cool2warm->GetColor(f);
-            vcolors.push_back(col[0]);
-            vcolors.push_back(col[1]);
-            vcolors.push_back(col[2]);
-            vcolors.push_back(f);
+            dataset->GetPoint(vertex_points[i], p);
+            positions[3*i+0] = p[0];
+            positions[3*i+1] = p[1];
+            positions[3*i+2] = p[2];
         }
     }
 
+    if (color_by_scalars)
+    {
+        std::vector<float> values(nv);
+        gather_array(values.data(), 1, scalar_data, vertex_points);
+
+        // Sample the transfer function once, instead of per vertex
+        std::vector<float> lut(3*LUT_SIZE);
+        cool2warm->GetTable(0.0, 1.0, LUT_SIZE, lut.data());
+
+        vcolors.resize(4*nv);
+
+        parallel_for(nv, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                const float f = (values[i] - scalar_range[0]) / scalar_value_range;
+                const float t = std::min(std::max(f, 0.0f), 1.0f);
+                const float *col = &lut[3*(int)(t*(LUT_SIZE-1) + 0.5f)];
+
+                vcolors[4*i+0] = col[0];
+                vcolors[4*i+1] = col[1];
+                vcolors[4*i+2] = col[2];
+                vcolors[4*i+3] = f;           // Note: alpha = normalized value
+            }
+        });
+    }
+
     OSPData data;
 
     OSPGeometry geometry = ospNewGeometry("streamlines");
     {
-        printf("... %d positions\n", positions.size()/3);
-        printf("... %d indices\n", indices.size());
+        printf("... %zu positions\n", positions.size()/3);
+        printf("... %zu indices\n", indices.size());
 
         data = ospNewCopiedData(positions.size()/3, OSP_VEC3F, positions.data());
         ospCommit(data);
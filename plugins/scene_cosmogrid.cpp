@@ -18,131 +18,161 @@
 // limitations under the License.                                           //
 // ======================================================================== //
 
+#include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <stdint.h>
-#include "uhdf5.h"
-
+#include <vector>
 #include "plugin.h"
+#include "hdf5_reader.h"
+#include "mesh_processing.h"
+#include "parallel.h"
 
 std::string         data_file;
-OSPGeometricModel   model;
 
-bool
-load_points(const char *renderer_type, const char *fname, int max_points, float sphere_radius, float sphere_opacity)
+// Creates a group holding a single spheres geometry of the given points
+static OSPGroup
+create_spheres_group(const char *renderer_type, const float *positions, uint32_t num_points, 
+    float sphere_radius, float sphere_opacity)
 {
-    printf("Loading %d points from %s\n", max_points, fname);
-
-    uint32_t  num_points;
-    float     *colors;  
+    OSPGeometry spheres = ospNewGeometry("spheres");
     
-    float       *positions;
-    uint32_t    *nbcounts;
+      OSPData data = ospNewCopiedData(num_points, OSP_VEC3F, positions);
+      ospCommit(data);
+      ospSetObject(spheres, "sphere.position", data);
+      ospRelease(data);
+      ospSetFloat(spheres, "radius", sphere_radius);
+      
+    ospCommit(spheres);
+  
+    // XXX renderer dependent
+    OSPMaterial material = ospNewMaterial(renderer_type, "OBJMaterial");
+        ospSetVec3f(material, "Kd", 1.0f, 0.0f, 0.0f);
+        ospSetFloat(material, "d", sphere_opacity);
+    ospCommit(material);
     
-    // Read points
+    OSPGeometricModel model = ospNewGeometricModel(spheres);
+        ospSetObjectAsData(model, "material", OSP_MATERIAL, material);
+    ospCommit(model);
+    ospRelease(material);
+    ospRelease(spheres);
     
-    h5::File        file;
-    h5::Dataset     *dset;
-    h5::Attribute   *attr;
-    h5::Type        *type;
-
-    file.open(fname);
+    OSPGroup group = ospNewGroup();
+        OSPData models = ospNewCopiedData(1, OSP_GEOMETRIC_MODEL, &model);
+        ospCommit(models);
+        ospSetObject(group, "geometry", models); 
+        ospRelease(models);
+    ospCommit(group);
     
-    // Positions
-    // XXX we actually load ALL the points, regardless of max_points
+    ospRelease(model);
+    
+    return group;
+}
 
-    dset = file.open_dataset("/positions");
+// Loads the particle positions into the state's group instances.
+// With max_points > 0 (and more particles than that) a spatially 
+// stratified subsample of max_points particles is shown, with the 
+// sphere radius scaled by (particles / max_points)^(1/3) so the total
+// sphere volume, and so the overall look, stays about the same. To 
+// bound load time and memory the subsample is taken from at most 
+// 8 * max_points particles (every n-th one in the file).
+// With full_resolution set all particles are loaded and the subsample
+// is only used during interactive rendering (PluginState::lod_groups),
+// the server swaps in the complete set when the view is idle and for
+// final renders.
+bool
+load_points(std::string& message, PluginState *state, const char *fname, 
+    int max_points, bool full_resolution, float sphere_radius, float sphere_opacity)
+{
+    const char *renderer_type = state->renderer.c_str();
 
-    h5::dimensions dims;
-    dset->get_dimensions(dims);
-    printf("N=%d: %d, %d\n", dims.size(), dims[0], dims[1]);
-    
-    num_points = dims[0];
+    printf("Loading %d points from %s\n", max_points, fname);
+
+    // Positions
+
+    HDF5Dataset dset;
 
-    type = dset->get_type();
-    printf("Dataset data class = %d, order = %d, size = %d, precision = %d, signed = %d\n",
-        type->get_class(), type->get_order(), type->get_size(), type->get_precision(), type->is_signed());
+    if (!open_hdf5_dataset(dset, fname, "/positions", message))
+        return false;
 
-    if (!type->matches<float>())
+    if (dset.dims.size() != 2 || dset.dims[1] != 3)
     {
-        printf("Type doesn't match float!\n");
-        // XXX throw error
-        exit(-1);
+        message = "Dataset /positions is not of shape N x 3";
+        return false;
     }
 
-    delete type;
+    const hsize_t total_points = dset.dims[0];
+    const bool subsample = max_points > 0 && total_points > (hsize_t)max_points;
+    hsize_t stride = 1;
 
-    positions = new float[dims[0]*dims[1]];
-    dset->read<float>(positions);
-    
-    delete dset;
-    
-    // Counts
-
-    dset = file.open_dataset("/nbcounts");
+    if (subsample && !full_resolution)
+        stride = std::max<hsize_t>(1, total_points / (8 * (hsize_t)max_points));
 
-    type = dset->get_type();
-    printf("Dataset data class = %d, order = %d, size = %d, precision = %d, signed = %d\n",
-        type->get_class(), type->get_order(), type->get_size(), type->get_precision(), type->is_signed());
+    const hsize_t read_points = (total_points + stride - 1) / stride;
 
-    if (!type->matches<uint32_t>())
+    if (read_points > UINT32_MAX)
     {
-        printf("Type doesn't match uint32_t!\n");
-        // XXX error
-        exit(-1);
+        message = "Too many points, set max_points";
+        return false;
     }
 
-    delete type;
-
-    nbcounts = new uint32_t[num_points];
-    
-    dset->read<uint32_t>(nbcounts);
-    delete dset;
-    
-    file.close();
-    
-#if 0    
-    // Set vertex colors
+    const uint32_t num_points = read_points;
     
-    colors = new float[4*num_vertices];
+    printf("... %llu points in file, reading %u (stride %llu)\n", 
+        (unsigned long long)total_points, num_points, (unsigned long long)stride);
+
+    const hsize_t start[2] = { 0, 0 };
+    const hsize_t strides[2] = { stride, 1 };
+    const hsize_t count[2] = { num_points, 3 };
+
+    std::vector<float> positions((size_t)num_points*3);
+
+    if (!read_hdf5_dataset(&positions[0], dset, start, strides, count, state, message, "Reading positions"))
+        return false;
     
-    for (int i = 0; i < num_vertices; i++)
+    dset.close();
+
+    if (!subsample)
     {
-        colors[4*i+0] = 1.0f;   //187
-        colors[4*i+1] = 0.0f;   //96
-        colors[4*i+2] = 0.0f;   //96
-        colors[4*i+3] = 1.0f;
+        state->group_instances.push_back(std::make_pair(
+            create_spheres_group(renderer_type, &positions[0], num_points, sphere_radius, sphere_opacity), 
+            glm::mat4(1.0f)));
+        state->data_size = (size_t)num_points * 3 * sizeof(float);
+        return true;
     }
-#endif
 
-    // Create spheres
-    
-    OSPGeometry spheres = ospNewGeometry("spheres");
-    
-      OSPData data = ospNewCopiedData(num_points, OSP_VEC3F, positions);
-      ospSetObject(spheres, "sphere.position", data);
-      //ospSetInt(spheres, "bytes_per_sphere", 3*sizeof(float));
-      ospSetFloat(spheres, "radius", sphere_radius);
+    state->set_progress(1.0f, "Subsampling");
 
-      //data = ospNewCopiedData(num_vertices, OSP_VEC4F, colors);
-      //ospCommit(data);
-      //ospSetData(mesh, "vertex.color", data);
-      
-    ospCommit(spheres);
-  
-    // XXX renderer dependent
-    OSPMaterial material = ospNewMaterial(renderer_type, "OBJMaterial");
-        ospSetVec3f(material, "Kd", 1.0f, 0.0f, 0.0f);
-        ospSetFloat(material, "d", sphere_opacity);
-    ospCommit(material);
-    
-    model = ospNewGeometricModel(spheres);
-        ospSetObjectAsData(model, "material", OSP_MATERIAL, material);
-    ospCommit(model);
-    ospRelease(material);
-    ospRelease(spheres);
-    
-    delete [] positions;
-    delete [] nbcounts;
+    std::vector<uint32_t> selected;
+    subsample_points(selected, &positions[0], num_points, max_points);
+
+    std::vector<float> subset(selected.size()*3);
+
+    parallel_for(selected.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            memcpy(&subset[3*i], &positions[3*(size_t)selected[i]], 3*sizeof(float));
+    });
+
+    const float subset_radius = sphere_radius * std::cbrt((double)total_points / selected.size());
+
+    printf("... Subsample of %zu points, sphere radius %.6f\n", selected.size(), subset_radius);
+
+    OSPGroup subset_group = create_spheres_group(renderer_type, &subset[0], selected.size(), 
+        subset_radius, sphere_opacity);
+
+    if (full_resolution)
+    {
+        state->group_instances.push_back(std::make_pair(
+            create_spheres_group(renderer_type, &positions[0], num_points, sphere_radius, sphere_opacity), 
+            glm::mat4(1.0f)));
+        state->lod_groups.push_back(subset_group);
+        state->data_size = (size_t)(num_points + selected.size()) * 3 * sizeof(float);
+    }
+    else
+    {
+        state->group_instances.push_back(std::make_pair(subset_group, glm::mat4(1.0f)));
+        state->data_size = selected.size() * 3 * sizeof(float);
+    }
         
     return true;
 }
@@ -182,57 +212,18 @@ generate(PluginResult &result, PluginState *state)
     if (parameters.find("sphere_opacity") != parameters.end())
         sphere_opacity = parameters["sphere_opacity"].get<float>();
 
-    GroupInstances &instances = state->group_instances;
-    
-#if 1
-    if (!load_points(state->renderer.c_str(), data_file.c_str(), max_points, sphere_radius, sphere_opacity))
+    const bool full_resolution = parameters.find("full_resolution") != parameters.end() 
+        && parameters["full_resolution"].get<int>();
+
+    std::string message;
+
+    if (!load_points(message, state, data_file.c_str(), max_points, full_resolution, sphere_radius, sphere_opacity))
     {
+        fprintf(stderr, "ERROR: %s\n", message.c_str());
         result.set_success(false);
-        result.set_message("Failed to load points from HDF5 file");
+        result.set_message("Failed to load points from HDF5 file: " + message);
         return;
     }
-#else
-    //float positions[6] = { 0, 0, 0, 1, 1, 1 };
-    float posradius[2*4] = { 0, 0, 0, 1.0f, 1, 1, 1, 1.0f };
-
-    OSPGeometry spheres = ospNewGeometry("spheres");    
-      //OSPData data = ospNewCopiedData(2, OSP_VEC3F, positions);
-      OSPData data = ospNewCopiedData(2, OSP_VEC4F, posradius);
-      ospSetData(spheres, "sphere", data);
-      //ospSetInt(spheres, "bytes_per_sphere", 3*sizeof(float));
-      ospSetInt(spheres, "offset_center", 0);
-      ospSetInt(spheres, "offset_radius", 12);
-      ospSetInt(spheres, "bytes_per_sphere", 4*sizeof(float));
-      //ospSetFloat(spheres, "radius", 0.5f);
-    ospCommit(spheres);
-
-    /*
-    OSPMaterial material = ospNewMaterial("pathtracer", "OBJMaterial");
-        ospSetVec3f(material, "Kd", 0.8f, 0.8f, 0.8f);
-    ospCommit(material);
-    */
-
-    OSPMaterial material = ospNewMaterial("pathtracer", "Luminous");
-        ospSetVec3f(material, "color", 0.8f, 0.0f, 0.0f);
-        ospSetFloat(material, "intensity", 1.0f);
-    ospCommit(material);
-    
-    model = ospNewGeometricModel(spheres);
-        ospSetObjectAsData(model, "material", OSP_MATERIAL, material);
-    ospCommit(model);
-    ospRelease(material);
-    //ospRelease(spheres);
-  #endif
-    
-    OSPGroup group = ospNewGroup();
-        OSPData models = ospNewCopiedData(1, OSP_GEOMETRIC_MODEL, &model);
-        ospCommit(models);
-        ospSetObject(group, "geometry", models); 
-        ospRelease(models);
-    ospCommit(group);
-    
-    instances.push_back(std::make_pair(group, glm::mat4(1.0f)));
-    // XXX hmm, can't release group here?    
 
     state->bound = BoundingMesh::bbox(0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, true);
 }
@@ -245,7 +236,7 @@ parameters = {
         "Path to data file"},
         
     {"max_points",        PARAM_INT,      1, FLAG_NONE, 
-        "Maximum number of points to load"},
+        "Maximum number of points to show (spatially stratified subsample, -1 for all)"},
         
     {"sphere_radius",        PARAM_FLOAT,      1, FLAG_NONE, 
         "Radius of each sphere"},
@@ -253,6 +244,9 @@ parameters = {
     {"sphere_opacity",        PARAM_FLOAT,      1, FLAG_NONE, 
         "Opacity of each sphere"},
 
+    {"full_resolution",   /*PARAM_BOOL*/ PARAM_INT, 1, FLAG_OPTIONAL, 
+        "Load all points, using the max_points subsample only during interactive rendering"},
+
     PARAMETERS_DONE         // Sentinel (signals end of list)
 };
 
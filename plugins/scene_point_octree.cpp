@@ -0,0 +1,473 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Out-of-core point cloud, with view-dependent level of detail             //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "plugin.h"
+#include "input_data_cache.h"
+#include "parallel.h"
+#include "point_octree.h"
+
+// Renders a point octree file (see point_octree.h and the bloctree tool)
+// as spheres. Before each render the nodes to show are selected for the
+// current view: starting at the root, the node with the largest projected
+// size is replaced by its children, for as long as the number of points
+// shown stays within the point budget. Nodes outside the view are kept,
+// but not refined. The points of selected nodes are used directly from
+// the memory-mapped file, nodes stay resident (as OSPRay groups) until
+// max_resident_points is exceeded, least-recently used nodes are
+// released first.
+
+struct ResidentNode
+{
+    OSPGroup    group;
+    uint32_t    last_used;      // View update counter
+};
+
+struct PointOctreeData
+{
+    PointOctree         octree;
+    const uint8_t       *file_data;         // Memory-mapped, see PluginState::shared_memory
+
+    std::string         renderer_type;
+    float               point_radius;
+    uint64_t            point_budget;
+    uint64_t            final_point_budget;
+    uint64_t            max_resident_points;
+    float               min_node_pixels;
+
+    std::map<int32_t, ResidentNode>     resident;
+    uint64_t                            resident_points;
+    uint32_t                            view_counter;
+
+    std::vector<int32_t>                selected;       // Sorted
+};
+
+// Creates a group holding the points of the given node as spheres.
+// Inner nodes hold a subsample, so their spheres are enlarged to
+// cover about the same area as the points they represent.
+static OSPGroup
+create_node_group(const PointOctreeData *data, int32_t index)
+{
+    const PointOctree& octree = data->octree;
+    const PointOctreeNode& node = octree.nodes[index];
+    const uint8_t *node_data = data->file_data + node.offset;
+
+    // Let the kernel read ahead, the pages are touched when OSPRay
+    // builds the BVH
+    const long page_size = sysconf(_SC_PAGESIZE);
+    const uintptr_t start = (uintptr_t)node_data / page_size * page_size;
+    madvise((void*)start, (uintptr_t)node_data - start + (uint64_t)node.num_points*octree.point_size(), MADV_WILLNEED);
+
+    const float radius = data->point_radius * std::cbrt((double)node.subtree_points / std::max<uint32_t>(1, node.num_points));
+
+    OSPGeometry spheres = ospNewGeometry("spheres");
+
+      OSPData positions = ospNewSharedData(node_data, OSP_VEC3F, node.num_points);
+      ospCommit(positions);
+      ospSetObject(spheres, "sphere.position", positions);
+      ospRelease(positions);
+      ospSetFloat(spheres, "radius", radius);
+
+    ospCommit(spheres);
+
+    // XXX renderer dependent
+    OSPMaterial material = ospNewMaterial(data->renderer_type.c_str(), "OBJMaterial");
+        ospSetVec3f(material, "Kd", 1.0f, 1.0f, 1.0f);
+    ospCommit(material);
+
+    OSPGeometricModel model = ospNewGeometricModel(spheres);
+        ospSetObjectAsData(model, "material", OSP_MATERIAL, material);
+
+    if (octree.has_colors)
+    {
+        const uint8_t *rgba = node_data + (uint64_t)node.num_points*12;
+        std::vector<float> colors((size_t)node.num_points*4);
+
+        parallel_for(colors.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                colors[i] = rgba[i] / 255.0f;
+        });
+
+        OSPData color_data = ospNewCopiedData(node.num_points, OSP_VEC4F, colors.data());
+        ospCommit(color_data);
+        ospSetObject(model, "color", color_data);
+        ospRelease(color_data);
+    }
+
+    ospCommit(model);
+    ospRelease(material);
+    ospRelease(spheres);
+
+    OSPGroup group = ospNewGroup();
+        OSPData models = ospNewCopiedData(1, OSP_GEOMETRIC_MODEL, &model);
+        ospCommit(models);
+        ospSetObject(group, "geometry", models);
+        ospRelease(models);
+    ospCommit(group);
+
+    ospRelease(model);
+
+    return group;
+}
+
+// Projected radius in pixels of the node's bounding sphere, or -1 when
+// the node is outside the view
+static float
+node_pixels(const PointOctreeNode& node, const PluginView& view, float object_scale)
+{
+    const glm::vec3 bmin(node.bounds[0], node.bounds[1], node.bounds[2]);
+    const glm::vec3 bmax(node.bounds[3], node.bounds[4], node.bounds[5]);
+
+    const glm::vec3 center = glm::vec3(view.object2world * glm::vec4(0.5f*(bmin+bmax), 1.0f));
+    const float radius = 0.5f * glm::length(bmax - bmin) * object_scale;
+
+    const glm::vec3 position(view.position[0], view.position[1], view.position[2]);
+    const glm::vec3 view_dir = glm::normalize(glm::vec3(view.view_dir[0], view.view_dir[1], view.view_dir[2]));
+    const glm::vec3 to_center = center - position;
+    const float tan_half_fov = std::tan(0.5f * view.fov_y * M_PI / 180.0f);
+    const float diagonal = std::sqrt(1.0f + view.aspect*view.aspect);
+
+    if (!view.perspective)
+    {
+        const float lateral = glm::length(to_center - glm::dot(to_center, view_dir)*view_dir);
+        if (lateral > 0.5f*view.height*diagonal + radius)
+            return -1.0f;
+        return radius / (0.5f*view.height) * 0.5f * view.image_height;
+    }
+
+    const float distance = glm::length(to_center);
+
+    if (distance <= radius)
+        return view.image_height;
+
+    // Cone around the view direction containing the view, widened by
+    // the angular radius of the node
+    const float half_angle = std::atan(tan_half_fov * diagonal) + std::asin(radius / distance);
+
+    if (half_angle < M_PI && glm::dot(to_center, view_dir) < distance * std::cos(half_angle))
+        return -1.0f;
+
+    return radius / (distance * tan_half_fov) * 0.5f * view.image_height;
+}
+
+// Selects the nodes to show for the given view, within the point budget
+static void
+select_nodes(std::vector<int32_t>& selected, const PointOctreeData *data, const PluginView& view)
+{
+    const PointOctree& octree = data->octree;
+    const uint64_t budget = view.final_render ? data->final_point_budget : data->point_budget;
+
+    // Uniform scale of the object, approximately
+    const float object_scale = std::cbrt(std::fabs(glm::determinant(glm::mat3(view.object2world))));
+
+    std::priority_queue<std::pair<float, int32_t>> queue;
+    uint64_t shown = octree.nodes[octree.root].num_points;
+
+    selected.clear();
+    queue.push(std::make_pair(node_pixels(octree.nodes[octree.root], view, object_scale), octree.root));
+
+    while (!queue.empty())
+    {
+        const float pixels = queue.top().first;
+        const int32_t index = queue.top().second;
+        queue.pop();
+
+        const PointOctreeNode& node = octree.nodes[index];
+        uint64_t children_points = 0;
+
+        for (int o = 0; o < 8; o++)
+            if (node.children[o] >= 0)
+                children_points += octree.nodes[node.children[o]].num_points;
+
+        if (pixels < data->min_node_pixels || children_points == 0
+            || shown - node.num_points + children_points > budget)
+        {
+            selected.push_back(index);
+            continue;
+        }
+
+        shown += children_points - node.num_points;
+
+        for (int o = 0; o < 8; o++)
+        {
+            if (node.children[o] >= 0)
+            {
+                const PointOctreeNode& child = octree.nodes[node.children[o]];
+                queue.push(std::make_pair(node_pixels(child, view, object_scale), node.children[o]));
+            }
+        }
+    }
+
+    std::sort(selected.begin(), selected.end());
+}
+
+// Releases least-recently used nodes until within max_resident_points
+static void
+evict_nodes(PointOctreeData *data)
+{
+    if (data->resident_points <= data->max_resident_points)
+        return;
+
+    std::vector<std::pair<uint32_t, int32_t>> candidates;
+
+    for (auto& kv : data->resident)
+    {
+        if (kv.second.last_used != data->view_counter)
+            candidates.push_back(std::make_pair(kv.second.last_used, kv.first));
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+
+    for (auto& c : candidates)
+    {
+        if (data->resident_points <= data->max_resident_points)
+            break;
+
+        ospRelease(data->resident[c.second].group);
+        data->resident.erase(c.second);
+        data->resident_points -= data->octree.nodes[c.second].num_points;
+    }
+}
+
+// Sets the group instances of the state to the selected nodes,
+// loading nodes that aren't resident
+static void
+show_nodes(PointOctreeData *data, PluginState *state)
+{
+    for (auto& gi : state->group_instances)
+        ospRelease(gi.first);
+    state->group_instances.clear();
+
+    data->view_counter++;
+
+    int loaded = 0;
+
+    for (int32_t index : data->selected)
+    {
+        std::map<int32_t, ResidentNode>::iterator it = data->resident.find(index);
+
+        if (it == data->resident.end())
+        {
+            ResidentNode rn;
+            rn.group = create_node_group(data, index);
+            it = data->resident.insert(std::make_pair(index, rn)).first;
+            data->resident_points += data->octree.nodes[index].num_points;
+            loaded++;
+        }
+
+        it->second.last_used = data->view_counter;
+
+        ospRetain(it->second.group);
+        state->group_instances.push_back(std::make_pair(it->second.group, glm::mat4(1.0f)));
+    }
+
+    evict_nodes(data);
+
+    // Positions are shared with the file, colors are copied as vec4f
+    state->data_size = data->resident_points * (data->octree.has_colors ? 16 : 0);
+
+    printf("... Showing %d octree nodes (%d loaded), %d resident (%llu points)\n",
+        (int)data->selected.size(), loaded, (int)data->resident.size(), (unsigned long long)data->resident_points);
+}
+
+extern "C"
+void
+generate(PluginResult &result, PluginState *state)
+{
+    const json& parameters = state->parameters;
+
+    PointOctreeData *data = new PointOctreeData;
+
+    const std::string file = parameters["file"].get<std::string>();
+
+    if (!open_point_octree(data->octree, file))
+    {
+        delete data;
+        result.set_success(false);
+        result.set_message("Could not open point octree file '" + file + "'");
+        return;
+    }
+
+    struct stat st;
+    std::shared_ptr<const void> mapping;
+
+    if (stat(file.c_str(), &st) == 0)
+        mapping = map_input_data(file, 0, st.st_size);
+
+    if (!mapping)
+    {
+        delete data;
+        result.set_success(false);
+        result.set_message("Could not map point octree file '" + file + "'");
+        return;
+    }
+
+    state->shared_memory.push_back(mapping);
+
+    data->file_data = (const uint8_t*)mapping.get();
+    data->renderer_type = state->renderer;
+    data->point_radius = parameters["point_radius"].get<float>();
+    data->point_budget = 5000000;
+    data->min_node_pixels = 64.0f;
+
+    if (parameters.find("point_budget") != parameters.end())
+        data->point_budget = parameters["point_budget"].get<int>();
+
+    data->final_point_budget = 4 * data->point_budget;
+
+    if (parameters.find("final_point_budget") != parameters.end())
+        data->final_point_budget = parameters["final_point_budget"].get<int>();
+
+    data->max_resident_points = 2 * std::max(data->point_budget, data->final_point_budget);
+
+    if (parameters.find("max_resident_points") != parameters.end())
+        data->max_resident_points = parameters["max_resident_points"].get<int>();
+
+    if (parameters.find("min_node_pixels") != parameters.end())
+        data->min_node_pixels = parameters["min_node_pixels"].get<float>();
+
+    data->resident_points = 0;
+    data->view_counter = 0;
+
+    printf("Point octree %s: %llu points, %d nodes\n", file.c_str(),
+        (unsigned long long)data->octree.num_points, (int)data->octree.nodes.size());
+
+    state->data = data;
+
+    // Until the first view update only the root is shown
+    data->selected.push_back(data->octree.root);
+    show_nodes(data, state);
+
+    const float *b = data->octree.bounds;
+    state->bound = BoundingMesh::bbox(b[0], b[1], b[2], b[3], b[4], b[5], true);
+}
+
+extern "C"
+bool
+update_view(PluginResult &result, PluginState *state, const PluginView &view)
+{
+    PointOctreeData *data = (PointOctreeData*)state->data;
+
+    if (data == nullptr || view.image_height <= 0)
+        return false;
+
+    std::vector<int32_t> selected;
+    select_nodes(selected, data, view);
+
+    if (selected == data->selected)
+        return false;
+
+    data->selected.swap(selected);
+    show_nodes(data, state);
+
+    return true;
+}
+
+extern "C"
+void
+clear_data(PluginState *state)
+{
+    PointOctreeData *data = (PointOctreeData*)state->data;
+
+    for (auto& kv : data->resident)
+        ospRelease(kv.second.group);
+
+    delete data;
+    state->data = nullptr;
+}
+
+extern "C"
+void
+query_bound(PluginResult &result, PluginState *state)
+{
+    const std::string file = state->parameters["file"].get<std::string>();
+
+    PointOctree octree;
+
+    if (!open_point_octree(octree, file))
+    {
+        result.set_success(false);
+        result.set_message("Could not open point octree file '" + file + "'");
+        return;
+    }
+
+    const float *b = octree.bounds;
+    state->bound = BoundingMesh::bbox(b[0], b[1], b[2], b[3], b[4], b[5], true);
+}
+
+static PluginParameters
+parameters = {
+
+    {"file",                PARAM_STRING,   1, FLAG_NONE,
+        "Point octree file, as built with bloctree"},
+
+    {"point_radius",        PARAM_FLOAT,    1, FLAG_NONE,
+        "Radius of the spheres at full detail"},
+
+    {"point_budget",        PARAM_INT,      1, FLAG_OPTIONAL,
+        "Maximum number of points shown during interactive rendering (default 5M)"},
+
+    {"final_point_budget",  PARAM_INT,      1, FLAG_OPTIONAL,
+        "Maximum number of points shown in final renders (default 4 x point_budget)"},
+
+    {"min_node_pixels",     PARAM_FLOAT,    1, FLAG_OPTIONAL,
+        "Nodes with a smaller projected radius (in pixels) are not refined (default 64)"},
+
+    {"max_resident_points", PARAM_INT,      1, FLAG_OPTIONAL,
+        "Number of points kept loaded, including nodes not currently shown (default 2 x the largest budget)"},
+
+    PARAMETERS_DONE         // Sentinel (signals end of list)
+};
+
+static PluginFunctions
+functions = {
+
+    NULL,           // Plugin load
+    NULL,           // Plugin unload
+
+    generate,       // Generate
+    clear_data,     // Clear data
+    query_bound,    // Query bound
+    NULL,           // Update
+    update_view,    // Update view
+};
+
+extern "C" bool
+initialize(PluginDefinition *def)
+{
+    def->type = PT_SCENE;
+    def->uses_renderer_type = true;
+    def->thread_safe = true;
+    def->parameters = parameters;
+    def->functions = functions;
+
+    return true;
+}
@@ -20,6 +20,7 @@
 
 #include <cstdio>
 #include <stdint.h>
+#include <vector>
 #include <ospray/ospray.h>
 #include <glm/matrix.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -27,6 +28,7 @@
 
 //#include "util.h"       // XXX for ...?
 #include "plugin.h"
+#include "parallel.h"
 
 using json = nlohmann::json;
 
@@ -292,8 +294,8 @@ generate(PluginResult &result, PluginState *state)
     
     printf("rbc_data_path = %s\n", rbc_data_path.c_str());
     
-    int max_rbcs = -1;
-    int max_plts = -1;
+    int64_t max_rbcs = -1;
+    int64_t max_plts = -1;
     
     if (parameters.find("num_rbcs") != parameters.end())
         max_rbcs = parameters["num_rbcs"].get<int>();
@@ -308,8 +310,6 @@ generate(PluginResult &result, PluginState *state)
     }
     
     uint32_t    num_rbc, num_plt, num_wbc;
-    float       tx, ty, tz, rx, ry, rz;
-    glm::mat4   R;
 
     char fname[1024];
     sprintf(fname, "%s/cells.bin", rbc_data_path.c_str());
@@ -323,80 +323,63 @@ generate(PluginResult &result, PluginState *state)
         return;
     }
     
-    fread(&num_rbc, sizeof(uint32_t), 1, p);
-    fread(&num_plt, sizeof(uint32_t), 1, p);
-    fread(&num_wbc, sizeof(uint32_t), 1, p);    
+    if (fread(&num_rbc, sizeof(uint32_t), 1, p) != 1
+        || fread(&num_plt, sizeof(uint32_t), 1, p) != 1
+        || fread(&num_wbc, sizeof(uint32_t), 1, p) != 1)
+    {
+        fclose(p);
+        result.set_success(false);
+        result.set_message("could not read header of cells.bin");
+        return;
+    }
     printf("On-disk scene: %d rbc, %d plt, %d wbc\n", num_rbc, num_plt, num_wbc);
 
-    // Instantiate RBCs & PLTs
-    
-    GroupInstances &instances = state->group_instances;
-    
-    if (max_rbcs == -1)
+    if (max_rbcs < 0 || max_rbcs > num_rbc)
         max_rbcs = num_rbc;
-    
-    printf("Adding %d RBCs\n", max_rbcs);    
-      
-    for (int i = 0; i < max_rbcs; i++)
-    {      
-        fread(&tx, sizeof(float), 1, p);
-        fread(&ty, sizeof(float), 1, p);
-        fread(&tz, sizeof(float), 1, p);
-        fread(&rx, sizeof(float), 1, p);
-        fread(&ry, sizeof(float), 1, p);
-        fread(&rz, sizeof(float), 1, p);
-        
-        R = glm::mat4(1.0f);
-        R = glm::translate(R, glm::vec3(tx,ty,tz));        
-        R = glm::rotate(R, glm::radians(rx), glm::vec3(1,0,0));
-        R = glm::rotate(R, glm::radians(ry), glm::vec3(0,1,0));
-        R = glm::rotate(R, glm::radians(rz), glm::vec3(0,0,1));   
-        
-        // Add instance
-        instances.push_back(std::make_pair(rbc_group, R));
-    }    
-    
-    // Skip remaining RBCs in scene file
-    
-    for (int i = 0; i < num_rbc-max_rbcs; i++)
-    {      
-        fread(&tx, sizeof(float), 1, p);
-        fread(&ty, sizeof(float), 1, p);
-        fread(&tz, sizeof(float), 1, p);
-        fread(&rx, sizeof(float), 1, p);
-        fread(&ry, sizeof(float), 1, p);
-        fread(&rz, sizeof(float), 1, p);
-    }
-    
-    if (max_plts == -1)
+    if (max_plts < 0 || max_plts > num_plt)
         max_plts = num_plt;
+
+    // Read the cell records (translation xyz, rotation xyz in degrees) 
+    // in bulk: the RBCs used, then the PLTs used, after the RBCs in
+    // the file
+
+    std::vector<float> cells(6*((size_t)max_rbcs + max_plts));
     
-    printf("Adding %d PLTs\n", max_plts);
-      
-    for (int i = 0; i < max_plts; i++)
-    {      
-        fread(&tx, sizeof(float), 1, p);
-        fread(&ty, sizeof(float), 1, p);
-        fread(&tz, sizeof(float), 1, p);
-        fread(&rx, sizeof(float), 1, p);
-        fread(&ry, sizeof(float), 1, p);
-        fread(&rz, sizeof(float), 1, p);
-
-        R = glm::mat4(1.0f);
-        R = glm::translate(R, glm::vec3(tx,ty,tz));
-        R = glm::rotate(R, glm::radians(rx), glm::vec3(1,0,0));
-        R = glm::rotate(R, glm::radians(ry), glm::vec3(0,1,0));
-        R = glm::rotate(R, glm::radians(rz), glm::vec3(0,0,1));
-        
-        /*glm::mat4 T = glm::translate(
-        glm::mat4(1.0f), glm::vec3(tx, ty, tz)
-        );*/
-        
-        // Add instance
-        instances.push_back(std::make_pair(plt_group, R));
-    }        
+    bool ok = fread(cells.data(), 6*sizeof(float), max_rbcs, p) == (size_t)max_rbcs;
+    ok = ok && fseek(p, 12 + 6*sizeof(float)*(long)num_rbc, SEEK_SET) == 0;
+    ok = ok && fread(cells.data() + 6*(size_t)max_rbcs, 6*sizeof(float), max_plts, p) == (size_t)max_plts;
     
     fclose(p);        
+
+    if (!ok)
+    {
+        result.set_success(false);
+        result.set_message("could not read cells from cells.bin");
+        return;
+    }
+
+    // Instantiate RBCs & PLTs
+
+    printf("Adding %d RBCs\n", (int)max_rbcs);    
+    printf("Adding %d PLTs\n", (int)max_plts);
+    
+    GroupInstances &instances = state->group_instances;
+    instances.resize(max_rbcs + max_plts);
+
+    parallel_for(instances.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const float *c = &cells[6*i];
+
+            glm::mat4 R(1.0f);
+            R = glm::translate(R, glm::vec3(c[0], c[1], c[2]));        
+            R = glm::rotate(R, glm::radians(c[3]), glm::vec3(1,0,0));
+            R = glm::rotate(R, glm::radians(c[4]), glm::vec3(0,1,0));
+            R = glm::rotate(R, glm::radians(c[5]), glm::vec3(0,0,1));   
+            
+            instances[i] = std::make_pair(i < (size_t)max_rbcs ? rbc_group : plt_group, R);
+        }
+    });
     
     printf("Data loaded...\n");
     
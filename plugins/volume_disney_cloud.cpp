@@ -19,182 +19,270 @@
 // ======================================================================== //
 
 #include <cstdio>
+#include <cfloat>
 #include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
 #include <ospray/ospray.h>
 #include <openvdb/openvdb.h>
 #include <openvdb/tools/Interpolation.h>
 #include "json.hpp"
+#include "parallel.h"
 #include "plugin.h"
+#include "voxels.h"
 
 using json = nlohmann::json;
 
-extern "C"
-void
-generate(PluginResult &result, PluginState *state)
+using TreeType = openvdb::FloatGrid::TreeType;
+using LeafType = TreeType::LeafNodeType;
+
+// Active tile of an internal node, i.e. a constant-valued cube of voxels
+struct Tile
 {
-    const json& parameters = state->parameters;
-    
-    // Open file
-    
-    std::string fname = parameters["file"].get<std::string>();
-    
-    // Create object
-    openvdb::io::File file(fname.c_str());
+    openvdb::Coord  origin;
+    int             dim;
+    float           value;
+};
 
-    // Open the file.  This reads the file header, but not any grids.
-    file.open();
-    
-    /*if (!f)
+static inline int
+floor_div(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// Creates an AMR volume with one 8^3 block per VDB leaf node (the finest
+// level) and a single-cell block per active tile (one coarser level per
+// tile size). Only the leaf nodes are stored, so memory and load time 
+// scale with the active part of the grid instead of its bounding box.
+// Leaves are converted in parallel.
+static OSPVolume
+create_sparse_volume(float *bbox, float *data_range, openvdb::FloatGrid::Ptr grid, PluginState *state)
+{
+    const TreeType& tree = grid->tree();
+    const openvdb::Vec3d voxel_size = grid->voxelSize();
+
+    std::vector<const LeafType*> leaves;
+    leaves.reserve(tree.leafCount());
+
+    for (TreeType::LeafCIter iter = tree.cbeginLeaf(); iter; ++iter)
+        leaves.push_back(&(*iter));
+
+    // Active tiles only, no need to visit the voxels of the leaves
+
+    std::vector<Tile> tiles;
+
+    openvdb::FloatGrid::ValueOnCIter titer = grid->cbeginValueOn();
+    titer.setMaxDepth(openvdb::FloatGrid::ValueOnCIter::LEAF_DEPTH - 1);
+
+    for (; titer; ++titer)
     {
-        char msg[1024];
-        snprintf(msg, 1024, "Could not open file '%s'", fname.c_str());
-        result.set_success(false);
-        result.set_message(msg);
-        fprintf(stderr, "ERROR: %s\n", msg);
-        return;
+        openvdb::CoordBBox tbox;
+        titer.getBoundingBox(tbox);
+        tiles.push_back({ tbox.min(), tbox.dim().x(), *titer });
     }
-    */
-    
-    // Read the density grid
-    openvdb::GridBase::Ptr baseGrid = file.readGrid("density");
-    
-    // Done with the file already
-    file.close();
-    
-    // Cast grid to floag grid
-    openvdb::FloatGrid::Ptr grid = openvdb::gridPtrCast<openvdb::FloatGrid>(baseGrid);
-    
-    /*
-    for (openvdb::MetaMap::MetaIterator iter = grid->beginMeta(); iter != grid->endMeta(); ++iter)
+
+    const size_t num_leaves = leaves.size();
+    const size_t num_tiles = tiles.size();
+
+    printf("... %zd leaf nodes, %zd active tiles\n", num_leaves, num_tiles);
+
+    if (num_leaves + num_tiles == 0)
+        return nullptr;
+
+    // Levels, coarsest first: one per tile size, then the leaves
+
+    std::map<int, int, std::greater<int>> tile_levels;
+    for (const Tile& t : tiles)
+        tile_levels[t.dim] = 0;
+
+    std::vector<float> level_cellwidth;
+    for (auto& tl : tile_levels)
     {
-        const std::string& name = iter->first;
-        openvdb::Metadata::Ptr value = iter->second;
-        std::string valueAsString = value->str();
-        std::cout << name << " = " << valueAsString << std::endl;
+        tl.second = level_cellwidth.size();
+        level_cellwidth.push_back(tl.first);
     }
-    */
 
-    //openvdb::MetaMap::Ptr metadata = grid->getMetadata("file_bbox_min");
-    auto& file_bbox_min = grid->metaValue<openvdb::Vec3i>("file_bbox_min");
-    auto& file_bbox_max = grid->metaValue<openvdb::Vec3i>("file_bbox_max");
+    const int leaf_level = level_cellwidth.size();
+    level_cellwidth.push_back(1.0f);
 
-    const openvdb::Vec3d voxel_size = grid->voxelSize();
+    // Block bounds are in each level's index space, so the (possibly 
+    // negative) voxel coordinates are shifted to a positive origin that 
+    // is aligned to the largest cell width
 
-#if 0
-    // Create AMR volume
-    
-    OSPVolume volume = ospNewVolume("amr_volume");
-    
-    ospSetInt(volume, "voxelType", OSP_FLOAT);
-    
-    float origin[3] = { 0.0f, 0.0f, 0.0f };
-    float spacing[3] = { 1.0f, 1.0f, 1.0f };
-    
-    if (parameters.find("grid_origin") != parameters.end())
+    const int align = tile_levels.empty() ? (int)LeafType::DIM : tile_levels.begin()->first;
+
+    openvdb::Coord cmin(INT32_MAX), cmax(INT32_MIN);
+
+    for (const LeafType* leaf : leaves)
     {
-        auto o = parameters["grid_origin"];
-        origin[0] = o[0];
-        origin[1] = o[1];
-        origin[2] = o[2];
+        cmin.minComponent(leaf->origin());
+        cmax.maxComponent(leaf->origin().offsetBy(LeafType::DIM));
     }
 
-    if (parameters.find("grid_spacing") != parameters.end())
+    for (const Tile& t : tiles)
     {
-        auto s = parameters["grid_spacing"];
-        spacing[0] = s[0];
-        spacing[1] = s[1];
-        spacing[2] = s[2];
+        cmin.minComponent(t.origin);
+        cmax.maxComponent(t.origin.offsetBy(t.dim));
     }
-    
-    ospSetVec3f(volume, "gridOrigin", origin[0], origin[1], origin[2]);
-    ospSetVec3f(volume, "gridSpacing", spacing[0], spacing[1], spacing[2]);
-    
-    // Iterate over leaf nodes in the volume and fill the necessary data arrays
-    
-    std::vector<float>      block_bounds;
-    std::vector<float>      block_cellwidth;
-    std::vector<float>      block_level;
-    std::vector<OSPData>    block_data;
-    OSPData                 voxel_values;
-    int                     num_leafs = 0;
-    
-    
-    using TreeType = openvdb::FloatGrid::TreeType;
-    
-    // XXX keep track of min/max range here
-    for (TreeType::LeafCIter iter = grid->tree().cbeginLeaf(); iter; ++iter) 
+
+    const openvdb::Coord shift(
+        floor_div(cmin.x(), align)*align, floor_div(cmin.y(), align)*align, floor_div(cmin.z(), align)*align);
+
+    // All block values in a single array, shared with OSPRay
+
+    const size_t leaf_values = LeafType::NUM_VALUES;
+    const size_t num_blocks = num_leaves + num_tiles;
+
+    float *values = new float[num_leaves*leaf_values + num_tiles];
+    state->shared_memory.push_back(std::shared_ptr<const void>(values, [](const void *p) { delete [] (const float*)p; }));
+    state->data_size += (num_leaves*leaf_values + num_tiles) * sizeof(float);
+
+    std::vector<int>    block_bounds(6*num_blocks);
+    std::vector<int>    block_level(num_blocks);
+
+    float minval = FLT_MAX, maxval = -FLT_MAX;
+    std::mutex range_mutex;
+
+    // VDB leaf buffers are z-fastest, OSPRay blocks x-fastest
+
+    const size_t batch = 65536;
+
+    for (size_t first = 0; first < num_leaves; first += batch)
     {
-        const TreeType::LeafNodeType& leaf = *iter;
-        
-        /*printf("--- leaf ---\n");
-        std::cout << "origin " << leaf.origin() << std::endl;
-        std::cout << "dim " << leaf.dim() << std::endl;
-        std::cout << "size " << leaf.size() << std::endl;
-        std::cout << "isDense " << leaf.isDense() << std::endl;
-        std::cout << "offLeafVoxelCount " << leaf.offLeafVoxelCount() << std::endl;*/
-        
-        const auto& buffer = leaf.buffer();
-        const float *values = buffer.data();
-        //printf("%.6f\n", values[0]);
-        
-        int D = leaf.dim();
-        const int N = D*D*D;
-        auto O = leaf.origin();
-        
-        block_bounds.push_back(O.x());
-        block_bounds.push_back(O.y());
-        block_bounds.push_back(O.z());
-        block_bounds.push_back(O.x()+D);
-        block_bounds.push_back(O.y()+D);
-        block_bounds.push_back(O.z()+D);
-        
-        block_level.push_back(0);
-        block_cellwidth.push_back(1.0f);
-        
-        voxel_values = ospNewCopiedData(N, OSP_FLOAT, values);
-        ospCommit(voxel_values);
-        
-        block_data.push_back(voxel_values);
-        
-        num_leafs++;
+        const size_t last = std::min(first + batch, num_leaves);
+
+        parallel_for(last - first, [&](size_t begin, size_t end) {
+            float lmin = FLT_MAX, lmax = -FLT_MAX;
+
+            for (size_t l = first + begin; l < first + end; l++)
+            {
+                const LeafType& leaf = *leaves[l];
+                const float *src = leaf.buffer().data();
+                float *dst = values + l*leaf_values;
+
+                for (int z = 0; z < (int)LeafType::DIM; z++)
+                    for (int y = 0; y < (int)LeafType::DIM; y++)
+                        for (int x = 0; x < (int)LeafType::DIM; x++)
+                        {
+                            const float v = src[(x << (2*LeafType::LOG2DIM)) + (y << LeafType::LOG2DIM) + z];
+                            *dst++ = v;
+                            lmin = std::min(lmin, v);
+                            lmax = std::max(lmax, v);
+                        }
+
+                const openvdb::Coord o = leaf.origin() - shift;
+                int *b = &block_bounds[6*l];
+                b[0] = o.x(); b[1] = o.y(); b[2] = o.z();
+                b[3] = o.x() + LeafType::DIM - 1;
+                b[4] = o.y() + LeafType::DIM - 1;
+                b[5] = o.z() + LeafType::DIM - 1;
+                block_level[l] = leaf_level;
+            }
+
+            std::lock_guard<std::mutex> lock(range_mutex);
+            minval = std::min(minval, lmin);
+            maxval = std::max(maxval, lmax);
+        }, 64);
+
+        state->set_progress(0.9f * last / num_leaves, "Converting leaf nodes");
+
+        if (state->canceled())
+            return nullptr;
     }
-    
-    OSPData data = ospNewCopiedData(num_leafs, OSP_DATA, &block_data[0]);
+
+    for (size_t t = 0; t < num_tiles; t++)
+    {
+        const Tile& tile = tiles[t];
+        const size_t blk = num_leaves + t;
+        const openvdb::Coord o = tile.origin - shift;
+
+        values[num_leaves*leaf_values + t] = tile.value;
+        minval = std::min(minval, tile.value);
+        maxval = std::max(maxval, tile.value);
+
+        int *b = &block_bounds[6*blk];
+        b[0] = b[3] = o.x() / tile.dim;
+        b[1] = b[4] = o.y() / tile.dim;
+        b[2] = b[5] = o.z() / tile.dim;
+        block_level[blk] = tile_levels[tile.dim];
+    }
+
+    data_range[0] = minval;
+    data_range[1] = maxval;
+
+    // One (shared) data array per block
+
+    std::vector<OSPData> block_data(num_blocks);
+
+    for (size_t l = 0; l < num_leaves; l++)
+    {
+        block_data[l] = ospNewSharedData(values + l*leaf_values, OSP_FLOAT, 
+            LeafType::DIM, 0, LeafType::DIM, 0, LeafType::DIM, 0);
+        ospCommit(block_data[l]);
+    }
+
+    for (size_t t = 0; t < num_tiles; t++)
+    {
+        block_data[num_leaves+t] = ospNewSharedData(values + num_leaves*leaf_values + t, OSP_FLOAT, 1, 0, 1, 0, 1, 0);
+        ospCommit(block_data[num_leaves+t]);
+    }
+
+    OSPVolume volume = ospNewVolume("amr");
+
+    ospSetInt(volume, "voxelType", OSP_FLOAT);
+    ospSetVec3f(volume, "gridOrigin", shift.x()*voxel_size.x(), shift.y()*voxel_size.y(), shift.z()*voxel_size.z());
+    ospSetVec3f(volume, "gridSpacing", voxel_size.x(), voxel_size.y(), voxel_size.z());
+
+    OSPData data = ospNewCopiedData(num_blocks, OSP_DATA, &block_data[0]);
     ospCommit(data);
     ospSetObject(volume, "block.data", data);
     ospRelease(data);
 
-    data = ospNewCopiedData(num_leafs, OSP_BOX3F, &block_bounds[0]);
+    for (OSPData d : block_data)
+        ospRelease(d);
+
+    data = ospNewCopiedData(num_blocks, OSP_BOX3I, &block_bounds[0]);
     ospCommit(data);
     ospSetObject(volume, "block.bounds", data);
     ospRelease(data);
 
-    data = ospNewCopiedData(num_leafs, OSP_INT, &block_level[0]);
+    data = ospNewCopiedData(num_blocks, OSP_INT, &block_level[0]);
     ospCommit(data);
     ospSetObject(volume, "block.level", data);
     ospRelease(data);
-        
-    data = ospNewCopiedData(num_leafs, OSP_FLOAT, &block_level[0]);
+
+    data = ospNewCopiedData(level_cellwidth.size(), OSP_FLOAT, &level_cellwidth[0]);
     ospCommit(data);
     ospSetObject(volume, "block.cellWidth", data);
     ospRelease(data);
-    
-    //ospSetVec2f(volume, "voxelRange", 0.0f, 1.0f);
-    
+
     ospCommit(volume);
-    
-    state->volume = volume;
-    state->volume_data_range[0] = 0.0f;
-    state->volume_data_range[1] = 1.0f;    
-    
-    float bbox[6] = { -70, -70, -70, 70, 70, 70 };
-    
-    state->bound = BoundingMesh::bbox(
-        bbox[0], bbox[1], bbox[2],
-        bbox[3], bbox[4], bbox[5]
-    );
-#else
-    // Create regular volume
+
+    bbox[0] = cmin.x()*voxel_size.x();
+    bbox[1] = cmin.y()*voxel_size.y();
+    bbox[2] = cmin.z()*voxel_size.z();
+    bbox[3] = cmax.x()*voxel_size.x();
+    bbox[4] = cmax.y()*voxel_size.y();
+    bbox[5] = cmax.z()*voxel_size.z();
+
+    return volume;
+}
+
+// Creates a structured volume covering the file's bounding box, sampling
+// the grid at every voxel (slices in parallel). Optionally quantized.
+static OSPVolume
+create_dense_volume(float *bbox, float *data_range, openvdb::FloatGrid::Ptr grid, PluginState *state)
+{
+    const json& parameters = state->parameters;
+
+    //openvdb::MetaMap::Ptr metadata = grid->getMetadata("file_bbox_min");
+    auto& file_bbox_min = grid->metaValue<openvdb::Vec3i>("file_bbox_min");
+    auto& file_bbox_max = grid->metaValue<openvdb::Vec3i>("file_bbox_max");
+
+    const openvdb::Vec3d voxel_size = grid->voxelSize();
 
     int nx = file_bbox_max.x() - file_bbox_min.x() + 1;
     int ny = file_bbox_max.y() - file_bbox_min.y() + 1;
@@ -212,14 +300,13 @@ generate(PluginResult &result, PluginState *state)
     const float origin_y = min_y * voxel_size_y;
     const float origin_z = min_z * voxel_size_z;
     
-    printf("... Volume is %zd x %zd x %zd\n", nx, ny, nz);
+    printf("... Volume is %d x %d x %d\n", nx, ny, nz);
     printf("... Voxel size %.6f, %.6f, %.6f\n", voxel_size_x, voxel_size_y, voxel_size_z);
     printf("... Origin (index-space) is %d, %d, %d\n", min_x, min_y, min_z);
     printf("... Origin (scaled index-space) is %.6f, %.6f, %.6f\n", origin_x, origin_y, origin_z);
     
     OSPVolume volume = ospNewVolume("structured_regular");
     
-    ospSetInt(volume, "voxelType", OSP_FLOAT);
     ospSetVec3i(volume, "dimensions", nx, ny, nz);
     ospSetVec3f(volume, "gridOrigin", origin_x, origin_y, origin_z);
     ospSetVec3f(volume, "gridSpacing", voxel_size_x, voxel_size_y, voxel_size_z);
@@ -228,64 +315,159 @@ generate(PluginResult &result, PluginState *state)
     //openvdb::tools::GridSampler<openvdb::FloatTree, openvdb::tools::BoxSampler> interpolator(floatGrid->constTree() , floatGrid->transform());
     //data = interpolator.wsSample(openvdb::math::Vec3d(p.x, p.y, p.z));
 
-    // Use index-space sampler instead
+    // Use index-space sampler instead, with an accessor per thread
 
     size_t datalen = (size_t)nx * ny * nz;  
     printf("... Allocating voxel data array of %zd values\n", datalen);  
 
     float *data = new float[datalen];
+    std::shared_ptr<const void> values(data, [](const void *p) { delete [] (const float*)p; });
 
-    openvdb::FloatGrid::ConstAccessor accessor = grid->getConstAccessor();
+    parallel_for(nz, [&](size_t begin, size_t end) {
+        openvdb::FloatGrid::ConstAccessor accessor = grid->getConstAccessor();
 
-    for (int k = 0; k < nz; k++)
-    {
-        for (int j = 0; j < ny; j++)
+        for (int k = begin; k < (int)end; k++)
         {
-            for (int i = 0; i < nx; i++)
+            for (int j = 0; j < ny; j++)
             {
-                const openvdb::Vec3R ijk(i+min_x, j+min_y, k+min_z);
-                data[((size_t)k*ny + j)*nx + i] = openvdb::tools::PointSampler::sample(accessor, ijk);
-            }
-        }    
-    }
+                for (int i = 0; i < nx; i++)
+                {
+                    const openvdb::Vec3R ijk(i+min_x, j+min_y, k+min_z);
+                    data[((size_t)k*ny + j)*nx + i] = openvdb::tools::PointSampler::sample(accessor, ijk);
+                }
+            }    
+        }
+    }, 1);
     
-    float min = std::numeric_limits<float>::max();
-    float max = std::numeric_limits<float>::min();
+    float min, max;
+    voxel_value_range(data, datalen, min, max);
+
+    data_range[0] = min;
+    data_range[1] = max;
 
-    for (size_t i = 0; i < datalen; i++)
+    OSPDataType voxel_type = OSP_FLOAT;
+
+    if (parameters.find("quantize") != parameters.end())
     {
-        min = std::min(min, (float)(data[i]));
-        max = std::max(max, (float)(data[i]));
-    }    
+        std::shared_ptr<const void> quantized = quantize_volume(voxel_type, data, datalen, min, max, 
+            parameters["quantize"].get<std::string>(), state->volume_value_scale, state->volume_value_offset);
+
+        if (quantized)
+            values = quantized;
+        else
+            fprintf(stderr, "WARNING: can not quantize to '%s', keeping float values\n", 
+                parameters["quantize"].get<std::string>().c_str());
+    }
+
+    state->shared_memory.push_back(values);
+    state->data_size += datalen * (voxel_type == OSP_FLOAT ? 4 : (voxel_type == OSP_UCHAR ? 1 : 2));
 
-    printf("... Data range %.6f, %.6f\n", min, max);
+    ospSetInt(volume, "voxelType", voxel_type);
 
     //OSPData voxel_data = ospNewCopiedData(datalen, OSP_FLOAT, data);
-    OSPData voxel_data = ospNewSharedData(data, OSP_FLOAT, nx, 0, ny, 0, nz, 0);
+    OSPData voxel_data = ospNewSharedData(values.get(), voxel_type, nx, 0, ny, 0, nz, 0);
     ospSetObject(volume, "voxelData", voxel_data);
     ospRelease(voxel_data);
 
-    // XXX this currently leaks the data as the array is never deleted
-    // after the shared OSP_DATA gets destroyed. 
-    //delete [] data;
-
     ospCommit(volume);
     
-    state->volume = volume;
-    state->volume_data_range[0] = 0.0f; // XXX get from file, but should be correct in this case
-    state->volume_data_range[1] = 1.0f;    
+    bbox[0] = file_bbox_min.x()*voxel_size_x;
+    bbox[1] = file_bbox_min.y()*voxel_size_y;
+    bbox[2] = file_bbox_min.z()*voxel_size_z;
+    bbox[3] = file_bbox_max.x()*voxel_size_x;
+    bbox[4] = file_bbox_max.y()*voxel_size_y;
+    bbox[5] = file_bbox_max.z()*voxel_size_z;
+
+    return volume;
+}
+
+extern "C"
+void
+generate(PluginResult &result, PluginState *state)
+{
+    const json& parameters = state->parameters;
+    
+    // Open file
+    
+    std::string fname = parameters["file"].get<std::string>();
     
-    float bbox[6] = { 
-        file_bbox_min.x()*voxel_size_x, file_bbox_min.y()*voxel_size_y, file_bbox_min.z()*voxel_size_z,
-        file_bbox_max.x()*voxel_size_x, file_bbox_max.y()*voxel_size_y, file_bbox_max.z()*voxel_size_z
-     };
+    // Create object
+    openvdb::io::File file(fname.c_str());
+
+    // Open the file.  This reads the file header, but not any grids.
+    try
+    {
+        file.open();
+    }
+    catch (const openvdb::Exception& e)
+    {
+        char msg[1024];
+        snprintf(msg, 1024, "Could not open file '%s': %s", fname.c_str(), e.what());
+        result.set_success(false);
+        result.set_message(msg);
+        fprintf(stderr, "ERROR: %s\n", msg);
+        return;
+    }
+    
+    // Read the density grid
+    openvdb::GridBase::Ptr baseGrid = file.readGrid("density");
+    
+    // Done with the file already
+    file.close();
+    
+    // Cast grid to float grid
+    openvdb::FloatGrid::Ptr grid = openvdb::gridPtrCast<openvdb::FloatGrid>(baseGrid);
+
+    if (!grid)
+    {
+        result.set_success(false);
+        result.set_message("Density grid is not a float grid");
+        return;
+    }
+    
+    /*
+    for (openvdb::MetaMap::MetaIterator iter = grid->beginMeta(); iter != grid->endMeta(); ++iter)
+    {
+        const std::string& name = iter->first;
+        openvdb::Metadata::Ptr value = iter->second;
+        std::string valueAsString = value->str();
+        std::cout << name << " = " << valueAsString << std::endl;
+    }
+    */
+
+    const bool dense = parameters.find("dense") != parameters.end() && parameters["dense"].get<int>();
+
+    float bbox[6];
+    float data_range[2];
+    OSPVolume volume;
+
+    if (dense)
+        volume = create_dense_volume(bbox, data_range, grid, state);
+    else
+    {
+        if (parameters.find("quantize") != parameters.end())
+            fprintf(stderr, "WARNING: quantize is only supported for dense volumes, ignoring\n");
+
+        volume = create_sparse_volume(bbox, data_range, grid, state);
+    }
+
+    if (volume == nullptr)
+    {
+        result.set_success(false);
+        result.set_message(state->canceled() ? "Canceled" : "Grid has no active voxels");
+        return;
+    }
+
+    printf("... Data range %.6f, %.6f\n", data_range[0], data_range[1]);
+    
+    state->volume = volume;
+    state->volume_data_range[0] = data_range[0];
+    state->volume_data_range[1] = data_range[1];
     
     state->bound = BoundingMesh::bbox(
         bbox[0], bbox[1], bbox[2],
         bbox[3], bbox[4], bbox[5]
     );
-
-#endif
 }
 
 
@@ -294,6 +476,9 @@ static PluginParameters
 parameters = {
         
     {"file",                PARAM_STRING,   1, FLAG_NONE, "File to read"},
+    {"dense",               /*PARAM_BOOL*/ PARAM_INT, 1, FLAG_OPTIONAL, 
+        "Sample the grid into a dense volume (default 0: AMR blocks of the leaf nodes)"},
+    {"quantize",            PARAM_STRING,   1, FLAG_OPTIONAL, "Store the density as uchar or ushort (dense only)"},
         
     PARAMETERS_DONE         // Sentinel (signals end of list)
 };
@@ -320,4 +505,3 @@ initialize(PluginDefinition *def)
     
     return true;
 }
-
@@ -19,15 +19,63 @@
 // ======================================================================== //
 
 #include <cstdio>
+#include <cstring>
 #include <stdint.h>
-#include "uhdf5.h"
-
+#include <memory>
 #include "plugin.h"
+#include "hdf5_reader.h"
+#include "input_data_cache.h"
+#include "voxels.h"
+
+// With time_series set the dataset parameter is a pattern with a single 
+// integer conversion (e.g. "/step%04d/density"), which is formatted
+// with the frame number. Returns false if the pattern is invalid.
+static bool
+get_dataset_name(std::string& dataset, PluginState *state)
+{
+    const json& parameters = state->parameters;
+    const std::string& pattern = parameters["dataset"];
 
-extern "C" 
-void
-generate(PluginResult &result, PluginState *state)
-{    
+    if (parameters.find("time_series") == parameters.end() || parameters["time_series"].get<int>() == 0)
+    {
+        dataset = pattern;
+        return true;
+    }
+
+    size_t pos = pattern.find('%');
+    size_t end = pos == std::string::npos ? pos : pattern.find_first_not_of("0123456789", pos+1);
+
+    if (end == std::string::npos || pattern[end] != 'd' || pattern.find('%', end) != std::string::npos)
+        return false;
+
+    char name[1024];
+    snprintf(name, 1024, pattern.c_str(), state->frame);
+
+    dataset = name;
+    state->frame_dependent = true;
+
+    return true;
+}
+
+// Volume grid to create: the opened dataset, the region of it to read
+// and the resulting dimensions, origin and spacing
+struct HDF5Grid
+{
+    std::string     file;
+    std::string     dataset;
+    HDF5Dataset     dset;
+    VoxelRegion     region;
+    int32_t         dims[3];        // Of the region
+    float           origin[3];
+    float           spacing[3];
+};
+
+// Checks the parameters, opens the dataset (reading only its shape) and
+// sets up the region to read. Used by both generate() and query_bound().
+// Returns false, with result set, on failure.
+static bool
+setup_grid(HDF5Grid& grid, PluginResult &result, PluginState *state)
+{
     const json& parameters = state->parameters;
     
     if (parameters.find("hdf5_file") == parameters.end())
@@ -35,7 +83,7 @@ generate(PluginResult &result, PluginState *state)
         fprintf(stderr, "ERROR: hdf5_file not set!\n");
         result.set_success(false);
         result.set_message("ERROR: hdf5_file not set!");
-        return;
+        return false;
     }
 
     if (parameters.find("dataset") == parameters.end())
@@ -43,69 +91,141 @@ generate(PluginResult &result, PluginState *state)
         fprintf(stderr, "ERROR: dataset not set!\n");
         result.set_success(false);
         result.set_message("ERROR: dataset not set!");
-        return;
+        return false;
     }    
 
-    const std::string& hdf5_file = parameters["hdf5_file"];
-    const std::string& dataset = parameters["dataset"];
-
-    h5::File        file;
-    h5::Dataset     *dset;
-    h5::Attribute   *attr;
-    h5::Type        *type;
+    grid.file = parameters["hdf5_file"].get<std::string>();
 
-    file.open(hdf5_file.c_str(), true);
+    if (!get_dataset_name(grid.dataset, state))
+    {
+        fprintf(stderr, "ERROR: invalid dataset pattern for time series!\n");
+        result.set_success(false);
+        result.set_message("ERROR: invalid dataset pattern for time series!");
+        return false;
+    }
 
-    dset = file.open_dataset(dataset.c_str());
+    std::string message;
 
-    // Assume Xdmf's Z,Y,X order
-    h5::dimensions dims;
-    dset->get_dimensions(dims);
-    
-    int t = dims[0];
-    dims[0] = dims[2];
-    dims[2] = t;
-    
-    printf("N=%d: %d x %d x %d\n", dims.size(), dims[0], dims[1], dims[2]);
+    if (!open_hdf5_dataset(grid.dset, grid.file, grid.dataset, message))
+    {
+        fprintf(stderr, "ERROR: %s\n", message.c_str());
+        result.set_success(false);
+        result.set_message(message);
+        return false;
+    }
 
-    if (dims.size() != 3)
+    if (grid.dset.dims.size() != 3)
     {
         fprintf(stderr, "ERROR: dataset dimension is not 3!\n");
         result.set_success(false);
         result.set_message("ERROR: dataset dimension is not 3!");
-        return;  
+        return false;  
     }
 
-    type = dset->get_type();
-    printf("Dataset data class = %d, order = %d, size = %d, precision = %d, signed = %d\n",
-        type->get_class(), type->get_order(), type->get_size(), type->get_precision(), type->is_signed());
+    // Assume Xdmf's Z,Y,X order
+    int32_t dims[3] = { (int32_t)grid.dset.dims[2], (int32_t)grid.dset.dims[1], (int32_t)grid.dset.dims[0] };
+    
+    printf("... %d x %d x %d, %d-byte values (read as float)\n", dims[0], dims[1], dims[2], (int)grid.dset.value_size);
+
+    // Region to read, the complete dataset unless a region of interest
+    // and/or stride is given
 
-    if (!type->matches<float>())
+    if (!get_voxel_region(grid.region, dims, parameters, message))
     {
-        fprintf(stderr, "ERROR: type doesn't match float!\n");
+        fprintf(stderr, "ERROR: %s\n", message.c_str());
         result.set_success(false);
-        result.set_message("ERROR: type doesn't match float!");
-        delete type;
-        return;        
+        result.set_message(message);
+        return false;
     }
 
-    delete type;
+    const json& p_origin = parameters["origin"];
+    const json& p_spacing = parameters["spacing"];
+
+    for (int i = 0; i < 3; i++)
+    {
+        grid.dims[i] = grid.region.dims[i];
+        grid.origin[i] = p_origin[i];
+        grid.spacing[i] = p_spacing[i];
+    }
+
+    grid.region.apply(grid.origin, grid.spacing);
+
+    return true;
+}
+
+extern "C" 
+void
+generate(PluginResult &result, PluginState *state)
+{    
+    const json& parameters = state->parameters;
+
+    HDF5Grid grid;
+
+    if (!setup_grid(grid, result, state))
+        return;
 
-    const int n = dims[0]*dims[1]*dims[2];
-    float *grid_field_values = new float[n];
+    HDF5Dataset& dset = grid.dset;
+    const std::string& hdf5_file = grid.file;
+    const std::string& dataset = grid.dataset;
+    const VoxelRegion& region = grid.region;
+    const int32_t *dims = grid.dims;
+    const float *origin = grid.origin;
+    const float *spacing = grid.spacing;
+
+    std::string message;
+
+    const size_t n = region.num_voxels();
     float minval, maxval;
 
-    dset->read<float>(grid_field_values);
-    
-    minval = std::numeric_limits<float>::max();
-    maxval = std::numeric_limits<float>::min();
+    // Read through the shared input data cache, so instances using the 
+    // same dataset (and region) only read it once
 
-    for (int i = 0; i < n; i++)
+    std::string key = "hdf5:" + dataset + ":float";
+
+    if (!region.is_full())
+    {
+        char s[256];
+        snprintf(s, 256, ":%d,%d,%d:%d,%d,%d:%d,%d,%d", region.roi_min[0], region.roi_min[1], region.roi_min[2],
+            region.dims[0], region.dims[1], region.dims[2], region.stride[0], region.stride[1], region.stride[2]);
+        key += s;
+    }
+
+    std::shared_ptr<const void> source = get_input_data(hdf5_file, 0, n*sizeof(float), key, 
+        [&](void *buffer) {
+            const hsize_t start[3] = { (hsize_t)region.roi_min[2], (hsize_t)region.roi_min[1], (hsize_t)region.roi_min[0] };
+            const hsize_t stride[3] = { (hsize_t)region.stride[2], (hsize_t)region.stride[1], (hsize_t)region.stride[0] };
+            const hsize_t count[3] = { (hsize_t)region.dims[2], (hsize_t)region.dims[1], (hsize_t)region.dims[0] };
+            return read_hdf5_dataset((float*)buffer, dset, start, stride, count, state, message, "Reading " + dataset);
+        });
+
+    dset.close();
+
+    if (!source)
     {
-        minval = std::min(minval, grid_field_values[i]);
-        maxval = std::max(maxval, grid_field_values[i]);
+        if (message.empty())
+            message = "could not read dataset";
+        fprintf(stderr, "ERROR: %s!\n", message.c_str());
+        result.set_success(false);
+        result.set_message("ERROR: " + message);
+        return;
     }
 
+    // The data is shared with OSPRay, unless it needs to be modified 
+    // (fill), in which case a private copy is made
+
+    std::shared_ptr<const void> values = source;
+
+    if (parameters.find("fill") != parameters.end())
+    {
+        float *copy = new float[n];
+        memcpy(copy, source.get(), n*sizeof(float));
+        values = std::shared_ptr<const void>(copy, [](const void *p) { delete [] (const float*)p; });
+    }
+
+    float *grid_field_values = (float*)values.get();
+    
+    voxel_value_range(grid_field_values, n, minval, maxval);
+
     printf("... Data range: %.6f, %.6f\n", minval, maxval);
     
     if (parameters.find("fill") != parameters.end())
@@ -121,17 +241,21 @@ generate(PluginResult &result, PluginState *state)
         
         int i, j, k;
         
+        // Fill indices are in the complete dataset, convert to the region
+        const int first = std::max(0, (min_index - region.roi_min[2] + region.stride[2] - 1) / region.stride[2]);
+        const int last = std::min((int)dims[2]-1, (max_index - region.roi_min[2]) / region.stride[2]);
+        
         // XXX oh, the horror....
         switch (axis)
         {
         case 2:
-            for (k = min_index; k <= max_index; k++)
+            for (k = first; k <= last; k++)
             {
                 for (j = 0; j < dims[1]; j++)
                 {
                     for (i = 0;  i < dims[0]; i++)
                     {
-                        grid_field_values[(k*dims[1] + j)*dims[0] + i] = value;
+                        grid_field_values[((size_t)k*dims[1] + j)*dims[0] + i] = value;
                     }
                 }
             }
@@ -139,17 +263,43 @@ generate(PluginResult &result, PluginState *state)
         }
     }
 
-    const json& p_origin = parameters["origin"];
-    const json& p_spacing = parameters["spacing"];
-
-    float origin[3] = {p_origin[0], p_origin[1], p_origin[2]};
-    float spacing[3] = {p_spacing[0], p_spacing[1], p_spacing[2]};
-
+    float range_min = minval, range_max = maxval;
+    
+    if (parameters.find("value_range") != parameters.end())
+    {
+        const json& vrange = parameters["value_range"];
+        range_min = vrange[0].get<float>();
+        range_max = vrange[1].get<float>();
+    }
+    
     OSPDataType dataType = OSP_FLOAT;
+    
+    // Optionally store the values as 8/16-bit, in which case the float 
+    // values are released after quantization
+
+    if (parameters.find("quantize") != parameters.end())
+    {
+        std::shared_ptr<const void> quantized = quantize_volume(dataType, values.get(), n, 
+            range_min, range_max, parameters["quantize"].get<std::string>(), 
+            state->volume_value_scale, state->volume_value_offset);
+            
+        if (quantized)
+        {
+            printf("... Quantized to %s\n", parameters["quantize"].get<std::string>().c_str());
+            source = values = quantized;
+        }
+        else
+            fprintf(stderr, "WARNING: can not quantize to '%s', keeping float values\n", 
+                parameters["quantize"].get<std::string>().c_str());
+    }
+    
+    if (values != source)
+        state->shared_memory.push_back(source);
+    state->shared_memory.push_back(values);
 
     OSPVolume volume = ospNewVolume("structured_regular");
     
-        OSPData voxelData = ospNewCopiedData(n, dataType, grid_field_values);   
+        OSPData voxelData = ospNewSharedData(values.get(), dataType, n);   
         ospCommit(voxelData);
     
         ospSetObject(volume, "data", voxelData);
@@ -163,19 +313,19 @@ generate(PluginResult &result, PluginState *state)
 
     ospCommit(volume);
 
+    // For the plugin cache
+
+    state->cacheable.subtype = "structured_regular";
+    state->cacheable.add_array("data", dataType, n, values.get());
+    state->cacheable.add_int("voxelType", dataType);
+    state->cacheable.add_vec3i("dimensions", dims[0], dims[1], dims[2]);
+    state->cacheable.add_vec3f("gridOrigin", origin[0], origin[1], origin[2]);
+    state->cacheable.add_vec3f("gridSpacing", spacing[0], spacing[1], spacing[2]);
+
     state->volume = volume;
     
-    if (parameters.find("value_range") != parameters.end())
-    {
-        const json& vrange = parameters["value_range"];
-        state->volume_data_range[0] = vrange[0].get<float>();
-        state->volume_data_range[1] = vrange[1].get<float>();        
-    }
-    else
-    {    
-        state->volume_data_range[0] = minval;
-        state->volume_data_range[1] = maxval;
-    }
+    state->volume_data_range[0] = range_min;
+    state->volume_data_range[1] = range_max;
     
     state->bound = BoundingMesh::bbox(
         origin[0], origin[1], origin[2],
@@ -184,6 +334,25 @@ generate(PluginResult &result, PluginState *state)
     ); 
 }
 
+extern "C" 
+void
+query_bound(PluginResult &result, PluginState *state)
+{    
+    // Only reads the dataset shape, not the data itself
+
+    HDF5Grid grid;
+
+    if (!setup_grid(grid, result, state))
+        return;
+    
+    state->bound = BoundingMesh::bbox(
+        grid.origin[0], grid.origin[1], grid.origin[2],
+        grid.origin[0]+grid.spacing[0]*grid.dims[0], 
+        grid.origin[1]+grid.spacing[1]*grid.dims[1], 
+        grid.origin[2]+grid.spacing[2]*grid.dims[2],
+        true
+    ); 
+}
 
 static PluginParameters 
 parameters = {
@@ -206,6 +375,21 @@ parameters = {
     {"value_range", PARAM_FLOAT,    2, FLAG_OPTIONAL, 
         "Data range of the volume (derived from the data if not specified)"},        
 
+    {"quantize",    PARAM_STRING,   1, FLAG_OPTIONAL, 
+        "Store the values as uchar or ushort, over the data range"},
+
+    {"roi_min",     PARAM_INT,      3, FLAG_OPTIONAL, 
+        "First voxel (x, y, z) of the region of interest to read (default 0, 0, 0)"},
+
+    {"roi_max",     PARAM_INT,      3, FLAG_OPTIONAL, 
+        "Last voxel (inclusive) of the region of interest to read (default the last voxel)"},
+
+    {"stride",      PARAM_INT,      3, FLAG_OPTIONAL, 
+        "Read every n-th voxel per axis, within the region of interest (default 1, 1, 1)"},
+
+    {"time_series", PARAM_INT,      1, FLAG_OPTIONAL, 
+        "If 1, dataset is a pattern like /step%04d/density, formatted with the frame number"},
+
     PARAMETERS_DONE         // Sentinel (signals end of list)
 };
 
@@ -217,6 +401,7 @@ functions = {
     
     generate,       // Generate    
     NULL,           // Clear data
+    query_bound,    // Query bound
 };
 
 
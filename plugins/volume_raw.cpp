@@ -18,78 +18,27 @@
 // limitations under the License.                                           //
 // ======================================================================== //
 
+#include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <stdint.h>
+#include <algorithm>
 #include <limits>
+#include <memory>
+#include <set>
+#include <vector>
 #include <ospray/ospray.h>
 #include "json.hpp"
 #include "plugin.h"
-#include "util.h"       // float_swap()
+#include "input_data_cache.h"
+#include "util.h"
+#include "volume_pyramid.h"
+#include "voxels.h"
 
 using json = nlohmann::json;
 
 // XXX check for existence of "file", "header_skip", etc. entries in parameters[]
 
-static OSPVolumetricModel
-load_as_structured(float *bbox, PluginResult &result,
-    const json &parameters, const glm::mat4 &/*object2world*/, 
-    const int32_t *dims, const std::string &voxelType, OSPDataType dataType, void *grid_field_values)
-{
-    fprintf(stderr, "... WARNING: volume loaded as structured, OSPRay currently doesn't support object-to-world transformation on it\n");
-    
-    OSPVolume volume = ospNewVolume("structured_regular");
-    
-    // XXX shared
-    OSPData voxelData = ospNewCopiedData(dims[0]*dims[1]*dims[2], dataType, grid_field_values);   
-    ospCommit(voxelData);
-    
-    ospSetObject(volume, "data", voxelData);
-    ospRelease(voxelData);
-
-    ospSetString(volume, "voxelType", voxelType.c_str());
-    ospSetVec3i(volume, "dimensions", dims[0], dims[1], dims[2]);
-    
-    float origin[3] = { 0.0f, 0.0f, 0.0f };
-    float spacing[3] = { 1.0f, 1.0f, 1.0f };
-    
-    if (parameters.find("grid_origin") != parameters.end())
-    {
-        auto o = parameters["grid_origin"];
-        origin[0] = o[0];
-        origin[1] = o[1];
-        origin[2] = o[2];
-    }
-
-    if (parameters.find("grid_spacing") != parameters.end())
-    {
-        auto s = parameters["grid_spacing"];
-        spacing[0] = s[0];
-        spacing[1] = s[1];
-        spacing[2] = s[2];
-    }
-    
-    ospSetVec3f(volume, "gridOrigin", origin[0], origin[1], origin[2]);
-    ospSetVec3f(volume, "gridSpacing", spacing[0], spacing[1], spacing[2]);
-
-    ospCommit(volume);
-    
-    OSPVolumetricModel volume_model = ospNewVolumetricModel(volume);
-    ospCommit(volume_model);
-    ospRelease(volume);
-    
-    // XXX in the unstructured load function below we pass the bbox of the UNTRANSFORMED volume
-    
-    bbox[0] = origin[0];
-    bbox[1] = origin[1];
-    bbox[2] = origin[2];
-    
-    bbox[3] = origin[0] + dims[0] * spacing[0];
-    bbox[4] = origin[1] + dims[1] * spacing[1];
-    bbox[5] = origin[2] + dims[2] * spacing[2];
-    
-    return volume_model;
-}
-
 static OSPVolumetricModel
 load_as_unstructured(
     float *bbox, PluginResult &result,
@@ -215,244 +164,555 @@ load_as_unstructured(
 }
 
 
-extern "C"
-OSPVolumetricModel
-load(float *bbox, float *data_range, PluginResult &result, const json &parameters, const glm::mat4 &object2world)
+static void
+get_grid_origin_spacing(float *origin, float *spacing, const json &parameters)
 {
-    char msg[1024];
-        
-    if (parameters.find("volume") == parameters.end() || parameters["volume"].get<std::string>() != "raw")
+    origin[0] = origin[1] = origin[2] = 0.0f;
+    spacing[0] = spacing[1] = spacing[2] = 1.0f;
+    
+    if (parameters.find("grid_origin") != parameters.end())
     {
-        fprintf(stderr, "... WARNING: volume_raw.load() called without property 'volume' set to 'raw'!\n");
+        auto o = parameters["grid_origin"];
+        origin[0] = o[0];
+        origin[1] = o[1];
+        origin[2] = o[2];
     }
+
+    if (parameters.find("grid_spacing") != parameters.end())
+    {
+        auto s = parameters["grid_spacing"];
+        spacing[0] = s[0];
+        spacing[1] = s[1];
+        spacing[2] = s[2];
+    }
+}
+
+// Origin and spacing of the region loaded, see VoxelRegion
+static void
+get_region_origin_spacing(float *origin, float *spacing, const json &parameters, const VoxelRegion& region)
+{
+    get_grid_origin_spacing(origin, spacing, parameters);
+    region.apply(origin, spacing);
+}
+
+// The region to load, from the roi_min, roi_max and stride parameters
+static bool
+get_region(VoxelRegion& region, const json &parameters, std::string& message)
+{
+    const int32_t dims[3] = {
+        parameters["dimensions"][0].get<int>(),
+        parameters["dimensions"][1].get<int>(),
+        parameters["dimensions"][2].get<int>()
+    };
     
-    // Dimensions
-    
-    int32_t dims[3];            // XXX why int and not uint?
-    uint32_t num_grid_points;
+    return get_voxel_region(region, dims, parameters, message);
+}
+
+// The grid values are shared with OSPRay, not copied, so need to 
+// stay alive as long as the volume
+static OSPVolume
+create_volume(float *bbox, 
+    const float *origin, const float *spacing, const int32_t *dims, OSPDataType dataType, 
+    const void *grid_field_values)
+{
+    OSPVolume volume = ospNewVolume("structured_regular");
     
-    dims[0] = parameters["dimensions"][0];
-    dims[1] = parameters["dimensions"][1];
-    dims[2] = parameters["dimensions"][2];
+        OSPData voxelData = ospNewSharedData(grid_field_values, dataType, (size_t)dims[0]*dims[1]*dims[2]);   
+        ospCommit(voxelData);
     
-    num_grid_points = dims[0] * dims[1] * dims[2];
+        ospSetObject(volume, "data", voxelData);
+        ospRelease(voxelData);
+
+        ospSetInt(volume, "voxelType", dataType);
+        ospSetVec3i(volume, "dimensions", dims[0], dims[1], dims[2]);
     
-    // Open file
+        ospSetVec3f(volume, "gridOrigin", origin[0], origin[1], origin[2]);
+        ospSetVec3f(volume, "gridSpacing", spacing[0], spacing[1], spacing[2]);
+
+    ospCommit(volume);
     
-    std::string fname = parameters["file"].get<std::string>();
+    // bbox of the UNTRANSFORMED volume
     
-    FILE *f = fopen(fname.c_str(), "rb");
-    if (!f)
-    {
-        snprintf(msg, 1024, "Could not open file '%s'", fname.c_str());
-        result.set_success(false);
-        result.set_message(msg);
-        fprintf(stderr, "... %s\n", msg);
-        return NULL;
-    }
-
-    // XXX check return value?
-    fseek(f, parameters["header_skip"].get<int>(), SEEK_SET);
+    bbox[0] = origin[0];
+    bbox[1] = origin[1];
+    bbox[2] = origin[2];
     
-    // Prepare data array and read data from file
+    bbox[3] = origin[0] + dims[0] * spacing[0];
+    bbox[4] = origin[1] + dims[1] * spacing[1];
+    bbox[5] = origin[2] + dims[2] * spacing[2];    
     
-    OSPDataType dataType;
-    void *grid_field_values;
-    uint32_t read_size;
+    return volume;
+}
+
+// Creates an AMR volume (single level) of only the blocks of 
+// sparse_block_size^3 voxels holding values in the sparse_range 
+// parameter, or above the sparse_threshold parameter. The blocks 
+// are copied as float values (the only type AMR volumes support), 
+// the original grid values are no longer needed afterwards.
+// Returns nullptr when no block is occupied.
+static OSPVolume
+create_sparse_volume(float *bbox, 
+    const float *origin, const float *spacing, const int32_t *dims, OSPDataType dataType, 
+    const void *grid_field_values, const json& parameters, PluginState *state)
+{
+    int32_t block_size = 16;
+    float minval, maxval;
     
-    std::string voxelType = parameters["voxel_type"].get<std::string>();    // XXX rename parameter?
+    if (parameters.find("sparse_block_size") != parameters.end())
+        block_size = std::max(1, parameters["sparse_block_size"].get<int>());
     
-    if (voxelType == "uchar")
+    if (parameters.find("sparse_range") != parameters.end())
     {
-        grid_field_values = new uint8_t[num_grid_points];
-        dataType = OSP_UCHAR;
-        read_size = num_grid_points;
+        minval = parameters["sparse_range"][0].get<float>();
+        maxval = parameters["sparse_range"][1].get<float>();
     }
-    else if (voxelType == "ushort")
-    {
-        grid_field_values = new uint16_t[num_grid_points];
-        dataType = OSP_USHORT;
-        read_size = num_grid_points*sizeof(uint16_t);
-    }    
-    else if (voxelType == "float")
+    else
     {
-        grid_field_values = new float[num_grid_points];
-        dataType = OSP_FLOAT;
-        read_size = num_grid_points*sizeof(float);
+        // Values above the threshold
+        minval = std::nextafter(parameters["sparse_threshold"].get<float>(), std::numeric_limits<float>::max());
+        maxval = std::numeric_limits<float>::max();
     }
-    else 
+    
+    std::vector<VoxelBlock> blocks = find_voxel_blocks(grid_field_values, dataType, dims, block_size, minval, maxval);
+    
+    const size_t num_blocks = blocks.size();
+    const size_t total_blocks = (size_t)((dims[0]+block_size-1)/block_size) 
+        * ((dims[1]+block_size-1)/block_size) * ((dims[2]+block_size-1)/block_size);
+    
+    printf("... Keeping %zu of %zu blocks of %d^3 voxels (%.1f%%)\n", num_blocks, total_blocks, block_size,
+        100.0f * num_blocks / total_blocks);
+    
+    if (num_blocks == 0)
+        return nullptr;
+    
+    // All block values in a single array, shared with OSPRay
+    
+    std::vector<size_t> block_offset(num_blocks+1);
+    
+    block_offset[0] = 0;
+    for (size_t b = 0; b < num_blocks; b++)
+        block_offset[b+1] = block_offset[b] + (size_t)blocks[b].dims[0]*blocks[b].dims[1]*blocks[b].dims[2];
+    
+    float *values = new float[block_offset[num_blocks]];
+    state->shared_memory.push_back(std::shared_ptr<const void>(values, [](const void *p) { delete [] (const float*)p; }));
+    state->data_size += block_offset[num_blocks] * sizeof(float);
+    
+    std::vector<int32_t> block_bounds(6*num_blocks);
+    
+    parallel_for(num_blocks, [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; b++)
+        {
+            const VoxelBlock& block = blocks[b];
+            
+            gather_voxel_block(values + block_offset[b], grid_field_values, dataType, dims, block);
+            
+            for (int i = 0; i < 3; i++)
+            {
+                block_bounds[6*b+i] = block.origin[i];
+                block_bounds[6*b+3+i] = block.origin[i] + block.dims[i] - 1;
+            }
+        }
+    }, 16);
+    
+    std::vector<OSPData> block_data(num_blocks);
+    std::vector<int32_t> block_level(num_blocks, 0);
+    const float cell_width = 1.0f;
+    
+    for (size_t b = 0; b < num_blocks; b++)
     {
-        snprintf(msg, 1024, "ERROR: unhandled voxel data type '%s'!\n", voxelType.c_str());
-        result.set_success(false);
-        result.set_message(msg);
-        fprintf(stderr, "... %s\n", msg);
-        fclose(f);
-        return NULL;
+        const VoxelBlock& block = blocks[b];
+        block_data[b] = ospNewSharedData(values + block_offset[b], OSP_FLOAT, 
+            block.dims[0], 0, block.dims[1], 0, block.dims[2], 0);
+        ospCommit(block_data[b]);
     }
     
-    // XXX check bytes read
-    fread(grid_field_values, 1, read_size, f);   
+    OSPVolume volume = ospNewVolume("amr");
     
-    fclose(f);
+        ospSetInt(volume, "voxelType", OSP_FLOAT);
+        ospSetVec3f(volume, "gridOrigin", origin[0], origin[1], origin[2]);
+        ospSetVec3f(volume, "gridSpacing", spacing[0], spacing[1], spacing[2]);
     
-    // Endian-flip if needed
+        OSPData data = ospNewCopiedData(num_blocks, OSP_DATA, &block_data[0]);
+        ospCommit(data);
+        ospSetObject(volume, "block.data", data);
+        ospRelease(data);
+        
+        for (OSPData d : block_data)
+            ospRelease(d);
+    
+        data = ospNewCopiedData(num_blocks, OSP_BOX3I, &block_bounds[0]);
+        ospCommit(data);
+        ospSetObject(volume, "block.bounds", data);
+        ospRelease(data);
+    
+        data = ospNewCopiedData(num_blocks, OSP_INT, &block_level[0]);
+        ospCommit(data);
+        ospSetObject(volume, "block.level", data);
+        ospRelease(data);
+    
+        data = ospNewCopiedData(1, OSP_FLOAT, &cell_width);
+        ospCommit(data);
+        ospSetObject(volume, "block.cellWidth", data);
+        ospRelease(data);
 
-    if (parameters.find("endian_flip") != parameters.end() && parameters["endian_flip"].get<int>())
+    ospCommit(volume);
+    
+    // bbox of the UNTRANSFORMED volume, same as the dense volume
+    
+    bbox[0] = origin[0];
+    bbox[1] = origin[1];
+    bbox[2] = origin[2];
+    
+    bbox[3] = origin[0] + dims[0] * spacing[0];
+    bbox[4] = origin[1] + dims[1] * spacing[1];
+    bbox[5] = origin[2] + dims[2] * spacing[2];    
+    
+    return volume;
+}
+
+// Per-instance data, used for in-place updates of the voxel values
+struct RawVolumeData
+{
+    std::shared_ptr<const void> source;     // As read from file (shared through the input data cache), null when mapped
+    std::shared_ptr<const void> values;     // Used by the volume
+};
+
+static bool
+values_need_modification(const json& parameters)
+{
+    return (parameters.find("endian_flip") != parameters.end() && parameters["endian_flip"].get<int>())
+        || parameters.find("value_scale") != parameters.end()
+        || parameters.find("value_offset") != parameters.end();
+}
+
+// Applies endian flip and value mapping (if requested) to the values, in place,
+// in a single pass that also derives the data range (unless given).
+// Returns the data range of the values before mapping.
+static void
+transform_values(float& minval, float& maxval, void *grid_field_values,
+    const json& parameters, OSPDataType dataType, size_t num_grid_points)
+{
+    VoxelProcessing processing;
+    
+    processing.endian_flip = parameters.find("endian_flip") != parameters.end() && parameters["endian_flip"].get<int>();
+    
+    if (parameters.find("value_scale") != parameters.end())
     {
-        if (voxelType == "float")
-        {
-            float *falues = (float*)grid_field_values;
-            for (int i = 0; i < num_grid_points; i++)
-                falues[i] = float_swap(falues[i]);        
-        }
-        else if (voxelType == "ushort")
-        {
-            uint16_t *falues = (uint16_t*)grid_field_values;
-            for (int i = 0; i < num_grid_points; i++)
-                falues[i] = uint16_swap(falues[i]);    
-        }
-        else
-        {
-            fprintf(stderr, "... WARNING: no endian flip available for data type '%s'!\n", voxelType.c_str());
-        }
+        processing.value_scale = parameters["value_scale"].get<float>();    
+        processing.map_values = true;
     }
-
-    // Set up volume object
     
-    OSPVolumetricModel volume_model;
+    if (parameters.find("value_offset") != parameters.end())
+    {
+        processing.value_offset = parameters["value_offset"].get<float>();
+        processing.map_values = true;
+    }
     
-    if (parameters.find("make_unstructured") != parameters.end() && parameters["make_unstructured"].get<int>())
+    if (parameters.find("data_range") != parameters.end())
     {
-        // We support using an unstructured volume for now, as we can transform its
-        // vertices with the object2world matrix, as volumes currently don't
-        // support affine transformations in ospray themselves.
-        volume_model = load_as_unstructured(  
-                    bbox, result,
-                    parameters, object2world, 
-                    dims, voxelType, dataType, grid_field_values);
+        minval = parameters["data_range"][0];
+        maxval = parameters["data_range"][1];
+        processing.compute_range = false;
+        
+        printf("... User-provided input data range %.6f, %.6f\n", minval, maxval);
     }
     else
+        printf("... No data range, provided, deriving from voxel data\n");
+    
+    if (processing.map_values)
+        printf("... Mapping values with scale %.6f, offset %.6f\n", processing.value_scale, processing.value_offset);
+    
+    process_voxels(dataType, grid_field_values, num_grid_points, processing, minval, maxval);
+    
+    if (processing.compute_range)
+        printf("... Input data range derived from data %.6f, %.6f\n", minval, maxval);
+    
+    if (processing.map_values)
     {
-        volume_model = load_as_structured(
-                    bbox, result,
-                    parameters, object2world, 
-                    dims, voxelType, dataType, grid_field_values);
+        // XXX will be in wrong order when value_scale < 0
+        printf("... Mapped range %.6f %.6f\n", 
+            minval*processing.value_scale+processing.value_offset, 
+            maxval*processing.value_scale+processing.value_offset);
     }
+}
+
+// Sets up the voxel values to use. When possible the file is memory-mapped
+// and used by OSPRay directly: read-only when the values are used as-is, 
+// or as a private (copy-on-write) mapping when they need to be modified 
+// (endian flip, value mapping), which is then done in place. Both avoid 
+// reading the file up front and keep a single copy of the data.
+// Otherwise (e.g. a header size not a multiple of the value size, or a 
+// short file) the data is read through the input data cache, which is 
+// returned in source, and modified on a private copy.
+// A region of interest (or subsampled volume) is copied out of a read-only 
+// mapping of the file, touching only the parts of the file needed.
+// The data range returned is that of the values before mapping.
+static std::shared_ptr<const void>
+load_values(float& minval, float& maxval, std::shared_ptr<const void>& source, 
+    const json& parameters, const std::string& fname, uint64_t offset, 
+    const std::string& voxelType, OSPDataType dataType, uint32_t value_size, const VoxelRegion& region, 
+    PluginState *state)
+{
+    const size_t num_grid_points = region.num_voxels();
+    const uint64_t size = (uint64_t)num_grid_points * value_size;
+    const bool modify = values_need_modification(parameters);
     
-    if (!volume_model)
+    std::shared_ptr<const void> values;
+    
+    if (!region.is_full())
     {
-        fprintf(stderr, "Volume preparation failed!\n");
-        return NULL;
+        const uint64_t full_size = (uint64_t)region.full_dims[0] * region.full_dims[1] * region.full_dims[2] * value_size;
+        
+        std::shared_ptr<const void> mapping = map_input_data(fname, offset, full_size);
+        
+        if (!mapping)
+            return nullptr;
+        
+        void *buffer;
+        
+        if (posix_memalign(&buffer, 64, std::max<uint64_t>(size, 1)) != 0)
+            return nullptr;
+        
+        printf("... Loading region %d x %d x %d at (%d, %d, %d), stride (%d, %d, %d)\n",
+            region.dims[0], region.dims[1], region.dims[2], 
+            region.roi_min[0], region.roi_min[1], region.roi_min[2],
+            region.stride[0], region.stride[1], region.stride[2]);
+        
+        gather_voxel_region(buffer, mapping.get(), region, value_size);
+        
+        values = std::shared_ptr<const void>(buffer, [](const void *p) { free(const_cast<void*>(p)); });
+        source = nullptr;
     }
+    else if (offset % value_size == 0)
+        values = map_input_data(fname, offset, size, modify);
     
-    if (parameters.find("data_range") != parameters.end())
+    if (values)
     {
-        float minval = parameters["data_range"][0];
-        float maxval = parameters["data_range"][1];
-        ospSetVec2f(volume_model, "voxelRange", minval, maxval);
-        
-        data_range[0] = minval;
-        data_range[1] = maxval;
+        if (region.is_full())
+            printf("... Mapped %s (%s)\n", fname.c_str(), modify ? "private, modified in place" : "read-only");
+        source = nullptr;
     }
     else
     {
-        // XXX
-        data_range[0] = 0.0f;
-        data_range[1] = 1.0f;
+        source = read_input_data(fname, offset, size, voxelType, state);
+        
+        if (!source)
+            return nullptr;
+        
+        values = source;
+        
+        if (modify)
+        {
+            uint8_t *copy = new uint8_t[size];
+            memcpy(copy, source.get(), size);
+            values = std::shared_ptr<const void>(copy, [](const void *p) { delete [] (const uint8_t*)p; });
+        }
     }
+    
+    transform_values(minval, maxval, const_cast<void*>(values.get()), parameters, dataType, num_grid_points);
+    
+    return values;
+}
 
-    ospCommit(volume_model);
+// Quantizes float or double values to the type given by the quantize
+// parameter, over the range of the values (after value mapping). Sets 
+// dataType and the value scale and offset (see PluginState) on success.
+static std::shared_ptr<const void>
+quantize_values(OSPDataType& dataType, const std::shared_ptr<const void>& values, 
+    float minval, float maxval, const json& parameters, size_t num_grid_points, 
+    float& value_scale, float& value_offset)
+{
+    if (values_need_modification(parameters))
+    {
+        const float scale = parameters.find("value_scale") != parameters.end() ? parameters["value_scale"].get<float>() : 1.0f;
+        const float offset = parameters.find("value_offset") != parameters.end() ? parameters["value_offset"].get<float>() : 0.0f;
+        
+        minval = minval * scale + offset;
+        maxval = maxval * scale + offset;
+        
+        if (minval > maxval)
+            std::swap(minval, maxval);
+    }
+    
+    std::shared_ptr<const void> quantized = quantize_volume(dataType, values.get(), num_grid_points,
+        minval, maxval, parameters["quantize"].get<std::string>(), value_scale, value_offset);
     
-    return volume_model;
+    if (quantized)
+        printf("... Quantized values to %s over range %.6f, %.6f\n", parameters["quantize"].get<std::string>().c_str(), minval, maxval);
+    else
+        printf("... WARNING: can't quantize to '%s' (only float and double data to uchar or ushort)\n", parameters["quantize"].get<std::string>().c_str());
+    
+    return quantized;
 }
 
+// Loads the given pyramid level and creates a volume from it, with the
+// spacing scaled to the level's resolution. Value mapping is applied as
+// for the raw file (the pyramid already holds byte-swapped values).
+// Unless data_range is given, values are mapped and quantized over the 
+// pyramid's global data range, so all levels share value_scale and 
+// value_offset. The values are kept alive in the state's shared memory.
 static OSPVolume
-create_volume(float *bbox, 
-    const json &parameters, const int32_t *dims, OSPDataType dataType, 
-    void *grid_field_values)
+create_volume_from_pyramid_level(float& minval, float& maxval, float& value_scale, float& value_offset,
+    const VolumePyramid& pyramid, int level, const json& parameters, PluginState *state)
 {
-    float origin[3] = { 0.0f, 0.0f, 0.0f };
-    float spacing[3] = { 1.0f, 1.0f, 1.0f };
+    const VolumePyramidLevel& l = pyramid.levels[level];
+    const int32_t dims[3] = { (int32_t)l.dims[0], (int32_t)l.dims[1], (int32_t)l.dims[2] };
+    const float scale = (float)(1 << level);
     
-    if (parameters.find("grid_origin") != parameters.end())
+    printf("... Using pyramid level %d (%d x %d x %d)\n", level, dims[0], dims[1], dims[2]);
+    
+    std::shared_ptr<const void> values = read_volume_pyramid_level(pyramid, level, state);
+    
+    if (!values)
+        return nullptr;
+    
+    float origin[3], spacing[3];
+    get_grid_origin_spacing(origin, spacing, parameters);
+    
+    for (int i = 0; i < 3; i++)
+        spacing[i] *= scale;
+    
+    json level_parameters = parameters;
+    level_parameters["endian_flip"] = 0;
+    
+    if (level_parameters.find("data_range") == level_parameters.end())
+        level_parameters["data_range"] = { pyramid.data_range[0], pyramid.data_range[1] };
+    
+    const size_t num_grid_points = (size_t)dims[0]*dims[1]*dims[2];
+    OSPDataType dataType = pyramid.voxel_type;
+    
+    transform_values(minval, maxval, const_cast<void*>(values.get()), level_parameters, 
+        dataType, num_grid_points);
+    
+    if (parameters.find("quantize") != parameters.end())
     {
-        auto o = parameters["grid_origin"];
-        origin[0] = o[0];
-        origin[1] = o[1];
-        origin[2] = o[2];
+        std::shared_ptr<const void> quantized = quantize_values(dataType, values, 
+            minval, maxval, level_parameters, num_grid_points, value_scale, value_offset);
+        
+        if (quantized)
+            values = quantized;
     }
+    
+    state->shared_memory.push_back(values);
+    state->data_size += num_grid_points * (dataType == pyramid.voxel_type ? pyramid.value_size : (dataType == OSP_UCHAR ? 1 : 2));
+    
+    float bbox[6];
+    
+    return create_volume(bbox, origin, spacing, dims, dataType, values.get());
+}
 
-    if (parameters.find("grid_spacing") != parameters.end())
+// Pyramid mode: the volume is taken from a multi-resolution pyramid file
+// built from the raw file (see the blpyramid tool). The finest level that 
+// fits in pyramid_max_memory (if given) is used as the volume, and a 
+// coarse level as lower-resolution volume for interactive rendering.
+static void
+generate_from_pyramid(PluginResult &result, PluginState *state, const int32_t *dims, OSPDataType dataType)
+{
+    const json& parameters = state->parameters;
+    const std::string fname = parameters["pyramid"].get<std::string>();
+    
+    char msg[1024];
+    VolumePyramid pyramid;
+    
+    if (!open_volume_pyramid(pyramid, fname))
     {
-        auto s = parameters["grid_spacing"];
-        spacing[0] = s[0];
-        spacing[1] = s[1];
-        spacing[2] = s[2];
+        snprintf(msg, 1024, "Could not open volume pyramid '%s'", fname.c_str());
+        result.set_success(false);
+        result.set_message(msg);
+        return;
     }
     
-    OSPVolume volume = ospNewVolume("structured_regular");
+    const VolumePyramidLevel& full = pyramid.levels[0];
     
-        OSPData voxelData = ospNewCopiedData(dims[0]*dims[1]*dims[2], dataType, grid_field_values);   
-        ospCommit(voxelData);
+    if (pyramid.voxel_type != dataType 
+        || (int32_t)full.dims[0] != dims[0] || (int32_t)full.dims[1] != dims[1] || (int32_t)full.dims[2] != dims[2])
+    {
+        snprintf(msg, 1024, "Volume pyramid '%s' does not match the dimensions and voxel type", fname.c_str());
+        result.set_success(false);
+        result.set_message(msg);
+        fprintf(stderr, "... ERROR: %s\n", msg);
+        return;
+    }
     
-        ospSetObject(volume, "data", voxelData);
-        ospRelease(voxelData);
-
-        ospSetInt(volume, "voxelType", dataType);
-        ospSetVec3i(volume, "dimensions", dims[0], dims[1], dims[2]);
+    const int num_levels = pyramid.levels.size();
     
-        ospSetVec3f(volume, "gridOrigin", origin[0], origin[1], origin[2]);
-        ospSetVec3f(volume, "gridSpacing", spacing[0], spacing[1], spacing[2]);
-
-    ospCommit(volume);
+    int level = 0;
     
-    // bbox of the UNTRANSFORMED volume
+    if (parameters.find("pyramid_level") != parameters.end())
+        level = std::max(0, std::min(num_levels-1, parameters["pyramid_level"].get<int>()));
     
-    bbox[0] = origin[0];
-    bbox[1] = origin[1];
-    bbox[2] = origin[2];
+    if (parameters.find("pyramid_max_memory") != parameters.end())
+    {
+        const uint64_t max_memory = parameters["pyramid_max_memory"].get<float>() * 1024 * 1024;
+        
+        while (level+1 < num_levels && pyramid.level_size(level) > max_memory)
+            level++;
+    }
     
-    bbox[3] = origin[0] + dims[0] * spacing[0];
-    bbox[4] = origin[1] + dims[1] * spacing[1];
-    bbox[5] = origin[2] + dims[2] * spacing[2];    
+    // Preview level: the finest level (coarser than the one used) of at 
+    // most pyramid_preview_voxels voxels
     
-    return volume;
-}
-
-
-
-template <typename T>
-void get_value_range(const T* values, int n, float& minval, float& maxval)
-{
-    float min = std::numeric_limits<float>::max();
-    float max = std::numeric_limits<float>::min();
-
-    for (int i = 0; i < n; i++)
+    uint64_t preview_voxels = 256*256*256;
+    
+    if (parameters.find("pyramid_preview_voxels") != parameters.end())
+        preview_voxels = parameters["pyramid_preview_voxels"].get<float>();
+    
+    int preview_level = level+1;
+    
+    while (preview_level+1 < num_levels 
+        && pyramid.level_size(preview_level) / pyramid.value_size > preview_voxels)
+        preview_level++;
+    
+    float minval, maxval;
+    
+    state->volume = create_volume_from_pyramid_level(minval, maxval, 
+        state->volume_value_scale, state->volume_value_offset, pyramid, level, parameters, state);
+    
+    if (state->volume == nullptr)
     {
-        min = std::min(min, (float)(values[i]));
-        max = std::max(max, (float)(values[i]));
-    }    
-
-    minval = min;
-    maxval = max;
-}
+        if (state->canceled())
+            snprintf(msg, 1024, "Canceled");
+        else
+            snprintf(msg, 1024, "Could not read level %d of volume pyramid '%s'", level, fname.c_str());
+        result.set_success(false);
+        result.set_message(msg);
+        fprintf(stderr, "... ERROR: %s\n", msg);
+        return;
+    }
+    
+    if (preview_level < num_levels)
+    {
+        // Stored values of both levels must map to the same original values
+        float preview_minval, preview_maxval;
+        float preview_value_scale = 1.0f, preview_value_offset = 0.0f;
 
-template <typename T>
-void convert_to_float(float *float_values, const T* values, int n)
-{
-    for (int i = 0; i < n; i++)
-        float_values[i] = (float)(values[i]);
-}
+        state->lod_volume = create_volume_from_pyramid_level(preview_minval, preview_maxval, 
+            preview_value_scale, preview_value_offset, pyramid, preview_level, parameters, state);
 
-template <typename T>
-void map_values(T* values, int n, float scale, float offset)
-{
-    float m;
-    for (int i = 0; i < n; i++)
-    {
-        m = (float)(values[i]) * scale + offset;
-        values[i] = (T)m;
+        if (state->lod_volume != nullptr 
+            && (preview_value_scale != state->volume_value_scale || preview_value_offset != state->volume_value_offset))
+        {
+            printf("... WARNING: preview level quantized differently, not using it\n");
+            ospRelease(state->lod_volume);
+            state->lod_volume = nullptr;
+        }
     }
+    
+    state->volume_data_range[0] = minval;
+    state->volume_data_range[1] = maxval;
+    
+    // Bound of the full-resolution volume
+    
+    float origin[3], spacing[3];
+    get_grid_origin_spacing(origin, spacing, parameters);
+    
+    state->bound = BoundingMesh::bbox(
+        origin[0], origin[1], origin[2],
+        origin[0] + dims[0] * spacing[0], 
+        origin[1] + dims[1] * spacing[1], 
+        origin[2] + dims[2] * spacing[2],
+        true
+    );
 }
 
 extern "C"
@@ -466,217 +726,141 @@ generate(PluginResult &result, PluginState *state)
     // Dimensions
     
     int32_t dims[3];            // XXX why int and not uint?
-    uint32_t num_grid_points;
+    size_t num_grid_points;
     
     dims[0] = parameters["dimensions"][0];
     dims[1] = parameters["dimensions"][1];
     dims[2] = parameters["dimensions"][2];
     
-    num_grid_points = dims[0] * dims[1] * dims[2];
-
-    printf("... %d x %d x %d (%d values)\n", dims[0], dims[1], dims[2], num_grid_points);
+    printf("... %d x %d x %d (%zu values)\n", dims[0], dims[1], dims[2], (size_t)dims[0] * dims[1] * dims[2]);
     
-    // Open file
+    // Region to load, the complete volume unless a region of interest
+    // and/or stride is given
     
-    std::string fname = parameters["file"].get<std::string>();
+    VoxelRegion region;
+    std::string message;
     
-    FILE *f = fopen(fname.c_str(), "rb");
-    if (!f)
+    if (!get_region(region, parameters, message))
     {
-        snprintf(msg, 1024, "Could not open file '%s'", fname.c_str());
         result.set_success(false);
-        result.set_message(msg);
-        fprintf(stderr, "... ERROR: %s\n", msg);
+        result.set_message(message);
+        fprintf(stderr, "... ERROR: %s\n", message.c_str());
         return;
     }
-
-    // XXX check return value
-    fseek(f, parameters["header_skip"].get<int>(), SEEK_SET);
     
-    // Prepare data array and read data from file
+    std::string fname = parameters["file"].get<std::string>();
+    
+    // Determine data type
     
     OSPDataType dataType;
-    void *grid_field_values;
-    uint32_t read_size;
+    uint32_t value_size;
     
     std::string voxelType = parameters["voxel_type"].get<std::string>();    // XXX rename parameter?
     
-    if (voxelType == "uchar")
-    {
-        grid_field_values = new uint8_t[num_grid_points];
-        dataType = OSP_UCHAR;
-        read_size = num_grid_points;
-    }
-    else if (voxelType == "ushort")
-    {
-        grid_field_values = new uint16_t[num_grid_points];
-        dataType = OSP_USHORT;
-        read_size = num_grid_points*sizeof(uint16_t);
-    } 
-    else if (voxelType == "short")
-    {
-        grid_field_values = new int16_t[num_grid_points];
-        dataType = OSP_SHORT;
-        read_size = num_grid_points*sizeof(int16_t);
-    }        
-    else if (voxelType == "float")
-    {
-        grid_field_values = new float[num_grid_points];
-        dataType = OSP_FLOAT;
-        read_size = num_grid_points*sizeof(float);
-    }
-    else if (voxelType == "double")
-    {
-        grid_field_values = new double[num_grid_points];
-        dataType = OSP_DOUBLE;
-        read_size = num_grid_points*sizeof(double);
-    }
-    else 
+    if (!get_voxel_type(dataType, value_size, voxelType))
     {
         snprintf(msg, 1024, "ERROR: unhandled voxel data type '%s'!\n", voxelType.c_str());
         result.set_success(false);
         result.set_message(msg);
         fprintf(stderr, "... %s\n", msg);
-        fclose(f);
         return;
     }
     
-    // Read the actual voxel data
-
-    // XXX check bytes read
-    int actual_size = fread(grid_field_values, 1, read_size, f);
+    if (parameters.find("pyramid") != parameters.end())
+    {
+        generate_from_pyramid(result, state, dims, dataType);
+        return;
+    }
     
-    fclose(f);
-
-    if (actual_size != read_size)
-        printf("... WARNING: expected to read %d bytes from file, got only %d!\n", read_size, actual_size);
+    dims[0] = region.dims[0];
+    dims[1] = region.dims[1];
+    dims[2] = region.dims[2];
     
-    // Endian-flip if needed
-
-    if (parameters.find("endian_flip") != parameters.end() && parameters["endian_flip"].get<int>())
+    num_grid_points = region.num_voxels();
+    
+    // Map or read the voxel data
+    
+    float minval, maxval;
+    std::shared_ptr<const void> source;
+    
+    std::shared_ptr<const void> values = load_values(minval, maxval, source, parameters, 
+        fname, parameters["header_skip"].get<int>(), voxelType, dataType, value_size, region, state);
+    
+    if (!values)
     {
-        if (voxelType == "float")
-        {
-            float *falues = (float*)grid_field_values;
-            for (int i = 0; i < num_grid_points; i++)
-                falues[i] = float_swap(falues[i]);        
-        }
-        // XXX handle double swap
-        else if (voxelType == "ushort")
-        {
-            uint16_t *falues = (uint16_t*)grid_field_values;
-            for (int i = 0; i < num_grid_points; i++)
-                falues[i] = uint16_swap(falues[i]);    
-        }
-        else if (voxelType == "short")
-        {
-            int16_t *falues = (int16_t*)grid_field_values;
-            for (int i = 0; i < num_grid_points; i++)
-                falues[i] = int16_swap(falues[i]);  
-        }
+        if (state->canceled())
+            snprintf(msg, 1024, "Canceled");
         else
-            fprintf(stderr, "... WARNING: no endian flip available for data type '%s'!\n", voxelType.c_str());
+            snprintf(msg, 1024, "Could not read file '%s'", fname.c_str());
+        result.set_success(false);
+        result.set_message(msg);
+        fprintf(stderr, "... ERROR: %s\n", msg);
+        return;
     }
-
-#if 0
-    // XXX for now, convert to floats, as it seems not all types works well
-    if (voxelType != "float")        
+    
+    const bool sparse = parameters.find("sparse_threshold") != parameters.end() 
+        || parameters.find("sparse_range") != parameters.end();
+    
+    if (sparse)
     {
-        fprintf(stderr, "... WARNING: converting values to floats (for now)\n");
-
-        float *new_values = new float[num_grid_points];
-
-        // XXX really need to look into a better (templated) way of doing this
-        if (voxelType == "uchar")
-        {
-            convert_to_float(new_values, (uint8_t*)grid_field_values, num_grid_points);
-            delete [] (uint8_t*)grid_field_values;
-        }
-        else if (voxelType == "ushort") 
-        {           
-            convert_to_float(new_values, (uint16_t*)grid_field_values, num_grid_points);
-            delete [] (uint16_t*)grid_field_values;
-        }
-        else if (voxelType == "float")            
-        {
-            convert_to_float(new_values, (float*)grid_field_values, num_grid_points);
-            delete [] (float*)grid_field_values;
-        }
-        else if (voxelType == "double")            
+        // Only the occupied blocks are kept (as float values), 
+        // so such instances are re-created on changes
+        
+        if (parameters.find("quantize") != parameters.end())
+            fprintf(stderr, "... WARNING: quantize is not supported for sparse volumes, ignoring\n");
+        
+        float origin[3], spacing[3], bbox[6];
+        get_region_origin_spacing(origin, spacing, parameters, region);
+        
+        OSPVolume volume = create_sparse_volume(bbox, origin, spacing, dims, dataType, values.get(), parameters, state);
+        
+        if (!volume)
         {
-            convert_to_float(new_values, (double*)grid_field_values, num_grid_points);    
-            delete [] (double*)grid_field_values;
+            result.set_success(false);
+            result.set_message("No voxels in the sparse value range");
+            fprintf(stderr, "... ERROR: no voxels in the sparse value range\n");
+            return;
         }
-
-        voxelType = "float";
-        dataType = OSP_FLOAT;
-        grid_field_values = new_values;
-    }
-#endif
-
-    // Check data range if needed
-
-    float minval, maxval;
-    
-    if (parameters.find("data_range") != parameters.end())
-    {
-        minval = parameters["data_range"][0];
-        maxval = parameters["data_range"][1];
         
-        printf("... User-provided input data range %.6f, %.6f\n", minval, maxval);
-    }
-    else
-    {        
-        printf("... No data range, provided, deriving from voxel data\n");
+        state->volume = volume;
+        state->volume_data_range[0] = minval;
+        state->volume_data_range[1] = maxval;    
         
-        // XXX really need to look into a better (templated) way of doing this
-        if (voxelType == "uchar")
-            get_value_range((uint8_t*)grid_field_values, num_grid_points, minval, maxval);
-        else if (voxelType == "ushort")            
-            get_value_range((uint16_t*)grid_field_values, num_grid_points, minval, maxval);
-        else if (voxelType == "short")            
-            get_value_range((int16_t*)grid_field_values, num_grid_points, minval, maxval);
-        else if (voxelType == "float")            
-            get_value_range((float*)grid_field_values, num_grid_points, minval, maxval);
-        else if (voxelType == "double")            
-            get_value_range((double*)grid_field_values, num_grid_points, minval, maxval);
+        state->bound = BoundingMesh::bbox(
+            bbox[0], bbox[1], bbox[2],
+            bbox[3], bbox[4], bbox[5],
+            true
+        );
         
-        printf("... Input data range derived from data %.6f, %.6f\n", minval, maxval);
+        return;
     }
     
-    float value_scale = 1.0f;
-    float value_offset = 0.0f;
-    bool map_data = false;
+    // Optionally store float data as 8 or 16-bit values. Only the
+    // quantized values are kept, so such instances are re-created on
+    // changes instead of updated in place.
     
-    if (parameters.find("value_scale") != parameters.end())
+    if (parameters.find("quantize") != parameters.end())
     {
-        value_scale = parameters["value_scale"].get<float>();    
-        map_data = true;
+        std::shared_ptr<const void> quantized = quantize_values(dataType, values, 
+            minval, maxval, parameters, num_grid_points, state->volume_value_scale, state->volume_value_offset);
+        
+        if (quantized)
+            source = values = quantized;
     }
     
-    if (parameters.find("value_offset") != parameters.end())
-    {
-        value_offset = parameters["value_offset"].get<float>();
-        map_data = true;
-    }
+    // The values are used directly by OSPRay, so are kept alive with the 
+    // instance. Read source data is kept as well, so other instances can 
+    // share it.
     
-    if (map_data)
-    {
-        printf("... Mapping values with scale %.6f, offset %.6f\n", value_scale, value_offset);
-        
-        if (voxelType == "uchar")
-            map_values((uint8_t*)grid_field_values, num_grid_points, value_scale, value_offset);
-        else if (voxelType == "ushort")            
-            map_values((uint16_t*)grid_field_values, num_grid_points, value_scale, value_offset);
-        else if (voxelType == "short")           
-            map_values((int16_t*)grid_field_values, num_grid_points, value_scale, value_offset);
-        else if (voxelType == "float")            
-            map_values((float*)grid_field_values, num_grid_points, value_scale, value_offset);
-        //else if (voxelType == "double")    
-        
-        // XXX will be in wrong order when value_scale < 0
-        printf("... Mapped range %.6f %.6f\n", minval*value_scale+value_offset, maxval*value_scale+value_offset);
-    }
+    if (source)
+        state->shared_memory.push_back(source);
+    if (values != source)
+        state->shared_memory.push_back(values);
+    
+    if (parameters.find("quantize") == parameters.end())
+        state->data = new RawVolumeData{source, values};
+    
+    void *grid_field_values = const_cast<void*>(values.get());
 
 #if 0    
     // There's no OSP_SHORT, only OSP_USHORT, so convert here
@@ -720,7 +904,10 @@ generate(PluginResult &result, PluginState *state)
     }
     */
     
-    volume = create_volume(bbox, parameters, dims, dataType, grid_field_values);
+    float origin[3], spacing[3];
+    get_region_origin_spacing(origin, spacing, parameters, region);
+    
+    volume = create_volume(bbox, origin, spacing, dims, dataType, grid_field_values);
     
     if (!volume)
     {
@@ -730,7 +917,14 @@ generate(PluginResult &result, PluginState *state)
     
     ospCommit(volume);
     
-    // XXX delete grid values array
+    // Describe the volume for the plugin cache
+    
+    state->cacheable.subtype = "structured_regular";
+    state->cacheable.add_array("data", dataType, num_grid_points, grid_field_values);
+    state->cacheable.add_int("voxelType", dataType);
+    state->cacheable.add_vec3i("dimensions", dims[0], dims[1], dims[2]);
+    state->cacheable.add_vec3f("gridOrigin", origin[0], origin[1], origin[2]);
+    state->cacheable.add_vec3f("gridSpacing", spacing[0], spacing[1], spacing[2]);
     
     state->volume = volume;
     state->volume_data_range[0] = minval;
@@ -743,6 +937,141 @@ generate(PluginResult &result, PluginState *state)
     );
 }
 
+extern "C"
+bool
+update(PluginResult &result, PluginState *state, const std::set<std::string>& changed)
+{
+    const json& parameters = state->parameters;
+    RawVolumeData *data = (RawVolumeData*)state->data;
+    
+    // Only changes in value mapping and data range can be handled in place,
+    // by re-deriving the values from the (still loaded) source data, or 
+    // from a new mapping of the file
+    
+    if (data == nullptr)
+        return false;
+    
+    for (const std::string& key : changed)
+    {
+        if (key != "value_scale" && key != "value_offset" && key != "data_range")
+            return false;
+    }
+    
+    OSPDataType dataType;
+    uint32_t value_size;
+    
+    const std::string voxelType = parameters["voxel_type"].get<std::string>();
+    get_voxel_type(dataType, value_size, voxelType);
+    
+    VoxelRegion region;
+    std::string message;
+    
+    if (!get_region(region, parameters, message))
+        return false;
+    
+    const size_t num_grid_points = region.num_voxels();
+    
+    float minval, maxval;
+    std::shared_ptr<const void> values;
+    
+    if (data->source)
+    {
+        const uint64_t size = (uint64_t)num_grid_points * value_size;
+        
+        values = data->source;
+        
+        if (values_need_modification(parameters))
+        {
+            uint8_t *copy = new uint8_t[size];
+            memcpy(copy, data->source.get(), size);
+            values = std::shared_ptr<const void>(copy, [](const void *p) { delete [] (const uint8_t*)p; });
+        }
+        
+        transform_values(minval, maxval, const_cast<void*>(values.get()), parameters, dataType, num_grid_points);
+    }
+    else
+    {
+        // Mapped, set up a new mapping (which might be writable where the
+        // previous wasn't, or vice versa)
+        values = load_values(minval, maxval, data->source, parameters, parameters["file"].get<std::string>(), 
+            parameters["header_skip"].get<int>(), voxelType, dataType, value_size, region, nullptr);
+        
+        if (!values)
+            return false;
+        
+        if (data->source)
+            state->shared_memory.push_back(data->source);
+    }
+    
+    OSPData voxelData = ospNewSharedData(values.get(), dataType, num_grid_points);
+    ospCommit(voxelData);
+    ospSetObject(state->volume, "data", voxelData);
+    ospRelease(voxelData);
+    ospCommit(state->volume);
+    
+    // The previous values are no longer used by the volume
+    
+    std::vector<std::shared_ptr<const void>>& shared = state->shared_memory;
+    
+    if (data->values != data->source)
+        shared.erase(std::remove(shared.begin(), shared.end(), data->values), shared.end());
+    if (values != data->source)
+        shared.push_back(values);
+    
+    data->values = values;
+    
+    state->volume_data_range[0] = minval;
+    state->volume_data_range[1] = maxval;
+    
+    return true;
+}
+
+extern "C"
+void
+clear_data(PluginState *state)
+{
+    delete (RawVolumeData*)state->data;
+    state->data = nullptr;
+}
+
+extern "C"
+void
+query_bound(PluginResult &result, PluginState *state)
+{
+    const json& parameters = state->parameters;
+    
+    // The bound follows from the parameters alone, no need to touch the file
+    
+    VoxelRegion region;
+    std::string message;
+    
+    if (!get_region(region, parameters, message))
+    {
+        result.set_success(false);
+        result.set_message(message);
+        return;
+    }
+    
+    float origin[3], spacing[3];
+    const int32_t *dims = region.full_dims;
+    
+    get_grid_origin_spacing(origin, spacing, parameters);
+    
+    // The pyramid mode always uses the complete volume
+    if (parameters.find("pyramid") == parameters.end())
+    {
+        dims = region.dims;
+        region.apply(origin, spacing);
+    }
+    
+    state->bound = BoundingMesh::bbox(
+        origin[0], origin[1], origin[2],
+        origin[0] + dims[0] * spacing[0], 
+        origin[1] + dims[1] * spacing[1], 
+        origin[2] + dims[2] * spacing[2],
+        true
+    );
+}
 
 // XXX header_skip -> header-skip?
 static PluginParameters 
@@ -782,6 +1111,39 @@ parameters = {
     {"value_offset",         PARAM_FLOAT,    1, FLAG_OPTIONAL, 
         "Offset to apply to values"},
         
+    {"quantize",            PARAM_STRING,   1, FLAG_OPTIONAL, 
+        "Store float or double data as uchar or ushort, over the data range"},
+
+    {"sparse_threshold",    PARAM_FLOAT,    1, FLAG_OPTIONAL, 
+        "Only keep blocks with values above this threshold, as a sparse (AMR) volume"},
+        
+    {"sparse_range",        PARAM_FLOAT,    2, FLAG_OPTIONAL, 
+        "Only keep blocks with values in this range, as a sparse (AMR) volume"},
+        
+    {"sparse_block_size",   PARAM_INT,      1, FLAG_OPTIONAL, 
+        "Block size in voxels for sparse volumes (default 16)"},
+        
+    {"roi_min",             PARAM_INT,      3, FLAG_OPTIONAL, 
+        "First voxel of the region of interest to load (default 0, 0, 0)"},
+        
+    {"roi_max",             PARAM_INT,      3, FLAG_OPTIONAL, 
+        "Last voxel (inclusive) of the region of interest to load (default the last voxel)"},
+        
+    {"stride",              PARAM_INT,      3, FLAG_OPTIONAL, 
+        "Load every n-th voxel per axis, within the region of interest (default 1, 1, 1)"},
+        
+    {"pyramid",             PARAM_STRING,   1, FLAG_OPTIONAL, 
+        "Multi-resolution pyramid file built from the raw file (with blpyramid), used instead of it (ignores roi_min, roi_max and stride)"},
+        
+    {"pyramid_level",       PARAM_INT,      1, FLAG_OPTIONAL, 
+        "Pyramid level to use for the volume (0 = full resolution, the default)"},
+        
+    {"pyramid_max_memory",  PARAM_FLOAT,    1, FLAG_OPTIONAL, 
+        "Use the finest pyramid level that fits in this amount of memory (MB)"},
+        
+    {"pyramid_preview_voxels", PARAM_FLOAT, 1, FLAG_OPTIONAL, 
+        "Maximum number of voxels of the pyramid level used for interactive rendering (default 256^3)"},
+        
     PARAMETERS_DONE         // Sentinel (signals end of list)
 };
 
@@ -792,7 +1154,9 @@ functions = {
     NULL,           // Plugin unload
     
     generate,       // Generate    
-    NULL,           // Clear data
+    clear_data,     // Clear data
+    query_bound,    // Query bound
+    update,         // Update
 };
 
 extern "C" bool
@@ -800,6 +1164,7 @@ initialize(PluginDefinition *def)
 {
     def->type = PT_VOLUME;
     def->uses_renderer_type = false;
+    def->thread_safe = true;
     def->parameters = parameters;
     def->functions = functions;
     
@@ -212,6 +212,21 @@ class ReceiveRenderResultThread(threading.Thread):
 
                     framebuffer = numpy.empty(bytes_left, dtype=numpy.uint8)
                     fbview = memoryview(framebuffer)
+
+                elif render_result.type == RenderResult.LOADING:
+                    # Server is still creating plugin instances, no framebuffer data follows
+                    self.result_queue.put((render_result, None))
+
+                    mode = 'h'
+                    bytes_left = 4
+
+                    engine = self.engine_ref()
+                    if engine is not None:
+                        try:
+                            engine.tag_redraw()
+                        except ReferenceError:
+                            break
+                        engine = None
                     
                 else:
                     # DONE, CANCELED
@@ -630,6 +645,10 @@ class OsprayRenderEngine(bpy.types.RenderEngine):
                     self.log.info('Updating pixels of existing CustomDraw')
                     self.draw_data.update_pixels(fbpixels)
 
+            elif render_result.type == RenderResult.LOADING:
+                self.log.info('LOADING')
+                self.update_stats('', render_result.message)
+
             elif render_result.type == RenderResult.DONE:
                 self.log.info('DONE')
                 self.rendering_active = False
@@ -2,7 +2,7 @@ import os, re
 from struct import pack, unpack
 from logging import getLogger
 
-PROTOCOL_VERSION = 2
+PROTOCOL_VERSION = 6
 
 VERBOSE_PROTOBUF = False
 
@@ -84,6 +84,56 @@ def customproperties2dict(obj, filepath_keys=['file']):
     return properties
 
 
+def process_properties(obj, expression_locals, extract_plugin_parameters=False):
+    """
+    Get Blender custom properties set on obj, and process where necessary:
+
+    - Custom properties starting with an underscore become
+      element properties (with a key without the underscore), 
+      all the others become plugin parameters, but only if
+      extract_plugin_parameters is True
+    - Property values can include references to environment variables,
+      of the form "${NAME}". These are substituted with their actual
+      value.
+    """
+
+    properties = {}
+    plugin_parameters = {}
+
+    for k, v in customproperties2dict(obj).items():
+        #print('k', k, 'v', v)
+        if isinstance(v, str):
+            v = substitute_values(v, expression_locals)
+            print(v)
+        if k[0] == '_':
+            #print(properties, k, v)
+            properties[k[1:]] = v
+        elif extract_plugin_parameters:
+            plugin_parameters[k] = v       
+        else:
+            properties[k] = v
+            
+    return properties, plugin_parameters
+
+def plugin_properties(obj, frame):
+    """
+    Custom properties and plugin parameters of a plugin-enabled
+    mesh for the given frame. 
+
+    The server identifies a plugin instance by the hash of its 
+    parameters, so everything sending them (e.g. QUERY_BOUND) 
+    should use this.
+    """
+    return process_properties(obj, { 'frame': frame }, True)
+
+# Plugin types, as used in UpdatePluginInstance
+plugin_type2enum = dict(
+    geometry = UpdatePluginInstance.GEOMETRY,
+    volume = UpdatePluginInstance.VOLUME,
+    scene = UpdatePluginInstance.SCENE
+)
+
+
 class Connection:
 
     def __init__(self, engine, host, port):
@@ -252,37 +302,6 @@ class Connection:
     # Scene export
     #
 
-    def _process_properties(self, obj, expression_locals, extract_plugin_parameters=False):
-        """
-        Get Blender custom properties set on obj, and process where necessary:
-
-        - Custom properties starting with an underscore become
-          element properties (with a key without the underscore), 
-          all the others become plugin parameters, but only if
-          extract_plugin_parameters is True
-        - Property values can include references to environment variables,
-          of the form "${NAME}". These are substituted with their actual
-          value.
-        """
-
-        properties = {}
-        plugin_parameters = {}
-
-        for k, v in customproperties2dict(obj).items():
-            #print('k', k, 'v', v)
-            if isinstance(v, str):
-                v = substitute_values(v, expression_locals)
-                print(v)
-            if k[0] == '_':
-                #print(properties, k, v)
-                properties[k[1:]] = v
-            elif extract_plugin_parameters:
-                plugin_parameters[k] = v       
-            else:
-                properties[k] = v
-                
-        return properties, plugin_parameters
-        
     def send_clear_scene(self, keep_plugin_instances=True):
         client_message = ClientMessage()
         client_message.type = ClientMessage.CLEAR_SCENE
@@ -693,7 +712,7 @@ class Connection:
             'frame': depsgraph.scene.frame_current
         }
         
-        custom_properties, plugin_parameters = self._process_properties(obj, expression_locals, False)
+        custom_properties, plugin_parameters = process_properties(obj, expression_locals, False)
         assert len(plugin_parameters.keys()) == 0
         
         update.custom_properties = json.dumps(custom_properties)  
@@ -914,7 +933,7 @@ class Connection:
             'frame': depsgraph.scene.frame_current
         }
     
-        custom_properties, plugin_parameters = self._process_properties(obj, expression_locals, False)
+        custom_properties, plugin_parameters = process_properties(obj, expression_locals, False)
         assert len(plugin_parameters.keys()) == 0
         
         update.custom_properties = json.dumps(custom_properties)   
@@ -1122,13 +1141,20 @@ class Connection:
             plugin_name = ospray.plugin_name
             plugin_type = ospray.plugin_type
 
-            expression_locals = {
-                'frame': depsgraph.scene.frame_current
-            }
+            scene = depsgraph.scene
+            frame = scene.frame_current
 
-            custom_properties, plugin_parameters = self._process_properties(mesh, expression_locals, True)
+            custom_properties, plugin_parameters = plugin_properties(mesh, frame)
+
+            # When rendering an animation also pass the parameters for the
+            # next frame, so the server can prefetch that instance
+            next_frame = next_plugin_parameters = None
+            if self.engine().is_animation and frame + scene.frame_step <= scene.frame_end:
+                next_frame = frame + scene.frame_step
+                dummy, next_plugin_parameters = plugin_properties(mesh, next_frame)
             
-            self.update_plugin_instance(mesh.name, plugin_type, plugin_name, plugin_parameters, custom_properties)
+            self.update_plugin_instance(mesh.name, plugin_type, plugin_name, plugin_parameters, custom_properties,
+                frame, next_frame, next_plugin_parameters)
 
         else:
             # Treat as regular blender mesh
@@ -1139,26 +1165,25 @@ class Connection:
         self.mesh_data_exported.add(mesh.name)        
 
 
-    def update_plugin_instance(self, name, plugin_type, plugin_name, plugin_parameters, custom_properties):
+    def update_plugin_instance(self, name, plugin_type, plugin_name, plugin_parameters, custom_properties,
+            frame=0, next_frame=None, next_plugin_parameters=None):
         
         self.engine().update_stats('', 'Updating plugin instance %s (type: %s)' % (name, plugin_type))
         
-        type2enum = dict(
-            geometry = UpdatePluginInstance.GEOMETRY,
-            volume = UpdatePluginInstance.VOLUME,
-            scene = UpdatePluginInstance.SCENE
-        )
-        
         client_message = ClientMessage()
         client_message.type = ClientMessage.UPDATE_PLUGIN_INSTANCE            
         
         update = UpdatePluginInstance()
-        update.type = type2enum[plugin_type]
+        update.type = plugin_type2enum[plugin_type]
         update.name = name
         
         update.plugin_name = plugin_name
         update.plugin_parameters = json.dumps(plugin_parameters)
         update.custom_properties = json.dumps(custom_properties)
+        update.frame = frame
+        if next_plugin_parameters is not None:
+            update.next_frame = next_frame
+            update.next_plugin_parameters = json.dumps(next_plugin_parameters)
         
         send_protobuf(self.sock, client_message)
         send_protobuf(self.sock, update)
@@ -1192,16 +1217,17 @@ class Connection:
 
         self.engine().update_stats('', 'Updating Blender MESH DATA "%s"' % mesh.name)
 
-        # Get triangulated geometry
-        mesh.calc_loop_triangles()
+        # Polygons are sent as-is, the server takes care of triangulation,
+        # smooth normals and resolving loop colors to vertex colors
 
         nv = len(mesh.vertices)
-        nt = len(mesh.loop_triangles)
+        np = len(mesh.polygons)
+        nl = len(mesh.loops)
 
-        print('... MESH DATA "%s": %d vertices, %d triangles' % (mesh.name, nv, nt))
+        print('... MESH DATA "%s": %d vertices, %d polygons, %d loops' % (mesh.name, nv, np, nl))
 
-        if nt == 0 or nv == 0:
-            print('... No vertices/triangles, NOT sending mesh')
+        if np == 0 or nv == 0:
+            print('... No vertices/polygons, NOT sending mesh')
             self.mesh_data_exported.add(mesh.name)
             return        
 
@@ -1217,26 +1243,26 @@ class Connection:
         
         mesh_data = MeshData()
         mesh_data.num_vertices = nv
-        mesh_data.num_triangles = nt
+        mesh_data.num_polygons = np
+        mesh_data.num_loops = nl
 
-        flags = 0    
+        flags = MeshData.POLYGONS
 
         # Check if any faces use smooth shading
         # XXX we currently don't handle meshes with both smooth
         # and non-smooth faces, but those are probably not very common anyway
 
-        use_smooth = False
-        for tri in mesh.loop_triangles:
-            if tri.use_smooth:
-                print('... mesh uses smooth shading')
-                use_smooth = True
-                flags |= MeshData.NORMALS
-                break
+        use_smooth = numpy.empty(np, dtype=numpy.bool_)
+        mesh.polygons.foreach_get('use_smooth', use_smooth)
+
+        if use_smooth.any():
+            print('... mesh uses smooth shading')
+            flags |= MeshData.SMOOTH_NORMALS
 
         # Vertex colors
         #https://blender.stackexchange.com/a/8561
         if mesh.vertex_colors:
-            flags |= MeshData.VERTEX_COLORS
+            flags |= MeshData.LOOP_COLORS
 
         # Send mesh data
 
@@ -1247,66 +1273,39 @@ class Connection:
         # Send vertices
 
         vertices = numpy.empty(nv*3, dtype=numpy.float32)
+        mesh.vertices.foreach_get('co', vertices)
 
-        if xform is None:
-            xform = Matrix()    # Identity
-
-        for idx, v in enumerate(mesh.vertices):
-                p = xform @ v.co
-                vertices[3*idx+0] = p.x
-                vertices[3*idx+1] = p.y
-                vertices[3*idx+2] = p.z
-            
-        #print(vertices)
+        if xform is not None:
+            m = numpy.array(xform, dtype=numpy.float32)
+            vertices = vertices.reshape((nv, 3)) @ m[:3,:3].T + m[:3,3]
+            vertices = vertices.astype(numpy.float32).reshape(nv*3)
 
         self.sock.send(vertices.tobytes())
 
-        # Send vertex normals (if set)
+        # Send polygon loops. Blender stores these as signed ints, 
+        # which have the same representation as the uint32 values 
+        # the server expects
 
-        if use_smooth:
-            normals = numpy.empty(nv*3, dtype=numpy.float32)
+        loop_start = numpy.empty(np, dtype=numpy.int32)
+        mesh.polygons.foreach_get('loop_start', loop_start)
+        self.sock.send(loop_start.tobytes())
 
-            for idx, v in enumerate(mesh.vertices):
-                # XXX use .index?
-                n = v.normal
-                normals[3*idx+0] = n.x
-                normals[3*idx+1] = n.y
-                normals[3*idx+2] = n.z
+        loop_total = numpy.empty(np, dtype=numpy.int32)
+        mesh.polygons.foreach_get('loop_total', loop_total)
+        self.sock.send(loop_total.tobytes())
 
-            self.sock.send(normals.tobytes())
+        loop_vertices = numpy.empty(nl, dtype=numpy.int32)
+        mesh.loops.foreach_get('vertex_index', loop_vertices)
+        self.sock.send(loop_vertices.tobytes())
 
-        # Send vertex colors (if set)
+        # Send loop colors (if set)
 
         if mesh.vertex_colors:
             vcol_layer = mesh.vertex_colors.active
-            vcol_data = vcol_layer.data
-
-            vertex_colors = numpy.empty(nv*4, dtype=numpy.float32)
-
-            for poly in mesh.polygons:
-                for loop_index in poly.loop_indices:
-                    loop_vert_index = mesh.loops[loop_index].vertex_index
-                    color = vcol_data[loop_index].color
-                    # RGBA vertex colors in Blender 2.8x
-                    vertex_colors[4*loop_vert_index+0] = color[0]
-                    vertex_colors[4*loop_vert_index+1] = color[1]
-                    vertex_colors[4*loop_vert_index+2] = color[2]
-                    vertex_colors[4*loop_vert_index+3] = 1.0
-
-            self.sock.send(vertex_colors.tobytes())
-
-        # Send triangles
-
-        triangles = numpy.empty(nt*3, dtype=numpy.uint32)   # XXX opt possible with <64k vertices ;-)
-
-        for idx, tri in enumerate(mesh.loop_triangles):
-            triangles[3*idx+0] = tri.vertices[0]
-            triangles[3*idx+1] = tri.vertices[1]
-            triangles[3*idx+2] = tri.vertices[2]
-            
-        #print(triangles)
-
-        self.sock.send(triangles.tobytes())
+            # RGBA vertex colors in Blender 2.8x
+            loop_colors = numpy.empty(nl*4, dtype=numpy.float32)
+            vcol_layer.data.foreach_get('color', loop_colors)
+            self.sock.send(loop_colors.tobytes())
 
         self.mesh_data_exported.add(mesh.name)
 
@@ -1429,6 +1428,12 @@ class Connection:
                         'Server %.1fM (peak %.1fM)' % (render_result.memory_usage, render_result.peak_memory_usage),
                         'Variance %.3f | Rendering sample %d/%d' % (render_result.variance, sample, self.render_samples))                
 
+                elif render_result.type == RenderResult.LOADING:
+                    # Server is still creating plugin instances
+                    print(render_result.message)
+                    self.engine().update_stats('', render_result.message)
+                    self.engine().update_progress(render_result.progress)
+
                 elif render_result.type == RenderResult.CANCELED:
                     print('Rendering CANCELED!')
                     self.engine().update_stats('', 'Rendering canceled')
@@ -3,9 +3,11 @@ import socket
 from struct import unpack
 import numpy
 
+import json
+
 from .common import PROTOCOL_VERSION, send_protobuf, receive_protobuf, receive_buffer, receive_into_numpy_array
-from .connection import Connection
-from .messages_pb2 import ClientMessage, HelloResult, QueryBoundResult, ServerStateResult
+from .connection import Connection, plugin_properties, plugin_type2enum
+from .messages_pb2 import ClientMessage, HelloResult, QueryBoundResult, ServerStateResult, UpdatePluginInstance
 
 # XXX if this operator gets called during rendering, then what? :)
 
@@ -56,7 +58,24 @@ class OSPRayUpdateMeshBound(bpy.types.Operator):
         client_message = ClientMessage()
         client_message.type = ClientMessage.QUERY_BOUND
         client_message.string_value = mesh.name
-        send_protobuf(sock, client_message)
+
+        if mesh.ospray.plugin_enabled:
+            # Describe the plugin instance, so the server can query the
+            # bound from the plugin when the instance wasn't created yet
+            dummy, plugin_parameters = plugin_properties(mesh, scene.frame_current)
+
+            update = UpdatePluginInstance()
+            update.type = plugin_type2enum[mesh.ospray.plugin_type]
+            update.name = mesh.name
+            update.plugin_name = mesh.ospray.plugin_name
+            update.plugin_parameters = json.dumps(plugin_parameters)
+            update.frame = scene.frame_current
+
+            client_message.uint_value = 1
+            send_protobuf(sock, client_message)
+            send_protobuf(sock, update)
+        else:
+            send_protobuf(sock, client_message)
 
         # Get result
         
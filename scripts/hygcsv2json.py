@@ -1,8 +1,10 @@
 #!/usr/bin/env python
 # Convert Hyg star database (http://www.astronexus.com/hyg)
-# from CSV to JSON
+# from CSV to JSON, or to the binary columnar format read by the
+# geometry_hyg_stars plugin when the output file ends in .bin
 # Paul Melis <paul.melis@surfsara.nl>
-import sys, csv, json
+import sys, csv, json, struct
+from array import array
 
 STRING_FIELDS = {
     # v3
@@ -43,8 +45,40 @@ with open(sys.argv[1], 'rt', newline='') as f:
             
         lst.append(entry)
 
+
+def write_binary(fname, stars):
+    
+    # Header: magic, version, number of columns, number of stars,
+    # offsets of the x, y, z and mag columns (float32, little-endian)
+    HEADER = '<8sIIQ4Q'
+    ALIGN = 64
+    
+    columns = []
+    for key in ['x', 'y', 'z', 'mag']:
+        values = array('f', [(e.get(key) or 0.0) for e in stars])
+        if sys.byteorder == 'big':
+            values.byteswap()
+        columns.append(values)
         
-with open(sys.argv[2], 'wt') as g:
-    j = json.dumps(lst)
-    #print(j)
-    g.write(j)
+    n = len(stars)
+    offsets = []
+    offset = struct.calcsize(HEADER)
+    for c in columns:
+        offset = (offset + ALIGN - 1) // ALIGN * ALIGN
+        offsets.append(offset)
+        offset += 4*n
+    
+    with open(fname, 'wb') as g:
+        g.write(struct.pack(HEADER, b'BLSPSTAR', 1, len(columns), n, *offsets))
+        for offset, c in zip(offsets, columns):
+            g.write(b'\0' * (offset - g.tell()))
+            c.tofile(g)
+        
+
+if sys.argv[2].endswith('.bin'):
+    write_binary(sys.argv[2], lst)
+else:
+    with open(sys.argv[2], 'wt') as g:
+        j = json.dumps(lst)
+        #print(j)
+        g.write(j)
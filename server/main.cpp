@@ -24,14 +24,17 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cmath>
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <unistd.h>
 #include <dlfcn.h>
 #include <thread>
 #include <queue>
+#include <deque>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
 
 #include <ospray/ospray.h>
 //#include <ospray/ospray_testing/ospray_testing.h>
@@ -47,14 +50,18 @@
 #include "cool2warm.h"
 #include "util.h"
 #include "util_internal.h"
+#include "mesh_processing.h"
+#include "parallel.h"
 #include "plugin.h"
+#include "plugin_cache.h"
+#include "input_data_cache.h"
 #include "messages.pb.h"
 #include "scene.h"
 
 using json = nlohmann::json;
 
 const int       PORT = 5909;
-const uint32_t  PROTOCOL_VERSION = 2;
+const uint32_t  PROTOCOL_VERSION = 6;
 
 bool framebuffer_compression = getenv("BLOSPRAY_COMPRESS_FRAMEBUFFER") != nullptr;
 bool keep_framebuffer_files = getenv("BLOSPRAY_KEEP_FRAMEBUFFER_FILES") != nullptr;
@@ -62,6 +69,12 @@ bool dump_client_messages = getenv("BLOSPRAY_DUMP_CLIENT_MESSAGES") != nullptr;
 bool abort_on_ospray_error = getenv("BLOSPRAY_ABORT_ON_OSPRAY_ERROR") != nullptr;
 // Print server state to console just before starting to render
 bool dump_server_state = getenv("BLOSPRAY_DUMP_SERVER_STATE") != nullptr;
+// Weld and spatially reorder Blender meshes before handing them to OSPRay
+bool optimize_meshes = getenv("BLOSPRAY_OPTIMIZE_MESHES") != nullptr;
+// Directory for caching plugin instance data on disk, empty = disabled
+std::string plugin_cache_dir = getenv("BLOSPRAY_CACHE_DIR") != nullptr ? getenv("BLOSPRAY_CACHE_DIR") : "";
+// Memory budget in MB for plugin instances, Blender meshes and framebuffers, 0 = unlimited
+uint64_t memory_budget = getenv("BLOSPRAY_MEMORY_BUDGET") != nullptr ? strtoull(getenv("BLOSPRAY_MEMORY_BUDGET"), nullptr, 10) : 0;
 
 OSPRenderer     ospray_renderer;
 std::string     current_renderer_type;
@@ -109,6 +122,7 @@ int                         final_framebuffer_width = 0, final_framebuffer_heigh
 OSPFrameBufferFormat        final_framebuffer_format;
 int                         final_framebuffer_update_rate = 1;    
 OSPFrameBuffer              final_framebuffer = nullptr;   
+size_t                      final_framebuffer_data_size = 0;
 int                         framebuffer_update_rate = 1;    
 // Interactive render
 int                         interactive_framebuffer_width = 0, interactive_framebuffer_height = 0;
@@ -117,18 +131,42 @@ int                         framebuffer_initial_reduction_factor = 1;
 
 // Derived values    
 
+// Estimated memory used by a framebuffer, in bytes
+size_t
+framebuffer_data_size(int width, int height, OSPFrameBufferFormat format, int channels)
+{
+    size_t pixel_size = 0;
+
+    if (channels & OSP_FB_COLOR)
+        pixel_size += format == OSP_FB_RGBA32F ? 16 : (format == OSP_FB_NONE ? 0 : 4);
+    if (channels & OSP_FB_DEPTH)
+        pixel_size += 4;
+    if (channels & OSP_FB_ACCUM)
+        pixel_size += 16;
+    if (channels & OSP_FB_VARIANCE)
+        pixel_size += 16;
+    if (channels & OSP_FB_NORMAL)
+        pixel_size += 12;
+    if (channels & OSP_FB_ALBEDO)
+        pixel_size += 12;
+
+    return (size_t)width * height * pixel_size;
+}
+
 // XXX interactive render only
 struct AllocatedFramebuffer
 {
     OSPFrameBuffer  framebuffer;
     int             width;
     int             height;
+    size_t          data_size;
 
     AllocatedFramebuffer(int width, int height, OSPFrameBufferFormat format, int channels)
     {
         framebuffer = ospNewFrameBuffer(width, height, format, channels);
         this->width = width;
         this->height = height;
+        data_size = framebuffer_data_size(width, height, format, channels);
     }
 
     AllocatedFramebuffer(const AllocatedFramebuffer &other)
@@ -137,6 +175,7 @@ struct AllocatedFramebuffer
         ospRetain(framebuffer);
         width = other.width;
         height = other.height;
+        data_size = other.data_size;
     }
 
     ~AllocatedFramebuffer()
@@ -181,6 +220,10 @@ std::vector<float>      vertex_buffer;
 std::vector<float>      normal_buffer;
 std::vector<float>      vertex_color_buffer;
 std::vector<uint32_t>   triangle_buffer;
+std::vector<uint32_t>   loop_start_buffer;
+std::vector<uint32_t>   loop_total_buffer;
+std::vector<uint32_t>   loop_vertex_buffer;
+std::vector<float>      loop_color_buffer;
 
 // Plugin registry
 
@@ -209,34 +252,71 @@ struct PluginInstance
     // XXX move properties out of PluginState?
     PluginState     *state;     // XXX store as object, not as pointer?
 
+    // Simplified geometry for interactive rendering (geometry plugins only)
+    OSPGeometry     proxy_geometry;
+    uint32_t        lod_generation;
+
+    // Cache file the instance was written to or read from, may be ""
+    std::string     cache_file;
+
+    // Last render the instance was used in, for the memory budget
+    uint32_t        last_used;
+
+    // Changes when the group instances of the state are (re)created, so
+    // linked scene objects can tell their OSPRay instances are current
+    // (scene plugins only)
+    uint32_t        instances_generation;
+
     PluginInstance()
     {
         state = nullptr;
+        proxy_geometry = nullptr;
+        lod_generation = 0;
+        last_used = 0;
+        instances_generation = 0;
     }
 
     ~PluginInstance()
     {
         if (state != nullptr)
             delete state;
+        if (proxy_geometry != nullptr)
+            ospRelease(proxy_geometry);
     }
 };
 
 // A regular Blender Mesh 
-// XXX currently triangles only
+// Triangles, or quads when the mesh was sent as polygons
 struct BlenderMesh
 {
     std::string     name;
     uint32_t        num_vertices;
-    uint32_t        num_triangles;
+    uint32_t        num_triangles;  // Number of primitives, either triangles or quads
+    size_t          data_size;      // Bytes passed to OSPRay
 
     json            parameters;     // XXX not sure we need this
 
     OSPGeometry     geometry;
 
+    // Simplified geometry for interactive rendering, built in
+    // the background for large meshes
+    OSPGeometry     proxy_geometry;
+    uint32_t        lod_generation;
+
+    BlenderMesh()
+    {
+        data_size = 0;
+        geometry = nullptr;
+        proxy_geometry = nullptr;
+        lod_generation = 0;
+    }
+
     ~BlenderMesh()
     {
         if (geometry != nullptr)
             ospRelease(geometry);
+        if (proxy_geometry != nullptr)
+            ospRelease(proxy_geometry);
     }
 };
 
@@ -253,7 +333,135 @@ SceneDataTypeMap    scene_data_types;
 PluginInstanceMap   plugin_instances;
 BlenderMeshMap      blender_meshes;
 
+// Level-of-detail proxies for large meshes. A simplified version of
+// a Blender mesh or plugin geometry is built in a background thread.
+// During interactive rendering the proxies are used for the frames
+// at reduced resolution, or for the first frame at full resolution 
+// when the camera was just changed. Full detail is swapped in after
+// that (by changing the world's instance list only, so no BVH rebuilds
+// of the geometry are needed). Volume plugins can provide a lower-resolution
+// volume (PluginState::lod_volume), which is used in the same way, as can
+// scene plugins for their groups (PluginState::lod_groups).
+
+// Meshes with at least this number of primitives get a proxy, 0 = disabled
+uint32_t lod_min_primitives = getenv("BLOSPRAY_LOD_MIN_PRIMITIVES") != nullptr ? atoi(getenv("BLOSPRAY_LOD_MIN_PRIMITIVES")) : 2000000;
+uint32_t lod_target_triangles = 250000;
+// Camera changes less than this many seconds ago count as navigating
+const float lod_settle_time = 0.5f;
+
+struct LODJob
+{
+    std::string             name;
+    SceneDataType           data_type;
+    uint32_t                generation;
+
+    std::vector<float>      vertices;
+    std::vector<uint32_t>   indices;
+    int                     indices_per_primitive;
+
+    std::vector<float>      proxy_vertices;
+    std::vector<uint32_t>   proxy_triangles;
+
+    std::thread             thread;
+    std::atomic<bool>       done;
+};
+
+std::vector<LODJob*>    lod_jobs;
+uint32_t                lod_generation = 0;
+
+uint32_t                instances_generation = 0;
+
+// Full instance -> proxy instance
+std::map<OSPInstance, OSPInstance>  lod_proxy_instances;
+std::vector<OSPInstance>            ospray_scene_proxy_instances;
+bool                                lod_proxies_active = false;
+struct timeval                      last_camera_update = {0, 0};
+
+// Current view, for scene plugins with an update_view_function
+PluginView                          current_view;
+bool                                current_view_set = false;
+
+// Asynchronous creation of plugin instances. The create_instance_function
+// of a plugin is called on a separate thread, so other client messages
+// can be handled while (large) data is being loaded, and instances of
+// different plugins load concurrently. Object updates that link to a plugin
+// instance that is still being created are deferred until it is done.
+// Starting a render waits for all pending plugin instances, reporting
+// progress to the client. Canceling a final render cancels the pending 
+// plugin instances.
+
+struct DeferredObjectUpdate
+{
+    UpdateObject    update;
+    Volume          volume;
+    Slices          slices;
+};
+
+struct PluginLoadJob
+{
+    PluginInstance              *plugin_instance;       // With state set
+    create_instance_function_t  create_instance_function;
+    PluginResult                result;
+
+    std::string                 cache_file;             // Empty if not cached
+    bool                        from_cache;
+
+    // Request the instance was created for, holds the parameters 
+    // of the next frame to prefetch (if any)
+    UpdatePluginInstance        next_update;
+
+    std::vector<DeferredObjectUpdate>   object_updates;
+
+    struct timeval              t0;
+    std::thread                 thread;
+    std::atomic<bool>           done;
+};
+
+typedef std::map<std::string, PluginLoadJob*>   PluginLoadJobMap;
+
+PluginLoadJobMap                    plugin_load_jobs;
+// Per plugin (internal name), for plugins that are not thread-safe
+std::map<std::string, std::mutex>   plugin_load_mutexes;
+// Errors not yet reported to the client
+std::vector<std::string>            plugin_load_errors;
+bool                                waiting_for_plugin_loads = false;
+struct timeval                      last_plugin_load_report = {0, 0};
+
+// Number of renders started, used for least-recently used eviction
+// of plugin instances when over the memory budget
+uint32_t                            render_counter = 0;
+
+// Prefetching of time steps. When rendering an animation the client
+// also sends the plugin parameters for the next frame. After the instance
+// for the current frame is created, the instance for the next frame is 
+// created in the background while the current frame renders, and kept
+// in a small ring of prefetched instances. When the client asks for it
+// during the next frame it is taken from the ring. 
+
+// Maximum number of prefetched instances, the oldest are discarded first. 0 = disabled
+int                                 max_prefetch_jobs = getenv("BLOSPRAY_PREFETCH_INSTANCES") != nullptr ? atoi(getenv("BLOSPRAY_PREFETCH_INSTANCES")) : 2;
+std::deque<PluginLoadJob*>          prefetch_jobs;
+
+// Shared memory (e.g. mapped cache files) of a deleted plugin instance.
+// OSPRay objects in the scene might still reference it, so it is only
+// released once the scene objects linked to the instance have been
+// refreshed and the world has been recommitted, see 
+// release_retired_shared_memory().
+struct RetiredSharedMemory
+{
+    std::string                                 data_name;
+    uint64_t                                    data_size;
+    std::vector<std::shared_ptr<const void>>    shared_memory;
+};
+
+std::vector<RetiredSharedMemory>    retired_shared_memory;
+
+void cancel_plugin_load_job(const std::string& name);
+void cancel_all_plugin_load_jobs();
+void discard_plugin_load_job(PluginLoadJob *job);
+
 void start_rendering(const ClientMessage& client_message);
+void render_first_frame();
 
 // Plugin handling
 
@@ -330,6 +538,8 @@ ensure_plugin_is_loaded(GenerateFunctionResult &result, PluginDefinition &defini
             return false;
         }
 
+        definition.thread_safe = false;
+
         if (!initialize(&definition))
         {
             result.set_success(false);
@@ -445,7 +655,31 @@ check_plugin_parameters(GenerateFunctionResult& result, const PluginParameter *p
 }
 
 void
-delete_plugin_instance(const std::string& name)
+clear_plugin_data(const std::string& internal_name, PluginState *state)
+{
+    if (!state->data)
+        return;
+
+    PluginDefinitionsMap::iterator it = plugin_definitions.find(internal_name);
+
+    if (it != plugin_definitions.end() && it->second.functions.clear_data_function != NULL)
+    {
+        // Call plugin's clear_data_function_t
+        it->second.functions.clear_data_function(state);
+    }
+    else
+    {
+        printf("... WARNING: user data non-null on plugin instance of type '%s', but no clear data function set\n", 
+            internal_name.c_str());
+    }
+}
+
+// Deletes a plugin instance. Its shared memory is retired until the 
+// linked scene objects have been refreshed, as OSPRay objects might still
+// reference it, unless release_shared_memory is set (for instances not 
+// used in the scene).
+void
+delete_plugin_instance(const std::string& name, bool release_shared_memory=false)
 {        
     PluginInstanceMap::iterator it = plugin_instances.find(name);
 
@@ -457,25 +691,21 @@ delete_plugin_instance(const std::string& name)
 
     PluginInstance *plugin_instance = it->second;
     PluginState *state = plugin_instance->state;
-    const std::string& internal_name = plugin_instance->plugin_internal_name;
 
-    if (state->data)
-    {
-        PluginDefinitionsMap::iterator it = plugin_definitions.find(internal_name);
+    clear_plugin_data(plugin_instance->plugin_internal_name, state);
 
-        if (it != plugin_definitions.end())
-        {
-            // Call plugin's clear_data_function_t
-            it->second.functions.clear_data_function(state);
-        }
-        else
-        {
-            printf("... WARNING: user data non-null on plugin instance of type '%s', but no clear data function set\n", 
-                internal_name.c_str());
-        }
+    if (!release_shared_memory && state->shared_memory.size() > 0)
+    {
+        RetiredSharedMemory retired;
+        retired.data_name = name;
+        retired.data_size = state->data_size;
+        retired.shared_memory.swap(state->shared_memory);
+        retired_shared_memory.push_back(retired);
     }
     
-    delete state;
+    // Releases the OSPRay objects (of the state and the LOD proxy) before 
+    // the shared memory
+    delete plugin_instance;
 
     plugin_instances.erase(it);
     plugin_state.erase(name);
@@ -507,6 +737,7 @@ delete_blender_mesh(const std::string& name)
     }
 
     delete bm->second;
+    blender_meshes.erase(bm);
 
     scene_data_types.erase(name);
 }
@@ -518,6 +749,15 @@ delete_blender_mesh(const std::string& name)
 void
 delete_object(const std::string& object_name)
 {        
+    for (auto& kv : plugin_load_jobs)
+    {
+        std::vector<DeferredObjectUpdate>& updates = kv.second->object_updates;
+
+        updates.erase(std::remove_if(updates.begin(), updates.end(), 
+            [&](const DeferredObjectUpdate& u) { return u.update.name() == object_name; }), 
+            updates.end());
+    }
+
     SceneObjectMap::iterator it = scene_objects.find(object_name);
 
     if (it == scene_objects.end())
@@ -527,6 +767,19 @@ delete_object(const std::string& object_name)
     }
 
     SceneObject *scene_object = it->second;
+
+    if (scene_object->type == SOT_MESH)
+        lod_proxy_instances.erase(dynamic_cast<SceneObjectMesh*>(scene_object)->instance);
+    else if (scene_object->type == SOT_GEOMETRY)
+        lod_proxy_instances.erase(dynamic_cast<SceneObjectGeometry*>(scene_object)->instance);
+    else if (scene_object->type == SOT_VOLUME)
+        lod_proxy_instances.erase(dynamic_cast<SceneObjectVolume*>(scene_object)->instance);
+    else if (scene_object->type == SOT_SCENE)
+    {
+        for (OSPInstance i : dynamic_cast<SceneObjectScene*>(scene_object)->instances)
+            lod_proxy_instances.erase(i);
+    }
+
     delete scene_object;
 
     scene_objects.erase(object_name);
@@ -689,6 +942,15 @@ create_transfer_function(const std::string& name, float minval, float maxval)
     return nullptr;
 }
 
+// Maps a value in the units of the volume data (e.g. the data range or
+// an isovalue) to the value as stored in the volume, which differs for
+// quantized volumes
+float
+volume_stored_value(const PluginState *state, float value)
+{
+    return (value - state->volume_value_offset) / state->volume_value_scale;
+}
+
 OSPTransferFunction
 create_user_transfer_function(float minval, float maxval, const Volume& volume, int num_tf_entries=128)
 {
@@ -794,240 +1056,1018 @@ create_user_transfer_function(float minval, float maxval, const Volume& volume,
 }
 
 
-bool
-handle_update_plugin_instance(TCPSocket *sock)
+// Level-of-detail proxies
+
+// Starts building a proxy for the given scene data in the background,
+// taking over the vertex and index arrays. Returns the job generation,
+// which the scene data needs to store to accept the result.
+uint32_t
+start_lod_job(const std::string& name, SceneDataType data_type, 
+    std::vector<float>& vertices, std::vector<uint32_t>& indices, int indices_per_primitive)
 {
-    UpdatePluginInstance    update;
+    LODJob *job = new LODJob;
 
-    if (!receive_protobuf(sock, update))
-        return false;
+    job->name = name;
+    job->data_type = data_type;
+    job->generation = ++lod_generation;
+    job->vertices.swap(vertices);
+    job->indices.swap(indices);
+    job->indices_per_primitive = indices_per_primitive;
+    job->done = false;
 
-    //print_protobuf(update);
+    printf("... Building LOD proxy in the background (%d primitives)\n", 
+        (int)(job->indices.size() / indices_per_primitive));
 
-    const std::string& data_name = update.name();
+    job->thread = std::thread([job]() {
+        simplify_mesh(job->proxy_vertices, job->proxy_triangles,
+            &job->vertices[0], job->vertices.size()/3,
+            &job->indices[0], job->indices.size()/job->indices_per_primitive, job->indices_per_primitive,
+            lod_target_triangles);
 
-    printf("PLUGIN INSTANCE '%s'\n", data_name.c_str());
+        std::vector<float>().swap(job->vertices);
+        std::vector<uint32_t>().swap(job->indices);
 
-    bool create_new_instance;
-    PluginInstance *plugin_instance;
-    PluginState *state;    
-    PluginType plugin_type;
+        job->done = true;
+    });
 
-    switch (update.type())
+    lod_jobs.push_back(job);
+
+    return job->generation;
+}
+
+// Sets up (or removes) the proxy instance of a mesh or geometry object,
+// using the same transform and material as the full-detail instance
+void
+update_object_lod_proxy(LODProxy& proxy, OSPInstance instance, OSPGeometry proxy_geometry,
+    const float *affine_xform, OSPMaterial material)
+{
+    if (proxy.instance != nullptr)
+        lod_proxy_instances.erase(instance);
+
+    if (proxy_geometry == nullptr)
     {
-    case UpdatePluginInstance::GEOMETRY:
-        plugin_type = PT_GEOMETRY;
-        break;
-    case UpdatePluginInstance::VOLUME:
-        plugin_type = PT_VOLUME;
-        break;
-    case UpdatePluginInstance::SCENE:
-        plugin_type = PT_SCENE;
-        break;
-    default:
-        printf("... WARNING: unknown plugin instance type %d!\n", update.type());
-        return false;
+        proxy.clear();
+        return;
     }
 
-    const char *plugin_type_name = PluginType_names[plugin_type];
-    const std::string &plugin_name = update.plugin_name();
+    if (proxy.geometry != proxy_geometry)
+    {
+        proxy.clear();
+
+        proxy.geometry = proxy_geometry;
+        proxy.gmodel = ospNewGeometricModel(proxy_geometry);
+        proxy.group = ospNewGroup();
+        ospSetObjectAsData(proxy.group, "geometry", OSP_GEOMETRIC_MODEL, proxy.gmodel);
+        ospCommit(proxy.group);
+        proxy.instance = ospNewInstance(proxy.group);
+    }
 
-    printf("... plugin type: %s\n", plugin_type_name);
-    printf("... plugin name: '%s'\n", plugin_name.c_str());
+    if (material != nullptr)
+        ospSetObjectAsData(proxy.gmodel, "material", OSP_MATERIAL, material);
+    ospCommit(proxy.gmodel);
 
-    const char *s_plugin_parameters = update.plugin_parameters().c_str();
-    //printf("Received plugin parameters:\n%s\n", s_plugin_parameters);
-    const json &plugin_parameters = json::parse(s_plugin_parameters);
-    printf("... parameters:\n");
-    printf("%s\n", plugin_parameters.dump(4).c_str());
-    
-#if 0
-    const char *s_custom_properties = update.custom_properties().c_str();
-    //printf("Received custom properties:\n%s\n", s_custom_properties);
-    const json &custom_properties = json::parse(s_custom_properties);
-    if (!custom_properties.empty())
+    ospSetParam(proxy.instance, "xfm", OSP_AFFINE3F, affine_xform);
+    ospCommit(proxy.instance);
+
+    lod_proxy_instances[instance] = proxy.instance;
+}
+
+// Sets up (or removes) the proxy instance of a volume object, using the 
+// lower-resolution volume provided by the plugin, with the same transfer 
+// function and settings as the full-resolution volumetric model
+void
+update_volume_lod_proxy(LODProxy& proxy, OSPInstance instance, OSPVolume lod_volume,
+    const float *affine_xform, OSPTransferFunction tf, const Volume& volume_settings)
+{
+    if (proxy.instance != nullptr)
+        lod_proxy_instances.erase(instance);
+
+    if (lod_volume == nullptr)
     {
-        printf("... custom properties:\n");
-        printf("%s\n", custom_properties.dump(4).c_str());
+        proxy.clear();
+        return;
     }
-#endif
 
-    // Check against the current instances
+    if (proxy.volume != lod_volume)
+    {
+        proxy.clear();
 
-    create_new_instance = true;
+        proxy.volume = lod_volume;
+        proxy.vmodel = ospNewVolumetricModel(lod_volume);
+        proxy.group = ospNewGroup();
+        proxy.instance = ospNewInstance(proxy.group);
+    }
 
-    if (scene_data_with_type_exists(data_name, SDT_PLUGIN))
+    ospSetFloat(proxy.vmodel, "densityScale", volume_settings.density_scale());
+    ospSetFloat(proxy.vmodel, "anisotropy", volume_settings.anisotropy());
+    ospSetObject(proxy.vmodel, "transferFunction", tf);
+    ospCommit(proxy.vmodel);
+
+    ospSetObjectAsData(proxy.group, "volume", OSP_VOLUMETRIC_MODEL, proxy.vmodel);
+    ospCommit(proxy.group);
+
+    ospSetParam(proxy.instance, "xfm", OSP_AFFINE3F, affine_xform);
+    ospCommit(proxy.instance);
+
+    lod_proxy_instances[instance] = proxy.instance;
+}
+
+// Updates the proxies of all objects linked to the given scene data
+void
+update_linked_lod_proxies(const std::string& data_name, OSPGeometry proxy_geometry)
+{
+    float affine_xform[12];
+
+    for (auto& kv : scene_objects)
     {
-        // Have existing plugin instance with this name, check what it is
-        plugin_instance = plugin_instances[data_name];
-        assert(plugin_state.find(data_name) != plugin_state.end());
-        state = plugin_state[data_name];
+        SceneObject *scene_object = kv.second;
 
-        // XXX could use internal name?
-        if (plugin_instance->type != plugin_type || plugin_instance->plugin_name != plugin_name)
+        if (scene_object->data_link != data_name)
+            continue;
+
+        affine3fv_from_mat4(affine_xform, scene_object->object2world);
+
+        if (scene_object->type == SOT_MESH)
         {
-            printf("... Existing plugin (type %s, name '%s') does't match, overwriting!\n", 
-                PluginType_names[plugin_instance->type], plugin_name.c_str());
-            delete_plugin_instance(data_name);            
+            SceneObjectMesh *mesh_object = dynamic_cast<SceneObjectMesh*>(scene_object);
+            update_object_lod_proxy(mesh_object->proxy, mesh_object->instance, proxy_geometry, 
+                affine_xform, mesh_object->material);
         }
-        else
+        else if (scene_object->type == SOT_GEOMETRY)
         {
-            // Plugin still of the same type and name, check if parameters and properties still up to date
-            const std::string& parameters_hash = get_sha1(update.plugin_parameters());
-#if 0
-            const std::string& custom_props_hash = get_sha1(update.custom_properties());
-#endif
+            SceneObjectGeometry *geometry_object = dynamic_cast<SceneObjectGeometry*>(scene_object);
+            update_object_lod_proxy(geometry_object->proxy, geometry_object->instance, proxy_geometry, 
+                affine_xform, geometry_object->material);
+        }
+    }
+}
 
-            if (parameters_hash != plugin_instance->parameters_hash)
-            {
-                printf("... Parameters changed, re-creating plugin instance\n");
-                delete_plugin_instance(data_name);                
-            }
-#if 0
-            else if (custom_props_hash != plugin_instance->custom_properties_hash)
+// Installs the results of finished LOD jobs
+void
+poll_lod_jobs()
+{
+    std::vector<LODJob*>::iterator it = lod_jobs.begin();
+
+    while (it != lod_jobs.end())
+    {
+        LODJob *job = *it;
+
+        if (!job->done)
+        {
+            ++it;
+            continue;
+        }
+
+        job->thread.join();
+        it = lod_jobs.erase(it);
+
+        // Check the scene data still exists and wasn't updated in the meantime
+
+        OSPGeometry *proxy_geometry = nullptr;
+        SceneDataTypeMap::iterator sdt = scene_data_types.find(job->name);
+
+        if (sdt != scene_data_types.end() && sdt->second == job->data_type)
+        {
+            if (job->data_type == SDT_BLENDER_MESH)
             {
-                printf("... Custom properties changed, re-running plugin\n");
-                delete_plugin_instance(data_name);                
+                BlenderMesh *blender_mesh = blender_meshes[job->name];
+                if (blender_mesh->lod_generation == job->generation)
+                    proxy_geometry = &blender_mesh->proxy_geometry;
             }
-#endif
-            else if (plugin_instance->state->uses_renderer_type && plugin_instance->state->renderer != current_renderer_type)
+            else
             {
-                printf("... Plugin depends on renderer type, which changed from '%s', re-running plugin\n", 
-                    plugin_instance->state->renderer.c_str());
-                delete_plugin_instance(data_name);                
+                PluginInstance *plugin_instance = plugin_instances[job->name];
+                if (plugin_instance->lod_generation == job->generation)
+                    proxy_geometry = &plugin_instance->proxy_geometry;
             }
-            else
-                create_new_instance = false;
         }
-    }
 
-    // Prepare result
-    // By default all is well, we let the plugin signal something went wrong 
-    GenerateFunctionResult result;    
-    result.set_success(true);    
+        if (proxy_geometry == nullptr || job->proxy_triangles.size() == 0)
+        {
+            delete job;
+            continue;
+        }
 
-    if (!create_new_instance)
-    {
-        printf("... Cached plugin instance still up-to-date\n");
-        // XXX we misuse GenerateFunctionResult here, as nothing was generated...
-        send_protobuf(sock, result);
-        return true;
-    }
+        printf("LOD proxy for '%s' ready, %d triangles\n", job->name.c_str(), (int)(job->proxy_triangles.size()/3));
 
-    // At this point we're creating a new plugin instance, check the plugin itself first
+        OSPGeometry geometry = ospNewGeometry("mesh");
+        OSPData data;
 
-    PluginDefinition plugin_definition;
+        data = ospNewCopiedData(job->proxy_vertices.size()/3, OSP_VEC3F, &job->proxy_vertices[0]);
+        ospSetObject(geometry, "vertex.position", data);
+        ospRelease(data);
 
-    if (!ensure_plugin_is_loaded(result, plugin_definition, plugin_type, plugin_name))
-    {
-        // Something went wrong...
-        send_protobuf(sock, result);
-        return false;
-    }    
+        data = ospNewCopiedData(job->proxy_triangles.size()/3, OSP_VEC3UI, &job->proxy_triangles[0]);
+        ospSetObject(geometry, "index", data);
+        ospRelease(data);
 
-    create_instance_function_t create_instance_function = plugin_definition.functions.create_instance_function;
+        ospCommit(geometry);
 
-    if (create_instance_function == NULL)
-    {
-        printf("... ERROR: plugin create_instance_function is NULL!\n");
-        result.set_message("Plugin create_instance_function is NULL!");
-        send_protobuf(sock, result);
-        return false;
-    }
+        if (*proxy_geometry != nullptr)
+            ospRelease(*proxy_geometry);
+        *proxy_geometry = geometry;
 
-    // Check parameters passed to generate function
+        update_linked_lod_proxies(job->name, geometry);
 
-    if (!check_plugin_parameters(result, plugin_definition.parameters, plugin_parameters))
-    {
-        // Something went wrong...
-        send_protobuf(sock, result);
-        return false;
-    }    
-    
-    // XXX find a better place to replace envvars
-    // Could do this on the raw (unparsed) json string?
-    json plugin_parameters2;
-    for (json::const_iterator it = plugin_parameters.begin(); it != plugin_parameters.end(); ++it)
-    {
-        const json& value = it.value();
-        
-        if (value.is_string())
-            plugin_parameters2[it.key()] = replace_environment_variables(value.get<std::string>());
-        else
-            plugin_parameters2[it.key()] = value;
+        delete job;
     }
+}
 
-    // Create plugin instance and state    
+// Drops the current proxy of the given scene data, e.g. when it gets updated
+void
+invalidate_lod_proxy(const std::string& data_name, OSPGeometry& proxy_geometry, uint32_t& generation)
+{
+    generation = 0;
 
-    state = new PluginState; 
-    state->renderer = current_renderer_type;   
-    state->uses_renderer_type = plugin_definition.uses_renderer_type;
-    state->parameters = plugin_parameters2;
+    if (proxy_geometry == nullptr)
+        return;
 
-    PluginResult plugin_result;
+    update_linked_lod_proxies(data_name, nullptr);
 
-    // Call generate function
+    ospRelease(proxy_geometry);
+    proxy_geometry = nullptr;
+}
 
-    struct timeval t0, t1;
+bool
+camera_recently_updated()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return time_diff(last_camera_update, now) < lod_settle_time;
+}
 
-    printf("... Calling create_instance function\n");
-    gettimeofday(&t0, NULL);
+// Switches the world between full-detail and proxy instances
+void
+set_lod_proxies_active(bool active)
+{
+    if (active && lod_proxy_instances.size() == 0)
+        active = false;
 
-    create_instance_function(plugin_result, state);
+    if (active == lod_proxies_active)
+        return;
+
+    lod_proxies_active = active;
+
+    if (ospray_scene_instances.size() == 0)
+        return;
+
+    OSPData data;
+
+    if (active)
+    {
+        ospray_scene_proxy_instances = ospray_scene_instances;
+
+        for (auto& instance : ospray_scene_proxy_instances)
+        {
+            std::map<OSPInstance, OSPInstance>::iterator it = lod_proxy_instances.find(instance);
+            if (it != lod_proxy_instances.end())
+                instance = it->second;
+        }
+
+        data = ospNewSharedData(&ospray_scene_proxy_instances[0], OSP_INSTANCE, ospray_scene_proxy_instances.size());
+    }
+    else
+        data = ospNewSharedData(&ospray_scene_instances[0], OSP_INSTANCE, ospray_scene_instances.size());
+
+    ospCommit(data);
+    ospSetObject(ospray_world, "instance", data);
+    ospRelease(data);
+
+    ospCommit(ospray_world);
+}
+
+bool
+get_plugin_type(PluginType& plugin_type, const UpdatePluginInstance& update)
+{
+    switch (update.type())
+    {
+    case UpdatePluginInstance::GEOMETRY:
+        plugin_type = PT_GEOMETRY;
+        break;
+    case UpdatePluginInstance::VOLUME:
+        plugin_type = PT_VOLUME;
+        break;
+    case UpdatePluginInstance::SCENE:
+        plugin_type = PT_SCENE;
+        break;
+    default:
+        printf("... WARNING: unknown plugin instance type %d!\n", update.type());
+        return false;
+    }
+
+    return true;
+}
+
+// Replaces environment variables in string values
+// XXX find a better place to replace envvars
+// Could do this on the raw (unparsed) json string?
+json
+process_plugin_parameters(const json& plugin_parameters)
+{
+    json plugin_parameters2;
+
+    for (json::const_iterator it = plugin_parameters.begin(); it != plugin_parameters.end(); ++it)
+    {
+        const json& value = it.value();
+        
+        if (value.is_string())
+            plugin_parameters2[it.key()] = replace_environment_variables(value.get<std::string>());
+        else
+            plugin_parameters2[it.key()] = value;
+    }
+
+    return plugin_parameters2;
+}
+
+// Points the scene objects linked to a plugin instance at its (possibly
+// replaced) volume or geometry, after an in-place update
+void
+refresh_linked_objects(const std::string& data_name, PluginState *state)
+{
+    for (auto& kv : scene_objects)
+    {
+        SceneObject *scene_object = kv.second;
+
+        if (scene_object->data_link != data_name)
+            continue;
+
+        if (scene_object->type == SOT_GEOMETRY && state->geometry != nullptr)
+        {
+            SceneObjectGeometry *geometry_object = dynamic_cast<SceneObjectGeometry*>(scene_object);
+            ospSetObject(geometry_object->gmodel, "geometry", state->geometry);
+            ospCommit(geometry_object->gmodel);
+            ospCommit(geometry_object->group);
+        }
+        else if (scene_object->type == SOT_VOLUME && state->volume != nullptr)
+        {
+            SceneObjectVolume *volume_object = dynamic_cast<SceneObjectVolume*>(scene_object);
+            ospSetObject(volume_object->vmodel, "volume", state->volume);
+            ospCommit(volume_object->vmodel);
+            ospCommit(volume_object->group);
+
+            // A proxy for a previous lower-resolution volume is dropped, 
+            // it gets set up again when the object is updated
+            if (volume_object->proxy.volume != nullptr && volume_object->proxy.volume != state->lod_volume)
+            {
+                lod_proxy_instances.erase(volume_object->instance);
+                volume_object->proxy.clear();
+                update_ospray_scene_instances = true;
+            }
+        }
+        else if (scene_object->type == SOT_ISOSURFACES && state->volume != nullptr)
+        {
+            SceneObjectIsosurfaces *isosurfaces_object = dynamic_cast<SceneObjectIsosurfaces*>(scene_object);
+            ospSetObject(isosurfaces_object->vmodel, "volume", state->volume);
+            ospCommit(isosurfaces_object->vmodel);
+            ospCommit(isosurfaces_object->isosurfaces_geometry);
+            ospCommit(isosurfaces_object->gmodel);
+            ospCommit(isosurfaces_object->group);
+        }
+    }
+}
+
+// Returns true if none of the scene objects linked to the given plugin 
+// instance still use OSPRay objects of a previous (deleted) version of it,
+// i.e. they were refreshed by refresh_linked_objects() or updated since
+bool
+linked_objects_current(const std::string& data_name)
+{
+    PluginInstanceMap::iterator it = plugin_instances.find(data_name);
+    const PluginInstance *plugin_instance = it != plugin_instances.end() ? it->second : nullptr;
+
+    for (auto& kv : scene_objects)
+    {
+        const SceneObject *scene_object = kv.second;
+
+        if (scene_object->data_link != data_name)
+            continue;
+
+        // Re-creating the instance failed (or is still pending)
+        if (plugin_instance == nullptr)
+            return false;
+
+        const PluginState *state = plugin_instance->state;
+
+        switch (scene_object->type)
+        {
+        case SOT_GEOMETRY:
+            if (state->geometry == nullptr)
+                return false;
+            break;
+        case SOT_VOLUME:
+        case SOT_ISOSURFACES:
+            if (state->volume == nullptr)
+                return false;
+            break;
+        case SOT_SCENE:
+            if (dynamic_cast<const SceneObjectScene*>(scene_object)->instances_generation != plugin_instance->instances_generation)
+                return false;
+            break;
+        default:
+            // E.g. slices, only refreshed when the scene is cleared
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Releases the retired shared memory no longer referenced by the world.
+// Called after the world has been committed.
+void
+release_retired_shared_memory()
+{
+    std::vector<RetiredSharedMemory>::iterator it = retired_shared_memory.begin();
+
+    while (it != retired_shared_memory.end())
+    {
+        if (!linked_objects_current(it->data_name))
+        {
+            ++it;
+            continue;
+        }
+
+        printf("Releasing %.1f MB of memory of previous plugin instance '%s'\n", 
+            it->data_size / 1048576.0, it->data_name.c_str());
+
+        it = retired_shared_memory.erase(it);
+    }
+}
+
+// Tries to update an existing plugin instance for changed parameters with 
+// the plugin's update_instance_function, instead of re-creating it.
+// Returns false if the plugin doesn't support this or declined.
+bool
+update_plugin_instance(PluginInstance *plugin_instance, const std::string& s_plugin_parameters, const json& plugin_parameters)
+{
+    const std::string& internal_name = plugin_instance->plugin_internal_name;
+    PluginState *state = plugin_instance->state;
+
+    PluginDefinitionsMap::iterator it = plugin_definitions.find(internal_name);
+
+    if (it == plugin_definitions.end() || it->second.functions.update_instance_function == NULL)
+        return false;
+
+    const PluginDefinition& plugin_definition = it->second;
+
+    // Invalid parameters are reported when re-creating the instance
+    GenerateFunctionResult check_result;
+    if (!check_plugin_parameters(check_result, plugin_definition.parameters, plugin_parameters))
+        return false;
+
+    const json new_parameters = process_plugin_parameters(plugin_parameters);
+    const json& old_parameters = state->parameters;
+    std::set<std::string> changed;
+    std::string changed_names;
+
+    for (json::const_iterator jt = new_parameters.begin(); jt != new_parameters.end(); ++jt)
+    {
+        if (old_parameters.find(jt.key()) == old_parameters.end() || old_parameters[jt.key()] != jt.value())
+            changed.insert(jt.key());
+    }
+
+    for (json::const_iterator jt = old_parameters.begin(); jt != old_parameters.end(); ++jt)
+    {
+        if (new_parameters.find(jt.key()) == new_parameters.end())
+            changed.insert(jt.key());
+    }
+
+    for (const std::string& key : changed)
+        changed_names += (changed_names == "" ? "" : ", ") + key;
+
+    printf("... Parameters changed (%s), trying in-place update\n", changed_names.c_str());
+
+    json previous_parameters = state->parameters;
+    state->parameters = new_parameters;
+
+    PluginResult result;
+    struct timeval t0, t1;
+    bool updated;
+
+    gettimeofday(&t0, NULL);
+    {
+        std::unique_lock<std::mutex> lock;
+
+        // Don't block on instances of this plugin being created (or prefetched)
+        if (!plugin_definition.thread_safe)
+        {
+            lock = std::unique_lock<std::mutex>(plugin_load_mutexes[internal_name], std::try_to_lock);
+
+            if (!lock.owns_lock())
+            {
+                printf("... Plugin busy creating other instance(s), can't update in place\n");
+                state->parameters = previous_parameters;
+                return false;
+            }
+        }
+
+        updated = plugin_definition.functions.update_instance_function(result, state, changed);
+    }
+    gettimeofday(&t1, NULL);
+
+    if (!updated || !result.success)
+    {
+        if (!result.success)
+            printf("... WARNING: in-place update failed: %s\n", result.message.c_str());
+        else
+            printf("... Plugin can't update in place\n");
+
+        state->parameters = previous_parameters;
+        return false;
+    }
+
+    printf("... Updated plugin instance in place in %.3fs\n", time_diff(t0, t1));
+
+    plugin_instance->parameters_hash = get_sha1(s_plugin_parameters);
+    plugin_instance->instances_generation = ++instances_generation;
+    state->cacheable.clear();
+
+    refresh_linked_objects(plugin_instance->name, state);
+
+    if (plugin_instance->type == PT_GEOMETRY)
+    {
+        invalidate_lod_proxy(plugin_instance->name, plugin_instance->proxy_geometry, plugin_instance->lod_generation);
+
+        if (lod_min_primitives > 0 && state->lod_indices.size() / state->lod_indices_per_primitive >= lod_min_primitives)
+        {
+            plugin_instance->lod_generation = start_lod_job(plugin_instance->name, SDT_PLUGIN, 
+                state->lod_vertices, state->lod_indices, state->lod_indices_per_primitive);
+        }
+        else
+        {
+            std::vector<float>().swap(state->lod_vertices);
+            std::vector<uint32_t>().swap(state->lod_indices);
+        }
+    }
+
+    return true;
+}
+
+// Cache file for a plugin instance, based on the plugin, its parameters
+// and the modification times and sizes of the input files used. 
+// Any string parameter naming an existing file counts as input file.
+std::string
+get_plugin_cache_file(const std::string& internal_name, const std::string& parameters_hash, const json& parameters)
+{
+    std::string key = parameters_hash;
+    struct stat st;
+    char s[64];
+
+    for (json::const_iterator it = parameters.begin(); it != parameters.end(); ++it)
+    {
+        const json& value = it.value();
+
+        if (!value.is_string() || stat(value.get<std::string>().c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        snprintf(s, 64, ":%ld.%09ld:%ld", (long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec, (long)st.st_size);
+        key += "\n" + it.key() + s;
+    }
+
+    return plugin_cache_dir + "/" + internal_name + "-" + get_sha1(key) + ".cache";
+}
+
+// Creates a new plugin instance and starts a job calling the plugin's
+// create_instance function for it on a separate thread. The job is
+// finished in poll_plugin_load_jobs() (or discarded)
+PluginLoadJob*
+start_plugin_load_job(const std::string& data_name, PluginType plugin_type, const std::string& plugin_name,
+    const PluginDefinition& plugin_definition, const std::string& s_plugin_parameters, const json& plugin_parameters,
+    int frame)
+{
+    PluginState *state = new PluginState; 
+    state->renderer = current_renderer_type;   
+    state->uses_renderer_type = plugin_definition.uses_renderer_type;
+    state->parameters = process_plugin_parameters(plugin_parameters);
+    state->frame = frame;
+    state->lod_min_primitives = lod_min_primitives;
+
+    std::string internal_name;
+
+    switch (plugin_type)
+    {
+    case PT_GEOMETRY:
+        internal_name = "geometry";
+        break;
+    case PT_VOLUME:
+        internal_name = "volume";
+        break;
+    case PT_SCENE:
+        internal_name = "scene";
+        break;
+    }
+
+    internal_name += "_" + plugin_name;
+
+    PluginInstance *plugin_instance = new PluginInstance;
+    plugin_instance->type = plugin_type;
+    plugin_instance->plugin_name = plugin_name;
+    plugin_instance->plugin_internal_name = internal_name;
+    plugin_instance->state = state; 
+    plugin_instance->name = data_name;    
+    plugin_instance->parameters_hash = get_sha1(s_plugin_parameters);
+
+    PluginLoadJob *job = new PluginLoadJob;
+    job->plugin_instance = plugin_instance;
+    job->create_instance_function = plugin_definition.functions.create_instance_function;
+    job->from_cache = false;
+    job->done = false;
+    gettimeofday(&job->t0, NULL);
+
+    // Renderer-dependent output can't be cached, nor can scene plugin output
+    if (plugin_cache_dir != "" && plugin_type != PT_SCENE && !plugin_definition.uses_renderer_type)
+        job->cache_file = get_plugin_cache_file(internal_name, plugin_instance->parameters_hash, state->parameters);
+
+    std::mutex *plugin_mutex = nullptr;
+    if (!plugin_definition.thread_safe)
+        plugin_mutex = &plugin_load_mutexes[internal_name];
+
+    job->thread = std::thread([job, plugin_mutex]() {
+        PluginState *state = job->plugin_instance->state;
+        const PluginType type = job->plugin_instance->type;
+
+        if (job->cache_file != "" && read_plugin_cache(job->cache_file, type, state))
+        {
+            job->plugin_instance->cache_file = job->cache_file;
+            job->from_cache = true;
+            job->done = true;
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock;
+
+        if (plugin_mutex != nullptr)
+            lock = std::unique_lock<std::mutex>(*plugin_mutex);
+
+        if (state->canceled())
+        {
+            job->result.set_success(false);
+            job->result.set_message("Canceled");
+        }
+        else
+            job->create_instance_function(job->result, state);
+
+        // Arrays described in state->cacheable might be plugin globals,
+        // so write the cache file while still holding the plugin lock.
+        // The cache file name doesn't include the frame, so output of
+        // frame-dependent instances isn't cached.
+        if (job->result.success && job->cache_file != "" && !state->cacheable.empty() && !state->frame_dependent)
+        {
+            state->set_progress(1.0f, "Writing cache file");
+            if (write_plugin_cache(job->cache_file, type, state))
+            {
+                printf("... Wrote plugin cache file %s\n", job->cache_file.c_str());
+                job->plugin_instance->cache_file = job->cache_file;
+            }
+        }
+
+        if (state->data_size == 0)
+        {
+            for (const CacheableObject::Parameter& p : state->cacheable.parameters)
+                state->data_size += p.count * ospray_type_size(p.type);
+        }
+
+        state->cacheable.clear();
+
+        job->done = true;
+    });
+
+    return job;
+}
+
+// Returns the prefetch job creating the given plugin instance, removing
+// it from the ring, or nullptr if there is none
+PluginLoadJob*
+take_prefetch_job(const std::string& data_name, PluginType plugin_type, const std::string& plugin_name, 
+    const std::string& parameters_hash, int frame)
+{
+    for (std::deque<PluginLoadJob*>::iterator it = prefetch_jobs.begin(); it != prefetch_jobs.end(); ++it)
+    {
+        PluginLoadJob *job = *it;
+        const PluginInstance *plugin_instance = job->plugin_instance;
+        const PluginState *state = plugin_instance->state;
+
+        if (plugin_instance->name == data_name && plugin_instance->type == plugin_type 
+            && plugin_instance->plugin_name == plugin_name && plugin_instance->parameters_hash == parameters_hash 
+            && state->frame == frame
+            && !(state->uses_renderer_type && state->renderer != current_renderer_type))
+        {
+            prefetch_jobs.erase(it);
+            return job;
+        }
+    }
+
+    return nullptr;
+}
+
+// Starts creating the plugin instance for the next frame in the background,
+// if the client sent parameters for it and they lead to a different instance.
+// The plugin is already loaded, as it was used for the current frame.
+void
+start_prefetch_job(const UpdatePluginInstance& update, const PluginInstance *plugin_instance)
+{
+    if (max_prefetch_jobs <= 0 || update.next_plugin_parameters() == "")
+        return;
+
+    const std::string parameters_hash = get_sha1(update.next_plugin_parameters());
+    const int frame = update.next_frame();
+
+    if (parameters_hash == plugin_instance->parameters_hash && !plugin_instance->state->frame_dependent)
+        return;
+
+    for (const PluginLoadJob *job : prefetch_jobs)
+    {
+        if (job->plugin_instance->name == plugin_instance->name && job->plugin_instance->parameters_hash == parameters_hash 
+            && job->plugin_instance->state->frame == frame)
+            return;
+    }
+
+    PluginDefinitionsMap::iterator it = plugin_definitions.find(plugin_instance->plugin_internal_name);
+
+    if (it == plugin_definitions.end())
+        return;
+
+    const PluginDefinition& plugin_definition = it->second;
+    const json &plugin_parameters = json::parse(update.next_plugin_parameters());
+    GenerateFunctionResult check_result;
+
+    if (!check_plugin_parameters(check_result, plugin_definition.parameters, plugin_parameters))
+        return;
+
+    printf("Prefetching plugin instance '%s' for frame %d\n", plugin_instance->name.c_str(), frame);
+
+    prefetch_jobs.push_back(start_plugin_load_job(plugin_instance->name, plugin_instance->type, 
+        plugin_instance->plugin_name, plugin_definition, update.next_plugin_parameters(), plugin_parameters, frame));
+
+    while (prefetch_jobs.size() > (size_t)max_prefetch_jobs)
+    {
+        PluginLoadJob *job = prefetch_jobs.front();
+        prefetch_jobs.pop_front();
+
+        printf("... Discarding prefetched plugin instance '%s' for frame %d\n", 
+            job->plugin_instance->name.c_str(), job->plugin_instance->state->frame);
+
+        discard_plugin_load_job(job);
+    }
+}
+
+void
+cancel_all_prefetch_jobs()
+{
+    for (PluginLoadJob *job : prefetch_jobs)
+        job->plugin_instance->state->cancel();
+
+    for (PluginLoadJob *job : prefetch_jobs)
+        discard_plugin_load_job(job);
+
+    prefetch_jobs.clear();
+}
+
+bool
+handle_update_plugin_instance(TCPSocket *sock)
+{
+    UpdatePluginInstance    update;
+
+    if (!receive_protobuf(sock, update))
+        return false;
+
+    //print_protobuf(update);
+
+    const std::string& data_name = update.name();
+
+    printf("PLUGIN INSTANCE '%s'\n", data_name.c_str());
+
+    bool create_new_instance;
+    PluginInstance *plugin_instance;
+    PluginType plugin_type;
+
+    if (!get_plugin_type(plugin_type, update))
+        return false;
+
+    const char *plugin_type_name = PluginType_names[plugin_type];
+    const std::string &plugin_name = update.plugin_name();
+
+    printf("... plugin type: %s\n", plugin_type_name);
+    printf("... plugin name: '%s'\n", plugin_name.c_str());
+
+    const char *s_plugin_parameters = update.plugin_parameters().c_str();
+    //printf("Received plugin parameters:\n%s\n", s_plugin_parameters);
+    const json &plugin_parameters = json::parse(s_plugin_parameters);
+    printf("... parameters:\n");
+    printf("%s\n", plugin_parameters.dump(4).c_str());
+    
+#if 0
+    const char *s_custom_properties = update.custom_properties().c_str();
+    //printf("Received custom properties:\n%s\n", s_custom_properties);
+    const json &custom_properties = json::parse(s_custom_properties);
+    if (!custom_properties.empty())
+    {
+        printf("... custom properties:\n");
+        printf("%s\n", custom_properties.dump(4).c_str());
+    }
+#endif
+
+    // Check against an instance still being created
+
+    PluginLoadJobMap::iterator jt = plugin_load_jobs.find(data_name);
+
+    if (jt != plugin_load_jobs.end())
+    {
+        const PluginInstance *pending_instance = jt->second->plugin_instance;
+        const PluginState *pending_state = pending_instance->state;
+
+        if (pending_instance->type == plugin_type && pending_instance->plugin_name == plugin_name
+            && pending_instance->parameters_hash == get_sha1(update.plugin_parameters())
+            && pending_state->frame == update.frame()
+            && !(pending_state->uses_renderer_type && pending_state->renderer != current_renderer_type))
+        {
+            printf("... Plugin instance still being created, up-to-date\n");
+
+            jt->second->next_update = update;
+
+            GenerateFunctionResult result;
+            result.set_success(true);
+            send_protobuf(sock, result);
+            return true;
+        }
+
+        printf("... Plugin instance being created is out-of-date, canceling\n");
+        cancel_plugin_load_job(data_name);
+    }
+
+    // Check against the current instances
+
+    create_new_instance = true;
+
+    if (scene_data_with_type_exists(data_name, SDT_PLUGIN))
+    {
+        // Have existing plugin instance with this name, check what it is
+        plugin_instance = plugin_instances[data_name];
+        assert(plugin_state.find(data_name) != plugin_state.end());
+
+        // XXX could use internal name?
+        if (plugin_instance->type != plugin_type || plugin_instance->plugin_name != plugin_name)
+        {
+            printf("... Existing plugin (type %s, name '%s') does't match, overwriting!\n", 
+                PluginType_names[plugin_instance->type], plugin_name.c_str());
+            delete_plugin_instance(data_name);            
+        }
+        else
+        {
+            // Plugin still of the same type and name, check if parameters and properties still up to date
+            const std::string& parameters_hash = get_sha1(update.plugin_parameters());
+#if 0
+            const std::string& custom_props_hash = get_sha1(update.custom_properties());
+#endif
+
+            if (parameters_hash != plugin_instance->parameters_hash)
+            {
+                if (update_plugin_instance(plugin_instance, update.plugin_parameters(), plugin_parameters))
+                    create_new_instance = false;
+                else
+                {
+                    printf("... Parameters changed, re-creating plugin instance\n");
+                    delete_plugin_instance(data_name);                
+                }
+            }
+#if 0
+            else if (custom_props_hash != plugin_instance->custom_properties_hash)
+            {
+                printf("... Custom properties changed, re-running plugin\n");
+                delete_plugin_instance(data_name);                
+            }
+#endif
+            else if (plugin_instance->state->frame_dependent && plugin_instance->state->frame != update.frame())
+            {
+                printf("... Plugin instance depends on frame, which changed from %d, re-running plugin\n", 
+                    plugin_instance->state->frame);
+                delete_plugin_instance(data_name);
+            }
+            else if (plugin_instance->state->uses_renderer_type && plugin_instance->state->renderer != current_renderer_type)
+            {
+                printf("... Plugin depends on renderer type, which changed from '%s', re-running plugin\n", 
+                    plugin_instance->state->renderer.c_str());
+                delete_plugin_instance(data_name);                
+            }
+            else
+                create_new_instance = false;
+        }
+    }
+
+    // Prepare result
+    // By default all is well, we let the plugin signal something went wrong 
+    GenerateFunctionResult result;    
+    result.set_success(true);    
+
+    if (!create_new_instance)
+    {
+        plugin_instance->last_used = render_counter;
+        printf("... Plugin instance up-to-date\n");
+        start_prefetch_job(update, plugin_instance);
+        // XXX we misuse GenerateFunctionResult here, as nothing was generated...
+        send_protobuf(sock, result);
+        return true;
+    }
+
+    // At this point we're creating a new plugin instance, check the plugin itself first
+
+    PluginDefinition plugin_definition;
+
+    if (!ensure_plugin_is_loaded(result, plugin_definition, plugin_type, plugin_name))
+    {
+        // Something went wrong...
+        send_protobuf(sock, result);
+        return false;
+    }    
+
+    create_instance_function_t create_instance_function = plugin_definition.functions.create_instance_function;
+
+    if (create_instance_function == NULL)
+    {
+        printf("... ERROR: plugin create_instance_function is NULL!\n");
+        result.set_message("Plugin create_instance_function is NULL!");
+        send_protobuf(sock, result);
+        return false;
+    }
+
+    // Check parameters passed to generate function
+
+    if (!check_plugin_parameters(result, plugin_definition.parameters, plugin_parameters))
+    {
+        // Something went wrong...
+        send_protobuf(sock, result);
+        return false;
+    }    
+    
+    // Use the instance prefetched for this frame, if any
+
+    PluginLoadJob *job = take_prefetch_job(data_name, plugin_type, plugin_name, 
+        get_sha1(update.plugin_parameters()), update.frame());
+
+    if (job != nullptr)
+        printf("... Using prefetched plugin instance%s\n", job->done ? "" : " (still being created)");
+    else
+    {
+        printf("... Calling create_instance function (in background)\n");
+
+        job = start_plugin_load_job(data_name, plugin_type, plugin_name, plugin_definition,
+            update.plugin_parameters(), plugin_parameters, update.frame());
+    }
+
+    job->next_update = update;
+    plugin_load_jobs[data_name] = job;
+
+    // The result only signals the instance creation was started
+    send_protobuf(sock, result);
+
+    return true;
+}
+
+// Handles a plugin instance that was created (or failed to be created).
+// Returns false on failure.
+bool
+finish_plugin_load_job(const std::string& data_name, PluginLoadJob *job)
+{
+    PluginInstance *plugin_instance = job->plugin_instance;
+    PluginState *state = plugin_instance->state;
+    const PluginResult& plugin_result = job->result;
+    struct timeval t1;
 
     gettimeofday(&t1, NULL);
-    printf("... Created instance in %.3fs\n", time_diff(t0, t1));
+    printf("PLUGIN INSTANCE '%s' created in %.3fs%s\n", data_name.c_str(), time_diff(job->t0, t1),
+        job->from_cache ? " (from cache)" : "");
     
     if (!plugin_result.success)
     {
-        result.set_success(false);
-        result.set_message(plugin_result.message);
-        
         printf("... ERROR: create_instance failed:\n");
-        printf("... %s\n", result.message().c_str());
-        send_protobuf(sock, result);
-        delete state;
+        printf("... %s\n", plugin_result.message.c_str());
+
+        plugin_load_errors.push_back("Creating plugin instance '" + data_name + "' failed: " + plugin_result.message);
+
+        clear_plugin_data(plugin_instance->plugin_internal_name, state);
+        delete plugin_instance;
         return false;
     }
 
     // Handle any other business for this type of plugin
-    // XXX set result.success to false?
-    
-    std::string internal_name;
 
-    switch (plugin_type)
+    const char *error = nullptr;
+
+    switch (plugin_instance->type)
     {
     case PT_GEOMETRY:
 
         if (state->geometry == nullptr)
-        {
-            send_protobuf(sock, result);
-
-            printf("... ERROR: geometry create_instance did not set an OSPGeometry!\n");
-            delete state;
-            return false;
-        }    
-        
-        internal_name = "geometry";
+            error = "geometry create_instance did not set an OSPGeometry!";
 
         break;
 
     case PT_VOLUME:
 
         if (state->volume != nullptr)
-        {
             printf("... volume data range %.6f %.6f\n", state->volume_data_range[0], state->volume_data_range[1]);
-        }
         else
-        {
-            send_protobuf(sock, result);
-
-            printf("... ERROR: volume create_instance did not set an OSPVolume!\n");
-            delete state;
-            return false;
-        }
-        
-        internal_name = "volume";
+            error = "volume create_instance did not set an OSPVolume!";
 
         break;
 
@@ -1040,32 +2080,48 @@ handle_update_plugin_instance(TCPSocket *sock)
         }
         else
             printf("... WARNING: scene create_instance returned zero instances!\n");    
-        
-        internal_name = "scene";
 
         break;
     }
 
-    // Load function succeeded
-    
-    internal_name += "_" + plugin_name;
+    if (error != nullptr)
+    {
+        printf("... ERROR: %s\n", error);
 
-    plugin_instance = new PluginInstance;
-    plugin_instance->type = plugin_type;
-    plugin_instance->plugin_name = plugin_name;
-    plugin_instance->plugin_internal_name = internal_name;
-    plugin_instance->state = state; 
-    plugin_instance->name = data_name;    
-    plugin_instance->parameters_hash = get_sha1(s_plugin_parameters);
-#if 0
-    plugin_instance->custom_properties_hash = get_sha1(s_custom_properties);    
-#endif
+        plugin_load_errors.push_back("Creating plugin instance '" + data_name + "' failed: " + error);
+
+        clear_plugin_data(plugin_instance->plugin_internal_name, state);
+        delete plugin_instance;
+        return false;
+    }
+
+    // Create instance succeeded
     
+    plugin_instance->instances_generation = ++instances_generation;
+
     plugin_instances[data_name] = plugin_instance;
     plugin_state[data_name] = state;
     scene_data_types[data_name] = SDT_PLUGIN;
 
-    send_protobuf(sock, result);
+    plugin_instance->last_used = render_counter;
+
+    if (state->data_size > 0)
+        printf("... %.1f MB of data\n", state->data_size / 1048576.0);
+
+    // Objects linked to a previous version of this instance
+    refresh_linked_objects(data_name, state);
+
+    if (plugin_instance->type == PT_GEOMETRY && lod_min_primitives > 0 
+        && state->lod_indices.size() / state->lod_indices_per_primitive >= lod_min_primitives)
+    {
+        plugin_instance->lod_generation = start_lod_job(data_name, SDT_PLUGIN, 
+            state->lod_vertices, state->lod_indices, state->lod_indices_per_primitive);
+    }
+    else
+    {
+        std::vector<float>().swap(state->lod_vertices);
+        std::vector<uint32_t>().swap(state->lod_indices);
+    }
 
     return true;
 }
@@ -1079,6 +2135,12 @@ handle_update_blender_mesh_data(TCPSocket *sock, const std::string& name)
     OSPGeometry geometry;
     bool create_new_mesh = false;
 
+    if (plugin_load_jobs.find(name) != plugin_load_jobs.end())
+    {
+        printf("... WARNING: plugin instance with this name is being created, canceling\n");
+        cancel_plugin_load_job(name);
+    }
+
     SceneDataTypeMap::iterator it = scene_data_types.find(name);
     if (it == scene_data_types.end())
     {
@@ -1108,6 +2170,7 @@ handle_update_blender_mesh_data(TCPSocket *sock, const std::string& name)
             // XXX is it ok to remove a param that was never set?
             ospRemoveParam(geometry, "vertex.normal");
             ospRemoveParam(geometry, "vertex.color");
+            invalidate_lod_proxy(name, blender_mesh->proxy_geometry, blender_mesh->lod_generation);
         }
     }
 
@@ -1121,6 +2184,7 @@ handle_update_blender_mesh_data(TCPSocket *sock, const std::string& name)
     MeshData    mesh_data;
     OSPData     data;
     uint32_t    nv, nt, flags;    
+    int         indices_per_primitive = 3;
 
     if (!receive_protobuf(sock, mesh_data))
         return false;
@@ -1129,40 +2193,118 @@ handle_update_blender_mesh_data(TCPSocket *sock, const std::string& name)
     nt = blender_mesh->num_triangles = mesh_data.num_triangles();
     flags = mesh_data.flags();
 
-    printf("... %d vertices, %d triangles, flags 0x%08x\n", nv, nt, flags);
+    if (flags & MeshData::POLYGONS)
+        printf("... %d vertices, %d polygons, %d loops, flags 0x%08x\n", nv, mesh_data.num_polygons(), mesh_data.num_loops(), flags);
+    else
+        printf("... %d vertices, %d triangles, flags 0x%08x\n", nv, nt, flags);
+
+    if (nv == 0 || (flags & MeshData::POLYGONS ? mesh_data.num_polygons() == 0 : nt == 0))
+    {
+        printf("... WARNING: mesh without vertices/triangles not allowed, ignoring!\n");
+        // XXX release geometry
+        return false;
+    }
+
+    // Receive mesh data
+
+    vertex_buffer.resize(nv*3);
+    if (sock->recvall(&vertex_buffer[0], nv*3*sizeof(float)) == -1)
+        return false;
+
+    if (flags & MeshData::NORMALS)
+    {
+        printf("... Mesh has normals\n");
+        normal_buffer.resize(nv*3);
+        if (sock->recvall(&normal_buffer[0], nv*3*sizeof(float)) == -1)
+            return false;
+    }
+
+    if (flags & MeshData::VERTEX_COLORS)
+    {
+        printf("... Mesh has vertex colors\n");
+        vertex_color_buffer.resize(nv*4);
+        if (sock->recvall(&vertex_color_buffer[0], nv*4*sizeof(float)) == -1)
+            return false;
+    }
+
+    if (flags & MeshData::POLYGONS)
+    {
+        // Polygon loops, triangulated here instead of on the client
+        const uint32_t np = mesh_data.num_polygons();
+        const uint32_t nl = mesh_data.num_loops();
+
+        loop_start_buffer.resize(np);
+        loop_total_buffer.resize(np);
+        loop_vertex_buffer.resize(nl);
+
+        if (sock->recvall(&loop_start_buffer[0], np*sizeof(uint32_t)) == -1)
+            return false;
+        if (sock->recvall(&loop_total_buffer[0], np*sizeof(uint32_t)) == -1)
+            return false;
+        if (sock->recvall(&loop_vertex_buffer[0], nl*sizeof(uint32_t)) == -1)
+            return false;
+
+        if (flags & MeshData::LOOP_COLORS)
+        {
+            printf("... Mesh has loop colors\n");
+            loop_color_buffer.resize(nl*4);
+            if (sock->recvall(&loop_color_buffer[0], nl*4*sizeof(float)) == -1)
+                return false;
+        }
+
+        if (!check_polygons(&loop_start_buffer[0], &loop_total_buffer[0], np, &loop_vertex_buffer[0], nl, nv))
+        {
+            printf("... ERROR: polygon loops reference out-of-range loops or vertices, ignoring mesh!\n");
+            return false;
+        }
 
-    if (nv == 0 || nt == 0)
-    {
-        printf("... WARNING: mesh without vertices/triangles not allowed, ignoring!\n");
-        // XXX release geometry
-        return false;
-    }
+        struct timeval t0, t1;
+        gettimeofday(&t0, NULL);
 
-    // Receive mesh data
+        indices_per_primitive = triangulate_polygons(triangle_buffer,
+            &loop_start_buffer[0], &loop_total_buffer[0], np, &loop_vertex_buffer[0]);
+        nt = blender_mesh->num_triangles = triangle_buffer.size() / indices_per_primitive;
 
-    vertex_buffer.reserve(nv*3);
-    if (sock->recvall(&vertex_buffer[0], nv*3*sizeof(float)) == -1)
-        return false;
+        if (flags & MeshData::SMOOTH_NORMALS)
+        {
+            compute_smooth_normals(normal_buffer, &vertex_buffer[0], nv,
+                &loop_start_buffer[0], &loop_total_buffer[0], np, &loop_vertex_buffer[0], nl);
+            flags |= MeshData::NORMALS;
+        }
 
-    if (flags & MeshData::NORMALS)
+        if (flags & MeshData::LOOP_COLORS)
+        {
+            resolve_loop_colors(vertex_color_buffer, &loop_color_buffer[0], nv, &loop_vertex_buffer[0], nl);
+            flags |= MeshData::VERTEX_COLORS;
+        }
+
+        gettimeofday(&t1, NULL);
+        printf("... Processed polygons into %d %s in %.3fs\n", nt, 
+            indices_per_primitive == 4 ? "quads" : "triangles", time_diff(t0, t1));
+    }
+    else
     {
-        printf("... Mesh has normals\n");
-        normal_buffer.reserve(nv*3);
-        if (sock->recvall(&normal_buffer[0], nv*3*sizeof(float)) == -1)
+        triangle_buffer.resize(nt*3);
+        if (sock->recvall(&triangle_buffer[0], nt*3*sizeof(uint32_t)) == -1)
             return false;
     }
 
-    if (flags & MeshData::VERTEX_COLORS)
+    if (optimize_meshes)
     {
-        printf("... Mesh has vertex colors\n");
-        vertex_color_buffer.reserve(nv*4);
-        if (sock->recvall(&vertex_color_buffer[0], nv*4*sizeof(float)) == -1)
-            return false;
-    }
+        struct timeval t0, t1;
+        gettimeofday(&t0, NULL);
 
-    triangle_buffer.reserve(nt*3);
-    if (sock->recvall(&triangle_buffer[0], nt*3*sizeof(uint32_t)) == -1)
-        return false;
+        nv = optimize_mesh(vertex_buffer,
+            flags & MeshData::NORMALS ? &normal_buffer : nullptr,
+            flags & MeshData::VERTEX_COLORS ? &vertex_color_buffer : nullptr,
+            nv, triangle_buffer, indices_per_primitive);
+
+        gettimeofday(&t1, NULL);
+        printf("... Optimized mesh in %.3fs, %d vertices after welding (was %d)\n", 
+            time_diff(t0, t1), nv, blender_mesh->num_vertices);
+
+        blender_mesh->num_vertices = nv;
+    }
 
     // Set up geometry
 
@@ -1170,11 +2312,14 @@ handle_update_blender_mesh_data(TCPSocket *sock, const std::string& name)
     ospSetObject(geometry, "vertex.position", data);
     ospRelease(data);
 
+    blender_mesh->data_size = (size_t)nv*12 + (size_t)nt*indices_per_primitive*4;
+
     if (flags & MeshData::NORMALS)
     {
         data = ospNewCopiedData(nv, OSP_VEC3F, &normal_buffer[0]);        
         ospSetObject(geometry, "vertex.normal", data);
         ospRelease(data);
+        blender_mesh->data_size += (size_t)nv*12;
     }
 
     if (flags & MeshData::VERTEX_COLORS)
@@ -1182,14 +2327,27 @@ handle_update_blender_mesh_data(TCPSocket *sock, const std::string& name)
         data = ospNewCopiedData(nv, OSP_VEC4F, &vertex_color_buffer[0]);        
         ospSetObject(geometry, "vertex.color", data);
         ospRelease(data);
+        blender_mesh->data_size += (size_t)nv*16;
     }
 
-    data = ospNewCopiedData(nt, OSP_VEC3UI, &triangle_buffer[0]);    
+    if (indices_per_primitive == 4)
+        data = ospNewCopiedData(nt, OSP_VEC4UI, &triangle_buffer[0]);    
+    else
+        data = ospNewCopiedData(nt, OSP_VEC3UI, &triangle_buffer[0]);    
     ospSetObject(geometry, "index", data);
     ospRelease(data);
 
     ospCommit(geometry);
 
+    if (lod_min_primitives > 0 && nt >= lod_min_primitives)
+    {
+        // Note: this takes over the vertex and triangle buffers
+        vertex_buffer.resize(nv*3);
+        triangle_buffer.resize(nt*indices_per_primitive);
+        blender_mesh->lod_generation = start_lod_job(name, SDT_BLENDER_MESH, 
+            vertex_buffer, triangle_buffer, indices_per_primitive);
+    }
+
     return true;
 }
 
@@ -1271,14 +2429,16 @@ update_blender_mesh_object(const UpdateObject& update)
     if (it != scene_materials.end())
     {
         printf("... Material '%s'\n", matname.c_str());
-        ospSetObjectAsData(gmodel, "material", OSP_MATERIAL, it->second->material);
+        mesh_object->material = it->second->material;
     }
     else
     {
         printf("... WARNING: Material '%s' not found, using default!\n", matname.c_str());
-        ospSetObjectAsData(gmodel, "material", OSP_MATERIAL, default_materials[current_renderer_type]);
+        mesh_object->material = default_materials[current_renderer_type];
     }
 
+    ospSetObjectAsData(gmodel, "material", OSP_MATERIAL, mesh_object->material);
+
     /*
     float cols[] = { 1, 0, 0, 1 };
     OSPData colors = ospNewCopiedData(1, OSP_VEC4F, &cols[0]);        
@@ -1288,6 +2448,10 @@ update_blender_mesh_object(const UpdateObject& update)
 
     ospCommit(gmodel);
 
+    mesh_object->object2world = obj2world;
+    update_object_lod_proxy(mesh_object->proxy, instance, blender_mesh->proxy_geometry, 
+        affine_xform, mesh_object->material);
+
     if (scene_object == nullptr)
         scene_objects[object_name] = mesh_object;
 
@@ -1359,6 +2523,8 @@ update_geometry_object(const UpdateObject& update)
     else
         gmodel = geometry_object->gmodel;
 
+    geometry_object->data_link = linked_data;
+
     glm::mat4   obj2world;
     float       affine_xform[12];
 
@@ -1374,16 +2540,22 @@ update_geometry_object(const UpdateObject& update)
     if (it != scene_materials.end())
     {
         printf("... Material '%s'\n", matname.c_str()); 
-        ospSetObjectAsData(gmodel, "material", OSP_MATERIAL, it->second->material);
+        geometry_object->material = it->second->material;
     }
     else
     {
         printf("... WARNING: Material '%s' not found, using default!\n", matname.c_str());
-        ospSetObjectAsData(gmodel, "material", OSP_MATERIAL, default_materials[current_renderer_type]);
+        geometry_object->material = default_materials[current_renderer_type];
     }
+
+    ospSetObjectAsData(gmodel, "material", OSP_MATERIAL, geometry_object->material);
     
     ospCommit(gmodel);
 
+    geometry_object->object2world = obj2world;
+    update_object_lod_proxy(geometry_object->proxy, instance, plugin_instance->proxy_geometry, 
+        affine_xform, geometry_object->material);
+
     if (scene_object == nullptr)
         scene_objects[object_name] = geometry_object;
 
@@ -1393,6 +2565,118 @@ update_geometry_object(const UpdateObject& update)
     return true;
 }
 
+// Creates the OSPRay instances of a scene object from the group instances
+// of its plugin instance, plus instances of the LOD proxies provided.
+// The instances are independent, so they are created in parallel.
+void
+add_scene_object_instances(SceneObjectScene *scene_object_scene, const PluginState *state)
+{
+    const GroupInstances& group_instances = state->group_instances;
+    const size_t n = group_instances.size();
+
+    std::vector<OSPInstance> instances(n), proxies(n, nullptr);
+
+    parallel_for(n, [&](size_t begin, size_t end) {
+
+        float affine_xform[12];
+
+        for (size_t i = begin; i < end; i++)
+        {
+            const GroupInstance& gi = group_instances[i];
+
+            affine3fv_from_mat4(affine_xform, scene_object_scene->object2world * gi.second);
+
+            instances[i] = ospNewInstance(gi.first);
+                ospSetParam(instances[i], "xfm", OSP_AFFINE3F, affine_xform);
+            ospCommit(instances[i]);
+
+            // Lower-detail version provided by the plugin
+            if (i < state->lod_groups.size() && state->lod_groups[i] != nullptr)
+            {
+                proxies[i] = ospNewInstance(state->lod_groups[i]);
+                    ospSetParam(proxies[i], "xfm", OSP_AFFINE3F, affine_xform);
+                ospCommit(proxies[i]);
+            }
+        }
+
+    }, 1024);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        scene_object_scene->instances.push_back(instances[i]);
+
+        if (proxies[i] != nullptr)
+        {
+            scene_object_scene->proxy_instances.push_back(proxies[i]);
+            lod_proxy_instances[instances[i]] = proxies[i];
+        }
+    }
+
+    if (n > 0)
+    {
+        ospray_scene_instances.insert(ospray_scene_instances.end(), instances.begin(), instances.end());
+        update_ospray_scene_instances = true;
+    }
+}
+
+// Updates the transforms of the existing OSPRay instances of a scene 
+// object (e.g. for a changed object2world), instead of re-creating them.
+// The instances must have been created from the same group instances.
+void
+update_scene_object_instances(SceneObjectScene *scene_object_scene, const PluginState *state)
+{
+    const GroupInstances& group_instances = state->group_instances;
+
+    parallel_for(group_instances.size(), [&](size_t begin, size_t end) {
+
+        float affine_xform[12];
+
+        for (size_t i = begin; i < end; i++)
+        {
+            OSPInstance instance = scene_object_scene->instances[i];
+
+            affine3fv_from_mat4(affine_xform, scene_object_scene->object2world * group_instances[i].second);
+
+            ospSetParam(instance, "xfm", OSP_AFFINE3F, affine_xform);
+            ospCommit(instance);
+
+            std::map<OSPInstance, OSPInstance>::const_iterator it = lod_proxy_instances.find(instance);
+            if (it != lod_proxy_instances.end())
+            {
+                ospSetParam(it->second, "xfm", OSP_AFFINE3F, affine_xform);
+                ospCommit(it->second);
+            }
+        }
+
+    }, 1024);
+}
+
+// Removes the OSPRay instances of a scene object from the world
+void
+remove_scene_object_instances(SceneObjectScene *scene_object_scene)
+{
+    if (scene_object_scene->instances.size() == 0)
+        return;
+
+    std::set<OSPInstance> instances(scene_object_scene->instances.begin(), scene_object_scene->instances.end());
+
+    ospray_scene_instances.erase(std::remove_if(ospray_scene_instances.begin(), ospray_scene_instances.end(), 
+        [&](OSPInstance i) { return instances.find(i) != instances.end(); }), 
+        ospray_scene_instances.end());
+    update_ospray_scene_instances = true;
+
+    for (OSPInstance &i : scene_object_scene->instances)
+    {
+        lod_proxy_instances.erase(i);
+        ospRelease(i);
+    }
+    for (OSPInstance &i : scene_object_scene->proxy_instances)
+        ospRelease(i);
+
+    scene_object_scene->instances.clear();
+    scene_object_scene->proxy_instances.clear();
+}
+
 bool
 update_scene_object(const UpdateObject& update)
 {    
@@ -1408,13 +2692,7 @@ update_scene_object(const UpdateObject& update)
     scene_object = find_scene_object(object_name, SOT_SCENE);
 
     if (scene_object != nullptr)
-    {
         scene_object_scene = dynamic_cast<SceneObjectScene*>(scene_object);
-        for (OSPInstance &i : scene_object_scene->instances)
-            ospRelease(i);
-        scene_object_scene->instances.clear();
-        scene_object_scene->lights.clear();
-    }
     else
     {
         scene_object_scene = new SceneObjectScene;
@@ -1427,6 +2705,8 @@ update_scene_object(const UpdateObject& update)
     {   
         if (scene_object == nullptr)
             delete scene_object_scene;
+        else
+            remove_scene_object_instances(scene_object_scene);
         return false;
     }
 
@@ -1434,34 +2714,37 @@ update_scene_object(const UpdateObject& update)
     assert(plugin_instance->type == PT_SCENE);
     PluginState *state = plugin_instance->state;
 
-    GroupInstances group_instances = state->group_instances;
-
-    if (group_instances.size() == 0)
-        printf("... WARNING: no instances to add!\n");
-    else
-        printf("... Adding %d instances to scene\n", group_instances.size());
+    if (scene_object != nullptr 
+        && scene_object_scene->data_link == linked_data
+        && scene_object_scene->instances_generation == plugin_instance->instances_generation
+        && scene_object_scene->instances.size() == state->group_instances.size())
+    {
+        // Same group instances as before, so only the object transform
+        // can have changed: keep the existing instances (and lights)
+        printf("... Updating transforms of %zu instances\n", state->group_instances.size());
 
-    glm::mat4   obj2world;
-    float       affine_xform[12];
+        object2world_from_protobuf(scene_object_scene->object2world, update);
+        update_scene_object_instances(scene_object_scene, state);
 
-    object2world_from_protobuf(obj2world, update);
+        return true;
+    }
 
-    for (GroupInstance& gi : group_instances)
+    if (scene_object != nullptr)
     {
-        OSPGroup group = gi.first;
-        const glm::mat4 instance_xform = gi.second;
-
-        affine3fv_from_mat4(affine_xform, obj2world * instance_xform);
+        remove_scene_object_instances(scene_object_scene);
+        scene_object_scene->lights.clear();
+        scene_object_scene->data_link = linked_data;
+    }
 
-        OSPInstance instance = ospNewInstance(group);
-            ospSetParam(instance, "xfm", OSP_AFFINE3F, affine_xform);
-        ospCommit(instance);
+    if (state->group_instances.size() == 0)
+        printf("... WARNING: no instances to add!\n");
+    else
+        printf("... Adding %zu instances to scene\n", state->group_instances.size());
 
-        scene_object_scene->instances.push_back(instance);
+    object2world_from_protobuf(scene_object_scene->object2world, update);
 
-        ospray_scene_instances.push_back(instance);
-        update_ospray_scene_instances = true;
-    }
+    add_scene_object_instances(scene_object_scene, state);
+    scene_object_scene->instances_generation = plugin_instance->instances_generation;
 
     // Lights
     const Lights& lights = state->lights;
@@ -1542,6 +2825,8 @@ update_volume_object(const UpdateObject& update, const Volume& volume_settings)
         scene_objects[object_name] = volume_object;
         vmodel = volume_object->vmodel = ospNewVolumetricModel(volume);
     }
+
+    volume_object->data_link = linked_data;
     
     // These are pathtracer only
     ospSetFloat(vmodel, "densityScale", volume_settings.density_scale());
@@ -1557,17 +2842,18 @@ update_volume_object(const UpdateObject& update, const Volume& volume_settings)
     if (volume_settings.tf_positions_size() > 0 && volume_settings.tf_colors_size() > 0)
     {
         printf("... Creating user-defined transfer function\n");
-        tf = create_user_transfer_function(state->volume_data_range[0], state->volume_data_range[1], volume_settings);
+        tf = create_user_transfer_function(volume_stored_value(state, state->volume_data_range[0]), 
+            volume_stored_value(state, state->volume_data_range[1]), volume_settings);
     }
     else
     {
         // Default TF        
         printf("... Creating default cool2warm transfer function\n");
-        tf = create_transfer_function("cool2warm", state->volume_data_range[0], state->volume_data_range[1]);
+        tf = create_transfer_function("cool2warm", volume_stored_value(state, state->volume_data_range[0]), 
+            volume_stored_value(state, state->volume_data_range[1]));
     }
 
     ospSetObject(vmodel, "transferFunction", tf);
-    ospRelease(tf);
 
     ospCommit(vmodel);
 
@@ -1583,6 +2869,10 @@ update_volume_object(const UpdateObject& update, const Volume& volume_settings)
     ospSetParam(instance, "xfm", OSP_AFFINE3F, affine_xform);
     ospCommit(instance);
 
+    update_volume_lod_proxy(volume_object->proxy, instance, state->lod_volume, 
+        affine_xform, tf, volume_settings);
+    ospRelease(tf);
+
     if (scene_object == nullptr)
         scene_objects[object_name] = volume_object;
 
@@ -1656,7 +2946,8 @@ update_isosurfaces_object(const UpdateObject& update)
 
         // XXX hacked temp volume module, as we need the volume to create it
         vmodel = isosurfaces_object->vmodel = ospNewVolumetricModel(volume);
-            OSPTransferFunction tf = create_transfer_function("cool2warm", state->volume_data_range[0], state->volume_data_range[1]);
+            OSPTransferFunction tf = create_transfer_function("cool2warm", volume_stored_value(state, state->volume_data_range[0]), 
+                volume_stored_value(state, state->volume_data_range[1]));
             ospSetObject(vmodel, "transferFunction", tf);
             ospRelease(tf);
          ospCommit(vmodel);
@@ -1685,8 +2976,8 @@ update_isosurfaces_object(const UpdateObject& update)
     float *isovalues = new float[n];
     for (int i = 0; i < n; i++)
     {        
-        isovalues[i] = isovalues_prop[i];
-        printf("... isovalue #%d: %.3f\n", i, isovalues[i]);
+        isovalues[i] = volume_stored_value(state, isovalues_prop[i]);
+        printf("... isovalue #%d: %.3f\n", i, isovalues_prop[i].get<float>());
     }
 
     OSPData isovalues_data = ospNewCopiedData(n, OSP_FLOAT, isovalues);  
@@ -1716,6 +3007,8 @@ update_isosurfaces_object(const UpdateObject& update)
     if (scene_object == nullptr)
         scene_objects[object_name] = isosurfaces_object;
 
+    isosurfaces_object->data_link = linked_data;
+
     ospray_scene_instances.push_back(instance);
     update_ospray_scene_instances = true;
     
@@ -1826,7 +3119,8 @@ add_slice_objects(const UpdateObject& update, const Slices& slices)
         if (vmodel == nullptr)
             vmodel = slice_object->vmodel = ospNewVolumetricModel(volume);
             
-        OSPTransferFunction tf = create_transfer_function("cool2warm", state->volume_data_range[0], state->volume_data_range[1]);
+        OSPTransferFunction tf = create_transfer_function("cool2warm", volume_stored_value(state, state->volume_data_range[0]), 
+            volume_stored_value(state, state->volume_data_range[1]));
         ospSetObject(vmodel, "transferFunction", tf);            
         ospCommit(vmodel);
         ospRelease(tf);
@@ -1858,6 +3152,8 @@ add_slice_objects(const UpdateObject& update, const Slices& slices)
         if (scene_object == nullptr)
             scene_objects[object_name] = slice_object;
 
+        slice_object->data_link = linked_data;
+
         ospray_scene_instances.push_back(instance);
         update_ospray_scene_instances = true;
     }
@@ -1981,6 +3277,34 @@ update_light_object(const UpdateObject& update, const LightSettings& light_setti
     return true;
 }
 
+// Memory accounting
+
+// Returns the estimated memory used by plugin instances, Blender meshes
+// and framebuffers, in bytes. Plugin instances sharing input data (see
+// get_input_data()) each count it. Retired memory of deleted instances 
+// counts as plugin instance memory.
+uint64_t
+get_memory_accounting(uint64_t& plugin_instances_size, uint64_t& blender_meshes_size, uint64_t& framebuffers_size)
+{
+    plugin_instances_size = 0;
+    for (auto& kv : plugin_instances)
+        plugin_instances_size += kv.second->state->data_size;
+
+    // Deleted instances whose memory the scene might still use
+    for (auto& retired : retired_shared_memory)
+        plugin_instances_size += retired.data_size;
+
+    blender_meshes_size = 0;
+    for (auto& kv : blender_meshes)
+        blender_meshes_size += kv.second->data_size;
+
+    framebuffers_size = final_framebuffer_data_size;
+    for (auto& fb : framebuffers)
+        framebuffers_size += fb.data_size;
+
+    return plugin_instances_size + blender_meshes_size + framebuffers_size;
+}
+
 // XXX add world/object bounds
 void
 get_server_state(json& j)
@@ -2019,6 +3343,8 @@ get_server_state(json& j)
             {"type", PluginType_names[instance->type]},
             {"plugin_name", instance->plugin_name},
             {"parameters_hash", instance->parameters_hash},
+            {"cache_file", instance->cache_file},
+            {"last_used", instance->last_used},
             {"custom_properties_hash", instance->custom_properties_hash},
             {"state", {
                 {"renderer", state->renderer},
@@ -2028,7 +3354,12 @@ get_server_state(json& j)
                 {"geometry", (size_t)state->geometry},
                 {"volume", (size_t)state->volume},
                 {"volume_data_range", { state->volume_data_range[0], state->volume_data_range[1] } },
+                {"volume_value_scale", state->volume_value_scale},
+                {"volume_value_offset", state->volume_value_offset},
                 {"data", (size_t)state->data},
+                {"data_size", state->data_size},
+                {"frame", state->frame},
+                {"frame_dependent", state->frame_dependent},
                 {"lights", ll},
                 {"group_instances", gi}
             } }
@@ -2036,13 +3367,26 @@ get_server_state(json& j)
     }
     j["plugin_instances"] = p;
 
+    p = json::array();
+    for (const PluginLoadJob *job : prefetch_jobs)
+    {
+        p.push_back({ 
+            {"name", job->plugin_instance->name}, 
+            {"parameters_hash", job->plugin_instance->parameters_hash},
+            {"frame", job->plugin_instance->state->frame},
+            {"done", job->done.load()}
+        });
+    }
+    j["prefetch_jobs"] = p;
+
     p = {};
     for (auto& kv: blender_meshes)
     {
         const BlenderMesh *mesh = kv.second;
         p[kv.first] = { 
             {"name", mesh->name}, {"parameters", mesh->parameters}, {"geometry", (size_t)mesh->geometry},
-            {"num_vertices", mesh->num_vertices}, {"num_triangles", mesh->num_triangles}
+            {"num_vertices", mesh->num_vertices}, {"num_triangles", mesh->num_triangles},
+            {"data_size", mesh->data_size}
         };
     }
     j["blender_meshes"] = p;
@@ -2091,6 +3435,20 @@ get_server_state(json& j)
 
     j["framebuffer"] = fb;
 
+    // Memory
+
+    json mem;
+    uint64_t plugin_instances_size, blender_meshes_size, framebuffers_size;
+
+    mem["total"] = get_memory_accounting(plugin_instances_size, blender_meshes_size, framebuffers_size);
+    mem["plugin_instances"] = plugin_instances_size;
+    mem["blender_meshes"] = blender_meshes_size;
+    mem["framebuffers"] = framebuffers_size;
+    mem["input_data_cache"] = get_input_data_cache_size();
+    mem["budget"] = memory_budget * 1024 * 1024;
+
+    j["memory"] = mem;
+
     // Camera
 
     json cam;
@@ -2147,67 +3505,241 @@ print_server_state()
 }
 
 
-bool
-handle_update_object(TCPSocket *sock)
+void
+apply_object_update(const UpdateObject& update, const Volume& volume, const Slices& slices, const LightSettings& light_settings)
+{
+    switch (update.type())
+    {
+    case UpdateObject::MESH:
+        update_blender_mesh_object(update);
+        break;
+
+    case UpdateObject::GEOMETRY:
+        update_geometry_object(update);
+        break;
+
+    case UpdateObject::SCENE:
+        update_scene_object(update);
+        break;
+
+    case UpdateObject::VOLUME:
+        update_volume_object(update, volume);
+        break;
+
+    case UpdateObject::ISOSURFACES:
+        update_isosurfaces_object(update);
+        break;
+    
+    case UpdateObject::SLICES:
+        add_slice_objects(update, slices);
+        break;
+
+    case UpdateObject::LIGHT:
+        update_light_object(update, light_settings);
+        break;
+
+    default:
+        printf("WARNING: unhandled update type %s\n", UpdateObject_Type_descriptor()->FindValueByNumber(update.type())->name().c_str());
+        break;
+    }
+}
+
+bool
+handle_update_object(TCPSocket *sock)
+{
+    UpdateObject    update;
+    Volume          volume;
+    Slices          slices;
+    LightSettings   light_settings;
+
+    if (!receive_protobuf(sock, update))
+        return false;
+
+    //print_protobuf(update);
+
+    switch (update.type())
+    {
+    case UpdateObject::VOLUME:
+        if (!receive_protobuf(sock, volume))
+            return false;
+        break;
+    
+    case UpdateObject::SLICES:
+        if (!receive_protobuf(sock, slices))
+            return false;
+        break;
+
+    case UpdateObject::LIGHT:
+        if (!receive_protobuf(sock, light_settings))
+            return false;
+        break;
+
+    default:
+        break;
+    }
+
+    // Defer until the linked plugin instance has been created
+    if (update.type() != UpdateObject::MESH && update.type() != UpdateObject::LIGHT)
+    {
+        PluginLoadJobMap::iterator it = plugin_load_jobs.find(update.data_link());
+
+        if (it != plugin_load_jobs.end())
+        {
+            printf("OBJECT '%s' (deferred, plugin instance '%s' still being created)\n", 
+                update.name().c_str(), update.data_link().c_str());
+
+            DeferredObjectUpdate deferred;
+            deferred.update = update;
+            deferred.volume = volume;
+            deferred.slices = slices;
+            it->second->object_updates.push_back(deferred);
+
+            return true;
+        }
+    }
+
+    apply_object_update(update, volume, slices, light_settings);
+
+    return true;
+}
+
+// Plugin instance creation jobs
+
+void
+poll_plugin_load_jobs()
+{
+    PluginLoadJobMap::iterator it = plugin_load_jobs.begin();
+
+    while (it != plugin_load_jobs.end())
+    {
+        PluginLoadJob *job = it->second;
+
+        if (!job->done)
+        {
+            ++it;
+            continue;
+        }
+
+        job->thread.join();
+
+        const std::string name = it->first;
+        it = plugin_load_jobs.erase(it);
+
+        if (finish_plugin_load_job(name, job))
+        {
+            start_prefetch_job(job->next_update, plugin_instances[name]);
+
+            if (job->object_updates.size() > 0)
+                printf("... Applying %zu deferred object update(s)\n", job->object_updates.size());
+
+            LightSettings dummy;
+
+            for (const DeferredObjectUpdate& u : job->object_updates)
+                apply_object_update(u.update, u.volume, u.slices, dummy);
+        }
+
+        delete job;
+    }
+}
+
+// Blocks until the plugin has noticed the cancellation (or is done)
+void
+cancel_plugin_load_job(const std::string& name)
+{
+    PluginLoadJobMap::iterator it = plugin_load_jobs.find(name);
+
+    if (it == plugin_load_jobs.end())
+        return;
+
+    PluginLoadJob *job = it->second;
+
+    printf("Canceling creation of plugin instance '%s'\n", name.c_str());
+
+    discard_plugin_load_job(job);
+
+    plugin_load_jobs.erase(it);
+}
+
+// Cancels the job (if still running) and deletes it, together with its plugin instance
+void
+discard_plugin_load_job(PluginLoadJob *job)
+{
+    PluginInstance *plugin_instance = job->plugin_instance;
+
+    plugin_instance->state->cancel();
+    job->thread.join();
+
+    clear_plugin_data(plugin_instance->plugin_internal_name, plugin_instance->state);
+    delete plugin_instance;
+    delete job;
+}
+
+void
+cancel_all_plugin_load_jobs()
 {
-    UpdateObject    update;    
+    // Signal all first, so they can wind down concurrently
+    for (auto& kv : plugin_load_jobs)
+        kv.second->plugin_instance->state->cancel();
 
-    if (!receive_protobuf(sock, update))
-        return false;
+    while (plugin_load_jobs.size() > 0)
+        cancel_plugin_load_job(plugin_load_jobs.begin()->first);
+}
 
-    //print_protobuf(update);
+// Sends a LOADING render result to the client, at most a few times per second
+void
+report_plugin_load_progress(TCPSocket *sock)
+{
+    struct timeval now;
+    RenderResult render_result;
 
-    switch (update.type())
-    {
-    case UpdateObject::MESH:
-        update_blender_mesh_object(update);
-        break;
+    gettimeofday(&now, NULL);
 
-    case UpdateObject::GEOMETRY:
-        update_geometry_object(update);
-        break;
+    if (plugin_load_errors.size() == 0 && time_diff(last_plugin_load_report, now) < 0.25)
+        return;
 
-    case UpdateObject::SCENE:
-        update_scene_object(update);
-        break;
+    last_plugin_load_report = now;
 
-    case UpdateObject::VOLUME:
-        {
-        Volume volume;
-        if (!receive_protobuf(sock, volume))
-            return false;
-        update_volume_object(update, volume);
-        }
-        break;
+    render_result.set_type(RenderResult::LOADING);
 
-    case UpdateObject::ISOSURFACES:
-        update_isosurfaces_object(update);
-        break;
-    
-    case UpdateObject::SLICES:
-        {
-        Slices slices;
-        if (!receive_protobuf(sock, slices))
-            return false;
-        add_slice_objects(update, slices);
-        }
-        break;
+    if (plugin_load_errors.size() > 0)
+    {
+        render_result.set_message(plugin_load_errors[0]);
+        render_result.set_progress(0.0f);
+        plugin_load_errors.erase(plugin_load_errors.begin());
+    }
+    else if (plugin_load_jobs.size() > 0)
+    {
+        // Overall progress, plus the details of the least progressed instance
+        float total = 0.0f, min_progress = 2.0f;
+        std::string message, min_message, min_name;
+        char s[1024];
 
-    case UpdateObject::LIGHT:
+        for (auto& kv : plugin_load_jobs)
         {
-        LightSettings light_settings;
-        if (!receive_protobuf(sock, light_settings))
-            return false;
-        update_light_object(update, light_settings);
+            float p = kv.second->plugin_instance->state->get_progress(message);
+            total += p;
+            if (p < min_progress)
+            {
+                min_progress = p;
+                min_name = kv.first;
+                min_message = message;
+            }
         }
-        break;
 
-    default:
-        printf("WARNING: unhandled update type %s\n", UpdateObject_Type_descriptor()->FindValueByNumber(update.type())->name().c_str());
-        break;
+        snprintf(s, 1024, "Creating %d plugin instance(s) | '%s' %d%%%s%s", 
+            (int)plugin_load_jobs.size(), min_name.c_str(), (int)(min_progress*100), 
+            min_message != "" ? ": " : "", min_message.c_str());
+
+        render_result.set_message(s);
+        render_result.set_progress(total / plugin_load_jobs.size());
     }
+    else
+        return;
 
-    return true;
+    if (render_mode == RM_INTERACTIVE && render_output_socket != nullptr)
+        send_protobuf(render_output_socket, render_result);
+    else
+        send_protobuf(sock, render_result);
 }
 
 // XXX include channels
@@ -2232,6 +3764,7 @@ update_framebuffer_settings(const std::string& mode, OSPFrameBufferFormat format
         //int channels = OSP_FB_COLOR | /*OSP_FB_DEPTH |*/ OSP_FB_ACCUM | OSP_FB_VARIANCE | OSP_FB_NORMAL | OSP_FB_ALBEDO;    
 
         final_framebuffer = ospNewFrameBuffer(width, height, format, channels);
+        final_framebuffer_data_size = framebuffer_data_size(width, height, format, channels);
         final_framebuffer_width = width;
         final_framebuffer_height = height;
         final_framebuffer_format = format;
@@ -2260,6 +3793,8 @@ void
 update_camera(CameraSettings& camera_settings)
 {
     printf("CAMERA '%s' (camera)\n", camera_settings.object_name().c_str());
+
+    gettimeofday(&last_camera_update, NULL);
     printf("--> '%s' (camera data)\n", camera_settings.camera_name().c_str());
 
     float cam_pos[3], cam_viewdir[3], cam_updir[3];
@@ -2275,6 +3810,15 @@ update_camera(CameraSettings& camera_settings)
     cam_updir[0] = camera_settings.up_dir(0);
     cam_updir[1] = camera_settings.up_dir(1);
     cam_updir[2] = camera_settings.up_dir(2);
+
+    memcpy(current_view.position, cam_pos, sizeof(cam_pos));
+    memcpy(current_view.view_dir, cam_viewdir, sizeof(cam_viewdir));
+    memcpy(current_view.up_dir, cam_updir, sizeof(cam_updir));
+    current_view.perspective = camera_settings.type() != CameraSettings::ORTHOGRAPHIC;
+    current_view.fov_y = camera_settings.fov_y();
+    current_view.height = camera_settings.height();
+    current_view.aspect = camera_settings.aspect();
+    current_view_set = true;
     
     // XXX for now create new cam object
     // YYY why?
@@ -2784,60 +4328,162 @@ send_framebuffer(TCPSocket *sock)
 
 // Querying
 
-bool
-handle_query_bound(TCPSocket *sock, const std::string& name)
+void
+send_query_bound_result(TCPSocket *sock, const BoundingMesh *bound)
 {
     QueryBoundResult result;
-    char msg[1024];
-
-    PluginStateMap::const_iterator it = plugin_state.find(name);
 
-    if (it == plugin_state.end())
+    if (bound)
     {
-        sprintf(msg, "No plugin state for id '%s'", name.c_str());
+        uint32_t    size;
+        uint8_t     *buffer = bound->serialize(size);
+
+        result.set_success(true);
+        result.set_result_size(size);
+
+        send_protobuf(sock, result);
+        sock->sendall(buffer, size);
 
+        delete [] buffer;
+    }
+    else
+    {
         result.set_success(false);
-        result.set_message(msg);
+        result.set_message("No bound specified");
 
-        printf("... FAILED: %s\n", msg);
+        printf("... FAILED: No bound specified\n");
 
         send_protobuf(sock, result);
+    }
+}
 
+void
+send_query_bound_failure(TCPSocket *sock, const std::string& message)
+{
+    QueryBoundResult result;
+
+    result.set_success(false);
+    result.set_message(message);
+
+    printf("... FAILED: %s\n", message.c_str());
+
+    send_protobuf(sock, result);
+}
+
+// Queries the bound of a plugin instance that doesn't exist (yet), 
+// by calling the plugin's query_bound_function
+bool
+query_plugin_bound(TCPSocket *sock, const UpdatePluginInstance& update)
+{
+    PluginType plugin_type;
+
+    if (!get_plugin_type(plugin_type, update))
+    {
+        send_query_bound_failure(sock, "Unknown plugin type");
         return false;
     }
 
-    const PluginState *state = it->second;
+    const std::string &plugin_name = update.plugin_name();
+
+    printf("... plugin type: %s\n", PluginType_names[plugin_type]);
+    printf("... plugin name: '%s'\n", plugin_name.c_str());
 
-    BoundingMesh *bound = state->bound;
+    GenerateFunctionResult  result;
+    PluginDefinition        plugin_definition;
 
-    if (bound)
+    if (!ensure_plugin_is_loaded(result, plugin_definition, plugin_type, plugin_name))
     {
-        uint32_t    size;
-        uint8_t     *buffer = bound->serialize(size);
-
-        result.set_success(true);
-        result.set_result_size(size);
+        send_query_bound_failure(sock, result.message());
+        return false;
+    }
 
-        send_protobuf(sock, result);
-        sock->sendall(buffer, size);
+    query_bound_function_t query_bound_function = plugin_definition.functions.query_bound_function;
 
-        delete [] buffer;
+    if (query_bound_function == NULL)
+    {
+        send_query_bound_failure(sock, "Plugin does not support querying the bound without loading, render the scene first");
+        return false;
     }
-    else
+
+    const json &plugin_parameters = json::parse(update.plugin_parameters().c_str());
+
+    if (!check_plugin_parameters(result, plugin_definition.parameters, plugin_parameters))
     {
-        sprintf(msg, "No bound specified");
+        send_query_bound_failure(sock, "Invalid plugin parameters");
+        return false;
+    }
 
-        result.set_success(false);
-        result.set_message(msg);
+    PluginState     state;
+    PluginResult    plugin_result;
+    struct timeval  t0, t1;
 
-        printf("... FAILED: %s\n", msg);
+    state.renderer = current_renderer_type;
+    state.uses_renderer_type = plugin_definition.uses_renderer_type;
+    state.frame = update.frame();
+    state.parameters = process_plugin_parameters(plugin_parameters);
 
-        send_protobuf(sock, result);
+    printf("... Calling query_bound function\n");
+    gettimeofday(&t0, NULL);
+
+    query_bound_function(plugin_result, &state);
+
+    gettimeofday(&t1, NULL);
+    printf("... Queried bound in %.3fs\n", time_diff(t0, t1));
+
+    if (!plugin_result.success)
+    {
+        send_query_bound_failure(sock, plugin_result.message);
+        return false;
     }
 
+    send_query_bound_result(sock, state.bound);
+
     return true;
 }
 
+bool
+handle_query_bound(TCPSocket *sock, const ClientMessage& client_message)
+{
+    const std::string& name = client_message.string_value();
+    char msg[1024];
+
+    printf("QUERY BOUND '%s'\n", name.c_str());
+
+    // The plugin instance can optionally be described, so its bound
+    // can be queried without the instance having been created
+    UpdatePluginInstance    update;
+    const bool              have_update = client_message.uint_value() == 1;
+
+    if (have_update && !receive_protobuf(sock, update))
+        return false;
+
+    PluginStateMap::const_iterator it = plugin_state.find(name);
+
+    if (it != plugin_state.end())
+    {
+        // Existing instance, use its bound, but only if it is still up-to-date
+        const PluginInstance *plugin_instance = plugin_instances[name];
+
+        if (!have_update || 
+            (plugin_instance->plugin_name == update.plugin_name() 
+             && plugin_instance->parameters_hash == get_sha1(update.plugin_parameters())))
+        {
+            send_query_bound_result(sock, it->second->bound);
+            return true;
+        }
+
+        printf("... Existing plugin instance is out-of-date\n");
+    }
+
+    if (have_update)
+        return query_plugin_bound(sock, update);
+
+    sprintf(msg, "No plugin state for id '%s'", name.c_str());
+    send_query_bound_failure(sock, msg);
+
+    return false;
+}
+
 bool
 clear_scene(const std::string& type)
 {
@@ -2869,6 +4515,12 @@ clear_scene(const std::string& type)
         delete so.second;
     scene_objects.clear();
 
+    lod_proxy_instances.clear();
+    lod_proxies_active = false;
+
+    for (auto& kv : plugin_load_jobs)
+        kv.second->object_updates.clear();
+
     if (type == "keep_plugin_instances")
     {
         std::set<std::string> data_to_delete;
@@ -2885,6 +4537,8 @@ clear_scene(const std::string& type)
     else
     {
         // "all"
+        cancel_all_plugin_load_jobs();
+        cancel_all_prefetch_jobs();
         delete_all_scene_data();    
     }
 
@@ -2892,9 +4546,126 @@ clear_scene(const std::string& type)
         delete sm.second;
     scene_materials.clear();
 
+    retired_shared_memory.clear();
+
     return true;
 }
 
+// Deletes plugin instances not used by any scene object, least-recently
+// used first, until memory use is within the budget. When an evicted
+// instance is needed again it gets re-created, from its cache file if 
+// it has one.
+void
+enforce_memory_budget()
+{
+    std::set<std::string> linked_data;
+
+    for (auto& kv : scene_objects)
+        linked_data.insert(kv.second->data_link);
+
+    std::vector<PluginInstance*> unused;
+
+    for (auto& kv : plugin_instances)
+    {
+        if (linked_data.find(kv.first) != linked_data.end())
+            kv.second->last_used = render_counter;
+        else
+            unused.push_back(kv.second);
+    }
+
+    if (memory_budget == 0)
+        return;
+
+    uint64_t plugin_instances_size, blender_meshes_size, framebuffers_size;
+    uint64_t total = get_memory_accounting(plugin_instances_size, blender_meshes_size, framebuffers_size);
+    const uint64_t budget = memory_budget * 1024 * 1024;
+
+    if (total <= budget)
+        return;
+
+    printf("Memory use of %.1f MB exceeds budget of %d MB (plugin instances %.1f MB, meshes %.1f MB, framebuffers %.1f MB)\n",
+        total / 1048576.0, (int)memory_budget, plugin_instances_size / 1048576.0, 
+        blender_meshes_size / 1048576.0, framebuffers_size / 1048576.0);
+
+    std::stable_sort(unused.begin(), unused.end(), 
+        [](const PluginInstance *a, const PluginInstance *b) { return a->last_used < b->last_used; });
+
+    for (PluginInstance *plugin_instance : unused)
+    {
+        if (total <= budget)
+            break;
+
+        const size_t size = plugin_instance->state->data_size;
+
+        if (size == 0)
+            continue;
+
+        printf("... Evicting unused plugin instance '%s' (%.1f MB, last used %d render(s) ago)%s\n", 
+            plugin_instance->name.c_str(), size / 1048576.0, render_counter - plugin_instance->last_used,
+            plugin_instance->cache_file != "" ? ", kept in cache file" : "");
+
+        total -= size;
+
+        // The instance isn't linked to any scene object, so none of its 
+        // OSPRay objects are in the world and its memory can be freed now
+        const std::string name = plugin_instance->name;
+        delete_plugin_instance(name, true);
+    }
+
+    if (total > budget)
+        printf("... WARNING: %.1f MB still in use, scene does not fit in memory budget\n", total / 1048576.0);
+}
+
+// Lets scene plugins with an update_view_function update their instances
+// for the current view (e.g. the level of detail shown), replacing the 
+// OSPRay instances of the scene objects using them when changed
+void
+update_view_dependent_objects()
+{
+    if (!current_view_set)
+        return;
+
+    PluginView view = current_view;
+    view.final_render = render_mode == RM_FINAL;
+    view.image_height = render_mode == RM_FINAL ? final_framebuffer_height : interactive_framebuffer_height;
+
+    for (auto& kv : scene_objects)
+    {
+        if (kv.second->type != SOT_SCENE)
+            continue;
+
+        SceneObjectScene *scene_object_scene = dynamic_cast<SceneObjectScene*>(kv.second);
+
+        PluginInstanceMap::iterator it = plugin_instances.find(scene_object_scene->data_link);
+        if (it == plugin_instances.end())
+            continue;
+
+        PluginInstance *plugin_instance = it->second;
+
+        PluginDefinitionsMap::iterator dit = plugin_definitions.find(plugin_instance->plugin_internal_name);
+        if (dit == plugin_definitions.end() || dit->second.functions.update_view_function == NULL)
+            continue;
+
+        view.object2world = scene_object_scene->object2world;
+
+        PluginResult result;
+
+        if (!dit->second.functions.update_view_function(result, plugin_instance->state, view))
+        {
+            if (!result.success)
+                printf("... WARNING: view update of '%s' failed: %s\n", kv.first.c_str(), result.message.c_str());
+            continue;
+        }
+
+        remove_scene_object_instances(scene_object_scene);
+        add_scene_object_instances(scene_object_scene, plugin_instance->state);
+
+        // Other scene objects using the plugin instance now have stale instances
+        plugin_instance->instances_generation = ++instances_generation;
+        scene_object_scene->instances_generation = plugin_instance->instances_generation;
+    }
+}
+
 bool
 prepare_scene()
 {
@@ -2914,6 +4685,7 @@ prepare_scene()
         }
 
         update_ospray_scene_instances = false;
+        lod_proxies_active = false;
     }
     else
         printf("World instances (%d) still up-to-date\n", ospray_scene_instances.size());
@@ -2940,6 +4712,8 @@ prepare_scene()
 
     ospCommit(ospray_world);
 
+    release_retired_shared_memory();
+
     return true;
 }
 
@@ -2978,6 +4752,14 @@ ensure_idle_render_mode()
     if (render_mode == RM_IDLE)
         return;
 
+    if (waiting_for_plugin_loads)
+    {
+        waiting_for_plugin_loads = false;
+        render_mode = RM_IDLE;
+        printf("Stopped waiting for plugin instances to render\n");
+        return;
+    }
+
     if (render_future == nullptr)
         return;
 
@@ -3133,7 +4915,7 @@ handle_client_message(TCPSocket *sock, const ClientMessage& client_message, bool
             break;
 
         case ClientMessage::QUERY_BOUND:
-            handle_query_bound(sock, client_message.string_value());
+            handle_query_bound(sock, client_message);
             break;
 
         case ClientMessage::START_RENDERING:
@@ -3185,7 +4967,6 @@ void
 start_rendering(const ClientMessage& client_message)
 {
     int factor;
-    OSPFrameBuffer framebuffer;
 
     if (render_mode != RM_IDLE)
     {        
@@ -3207,7 +4988,6 @@ start_rendering(const ClientMessage& client_message)
         render_mode = RM_FINAL;
         framebuffer_update_rate = client_message.uint_value2();
 
-        framebuffer = final_framebuffer;
         ospResetAccumulation(final_framebuffer);
     }
     else if (mode == "interactive")
@@ -3267,21 +5047,58 @@ start_rendering(const ClientMessage& client_message)
         framebuffer_reduction_index = framebuffer_reduction_factors.size() - 1;
         framebuffer_reduction_factor = framebuffer_reduction_factors[framebuffer_reduction_index];
 
-        framebuffer = framebuffers[framebuffer_reduction_index].framebuffer;
-
         reduced_framebuffer_width = framebuffers[framebuffer_reduction_index].width;
         reduced_framebuffer_height = framebuffers[framebuffer_reduction_index].height;        
     }
         
     cancel_rendering = false;
 
+    if (plugin_load_jobs.size() > 0)
+    {
+        // Rendering starts when all plugin instances have been created,
+        // see handle_connection()
+        printf("Waiting for %zu plugin instance(s) to be created\n", plugin_load_jobs.size());
+        waiting_for_plugin_loads = true;
+        last_plugin_load_report.tv_sec = last_plugin_load_report.tv_usec = 0;
+        return;
+    }
+
+    render_first_frame();
+}
+
+void
+render_first_frame()
+{
+    OSPFrameBuffer framebuffer;
+
+    if (render_mode == RM_FINAL)
+        framebuffer = final_framebuffer;
+    else
+        framebuffer = framebuffers[framebuffer_reduction_index].framebuffer;
+
+    render_counter++;
+    enforce_memory_budget();
+
+    update_view_dependent_objects();
+
     // Set up world and scene objects
     prepare_scene();   
 
+    // Use LOD proxies for reduced-resolution frames, or for the first
+    // frame when navigating without reduced resolution. Final renders
+    // always use full detail.
+    if (render_mode == RM_INTERACTIVE)
+        set_lod_proxies_active(framebuffer_reduction_factor > 1 || camera_recently_updated());
+    else
+        set_lod_proxies_active(false);
+
+    if (lod_proxies_active)
+        printf("Using LOD proxies for %zu instance(s)\n", lod_proxy_instances.size());
+
     if (dump_server_state)
         print_server_state();    
 
-    printf("Rendering %d samples (%s):\n", render_samples, mode.c_str());
+    printf("Rendering %d samples (%s):\n", render_samples, render_mode == RM_FINAL ? "final" : "interactive");
 
     // XXX move this to rendering loop
     if (render_mode == RM_INTERACTIVE)
@@ -3321,6 +5138,9 @@ handle_connection(TCPSocket *sock)
     {
         usleep(1000);
 
+        poll_lod_jobs();
+        poll_plugin_load_jobs();
+
         // Check for new client message
         // XXX loop to get more messages before checking frame is done, as we 
         // currently have an implicit limit due to the usleep above
@@ -3362,12 +5182,23 @@ handle_connection(TCPSocket *sock)
         {    
             printf("CANCELING RENDER...\n");
 
-            // See https://github.com/ospray/ospray/issues/368
-            ospCancel(render_future);
-            ospWait(render_future, OSP_TASK_FINISHED);
+            if (waiting_for_plugin_loads)
+            {
+                // Interactive renders get restarted all the time, 
+                // so only a final render cancels the pending loads
+                if (render_mode == RM_FINAL)
+                    cancel_all_plugin_load_jobs();
+                waiting_for_plugin_loads = false;
+            }
+            else
+            {
+                // See https://github.com/ospray/ospray/issues/368
+                ospCancel(render_future);
+                ospWait(render_future, OSP_TASK_FINISHED);
 
-            ospRelease(render_future);
-            render_future = nullptr;
+                ospRelease(render_future);
+                render_future = nullptr;
+            }
 
             gettimeofday(&now, NULL);
             printf("Rendering cancelled after %.3f seconds\n", time_diff(rendering_start_time, now));
@@ -3384,6 +5215,22 @@ handle_connection(TCPSocket *sock)
 
             continue;            
         }
+
+        if (waiting_for_plugin_loads)
+        {
+            report_plugin_load_progress(sock);
+
+            if (plugin_load_jobs.size() > 0)
+                continue;
+
+            // Report any remaining errors
+            while (plugin_load_errors.size() > 0)
+                report_plugin_load_progress(sock);
+
+            waiting_for_plugin_loads = false;
+            render_first_frame();
+            continue;
+        }
                 
         if (!ospIsReady(render_future, OSP_TASK_FINISHED))
             continue;
@@ -3520,7 +5367,7 @@ handle_connection(TCPSocket *sock)
 
         // Check if we're done rendering
 
-        if (current_sample == render_samples && framebuffer_reduction_factor == 1)
+        if (current_sample == render_samples && framebuffer_reduction_factor == 1 && !lod_proxies_active)
         {
             // Rendering done!
 
@@ -3555,7 +5402,19 @@ handle_connection(TCPSocket *sock)
                 reduced_framebuffer_width = fb.width;
                 reduced_framebuffer_height = fb.height;
                 fb.clear();
+
+                // Full detail at full resolution
+                if (framebuffer_reduction_index == 0)
+                    set_lod_proxies_active(false);
             }            
+            else if (lod_proxies_active)
+            {
+                // Preview frame at full resolution used the LOD proxies,
+                // restart accumulation with full detail
+                set_lod_proxies_active(false);
+                framebuffers[framebuffer_reduction_index].clear();
+                current_sample = 1;
+            }
             else
             {
                 // Fire off render of next sample frame
@@ -3665,6 +5524,15 @@ main(int argc, const char **argv)
     // Prepare some things
     prepare_renderers();
 
+    if (plugin_cache_dir != "")
+    {
+        mkdir(plugin_cache_dir.c_str(), 0755);
+        printf("Caching plugin instance data in %s\n", plugin_cache_dir.c_str());
+    }
+
+    if (memory_budget > 0)
+        printf("Memory budget %d MB\n", (int)memory_budget);
+
     // Server loop
 
     TCPSocket *listen_sock;
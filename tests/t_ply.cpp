@@ -0,0 +1,350 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// PLY reader tests and benchmark                                           //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+// Without arguments: writes small PLY files in all formats (ascii,
+// binary_little_endian, binary_big_endian) and layouts the reader handles
+// differently (uniform faces, mixed faces, other lists before the vertex
+// indices, ...) to the current directory, reads them back with read_ply()
+// and compares. Returns non-zero on failure.
+//
+// With a PLY file argument: times read_ply() on that file (best of the
+// given number of repeats), e.g. for comparing against other readers
+// on large scans.
+
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "ply_reader.h"
+#include "util.h"
+
+// Test file description: the property types of each element, plus the
+// values of each record (one vector per property, scalars have one value)
+
+struct TestProperty
+{
+    std::string     name;
+    std::string     type;
+    std::string     count_type;     // Empty for scalars
+};
+
+struct TestElement
+{
+    std::string                                     name;
+    std::vector<TestProperty>                       properties;
+    std::vector<std::vector<std::vector<double>>>   records;
+};
+
+static void
+write_value(FILE *f, const std::string& type, double v, const std::string& format)
+{
+    if (format == "ascii")
+    {
+        if (type == "float" || type == "double")
+            fprintf(f, "%.9g ", v);
+        else
+            fprintf(f, "%lld ", (long long)v);
+        return;
+    }
+
+    uint8_t buf[8];
+    size_t size;
+
+    if (type == "char")         { int8_t x = v; memcpy(buf, &x, size = 1); }
+    else if (type == "uchar")   { uint8_t x = v; memcpy(buf, &x, size = 1); }
+    else if (type == "short")   { int16_t x = v; memcpy(buf, &x, size = 2); }
+    else if (type == "ushort")  { uint16_t x = v; memcpy(buf, &x, size = 2); }
+    else if (type == "int")     { int32_t x = v; memcpy(buf, &x, size = 4); }
+    else if (type == "uint")    { uint32_t x = v; memcpy(buf, &x, size = 4); }
+    else if (type == "float")   { float x = v; memcpy(buf, &x, size = 4); }
+    else                        { double x = v; memcpy(buf, &x, size = 8); }
+
+    // Tests run on little-endian hosts
+    if (format == "binary_big_endian")
+        std::reverse(buf, buf + size);
+
+    fwrite(buf, size, 1, f);
+}
+
+static bool
+write_ply(const std::string& fname, const std::string& format, const std::vector<TestElement>& elements)
+{
+    FILE *f = fopen(fname.c_str(), "wb");
+    if (!f)
+        return false;
+
+    fprintf(f, "ply\nformat %s 1.0\ncomment written by t_ply\n", format.c_str());
+
+    for (const TestElement& e : elements)
+    {
+        fprintf(f, "element %s %zu\n", e.name.c_str(), e.records.size());
+        for (const TestProperty& p : e.properties)
+        {
+            if (p.count_type.empty())
+                fprintf(f, "property %s %s\n", p.type.c_str(), p.name.c_str());
+            else
+                fprintf(f, "property list %s %s %s\n", p.count_type.c_str(), p.type.c_str(), p.name.c_str());
+        }
+    }
+
+    fprintf(f, "end_header\n");
+
+    for (const TestElement& e : elements)
+    {
+        for (const std::vector<std::vector<double>>& record : e.records)
+        {
+            for (size_t i = 0; i < e.properties.size(); i++)
+            {
+                const TestProperty& p = e.properties[i];
+
+                if (!p.count_type.empty())
+                    write_value(f, p.count_type, record[i].size(), format);
+                for (double v : record[i])
+                    write_value(f, p.type, v, format);
+            }
+
+            if (format == "ascii")
+                fprintf(f, "\n");
+        }
+    }
+
+    fclose(f);
+    return true;
+}
+
+// Vertex element with x, y, z of the given type, surrounded by other
+// scalar properties
+static TestElement
+vertex_element(const std::string& type, int n)
+{
+    TestElement e;
+    e.name = "vertex";
+    e.properties = { {"confidence", "uchar", ""}, {"x", type, ""}, {"y", type, ""}, {"z", type, ""}, {"intensity", "float", ""} };
+
+    for (int i = 0; i < n; i++)
+        e.records.push_back({ {(double)(i % 7)}, {0.5*i}, {-1.25*i}, {i + 0.75}, {0.1*i} });
+
+    return e;
+}
+
+struct TestCase
+{
+    std::string                 name;
+    std::vector<TestElement>    elements;
+};
+
+static std::vector<TestCase>
+test_cases()
+{
+    std::vector<TestCase> cases;
+    const int nv = 40;
+
+    {
+        // All triangles: fixed stride path
+        TestCase c;
+        c.name = "triangles";
+        TestElement faces;
+        faces.name = "face";
+        faces.properties = { {"vertex_indices", "int", "uchar"} };
+        for (int i = 0; i < nv-2; i++)
+            faces.records.push_back({ {(double)i, (double)i+1, (double)i+2} });
+        c.elements = { vertex_element("float", nv), faces };
+        cases.push_back(c);
+    }
+
+    {
+        // Triangles and quads, scalar after the indices: per-record scan
+        TestCase c;
+        c.name = "mixed_faces";
+        TestElement faces;
+        faces.name = "face";
+        faces.properties = { {"flags", "ushort", ""}, {"vertex_indices", "uint", "uchar"}, {"material", "int", ""} };
+        for (int i = 0; i < nv-3; i++)
+        {
+            if (i % 3 == 0)
+                faces.records.push_back({ {1}, {(double)i, (double)i+1, (double)i+2, (double)i+3}, {(double)i} });
+            else
+                faces.records.push_back({ {2}, {(double)i+2, (double)i+1, (double)i}, {-1} });
+        }
+        c.elements = { vertex_element("double", nv), faces };
+        cases.push_back(c);
+    }
+
+    {
+        // A list of varying length before the vertex indices
+        TestCase c;
+        c.name = "list_before_indices";
+        TestElement faces;
+        faces.name = "face";
+        faces.properties = { {"flags", "uchar", ""}, {"texcoord", "float", "uchar"}, {"vertex_indices", "int", "int"} };
+        for (int i = 0; i < nv-2; i++)
+        {
+            std::vector<double> texcoord;
+            for (int j = 0; j < 2*(i % 4); j++)
+                texcoord.push_back(0.125*j);
+            faces.records.push_back({ {(double)i}, texcoord, {(double)i, (double)i+1, (double)i+2} });
+        }
+        c.elements = { vertex_element("float", nv), faces };
+        cases.push_back(c);
+    }
+
+    {
+        // Same-length list before the vertex indices (all faces uniform)
+        // and an unrelated element in between
+        TestCase c;
+        c.name = "uniform_list_before_indices";
+        TestElement other;
+        other.name = "camera";
+        other.properties = { {"view_px", "float", ""}, {"view_py", "float", ""} };
+        other.records.push_back({ {1.0}, {2.0} });
+        TestElement faces;
+        faces.name = "face";
+        faces.properties = { {"texcoord", "float", "uchar"}, {"vertex_index", "ushort", "uchar"} };
+        for (int i = 0; i < nv-2; i++)
+            faces.records.push_back({ {0.0, 1.0, 0.5, 0.5, 1.0, 0.0}, {(double)i, (double)i+2, (double)i+1} });
+        c.elements = { vertex_element("float", nv), other, faces };
+        cases.push_back(c);
+    }
+
+    return cases;
+}
+
+static bool
+check(const TestCase& c, const PlyMesh& mesh)
+{
+    const TestElement& vertices = c.elements[0];
+    const TestElement& faces = c.elements.back();
+
+    int vi = 0;
+    while (faces.properties[vi].name != "vertex_indices" && faces.properties[vi].name != "vertex_index")
+        vi++;
+
+    if (mesh.vertices.size() != 3*vertices.records.size() || mesh.face_lengths.size() != faces.records.size())
+        return false;
+
+    for (size_t i = 0; i < vertices.records.size(); i++)
+        for (int j = 0; j < 3; j++)
+            if (mesh.vertices[3*i+j] != (float)vertices.records[i][1+j][0])
+                return false;
+
+    size_t k = 0;
+    for (size_t f = 0; f < faces.records.size(); f++)
+    {
+        const std::vector<double>& indices = faces.records[f][vi];
+
+        if (mesh.face_lengths[f] != indices.size() || k + indices.size() > mesh.faces.size())
+            return false;
+
+        for (double index : indices)
+            if (mesh.faces[k++] != (uint32_t)index)
+                return false;
+    }
+
+    return k == mesh.faces.size();
+}
+
+static int
+run_tests()
+{
+    const char *formats[] = { "ascii", "binary_little_endian", "binary_big_endian" };
+    int failures = 0;
+
+    for (const TestCase& c : test_cases())
+    {
+        for (const char *format : formats)
+        {
+            const std::string fname = "t_ply_" + c.name + "_" + format + ".ply";
+            PlyMesh mesh;
+            std::string message;
+
+            bool ok = write_ply(fname, format, c.elements);
+            if (!ok)
+                message = "could not write file";
+            else if (!(ok = read_ply(mesh, fname, message)))
+                ;
+            else if (!(ok = check(c, mesh)))
+                message = "mesh differs";
+
+            printf("%-30s %-22s %s %s\n", c.name.c_str(), format, ok ? "OK" : "FAILED", message.c_str());
+
+            if (!ok)
+                failures++;
+            else
+                unlink(fname.c_str());
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
+
+static int
+run_benchmark(const char *fname, int repeats)
+{
+    struct stat st;
+
+    if (stat(fname, &st) != 0)
+    {
+        fprintf(stderr, "Can't stat %s\n", fname);
+        return 1;
+    }
+
+    double best = 0.0;
+
+    for (int r = 0; r < repeats; r++)
+    {
+        PlyMesh mesh;
+        std::string message;
+        struct timeval t0, t1;
+
+        gettimeofday(&t0, NULL);
+        if (!read_ply(mesh, fname, message))
+        {
+            fprintf(stderr, "%s\n", message.c_str());
+            return 1;
+        }
+        gettimeofday(&t1, NULL);
+
+        const double t = time_diff(t0, t1);
+        if (r == 0 || t < best)
+            best = t;
+
+        printf("Run %d: %.3fs, %zu vertices, %zu faces\n", r+1, t, mesh.vertices.size()/3, mesh.face_lengths.size());
+    }
+
+    printf("Best of %d: %.3fs (%.1f MB/s)\n", repeats, best, st.st_size / 1048576.0 / best);
+
+    return 0;
+}
+
+int
+main(int argc, const char **argv)
+{
+    if (argc == 1)
+        return run_tests();
+
+    return run_benchmark(argv[1], argc > 2 ? atoi(argv[2]) : 3);
+}
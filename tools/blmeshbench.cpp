@@ -0,0 +1,355 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Benchmark mesh optimization (welding, Morton order) for BVH and render   //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <sys/time.h>
+#include <stdint.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include <ospray/ospray.h>
+
+#include "mesh_processing.h"
+#include "ply_reader.h"
+#include "util.h"
+
+// Loads a mesh from a PLY file and compares the mesh as given (optionally
+// shuffled and with split vertices, to mimic meshes coming from Blender
+// after modifiers) against the same mesh after optimize_mesh(), as done
+// by the server with BLOSPRAY_OPTIMIZE_MESHES. Reported are the time
+// taken by optimize_mesh(), index locality, the time to commit the
+// OSPRay world (which builds the BVH) and the mean time per rendered
+// frame.
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [options] <mesh.ply>\n", prog);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -s           Shuffle vertices and triangles before optimizing\n");
+    fprintf(stderr, "  -d           Split vertices, giving each triangle its own vertices\n");
+    fprintf(stderr, "  -f <n>       Number of frames to render and time (default 10)\n");
+    fprintf(stderr, "  -i <w> <h>   Image size (default 1920 1080)\n");
+    fprintf(stderr, "  -r <type>    Renderer type (default scivis)\n");
+    fprintf(stderr, "  -n           Don't use OSPRay, only time optimize_mesh() and report locality\n");
+}
+
+struct Mesh
+{
+    std::vector<float>      vertices;
+    std::vector<uint32_t>   triangles;
+};
+
+// Mean index span (max - min index) of the triangles and mean distance
+// between the centroids of consecutive triangles, relative to the
+// bounding box diagonal. Both are lower for better locality.
+static void
+locality(double& index_span, double& centroid_step, const Mesh& mesh, float diagonal)
+{
+    const size_t nt = mesh.triangles.size() / 3;
+    double span = 0.0, step = 0.0;
+    float prev[3] = { 0.0f, 0.0f, 0.0f };
+
+    for (size_t t = 0; t < nt; t++)
+    {
+        const uint32_t *tri = &mesh.triangles[3*t];
+        span += std::max(tri[0], std::max(tri[1], tri[2])) - std::min(tri[0], std::min(tri[1], tri[2]));
+
+        float c[3];
+        for (int i = 0; i < 3; i++)
+            c[i] = (mesh.vertices[3*tri[0]+i] + mesh.vertices[3*tri[1]+i] + mesh.vertices[3*tri[2]+i]) / 3.0f;
+
+        if (t > 0)
+            step += std::sqrt((c[0]-prev[0])*(c[0]-prev[0]) + (c[1]-prev[1])*(c[1]-prev[1]) + (c[2]-prev[2])*(c[2]-prev[2]));
+
+        memcpy(prev, c, sizeof(c));
+    }
+
+    index_span = nt > 0 ? span / nt : 0.0;
+    centroid_step = nt > 1 ? step / (nt-1) / diagonal : 0.0;
+}
+
+// Commits a world holding the mesh and renders frames of it. Returns
+// the world commit time and the mean frame time.
+static void
+time_ospray(double& commit_time, double& frame_time, const Mesh& mesh, const float *bbox,
+    const char *renderer_type, int width, int height, int frames)
+{
+    struct timeval t0, t1;
+
+    const uint32_t nv = mesh.vertices.size() / 3;
+    const uint32_t nt = mesh.triangles.size() / 3;
+
+    OSPData positions = ospNewSharedData(mesh.vertices.data(), OSP_VEC3F, nv);
+    OSPData indices = ospNewSharedData(mesh.triangles.data(), OSP_VEC3UI, nt);
+
+    gettimeofday(&t0, NULL);
+
+    ospCommit(positions);
+    ospCommit(indices);
+
+    OSPGeometry geometry = ospNewGeometry("triangles");
+        ospSetObject(geometry, "vertex.position", positions);
+        ospSetObject(geometry, "index", indices);
+    ospCommit(geometry);
+
+    OSPGeometricModel model = ospNewGeometricModel(geometry);
+    ospCommit(model);
+
+    OSPGroup group = ospNewGroup();
+        ospSetObjectAsData(group, "geometry", OSP_GEOMETRIC_MODEL, model);
+    ospCommit(group);
+
+    OSPInstance instance = ospNewInstance(group);
+    ospCommit(instance);
+
+    OSPLight light = ospNewLight("ambient");
+    ospCommit(light);
+
+    OSPWorld world = ospNewWorld();
+        ospSetObjectAsData(world, "instance", OSP_INSTANCE, instance);
+        ospSetObjectAsData(world, "light", OSP_LIGHT, light);
+    ospCommit(world);
+
+    gettimeofday(&t1, NULL);
+    commit_time = time_diff(t0, t1);
+
+    // Camera looking at the center of the bounding box, from outside
+
+    const float center[3] = { 0.5f*(bbox[0]+bbox[3]), 0.5f*(bbox[1]+bbox[4]), 0.5f*(bbox[2]+bbox[5]) };
+    const float radius = 0.5f * std::sqrt((bbox[3]-bbox[0])*(bbox[3]-bbox[0]) +
+        (bbox[4]-bbox[1])*(bbox[4]-bbox[1]) + (bbox[5]-bbox[2])*(bbox[5]-bbox[2]));
+    const float distance = 1.5f * radius / std::tan(0.5f * 45.0f * M_PI / 180.0f);
+    const float d = distance / std::sqrt(3.0f);
+
+    OSPCamera camera = ospNewCamera("perspective");
+        ospSetFloat(camera, "aspect", 1.0f * width / height);
+        ospSetFloat(camera, "fovy", 45.0f);
+        ospSetVec3f(camera, "position", center[0]+d, center[1]+d, center[2]+d);
+        ospSetVec3f(camera, "direction", -1.0f, -1.0f, -1.0f);
+        ospSetVec3f(camera, "up", 0.0f, 0.0f, 1.0f);
+    ospCommit(camera);
+
+    OSPRenderer renderer = ospNewRenderer(renderer_type);
+        ospSetInt(renderer, "pixelSamples", 1);
+    ospCommit(renderer);
+
+    OSPFrameBuffer framebuffer = ospNewFrameBuffer(width, height, OSP_FB_RGBA32F, OSP_FB_COLOR);
+
+    // First frame not timed (warm-up)
+    OSPFuture future = ospRenderFrame(framebuffer, renderer, camera, world);
+    ospWait(future, OSP_TASK_FINISHED);
+    ospRelease(future);
+
+    gettimeofday(&t0, NULL);
+
+    for (int f = 0; f < frames; f++)
+    {
+        future = ospRenderFrame(framebuffer, renderer, camera, world);
+        ospWait(future, OSP_TASK_FINISHED);
+        ospRelease(future);
+    }
+
+    gettimeofday(&t1, NULL);
+    frame_time = frames > 0 ? time_diff(t0, t1) / frames : 0.0;
+
+    ospRelease(framebuffer);
+    ospRelease(renderer);
+    ospRelease(camera);
+    ospRelease(world);
+    ospRelease(light);
+    ospRelease(instance);
+    ospRelease(group);
+    ospRelease(model);
+    ospRelease(geometry);
+    ospRelease(indices);
+    ospRelease(positions);
+}
+
+int
+main(int argc, const char **argv)
+{
+    bool shuffle = false, split = false, use_ospray = true;
+    int frames = 10, width = 1920, height = 1080;
+    const char *renderer_type = "scivis";
+
+    if (ospInit(&argc, argv) != OSP_NO_ERROR)
+    {
+        fprintf(stderr, "Error initializing OSPRay\n");
+        return -1;
+    }
+
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-s") == 0)
+            shuffle = true;
+        else if (strcmp(argv[i], "-d") == 0)
+            split = true;
+        else if (strcmp(argv[i], "-n") == 0)
+            use_ospray = false;
+        else if (strcmp(argv[i], "-f") == 0 && i+1 < argc)
+            frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-i") == 0 && i+2 < argc)
+        {
+            width = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i+1 < argc)
+            renderer_type = argv[++i];
+        else
+        {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (argc - i != 1)
+    {
+        usage(argv[0]);
+        return -1;
+    }
+
+    PlyMesh ply;
+    std::string message;
+
+    if (!read_ply(ply, argv[i], message))
+    {
+        fprintf(stderr, "%s\n", message.c_str());
+        return -1;
+    }
+
+    // Triangulate (fans), or split into per-triangle vertices
+
+    Mesh mesh;
+    size_t k = 0;
+
+    for (uint32_t n : ply.face_lengths)
+    {
+        for (uint32_t j = 1; j + 1 < n; j++)
+        {
+            const uint32_t tri[3] = { ply.faces[k], ply.faces[k+j], ply.faces[k+j+1] };
+
+            for (int c = 0; c < 3; c++)
+            {
+                if (split)
+                {
+                    mesh.triangles.push_back(mesh.vertices.size() / 3);
+                    mesh.vertices.insert(mesh.vertices.end(), &ply.vertices[3*tri[c]], &ply.vertices[3*tri[c]+3]);
+                }
+                else
+                    mesh.triangles.push_back(tri[c]);
+            }
+        }
+        k += n;
+    }
+
+    if (!split)
+        mesh.vertices.swap(ply.vertices);
+
+    if (shuffle)
+    {
+        const uint32_t nv = mesh.vertices.size() / 3;
+        const size_t nt = mesh.triangles.size() / 3;
+        std::mt19937 rng(1234);
+
+        std::vector<uint32_t> order(nv), new_index(nv);
+        for (uint32_t v = 0; v < nv; v++)
+            order[v] = v;
+        std::shuffle(order.begin(), order.end(), rng);
+
+        std::vector<float> vertices(3*nv);
+        for (uint32_t v = 0; v < nv; v++)
+        {
+            memcpy(&vertices[3*v], &mesh.vertices[3*order[v]], 3*sizeof(float));
+            new_index[order[v]] = v;
+        }
+        mesh.vertices.swap(vertices);
+
+        std::vector<size_t> tri_order(nt);
+        for (size_t t = 0; t < nt; t++)
+            tri_order[t] = t;
+        std::shuffle(tri_order.begin(), tri_order.end(), rng);
+
+        std::vector<uint32_t> triangles(3*nt);
+        for (size_t t = 0; t < nt; t++)
+            for (int c = 0; c < 3; c++)
+                triangles[3*t+c] = new_index[mesh.triangles[3*tri_order[t]+c]];
+        mesh.triangles.swap(triangles);
+    }
+
+    float bbox[6] = { 1e30f, 1e30f, 1e30f, -1e30f, -1e30f, -1e30f };
+    for (size_t v = 0; v < mesh.vertices.size(); v += 3)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            bbox[c] = std::min(bbox[c], mesh.vertices[v+c]);
+            bbox[3+c] = std::max(bbox[3+c], mesh.vertices[v+c]);
+        }
+    }
+    const float diagonal = std::sqrt((bbox[3]-bbox[0])*(bbox[3]-bbox[0]) +
+        (bbox[4]-bbox[1])*(bbox[4]-bbox[1]) + (bbox[5]-bbox[2])*(bbox[5]-bbox[2]));
+
+    // Optimized copy
+
+    Mesh optimized = mesh;
+    struct timeval t0, t1;
+
+    gettimeofday(&t0, NULL);
+    const uint32_t nv = optimize_mesh(optimized.vertices, nullptr, nullptr,
+        optimized.vertices.size()/3, optimized.triangles, 3);
+    gettimeofday(&t1, NULL);
+
+    printf("%zu triangles, %zu vertices, %u after welding\n",
+        mesh.triangles.size()/3, mesh.vertices.size()/3, nv);
+    printf("optimize_mesh(): %.3fs\n", time_diff(t0, t1));
+    printf("\n");
+    printf("%-10s %12s %14s %12s %12s\n", "", "index span", "centroid step", "commit (s)", "frame (s)");
+
+    const Mesh *meshes[2] = { &mesh, &optimized };
+    const char *names[2] = { "original", "optimized" };
+
+    for (int m = 0; m < 2; m++)
+    {
+        double index_span, centroid_step;
+        locality(index_span, centroid_step, *meshes[m], diagonal);
+
+        printf("%-10s %12.1f %14.6f", names[m], index_span, centroid_step);
+
+        if (use_ospray)
+        {
+            double commit_time, frame_time;
+            time_ospray(commit_time, frame_time, *meshes[m], bbox, renderer_type, width, height, frames);
+            printf(" %12.3f %12.4f", commit_time, frame_time);
+        }
+
+        printf("\n");
+    }
+
+    ospShutdown();
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Build an out-of-core point octree from a raw point cloud                 //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "input_data_cache.h"
+#include "point_octree.h"
+#include "util.h"
+
+// The input is a raw file of point records, either 3 floats (xyz) or,
+// with -c, 3 floats followed by 3 bytes (RGB). The input file is
+// memory-mapped, so it does not need to fit in memory. Temporary
+// storage of 16 bytes per point is used next to the output file.
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [options] <raw file> <output file>\n", prog);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -c           Records include RGB colors (3 bytes after the position)\n");
+    fprintf(stderr, "  -s <bytes>   Number of header bytes to skip (default 0)\n");
+    fprintf(stderr, "  -n <points>  Maximum number of points per node (default 65536)\n");
+}
+
+int
+main(int argc, const char **argv)
+{
+    uint64_t header_skip = 0;
+    bool colors = false;
+    uint32_t node_capacity = 65536;
+
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-c") == 0)
+            colors = true;
+        else if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+            header_skip = atoll(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+            node_capacity = atoi(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (argc - i != 2 || node_capacity == 0)
+    {
+        usage(argv[0]);
+        return -1;
+    }
+
+    const std::string fname = argv[i];
+    const std::string output = argv[i+1];
+
+    struct stat st;
+
+    if (stat(fname.c_str(), &st) != 0 || (uint64_t)st.st_size <= header_skip)
+    {
+        fprintf(stderr, "Could not read %s\n", fname.c_str());
+        return -1;
+    }
+
+    const uint32_t stride = colors ? 15 : 12;
+    const uint64_t num_points = ((uint64_t)st.st_size - header_skip) / stride;
+    const uint64_t size = num_points * stride;
+
+    std::shared_ptr<const void> data = map_input_data(fname, header_skip, size);
+
+    if (!data)
+    {
+        fprintf(stderr, "Could not map %llu bytes at offset %llu from %s\n",
+            (unsigned long long)size, (unsigned long long)header_skip, fname.c_str());
+        return -1;
+    }
+
+    const uint8_t *records = (const uint8_t*)data.get();
+
+    struct timeval t0, t1;
+    gettimeofday(&t0, NULL);
+
+    if (!build_point_octree(output, (const float*)records, colors ? records+12 : nullptr,
+            num_points, stride, node_capacity))
+        return -1;
+
+    gettimeofday(&t1, NULL);
+
+    PointOctree octree;
+
+    if (!open_point_octree(octree, output))
+        return -1;
+
+    printf("Wrote %s: %llu points, %d nodes (%.3fs)\n", output.c_str(),
+        (unsigned long long)octree.num_points, (int)octree.nodes.size(), time_diff(t0, t1));
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+// ======================================================================== //
+// BLOSPRAY - OSPRay as a Blender render engine                             //
+// Paul Melis, SURFsara <paul.melis@surfsara.nl>                            //
+// Build a multi-resolution volume pyramid from a raw volume                //
+// ======================================================================== //
+// Copyright 2018-2019 SURFsara                                             //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <sys/time.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "input_data_cache.h"
+#include "util.h"
+#include "volume_pyramid.h"
+#include "voxels.h"
+
+// Takes the same description of the raw volume as the volume_raw
+// plugin (dimensions, voxel_type, header_skip, endian_flip). The input
+// file is memory-mapped, so it does not need to fit in memory.
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [options] <raw file> <nx> <ny> <nz> <voxel type> <output file>\n", prog);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Voxel type is one of uchar, short, ushort, float, double.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -s <bytes>   Number of header bytes to skip (default 0)\n");
+    fprintf(stderr, "  -e           Endian-flip the values\n");
+    fprintf(stderr, "  -b <size>    Brick size in voxels (default 64)\n");
+    fprintf(stderr, "  -l <levels>  Maximum number of levels (default: until a level fits in one brick)\n");
+}
+
+int
+main(int argc, const char **argv)
+{
+    uint64_t header_skip = 0;
+    bool endian_flip = false;
+    uint32_t brick_size = 64;
+    int max_levels = 0;
+
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-e") == 0)
+            endian_flip = true;
+        else if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+            header_skip = atoll(argv[++i]);
+        else if (strcmp(argv[i], "-b") == 0 && i+1 < argc)
+            brick_size = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-l") == 0 && i+1 < argc)
+            max_levels = atoi(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (argc - i != 6)
+    {
+        usage(argv[0]);
+        return -1;
+    }
+
+    const std::string fname = argv[i];
+    const uint32_t dims[3] = { (uint32_t)atoi(argv[i+1]), (uint32_t)atoi(argv[i+2]), (uint32_t)atoi(argv[i+3]) };
+    const std::string voxel_type = argv[i+4];
+    const std::string output = argv[i+5];
+
+    OSPDataType data_type;
+    uint32_t value_size;
+
+    if (!get_voxel_type(data_type, value_size, voxel_type))
+    {
+        fprintf(stderr, "Unknown voxel type '%s'\n", voxel_type.c_str());
+        return -1;
+    }
+
+    if (brick_size == 0 || dims[0] == 0 || dims[1] == 0 || dims[2] == 0)
+    {
+        usage(argv[0]);
+        return -1;
+    }
+
+    const uint64_t size = (uint64_t)dims[0] * dims[1] * dims[2] * value_size;
+
+    std::shared_ptr<const void> values = map_input_data(fname, header_skip, size);
+
+    if (!values)
+    {
+        fprintf(stderr, "Could not map %llu bytes at offset %llu from %s\n",
+            (unsigned long long)size, (unsigned long long)header_skip, fname.c_str());
+        return -1;
+    }
+
+    struct timeval t0, t1;
+    gettimeofday(&t0, NULL);
+
+    if (!build_volume_pyramid(output, values.get(), data_type, dims, endian_flip, brick_size, max_levels))
+        return -1;
+
+    gettimeofday(&t1, NULL);
+
+    VolumePyramid pyramid;
+
+    if (!open_volume_pyramid(pyramid, output))
+        return -1;
+
+    printf("Wrote %s: %d levels, data range %.6f, %.6f (%.3fs)\n", output.c_str(),
+        (int)pyramid.levels.size(), pyramid.data_range[0], pyramid.data_range[1], time_diff(t0, t1));
+
+    return 0;
+}